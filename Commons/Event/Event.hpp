@@ -137,15 +137,22 @@ namespace NewsGate
     typedef El::LightArray<EventWordWeightOld, uint32_t>
     EventWordWeightOldArray;
 
-    class EventWordPosMap :
-      public google::dense_hash_map<uint32_t,
-                                    uint32_t,
-                                    El::Hash::Numeric<uint32_t> >
+    //
+    // Event word position, counted from the event words end, so the most
+    // significant word has the biggest one. Positions are kept ordered by
+    // word id, so common words of 2 events are found with a single merge
+    // pass over compact arrays instead of per word hash lookups.
+    //
+    struct EventWordPos
     {
-    public:
-      EventWordPosMap() throw(El::Exception);
+      uint32_t word_id;
+      uint32_t pos;
+
+      bool operator<(const EventWordPos& val) const throw();
     };
 
+    typedef El::LightArray<EventWordPos, uint32_t> EventWordPosArray;
+
     struct EventWordWC
     {
       uint32_t first_count;
@@ -202,7 +209,7 @@ namespace NewsGate
       
     public:
       EventWordWeightArray words;
-      EventWordPosMap word_positions;
+      EventWordPosArray word_positions; // Ordered by word id
       El::Luid id;
       uint64_t published_min;
       uint64_t published_max;      
@@ -300,6 +307,16 @@ namespace NewsGate
       void calc_strain() throw();
       void calc_word_pos() throw();
 
+      //
+      // Fills short_pos and long_pos with positions of words common for
+      // the events, returns common words count
+      //
+      static size_t common_word_positions(const EventWordPosArray& short_words,
+                                          const EventWordPosArray& long_words,
+                                          size_t* short_pos,
+                                          size_t* long_pos)
+        throw();
+
       static size_t offset_penalty(size_t val) throw();
       static double pw(size_t val) throw();
       static double pw3(size_t val) throw();
@@ -547,14 +564,56 @@ namespace NewsGate
     void
     EventObject::calc_word_pos() throw()
     {
-      word_positions.clear();
       uint32_t pos = words.size();
       word_positions.resize(pos);
+
+      EventWordPosArray::iterator wp(word_positions.begin());
       
-      for(EventWordWeightArray::const_iterator i(words.begin()); pos; ++i)
+      for(EventWordWeightArray::const_iterator i(words.begin()); pos;
+          ++i, ++wp)
       {
-        word_positions[i->word_id] = pos--;
+        wp->word_id = i->word_id;
+        wp->pos = pos--;
+      }
+
+      std::sort(word_positions.begin(), word_positions.end());
+    }
+
+    inline
+    size_t
+    EventObject::common_word_positions(const EventWordPosArray& short_words,
+                                       const EventWordPosArray& long_words,
+                                       size_t* short_pos,
+                                       size_t* long_pos)
+      throw()
+    {
+      const EventWordPos* is = short_words.begin();
+      const EventWordPos* ise = short_words.end();
+      const EventWordPos* il = long_words.begin();
+      const EventWordPos* ile = long_words.end();
+
+      size_t count = 0;
+
+      while(is != ise && il != ile)
+      {
+        uint32_t ws = is->word_id;
+        uint32_t wl = il->word_id;
+
+        if(ws == wl)
+        {
+          short_pos[count] = is++->pos;
+          long_pos[count++] = il++->pos;
+        }
+        else
+        {
+          // Advancing both sides without branching on the comparison
+          // result which is unpredictable for word ids
+          is += ws < wl;
+          il += wl < ws;
+        }
       }
+
+      return count;
     }
     
     inline
@@ -925,26 +984,11 @@ namespace NewsGate
       size_t short_common_words[len_short];
       size_t long_common_words[len_short];
 
-      size_t short_pos = len_short;
-      size_t common_words_cnt = 0;
-
-      const EventWordPosMap& word_positions_long = event.word_positions;      
-      EventWordPosMap::const_iterator wp_end = word_positions_long.end();
-      
-      for(EventWordWeightArray::const_iterator i(words.begin());
-          short_pos; ++i)
-      {
-        EventWordPosMap::const_iterator wit =
-          word_positions_long.find(i->word_id);
-
-        if(wit != wp_end)
-        {
-          short_common_words[common_words_cnt] = short_pos;
-          long_common_words[common_words_cnt++] = wit->second;
-        }
-
-        --short_pos;
-      }
+      size_t common_words_cnt =
+        common_word_positions(word_positions,
+                              event.word_positions,
+                              short_common_words,
+                              long_common_words);
       
       if(common_word_count)
       {
@@ -968,6 +1012,12 @@ namespace NewsGate
         return 0;
       }
 
+      // Positions come in word id order; pairing them in position
+      // descending order as words go in event
+      std::sort(short_common_words,
+                short_common_words + common_words_cnt,
+                std::greater<size_t>());
+
       std::sort(long_common_words,
                 long_common_words + common_words_cnt,
                 std::greater<size_t>());
@@ -1569,14 +1619,13 @@ namespace NewsGate
     }
 
     //
-    // EventWordPosMap class
+    // EventWordPos struct
     //
     inline
-    EventWordPosMap::EventWordPosMap() throw(El::Exception)
+    bool
+    EventWordPos::operator<(const EventWordPos& val) const throw()
     {
-      set_empty_key(0);
-      set_deleted_key(UINT32_MAX);
-//      set_deleted_key(0);
+      return word_id < val.word_id;
     }
 
     //
@@ -187,6 +187,181 @@ namespace NewsGate
                    respected_impressions + 0.5F) : 0;
     }
 
+    //
+    // HostTrie class
+    //
+    void
+    HostTrie::insert(const char* host, const NumberSet* messages)
+      throw(El::Exception)
+    {
+      std::vector<Node*> path(1, &root_);
+      const char* end = host + strlen(host);
+      std::string label;
+
+      while(prev_label(host, end, label))
+      {
+        NodeMap& children = path.back()->children;
+        NodeMap::iterator i = children.find(label);
+
+        if(i == children.end())
+        {
+          i = children.insert(std::make_pair(label, new Node())).first;
+        }
+
+        path.push_back(i->second);
+      }
+
+      Node* node = path.back();
+      ++node->own;
+
+      if(messages)
+      {
+        node->messages = messages;
+      }
+
+      for(std::vector<Node*>::iterator i(path.begin()), e(path.end()); i != e;
+          ++i)
+      {
+        ++(*i)->count;
+      }
+    }
+
+    void
+    HostTrie::remove(const char* host) throw(El::Exception)
+    {
+      typedef std::vector<std::pair<Node*, std::string> > NodePath;
+
+      NodePath path;
+      Node* node = &root_;
+      const char* end = host + strlen(host);
+      std::string label;
+
+      while(prev_label(host, end, label))
+      {
+        NodeMap::iterator i = node->children.find(label);
+
+        if(i == node->children.end())
+        {
+          return;
+        }
+
+        path.push_back(std::make_pair(node, label));
+        node = i->second;
+      }
+
+      if(node->own == 0)
+      {
+        return;
+      }
+
+      if(--node->own == 0)
+      {
+        node->messages = 0;
+      }
+
+      --node->count;
+
+      for(NodePath::reverse_iterator i(path.rbegin()), e(path.rend()); i != e;
+          ++i)
+      {
+        Node* parent = i->first;
+        --parent->count;
+
+        if(node->count == 0)
+        {
+          delete node;
+          parent->children.erase(i->second);
+        }
+
+        node = parent;
+      }
+    }
+
+    const HostTrie::Node*
+    HostTrie::find(const char* domain) const throw(El::Exception)
+    {
+      const Node* node = &root_;
+      const char* end = domain + strlen(domain);
+      std::string label;
+
+      while(prev_label(domain, end, label))
+      {
+        NodeMap::const_iterator i = node->children.find(label);
+
+        if(i == node->children.end())
+        {
+          return 0;
+        }
+
+        node = i->second;
+      }
+
+      return node == &root_ ? 0 : node;
+    }
+
+    bool
+    HostTrie::covers(const char* host) const throw(El::Exception)
+    {
+      const Node* node = &root_;
+      const char* end = host + strlen(host);
+      std::string label;
+
+      while(prev_label(host, end, label))
+      {
+        NodeMap::const_iterator i = node->children.find(label);
+
+        if(i == node->children.end())
+        {
+          return false;
+        }
+
+        node = i->second;
+
+        if(node->own)
+        {
+          return true;
+        }
+      }
+
+      return false;
+    }
+
+    void
+    HostTrie::number_sets(const Node& node, NumberSetArray& sets)
+      throw(El::Exception)
+    {
+      if(node.messages)
+      {
+        sets.push_back(node.messages);
+      }
+
+      for(NodeMap::const_iterator i(node.children.begin()),
+            e(node.children.end()); i != e; ++i)
+      {
+        number_sets(*i->second, sets);
+      }
+    }
+
+    bool
+    HostTrie::prev_label(const char* host,
+                         const char*& end,
+                         std::string& label)
+      throw(El::Exception)
+    {
+      if(end == 0)
+      {
+        return false;
+      }
+
+      const char* begin = end;
+      for(; begin != host && begin[-1] != '.'; --begin);
+
+      label.assign(begin, end - begin);
+      end = begin == host ? 0 : begin - 1;
+
+      return true;
+    }
+
     //
     // StoredMessage::WordComplementElem struct
     //
@@ -460,6 +635,9 @@ namespace NewsGate
     uint64_t
     StoredMessage::word_hash(bool core_word_flag) const throw()
     {
+      WordPositionArray buffer;
+      const WordPositionArray& msg_positions = get_positions(buffer);
+      
       uint64_t crc = 0;
       El::CRC(crc, (unsigned char*)&lang, sizeof(lang));
 
@@ -491,7 +669,7 @@ namespace NewsGate
 
           for(WordPositionNumber j = 0; j < count; ++j)
           {
-            WordPosition pos = nf_pos.position(positions, j);
+            WordPosition pos = nf_pos.position(msg_positions, j);
             El::CRC(crc, (unsigned char*)&pos, sizeof(pos));
           }
         }   
@@ -519,7 +697,7 @@ namespace NewsGate
 
           for(WordPositionNumber j = 0; j < count; ++j)
           {
-            WordPosition pos = w_pos.position(positions, j);
+            WordPosition pos = w_pos.position(msg_positions, j);
             El::CRC(crc, (unsigned char*)&pos, sizeof(pos));
           }
         }
@@ -528,6 +706,112 @@ namespace NewsGate
       return crc;
     }
     
+    bool
+    StoredMessage::pack_positions() throw(El::Exception)
+    {
+      if(positions_packed() || positions.size() == 0)
+      {
+        return false;
+      }
+
+      std::vector<uint8_t> packed;
+      packed.reserve(positions.size() * sizeof(WordPosition));
+
+      int32_t prev = 0;
+      
+      for(WordPositionNumber i = 0; i < positions.size(); ++i)
+      {
+        int32_t delta = (int32_t)positions[i] - prev;
+        prev = positions[i];
+
+        uint32_t val = delta < 0 ? ((uint32_t)(-delta) << 1) - 1 :
+          (uint32_t)delta << 1;
+
+        for(; val >= 0x80; val >>= 7)
+        {
+          packed.push_back((uint8_t)(val | 0x80));
+        }
+
+        packed.push_back((uint8_t)val);
+      }
+
+      if(packed.size() >= positions.size() * sizeof(WordPosition))
+      {
+        return false;
+      }
+
+      // Trailing continuation byte completes no position
+      if(packed.size() & 1)
+      {
+        packed.push_back(0x80);
+      }
+
+      WordPositionArray packed_positions(packed.size() / 2);
+
+      for(size_t i = 0; i < packed_positions.size(); ++i)
+      {
+        packed_positions[i] =
+          (WordPosition)packed[i * 2] | ((WordPosition)packed[i * 2 + 1] << 8);
+      }
+
+      positions.swap(packed_positions);
+      flags |= MF_PACKED_POSITIONS;
+      
+      return true;
+    }
+
+    void
+    StoredMessage::unpack_positions() throw(El::Exception)
+    {
+      if(positions_packed())
+      {
+        WordPositionArray unpacked;
+        unpack_positions(positions, unpacked);
+        
+        positions.swap(unpacked);
+        flags &= ~MF_PACKED_POSITIONS;
+      }
+    }
+
+    void
+    StoredMessage::unpack_positions(const WordPositionArray& src,
+                                    WordPositionArray& dest)
+      throw(El::Exception)
+    {
+      uint32_t bytes = (uint32_t)src.size() * 2;
+      WordPositionNumber count = 0;
+      
+      for(uint32_t i = 0; i < bytes; ++i)
+      {
+        count += ((src[i / 2] >> (i & 1 ? 8 : 0)) & 0x80) == 0;
+      }
+
+      dest.resize(count);
+
+      int32_t prev = 0;
+      uint32_t val = 0;
+      unsigned long shift = 0;
+      WordPositionNumber index = 0;
+      
+      for(uint32_t i = 0; i < bytes; ++i)
+      {
+        uint8_t byte = (uint8_t)(src[i / 2] >> (i & 1 ? 8 : 0));
+        val |= (uint32_t)(byte & 0x7F) << shift;
+
+        if(byte & 0x80)
+        {
+          shift += 7;
+          continue;
+        }
+
+        prev += (val & 1) ? -(int32_t)((val + 1) >> 1) : (int32_t)(val >> 1);
+        dest[index++] = (WordPosition)prev;
+        
+        val = 0;
+        shift = 0;
+      }
+    }
+    
     void
     StoredMessage::clear() throw()
     {
@@ -601,7 +885,16 @@ namespace NewsGate
     void
     StoredMessage::normalize_word(std::wstring& word) throw(El::Exception)
     {
-      El::String::Manip::replace(word, FUNKY_QUOTES, REPLACEMENT_QUOTES);
+      // The only ASCII funky quote is the grave accent
+      
+      for(const wchar_t* ptr = word.c_str(); *ptr != L'\0'; ++ptr)
+      {
+        if(*ptr >= 0x80 || *ptr == L'`')
+        {
+          El::String::Manip::replace(word, FUNKY_QUOTES, REPLACEMENT_QUOTES);
+          break;
+        }
+      }
     }
      
     void
@@ -740,6 +1033,9 @@ namespace NewsGate
                             WordPosition max_pos) const
       throw(Exception, El::Exception)
     {
+      WordPositionArray buffer;
+      const WordPositionArray& msg_positions = get_positions(buffer);
+      
       long positions_count = -1;
       bool interrupted = false;
       
@@ -750,7 +1046,7 @@ namespace NewsGate
 
         for(size_t j = 0; j < word_pos_count; j++)
         {
-          WordPosition pos = word_pos.position(positions, j);
+          WordPosition pos = word_pos.position(msg_positions, j);
 
           if(pos < min_pos || pos >= max_pos)
           {
@@ -781,7 +1077,7 @@ namespace NewsGate
 
         for(size_t j = 0; j < word_pos_count; j++)
         {
-          WordPosition pos = word_pos.position(positions, j);
+          WordPosition pos = word_pos.position(msg_positions, j);
 
           if(pos < min_pos || pos >= max_pos)
           {
@@ -1468,15 +1764,10 @@ namespace NewsGate
                               const SegMarkerPositionSet* seg_markers)
       throw(El::Exception)
     {
-      std::wstring wtext;
-      El::String::Manip::utf8_to_wchar(text, wtext);
+      Utf8Reader reader(text);
       
       std::wstring word;
       word.reserve(100);
-      word = L"";
-
-//      MsWdPs::QuoteStack quotes;
-      const wchar_t* text_str = wtext.c_str();
 
 /*      
       if(flags & WordPositions::FL_TITLE)
@@ -1496,53 +1787,59 @@ namespace NewsGate
       }
 */
       bool end_of_sentence = true;
+
+      // Segmentation marker positions are character indexes
+      uint32_t index = 0;
       
-      for(const wchar_t* ptr = text_str; *ptr != L'\0'; ptr++)
-      {  
-        if(El::String::Unicode::CharTable::is_space(*ptr)) 
-        {
-          word_pos.push_word(word,
-                             flags,
-                             position,
-                             psignature,
-                             word_complements,
-                             end_of_sentence);
+      wchar_t prev = L'\0';
+      wchar_t chr = reader.get();
+      wchar_t next = L'\0';
+      
+      for(; chr != L'\0'; ++index, prev = chr, chr = next)
+      {
+        next = reader.get();
+        
+        if(!El::String::Unicode::CharTable::is_space(chr)) 
+        {
+          word.append(1, chr);
+          continue;
+        }
+        
+        word_pos.push_word(word,
+                           flags,
+                           position,
+                           psignature,
+                           word_complements,
+                           end_of_sentence);
           
-          if(seg_markers &&
-             seg_markers->find(ptr - text_str) != seg_markers->end())
-          {
-            if(!word_complements.empty())
-            {
-              const WordComplementElem& last = *word_complements.rbegin();
-
-              if(last.position == position &&
-                 last.type == WordComplement::TP_SEGMENTATION)
-              {
-                // Segmentation marker for this position already set
-                continue;
-              }
-            }
+        if(seg_markers == 0 || seg_markers->find(index) == seg_markers->end())
+        {
+          continue;
+        }
+        
+        if(!word_complements.empty())
+        {
+          const WordComplementElem& last = *word_complements.rbegin();
 
-            if(ptr == text_str || ptr[1] == L'\0' ||
-               El::String::Unicode::CharTable::is_space(*(ptr - 1)) ||
-               El::String::Unicode::CharTable::is_space(*(ptr + 1)))
-            {
-              // No need in segmentation marker at the beginning, end or
-              // next to whitespace character
-              continue;
-            }
-               
-            WordComplementElem wc(position,
-                                  WordComplement::TP_SEGMENTATION,
-                                  0);
-            
-            word_complements.add(wc);
+          if(last.position == position &&
+             last.type == WordComplement::TP_SEGMENTATION)
+          {
+            // Segmentation marker for this position already set
+            continue;
           }
-          
-          continue;
         }
 
-        word.append(ptr, 1);
+        if(index == 0 || next == L'\0' ||
+           El::String::Unicode::CharTable::is_space(prev) ||
+           El::String::Unicode::CharTable::is_space(next))
+        {
+          // No need in segmentation marker at the beginning, end or
+          // next to whitespace character
+          continue;
+        }
+               
+        WordComplementElem wc(position, WordComplement::TP_SEGMENTATION, 0);
+        word_complements.add(wc);
       }
       
       word_pos.push_word(word,
@@ -1591,11 +1888,14 @@ namespace NewsGate
         key_val.second.write(bin_str);        
       }
 
-      bin_str << (uint16_t)positions.size();
+      WordPositionArray buffer;
+      const WordPositionArray& msg_positions = get_positions(buffer);
       
-      for(unsigned long i = 0; i < positions.size(); i++)
+      bin_str << (uint16_t)msg_positions.size();
+      
+      for(unsigned long i = 0; i < msg_positions.size(); i++)
       {
-        bin_str << positions[i];
+        bin_str << msg_positions[i];
       }
 
       core_words.write(bin_str);
@@ -1697,6 +1997,8 @@ namespace NewsGate
         bin_str >> positions[i];
       }
 
+      flags &= ~MF_PACKED_POSITIONS;
+
       core_words.read(bin_str);
 
 /*
@@ -2053,6 +2355,11 @@ namespace NewsGate
         }
 
         it->second->insert(number);
+
+        if(msg.hostname_len)
+        {
+          hosts.insert(msg.hostname.c_str(), it->second);
+        }
       }
       
       StoredMessage* message = new StoredMessage(msg);
@@ -2648,6 +2955,11 @@ namespace NewsGate
         NumberSet* number_set = sites[msg->hostname.c_str()];
         number_set->erase(number);
 
+        if(msg->hostname_len)
+        {
+          hosts.remove(msg->hostname.c_str());
+        }
+
         if(number_set->empty())
         {
           msg->hostname.remove();
@@ -3281,6 +3593,9 @@ namespace NewsGate
                                            WordsFreqInfo& result)
       const throw(El::Exception)
     {      
+      WordPositionArray buffer;
+      const WordPositionArray& msg_positions = msg.get_positions(buffer);
+      
       const FeedInfo* feed_info = 0;
       
       if(!msg.source_url.empty())
@@ -3331,7 +3646,7 @@ namespace NewsGate
 
         for(size_t i = 0; i < positions.position_count(); i++)
         {
-          WordPosition pos = positions.position(msg.positions, i);
+          WordPosition pos = positions.position(msg_positions, i);
             
           WordsFreqInfo::PositionInfo& pi =
             result.word_positions[pos];
@@ -3436,7 +3751,7 @@ namespace NewsGate
 
         for(size_t i = 0; i < positions.position_count(); i++)
         {
-          WordPosition p = positions.position(msg.positions, i);
+          WordPosition p = positions.position(msg_positions, i);
           WordsFreqInfo::PositionInfo& pi = result.word_positions[p];
 
           //
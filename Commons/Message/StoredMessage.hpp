@@ -16,6 +16,7 @@
 
 #include <stdint.h>
 #include <limits.h>
+#include <string.h>
 
 #include <list>
 #include <utility>
@@ -266,6 +267,35 @@ namespace NewsGate
       ImagesInfo images;
     };
 
+    //
+    // Reads wide characters of UTF-8 text without converting it as a
+    // whole. ASCII runs are located a machine word at a time and read
+    // byte by byte; runs of non-ASCII bytes are decoded with
+    // El::String::Manip::utf8_to_wchar. As multibyte sequences never
+    // contain ASCII bytes, characters read are the same as of the
+    // text converted at once.
+    //
+    class Utf8Reader
+    {
+    public:
+      Utf8Reader(const char* text) throw();
+
+      // Returns L'\0' at the end of text
+      wchar_t get() throw(El::Exception);
+
+    private:
+      static const unsigned char* ascii_end(const unsigned char* text,
+                                            const unsigned char* end)
+        throw();
+
+    private:
+      const unsigned char* ptr_;
+      const unsigned char* end_;
+      const unsigned char* ascii_end_;
+      std::wstring run_;
+      size_t run_pos_;
+    };
+
     class CoreWords : public El::LightArray<uint32_t, uint8_t>
     {
     public:
@@ -312,6 +342,8 @@ namespace NewsGate
       {
         MF_HAS_IMAGES = 0x1,
         MF_HAS_THUMBS = 0x2,
+        // Positions array holds packed positions (not persistent)
+        MF_PACKED_POSITIONS = 0x4,
         MF_HIDDEN = 0x40,
         MF_DIRTY = 0x80,
         MF_PERSISTENT_FLAGS = 0x3
@@ -498,6 +530,30 @@ namespace NewsGate
         throw(El::Exception);
 
       uint64_t word_hash(bool core_word_flag) const throw();
+
+      //
+      // Packs positions of rarely searched message in place unless
+      // packing saves nothing; MF_PACKED_POSITIONS flag is set then.
+      // Positions of a word go in ascending order, so they are stored as
+      // zigzag encoded deltas of adjacent elements in 7-bit groups, which
+      // mostly take a byte per position instead of two; two bytes are
+      // kept in an array element. Returns true if positions were packed.
+      //
+      bool pack_positions() throw(El::Exception);
+      void unpack_positions() throw(El::Exception);
+
+      bool positions_packed() const throw();
+
+      //
+      // Returns positions, unpacking them into buffer if packed; to be
+      // used instead of positions member for messages which can be packed
+      //
+      const WordPositionArray& get_positions(WordPositionArray& buffer) const
+        throw(El::Exception);
+      
+      static void unpack_positions(const WordPositionArray& src,
+                                   WordPositionArray& dest)
+        throw(El::Exception);
       
     protected:
       
@@ -707,6 +763,77 @@ namespace NewsGate
       void operator=(const SiteToMessageNumberMap&);
     };
 
+    //
+    // Hostnames keyed by reversed labels, so news.bbc.co.uk is stored
+    // under uk -> co -> bbc -> news path. Node counts items registered for
+    // the exact host (own) and for the whole subtree (count), so the node
+    // found for a domain covers the domain and all its subdomains.
+    //
+    class HostTrie
+    {
+    public:
+      struct Node;
+
+      typedef __gnu_cxx::hash_map<std::string, Node*, El::Hash::String>
+      NodeMap;
+
+      struct Node
+      {
+        NodeMap children;
+        const NumberSet* messages;
+        uint32_t own;
+        uint32_t count;
+
+        Node() throw() : messages(0), own(0), count(0) {}
+        ~Node() throw();
+
+      private:
+        Node(const Node&);
+        void operator=(const Node&);
+      };
+
+      typedef std::vector<const NumberSet*> NumberSetArray;
+
+      HostTrie() throw() {}
+
+      //
+      // Registers one more item for the host; messages, if specified,
+      // are the exact host message numbers which should outlive the item
+      //
+      void insert(const char* host, const NumberSet* messages = 0)
+        throw(El::Exception);
+
+      void remove(const char* host) throw(El::Exception);
+
+      const Node* find(const char* domain) const throw(El::Exception);
+
+      //
+      // Checks if host belongs to any registered domain
+      //
+      bool covers(const char* host) const throw(El::Exception);
+
+      size_t size() const throw() { return root_.count; }
+
+      //
+      // Collects message number sets of the node subtree
+      //
+      static void number_sets(const Node& node, NumberSetArray& sets)
+        throw(El::Exception);
+
+    private:
+      static bool prev_label(const char* host,
+                             const char*& end,
+                             std::string& label)
+        throw(El::Exception);
+
+    private:
+      Node root_;
+
+    private:
+      HostTrie(const HostTrie&);
+      void operator=(const HostTrie&);
+    };
+
     struct WordIdToCountMap :
       public google::sparse_hash_map<
       El::Dictionary::Morphology::WordId,
@@ -1030,6 +1157,7 @@ namespace NewsGate
       WordToMessageNumberMap   words;
       WordIdToMessageNumberMap norm_forms;
       SiteToMessageNumberMap   sites;
+      HostTrie                 hosts;
       FeedInfoMap              feeds;
       StoredMessageMap         messages;
       IdToNumberMap            id_to_number;
@@ -1166,6 +1294,88 @@ namespace NewsGate
 { 
   namespace Message
   {
+    //
+    // Utf8Reader class
+    //
+    inline
+    Utf8Reader::Utf8Reader(const char* text) throw()
+        : ptr_((const unsigned char*)text),
+          end_(ptr_ + strlen(text)),
+          ascii_end_(ptr_),
+          run_pos_(0)
+    {
+    }
+
+    inline
+    const unsigned char*
+    Utf8Reader::ascii_end(const unsigned char* text,
+                          const unsigned char* end) throw()
+    {
+      //
+      // Words are read only while fully before the terminating zero;
+      // the tail is checked byte by byte. A byte with high bit set makes
+      // the whole word to be checked byte by byte.
+      //
+      
+      const uint64_t HIGHS = 0x8080808080808080ULL;
+
+      for(; (size_t)(end - text) >= sizeof(uint64_t);
+          text += sizeof(uint64_t))
+      {
+        uint64_t val;
+        memcpy(&val, text, sizeof(val));
+
+        if((val & HIGHS) != 0)
+        {
+          break;
+        }
+      }
+      
+      for(; text < end && *text < 0x80; ++text);
+      return text;
+    }
+    
+    inline
+    wchar_t
+    Utf8Reader::get() throw(El::Exception)
+    {
+      while(true)
+      {
+        if(ptr_ < ascii_end_)
+        {
+          return *ptr_++;
+        }
+
+        if(run_pos_ < run_.length())
+        {
+          return run_[run_pos_++];
+        }
+
+        if(*ptr_ == 0)
+        {
+          return L'\0';
+        }
+
+        if(*ptr_ < 0x80)
+        {
+          ascii_end_ = ascii_end(ptr_, end_);
+          continue;
+        }
+
+        const unsigned char* end = ptr_ + 1;
+        for(; *end >= 0x80; ++end);
+
+        run_.clear();
+        run_pos_ = 0;
+        
+        El::String::Manip::utf8_to_wchar(
+          std::string((const char*)ptr_, end - ptr_).c_str(), run_);
+
+        ptr_ = end;
+        ascii_end_ = end;
+      }
+    }
+
     //
     // WordPositions struct
     //
@@ -1725,7 +1935,16 @@ namespace NewsGate
 
       word_positions = src.word_positions;      
       norm_form_positions = src.norm_form_positions;
-      positions = src.positions;
+
+      if(src.positions_packed())
+      {
+        unpack_positions(src.positions, positions);
+        flags &= ~MF_PACKED_POSITIONS;
+      }
+      else
+      {
+        positions = src.positions;
+      }
       core_words = src.core_words;
 
       categories = src.categories;
@@ -1923,6 +2142,27 @@ namespace NewsGate
       feed_search_weight = &zero_feed_search_weight;
     }
 
+    inline
+    bool
+    StoredMessage::positions_packed() const throw()
+    {
+      return (flags & MF_PACKED_POSITIONS) != 0;
+    }
+
+    inline
+    const WordPositionArray&
+    StoredMessage::get_positions(WordPositionArray& buffer) const
+      throw(El::Exception)
+    {
+      if(positions_packed())
+      {
+        unpack_positions(positions, buffer);
+        return buffer;
+      }
+
+      return positions;
+    }
+
     //
     // WordsFreqInfo struct
     //
@@ -2749,6 +2989,19 @@ namespace NewsGate
       }
     }
 
+    //
+    // HostTrie::Node struct
+    //
+    inline
+    HostTrie::Node::~Node() throw()
+    {
+      for(NodeMap::iterator i(children.begin()), e(children.end()); i != e;
+          ++i)
+      {
+        delete i->second;
+      }
+    }
+
     //
     // FeedInfo class
     //
@@ -180,6 +180,48 @@ namespace NewsGate
         old = orb->register_value_factory(
           "IDL:NewsGate/Message/Transport/CategoryLocale:1.0",
           factory);
+
+        factory = new NewsGate::Message::Transport::
+          WordCompletionRequestImpl::Init();
+      
+        old = orb->register_value_factory(
+          "IDL:NewsGate/Message/Transport/WordCompletionRequest:1.0",
+          factory);
+        
+        factory = new NewsGate::Message::Transport::
+          WordCompletionResponseImpl::Init();
+      
+        old = orb->register_value_factory(
+          "IDL:NewsGate/Message/Transport/WordCompletionResponse:1.0",
+          factory);
+
+        factory = new NewsGate::Message::Transport::
+          TrendingTermsRequestImpl::Init();
+      
+        old = orb->register_value_factory(
+          "IDL:NewsGate/Message/Transport/TrendingTermsRequest:1.0",
+          factory);
+        
+        factory = new NewsGate::Message::Transport::
+          TrendingTermsResponseImpl::Init();
+      
+        old = orb->register_value_factory(
+          "IDL:NewsGate/Message/Transport/TrendingTermsResponse:1.0",
+          factory);
+
+        factory = new NewsGate::Message::Transport::
+          FuzzyWordsRequestImpl::Init();
+      
+        old = orb->register_value_factory(
+          "IDL:NewsGate/Message/Transport/FuzzyWordsRequest:1.0",
+          factory);
+        
+        factory = new NewsGate::Message::Transport::
+          FuzzyWordsResponseImpl::Init();
+      
+        old = orb->register_value_factory(
+          "IDL:NewsGate/Message/Transport/FuzzyWordsResponse:1.0",
+          factory);
       }
 
       //
@@ -15,6 +15,7 @@
 #define _NEWSGATE_SERVER_COMMONS_MESSAGE_TRANSPORTIMPL_HPP_
 
 #include <stdint.h>
+#include <math.h>
 
 #include <memory>
 #include <vector>
@@ -767,6 +768,341 @@ namespace NewsGate
         typedef El::Corba::ValueOut<Type> Out;
       };
       
+      //
+      // WordCompletionRequest implementation
+      //
+
+      struct WordCompletionRequestInfo
+      {
+        std::string prefix;
+        El::Lang lang;
+        uint32_t count;
+
+        WordCompletionRequestInfo() throw(El::Exception) : count(0) {}
+
+        void write(El::BinaryOutStream& bstr) const throw(El::Exception);
+        void read(El::BinaryInStream& bstr) throw(El::Exception);
+      };
+
+      struct WordCompletionRequestImpl
+      {
+        typedef El::Corba::Transport::Entity<
+          WordCompletionRequest,
+          WordCompletionRequestInfo,
+          El::Corba::Transport::TE_IDENTITY> Type;
+        
+        typedef El::Corba::Transport::Entity_init<WordCompletionRequestInfo,
+                                                  Type> Init;
+
+        typedef El::Corba::ValueVar<Type> Var;
+        typedef El::Corba::ValueOut<Type> Out;
+      };
+
+      //
+      // WordCompletionResponse implementation
+      //
+
+      struct WordCompletion
+      {
+        std::string word;
+        uint64_t count;
+
+        WordCompletion() throw(El::Exception) : count(0) {}
+        
+        WordCompletion(const char* word_val, uint64_t count_val)
+          throw(El::Exception);
+
+        void write(El::BinaryOutStream& bstr) const throw(El::Exception);
+        void read(El::BinaryInStream& bstr) throw(El::Exception);
+      };
+
+      typedef std::vector<WordCompletion> WordCompletionArray;
+
+      struct WordCompletionResponseImpl
+      {
+        class WordCompletionResponseSemiImpl : public WordCompletionResponse
+        {
+          //
+          // IDL:NewsGate/Message/Transport/Response/absorb:1.0
+          //
+          virtual void absorb(Response* src)
+            throw(Response::ImplementationException,
+                  CORBA::SystemException) {}
+        };
+        
+        class Type :
+          public El::Corba::Transport::EntityPack<
+              WordCompletionResponseSemiImpl,
+              WordCompletion,
+              WordCompletionArray,
+              El::Corba::Transport::TE_IDENTITY>
+        {
+        public:
+
+          Type(WordCompletionArray* entities) throw(El::Exception);
+          virtual ~Type() throw() {}
+            
+          //
+          // IDL:NewsGate/Message/Transport/Response/absorb:1.0
+          //
+          virtual void absorb(Response* src)
+            throw(Response::ImplementationException,
+                  CORBA::SystemException);
+
+          virtual CORBA::ValueBase* _copy_value() throw(CORBA::NO_IMPLEMENT);
+          
+        private:
+          typedef ACE_Thread_Mutex Mutex;
+          typedef ACE_Read_Guard<Mutex> ReadGuard;
+          typedef ACE_Write_Guard<Mutex> WriteGuard;
+
+          Mutex lock_;
+        };
+
+        typedef El::Corba::Transport::EntityPack_init<WordCompletionResponse,
+                                                      WordCompletionArray,
+                                                      Type>
+        Init;
+
+        typedef El::Corba::ValueVar<Type> Var;
+        typedef El::Corba::ValueOut<Type> Out;        
+      };
+      
+      //
+      // TrendingTermsRequest implementation
+      //
+
+      struct TrendingTermsRequestInfo
+      {
+        El::Lang lang; // Any language if El::Lang::null
+        uint32_t hours;
+        uint32_t min_count;
+        uint32_t count;
+
+        TrendingTermsRequestInfo() throw(El::Exception);
+
+        void write(El::BinaryOutStream& bstr) const throw(El::Exception);
+        void read(El::BinaryInStream& bstr) throw(El::Exception);
+      };
+
+      struct TrendingTermsRequestImpl
+      {
+        typedef El::Corba::Transport::Entity<
+          TrendingTermsRequest,
+          TrendingTermsRequestInfo,
+          El::Corba::Transport::TE_IDENTITY> Type;
+        
+        typedef El::Corba::Transport::Entity_init<TrendingTermsRequestInfo,
+                                                  Type> Init;
+
+        typedef El::Corba::ValueVar<Type> Var;
+        typedef El::Corba::ValueOut<Type> Out;
+      };
+
+      //
+      // TrendingTermsResponse implementation
+      //
+
+      //
+      // Core word or core word pair (word_id1 is 0 for single word)
+      // counted in recent messages, and the count expected from the
+      // messages preceding them. As each bank counts own messages only,
+      // recent and expected values are summed up across banks.
+      //
+      struct TrendingTerm
+      {
+        uint32_t word_id1;
+        uint32_t word_id2;
+        std::string text;
+        uint64_t recent;
+        float expected;
+
+        TrendingTerm() throw(El::Exception);
+
+        float rise() const throw();
+
+        void write(El::BinaryOutStream& bstr) const throw(El::Exception);
+        void read(El::BinaryInStream& bstr) throw(El::Exception);
+      };
+
+      typedef std::vector<TrendingTerm> TrendingTermArray;
+
+      struct TrendingTermsResponseImpl
+      {
+        class TrendingTermsResponseSemiImpl : public TrendingTermsResponse
+        {
+          //
+          // IDL:NewsGate/Message/Transport/Response/absorb:1.0
+          //
+          virtual void absorb(Response* src)
+            throw(Response::ImplementationException,
+                  CORBA::SystemException) {}
+        };
+        
+        class Type :
+          public El::Corba::Transport::EntityPack<
+              TrendingTermsResponseSemiImpl,
+              TrendingTerm,
+              TrendingTermArray,
+              El::Corba::Transport::TE_IDENTITY>
+        {
+        public:
+
+          Type(TrendingTermArray* entities) throw(El::Exception);
+          virtual ~Type() throw() {}
+            
+          //
+          // IDL:NewsGate/Message/Transport/Response/absorb:1.0
+          //
+          virtual void absorb(Response* src)
+            throw(Response::ImplementationException,
+                  CORBA::SystemException);
+
+          virtual CORBA::ValueBase* _copy_value() throw(CORBA::NO_IMPLEMENT);
+          
+        private:
+          typedef ACE_Thread_Mutex Mutex;
+          typedef ACE_Write_Guard<Mutex> WriteGuard;
+
+          Mutex lock_;
+        };
+
+        typedef El::Corba::Transport::EntityPack_init<TrendingTermsResponse,
+                                                      TrendingTermArray,
+                                                      Type>
+        Init;
+
+        typedef El::Corba::ValueVar<Type> Var;
+        typedef El::Corba::ValueOut<Type> Out;        
+      };
+      
+      //
+      // FuzzyWordsRequest implementation
+      //
+
+      //
+      // Search expression word to be checked against bank word index.
+      // Word is considered misspelled if no bank has it indexed,
+      // in this case up to count index words within max_distance edits
+      // are requested from each bank.
+      //
+      struct FuzzyWordQuery
+      {
+        std::string text;
+        std::vector<uint32_t> norm_forms;
+        uint32_t max_distance;
+        uint32_t count;
+
+        FuzzyWordQuery() throw(El::Exception);
+
+        void write(El::BinaryOutStream& bstr) const throw(El::Exception);
+        void read(El::BinaryInStream& bstr) throw(El::Exception);
+      };
+
+      typedef std::vector<FuzzyWordQuery> FuzzyWordQueryArray;
+
+      struct FuzzyWordsRequestInfo
+      {
+        FuzzyWordQueryArray words;
+
+        void write(El::BinaryOutStream& bstr) const throw(El::Exception);
+        void read(El::BinaryInStream& bstr) throw(El::Exception);
+      };
+
+      struct FuzzyWordsRequestImpl
+      {
+        typedef El::Corba::Transport::Entity<
+          FuzzyWordsRequest,
+          FuzzyWordsRequestInfo,
+          El::Corba::Transport::TE_IDENTITY> Type;
+        
+        typedef El::Corba::Transport::Entity_init<FuzzyWordsRequestInfo,
+                                                  Type> Init;
+
+        typedef El::Corba::ValueVar<Type> Var;
+        typedef El::Corba::ValueOut<Type> Out;
+      };
+
+      //
+      // FuzzyWordsResponse implementation
+      //
+
+      //
+      // Index word similar to query word with query index position in the
+      // request. Zero distance means the query word itself is indexed by
+      // the bank. Count is the number of bank messages containing the word,
+      // so is summed up across banks.
+      //
+      struct FuzzyWord
+      {
+        uint32_t query;
+        std::string word;
+        uint32_t distance;
+        uint64_t count;
+
+        FuzzyWord() throw(El::Exception);
+        
+        FuzzyWord(uint32_t query_val,
+                  const char* word_val,
+                  uint32_t distance_val,
+                  uint64_t count_val)
+          throw(El::Exception);
+
+        void write(El::BinaryOutStream& bstr) const throw(El::Exception);
+        void read(El::BinaryInStream& bstr) throw(El::Exception);
+      };
+
+      typedef std::vector<FuzzyWord> FuzzyWordArray;
+
+      struct FuzzyWordsResponseImpl
+      {
+        class FuzzyWordsResponseSemiImpl : public FuzzyWordsResponse
+        {
+          //
+          // IDL:NewsGate/Message/Transport/Response/absorb:1.0
+          //
+          virtual void absorb(Response* src)
+            throw(Response::ImplementationException,
+                  CORBA::SystemException) {}
+        };
+        
+        class Type :
+          public El::Corba::Transport::EntityPack<
+              FuzzyWordsResponseSemiImpl,
+              FuzzyWord,
+              FuzzyWordArray,
+              El::Corba::Transport::TE_IDENTITY>
+        {
+        public:
+
+          Type(FuzzyWordArray* entities) throw(El::Exception);
+          virtual ~Type() throw() {}
+            
+          //
+          // IDL:NewsGate/Message/Transport/Response/absorb:1.0
+          //
+          virtual void absorb(Response* src)
+            throw(Response::ImplementationException,
+                  CORBA::SystemException);
+
+          virtual CORBA::ValueBase* _copy_value() throw(CORBA::NO_IMPLEMENT);
+          
+        private:
+          typedef ACE_Thread_Mutex Mutex;
+          typedef ACE_Write_Guard<Mutex> WriteGuard;
+
+          Mutex lock_;
+        };
+
+        typedef El::Corba::Transport::EntityPack_init<FuzzyWordsResponse,
+                                                      FuzzyWordArray,
+                                                      Type>
+        Init;
+
+        typedef El::Corba::ValueVar<Type> Var;
+        typedef El::Corba::ValueOut<Type> Out;        
+      };
+      
       //
       // CategoryLocale implementation
       //
@@ -1361,6 +1697,385 @@ namespace NewsGate
 
         return res._retn();        
       }      
+
+      //
+      // WordCompletionRequestInfo struct
+      //
+      inline
+      void
+      WordCompletionRequestInfo::write(El::BinaryOutStream& bstr) const
+        throw(El::Exception)
+      {
+        bstr << (uint32_t)1 << prefix << lang << count;
+      }
+      
+      inline
+      void
+      WordCompletionRequestInfo::read(El::BinaryInStream& bstr)
+        throw(El::Exception)
+      {
+        uint32_t version = 0;
+        bstr >> version >> prefix >> lang >> count;
+      }
+
+      //
+      // WordCompletion struct
+      //
+      inline
+      WordCompletion::WordCompletion(const char* word_val,
+                                     uint64_t count_val)
+        throw(El::Exception)
+          : word(word_val),
+            count(count_val)
+      {
+      }
+      
+      inline
+      void
+      WordCompletion::write(El::BinaryOutStream& bstr) const
+        throw(El::Exception)
+      {
+        bstr << word << count;
+      }
+
+      inline
+      void
+      WordCompletion::read(El::BinaryInStream& bstr) throw(El::Exception)
+      {
+        bstr >> word >> count;
+      }
+
+      //
+      // WordCompletionResponseImpl class
+      //
+      inline
+      WordCompletionResponseImpl::Type::Type(WordCompletionArray* completions)
+        throw(El::Exception)
+          : El::Corba::Transport::EntityPack<
+              WordCompletionResponseSemiImpl,
+              WordCompletion,
+              WordCompletionArray,
+              El::Corba::Transport::TE_IDENTITY>(completions)
+      {
+      }
+
+      inline
+      void
+      WordCompletionResponseImpl::Type::absorb(Response* src)
+        throw(Response::ImplementationException,
+              CORBA::SystemException)
+      {
+        Type* response = dynamic_cast<Type*>(src);
+
+        if(response == 0)
+        {
+          Response::ImplementationException ex;
+          ex.description = "WordCompletionResponseImpl::Type::absorb: "
+            "dynamic_cast<Type*> failed";
+          
+          throw ex;
+        }
+        
+        WriteGuard guard(lock_);
+
+        entities().insert(entities().end(),
+                          response->entities().begin(),
+                          response->entities().end());
+      }
+          
+      inline
+      CORBA::ValueBase*
+      WordCompletionResponseImpl::Type::_copy_value()
+        throw(CORBA::NO_IMPLEMENT)
+      {
+        El::Corba::ValueVar<WordCompletionResponseImpl::Type> res(
+          new WordCompletionResponseImpl::Type(0));
+
+        if(serialized_)
+        {
+          res->packed_entities_ = new CORBA::OctetSeq();
+          res->packed_entities_.inout() = packed_entities_.in();
+        }
+        else
+        {
+          res->entities_.reset(new WordCompletionArray());
+          *res->entities_ = *entities_;
+        }
+
+        return res._retn();        
+      }
+      //
+      // TrendingTermsRequestInfo struct
+      //
+      inline
+      TrendingTermsRequestInfo::TrendingTermsRequestInfo()
+        throw(El::Exception)
+          : hours(0),
+            min_count(0),
+            count(0)
+      {
+      }
+      
+      inline
+      void
+      TrendingTermsRequestInfo::write(El::BinaryOutStream& bstr) const
+        throw(El::Exception)
+      {
+        bstr << (uint32_t)1 << lang << hours << min_count << count;
+      }
+      
+      inline
+      void
+      TrendingTermsRequestInfo::read(El::BinaryInStream& bstr)
+        throw(El::Exception)
+      {
+        uint32_t version = 0;
+        bstr >> version >> lang >> hours >> min_count >> count;
+      }
+
+      //
+      // TrendingTerm struct
+      //
+      inline
+      TrendingTerm::TrendingTerm() throw(El::Exception)
+          : word_id1(0),
+            word_id2(0),
+            recent(0),
+            expected(0)
+      {
+      }
+
+      inline
+      float
+      TrendingTerm::rise() const throw()
+      {
+        // Deviation from expectation in a Poisson-like manner, so a
+        // rare term needs less occurrences than a common one to rise
+        return ((float)recent - expected) / sqrt(expected + 1);
+      }
+      
+      inline
+      void
+      TrendingTerm::write(El::BinaryOutStream& bstr) const
+        throw(El::Exception)
+      {
+        bstr << word_id1 << word_id2 << text << recent << expected;
+      }
+
+      inline
+      void
+      TrendingTerm::read(El::BinaryInStream& bstr) throw(El::Exception)
+      {
+        bstr >> word_id1 >> word_id2 >> text >> recent >> expected;
+      }
+
+      //
+      // TrendingTermsResponseImpl class
+      //
+      inline
+      TrendingTermsResponseImpl::Type::Type(TrendingTermArray* terms)
+        throw(El::Exception)
+          : El::Corba::Transport::EntityPack<
+              TrendingTermsResponseSemiImpl,
+              TrendingTerm,
+              TrendingTermArray,
+              El::Corba::Transport::TE_IDENTITY>(terms)
+      {
+      }
+
+      inline
+      void
+      TrendingTermsResponseImpl::Type::absorb(Response* src)
+        throw(Response::ImplementationException,
+              CORBA::SystemException)
+      {
+        Type* response = dynamic_cast<Type*>(src);
+
+        if(response == 0)
+        {
+          Response::ImplementationException ex;
+          ex.description = "TrendingTermsResponseImpl::Type::absorb: "
+            "dynamic_cast<Type*> failed";
+          
+          throw ex;
+        }
+        
+        WriteGuard guard(lock_);
+
+        entities().insert(entities().end(),
+                          response->entities().begin(),
+                          response->entities().end());
+      }
+          
+      inline
+      CORBA::ValueBase*
+      TrendingTermsResponseImpl::Type::_copy_value()
+        throw(CORBA::NO_IMPLEMENT)
+      {
+        El::Corba::ValueVar<TrendingTermsResponseImpl::Type> res(
+          new TrendingTermsResponseImpl::Type(0));
+
+        if(serialized_)
+        {
+          res->packed_entities_ = new CORBA::OctetSeq();
+          res->packed_entities_.inout() = packed_entities_.in();
+        }
+        else
+        {
+          res->entities_.reset(new TrendingTermArray());
+          *res->entities_ = *entities_;
+        }
+
+        return res._retn();        
+      }
+
+      //
+      // FuzzyWordQuery struct
+      //
+      inline
+      FuzzyWordQuery::FuzzyWordQuery() throw(El::Exception)
+          : max_distance(0),
+            count(0)
+      {
+      }
+      
+      inline
+      void
+      FuzzyWordQuery::write(El::BinaryOutStream& bstr) const
+        throw(El::Exception)
+      {
+        bstr << text << max_distance << count;
+        bstr.write_array(norm_forms);
+      }
+
+      inline
+      void
+      FuzzyWordQuery::read(El::BinaryInStream& bstr) throw(El::Exception)
+      {
+        bstr >> text >> max_distance >> count;
+        bstr.read_array(norm_forms);
+      }
+
+      //
+      // FuzzyWordsRequestInfo struct
+      //
+      inline
+      void
+      FuzzyWordsRequestInfo::write(El::BinaryOutStream& bstr) const
+        throw(El::Exception)
+      {
+        bstr << (uint32_t)1;
+        bstr.write_array(words);
+      }
+      
+      inline
+      void
+      FuzzyWordsRequestInfo::read(El::BinaryInStream& bstr)
+        throw(El::Exception)
+      {
+        uint32_t version = 0;
+        bstr >> version;
+        bstr.read_array(words);
+      }
+
+      //
+      // FuzzyWord struct
+      //
+      inline
+      FuzzyWord::FuzzyWord() throw(El::Exception)
+          : query(0),
+            distance(0),
+            count(0)
+      {
+      }
+      
+      inline
+      FuzzyWord::FuzzyWord(uint32_t query_val,
+                           const char* word_val,
+                           uint32_t distance_val,
+                           uint64_t count_val)
+        throw(El::Exception)
+          : query(query_val),
+            word(word_val),
+            distance(distance_val),
+            count(count_val)
+      {
+      }
+      
+      inline
+      void
+      FuzzyWord::write(El::BinaryOutStream& bstr) const
+        throw(El::Exception)
+      {
+        bstr << query << word << distance << count;
+      }
+
+      inline
+      void
+      FuzzyWord::read(El::BinaryInStream& bstr) throw(El::Exception)
+      {
+        bstr >> query >> word >> distance >> count;
+      }
+
+      //
+      // FuzzyWordsResponseImpl class
+      //
+      inline
+      FuzzyWordsResponseImpl::Type::Type(FuzzyWordArray* words)
+        throw(El::Exception)
+          : El::Corba::Transport::EntityPack<
+              FuzzyWordsResponseSemiImpl,
+              FuzzyWord,
+              FuzzyWordArray,
+              El::Corba::Transport::TE_IDENTITY>(words)
+      {
+      }
+
+      inline
+      void
+      FuzzyWordsResponseImpl::Type::absorb(Response* src)
+        throw(Response::ImplementationException,
+              CORBA::SystemException)
+      {
+        Type* response = dynamic_cast<Type*>(src);
+
+        if(response == 0)
+        {
+          Response::ImplementationException ex;
+          ex.description = "FuzzyWordsResponseImpl::Type::absorb: "
+            "dynamic_cast<Type*> failed";
+          
+          throw ex;
+        }
+        
+        WriteGuard guard(lock_);
+
+        entities().insert(entities().end(),
+                          response->entities().begin(),
+                          response->entities().end());
+      }
+          
+      inline
+      CORBA::ValueBase*
+      FuzzyWordsResponseImpl::Type::_copy_value()
+        throw(CORBA::NO_IMPLEMENT)
+      {
+        El::Corba::ValueVar<FuzzyWordsResponseImpl::Type> res(
+          new FuzzyWordsResponseImpl::Type(0));
+
+        if(serialized_)
+        {
+          res->packed_entities_ = new CORBA::OctetSeq();
+          res->packed_entities_.inout() = packed_entities_.in();
+        }
+        else
+        {
+          res->entities_.reset(new FuzzyWordArray());
+          *res->entities_ = *entities_;
+        }
+
+        return res._retn();        
+      }
     }
   }
 }
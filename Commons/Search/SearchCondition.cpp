@@ -12,6 +12,7 @@
  */
 
 #include <limits.h>
+#include <math.h>
 
 #include <iomanip>
 #include <iostream>
@@ -20,6 +21,9 @@
 #include <utility>
 #include <memory>
 #include <list>
+#include <algorithm>
+
+#include <ext/hash_set>
 
 #include <El/Exception.hpp>
 #include <El/Stat.hpp>
@@ -33,6 +37,11 @@ namespace
 {
 //  const unsigned long ANY_WORD_RESULT_RESERVE = 100000;
   const size_t ANY_WORD_POS_RESERVE = 10000;
+  const size_t DOMAIN_INDEX_SHARE_DIVIDER = 4;
+
+  const uint32_t RELATED_MIN_SHARED_WORDS = 2;
+  const size_t RELATED_WORD_SHARE_DIVIDER = 4;
+  const size_t RELATED_WORD_SHARE_MIN_MESSAGES = 1000;
 }
 
 namespace NewsGate
@@ -46,6 +55,7 @@ namespace NewsGate
     El::Stat::TimeMeter Url::evaluate_meter("Url::evaluate", false);
     El::Stat::TimeMeter Category::evaluate_meter("Category::evaluate", false);
     El::Stat::TimeMeter Msg::evaluate_meter("Msg::evaluate", false);
+    El::Stat::TimeMeter Related::evaluate_meter("Related::evaluate", false);
     El::Stat::TimeMeter Event::evaluate_meter("Event::evaluate", false);
     El::Stat::TimeMeter Every::evaluate_meter("Every::evaluate", false);
     El::Stat::TimeMeter None::evaluate_meter("None::evaluate", false);
@@ -1414,7 +1424,10 @@ namespace NewsGate
           const Message::MessageWordPosition& msg_word_positions =
             msg->word_positions;
 
-          const Message::WordPositionArray& word_positions = msg->positions;
+          Message::WordPositionArray positions_buffer;
+          
+          const Message::WordPositionArray& word_positions =
+            msg->get_positions(positions_buffer);
 
           const Message::NormFormPosition& norm_form_positions =
             msg->norm_form_positions;
@@ -2123,6 +2136,199 @@ namespace NewsGate
       }
     }
 
+    Domain::DomainOptimizationInfo*
+    Domain::optimization_info() throw(Exception, El::Exception)
+    {
+      if(optimization_info_.get() == 0)
+      {
+        optimization_info_.reset(new DomainOptimizationInfo());
+
+        DomainOptimizationInfo* opt =
+          dynamic_cast<DomainOptimizationInfo*>(optimization_info_.get());
+
+        for(DomainList::const_iterator i(domains.begin()), e(domains.end());
+            i != e; ++i)
+        {
+          if(i->len)
+          {
+            opt->domains.insert(i->name.c_str());
+          }
+        }
+      }
+
+      DomainOptimizationInfo* opt =
+        dynamic_cast<DomainOptimizationInfo*>(optimization_info_.get());
+
+      assert(opt != 0);
+      return opt;
+    }
+
+    Condition::Result*
+    Domain::evaluate(Context& context,
+                     MessageMatchInfoMap& match_info,
+                     unsigned long flags) const
+      throw(El::Exception)
+    {
+      El::Stat::TimeMeasurement measurement(evaluate_meter);
+
+      if(reversed)
+      {
+        return Filter::evaluate(context, match_info, flags);
+      }
+
+      //
+      // Messages of domains and their subdomains are those of
+      // corresponding host trie subtrees
+      //
+
+      const Message::HostTrie& hosts = context.messages.hosts;
+      Message::HostTrie::NumberSetArray number_sets;
+
+      for(DomainList::const_iterator i(domains.begin()), e(domains.end());
+          i != e; ++i)
+      {
+        const Message::HostTrie::Node* node =
+          i->len ? hosts.find(i->name.c_str()) : 0;
+
+        if(node)
+        {
+          Message::HostTrie::number_sets(*node, number_sets);
+        }
+      }
+
+      // Nested domains (like gov and state.gov) give same sets
+      std::sort(number_sets.begin(), number_sets.end());
+
+      number_sets.erase(std::unique(number_sets.begin(), number_sets.end()),
+                        number_sets.end());
+
+      size_t size_forecast = 0;
+
+      for(Message::HostTrie::NumberSetArray::const_iterator
+            i(number_sets.begin()), e(number_sets.end()); i != e; ++i)
+      {
+        size_forecast += (*i)->size();
+      }
+
+      if(!size_forecast)
+      {
+        return new Result();
+      }
+
+      const Message::StoredMessageMap& stored_message =
+        context.messages.messages;
+
+      bool every = condition->type() == TP_EVERY;
+
+      if(!every &&
+         size_forecast > stored_message.size() / DOMAIN_INDEX_SHARE_DIVIDER)
+      {
+        //
+        // For wide domains filtering the condition results is cheaper
+        // than uniting posting sets
+        //
+        return Filter::evaluate(context, match_info, flags);
+      }
+
+      ResultList::const_iterator intersect_list_begin =
+        context.intersect_list.begin();
+
+      ResultList::const_iterator intersect_list_end =
+        context.intersect_list.end();
+
+      ResultList::const_iterator skip_list_begin =
+        context.skip_list.begin();
+
+      ResultList::const_iterator skip_list_end =
+        context.skip_list.end();
+
+      MessageFilterList::const_iterator filters_begin =
+        context.filters.begin();
+
+      MessageFilterList::const_iterator filters_end =
+        context.filters.end();
+
+      bool search_hidden = (flags & EF_SEARCH_HIDDEN) == EF_SEARCH_HIDDEN;
+
+      ResultPtr presult(new Result(size_forecast));
+      Result& result = *presult;
+
+      for(Message::HostTrie::NumberSetArray::const_iterator
+            i(number_sets.begin()), e(number_sets.end()); i != e; ++i)
+      {
+        const Message::NumberSet& numbers = **i;
+
+        for(Message::NumberSet::const_iterator nit = numbers.begin();
+            nit != numbers.end(); ++nit)
+        {
+          Message::Number number = *nit;
+
+          if(every && (message_not_in_list(number,
+                                           intersect_list_begin,
+                                           intersect_list_end) ||
+                       message_in_list(number,
+                                       skip_list_begin,
+                                       skip_list_end)))
+          {
+            continue;
+          }
+
+          Message::StoredMessageMap::const_iterator mit  =
+            stored_message.find(number);
+
+          if(mit == stored_message.end())
+          {
+            continue;
+          }
+
+          const Message::StoredMessage* msg = mit->second;
+
+          if(every)
+          {
+            if(msg->hidden() != search_hidden)
+            {
+              continue;
+            }
+
+            MessageFilterList::const_iterator fit = filters_begin;
+
+            for(; fit != filters_end && (*fit)->satisfy(*msg, context);
+                fit++);
+
+            if(fit != filters_end)
+            {
+              // Filtered out
+              continue;
+            }
+          }
+
+          result.insert(std::make_pair(number, msg));
+        }
+      }
+
+      if(every)
+      {
+        return presult.release();
+      }
+
+      //
+      // Domain messages restrict the condition evaluation the same way
+      // And operands do
+      //
+
+      ResultList::iterator iwit = context.intersect_list.begin();
+
+      for(; iwit != context.intersect_list.end() &&
+            (*iwit)->size() < result.size(); iwit++);
+
+      iwit = context.intersect_list.insert(iwit, &result);
+
+      ResultPtr res(condition->evaluate(context, match_info, flags));
+
+      context.intersect_list.erase(iwit);
+      return res.release();
+    }
+
     //
     // Signature class
     //
@@ -2717,6 +2923,355 @@ namespace NewsGate
       return presult.release();
     }
 
+    //
+    // Related class
+    //
+    void
+    Related::print(std::ostream& ostr) const throw(El::Exception)
+    {
+      ostr << "RELATED";
+
+      for(Message::IdArray::const_iterator i(ids.begin()), e(ids.end());
+          i != e; ++i)
+      {
+        ostr << " " << i->string();
+      }
+
+      if(!core_words.empty())
+      {
+        ostr << " CORE";
+
+        for(size_t i = 0; i < core_words.size(); ++i)
+        {
+          ostr << " " << core_words[i];
+        }
+      }
+    }
+
+    template<typename WordArray>
+    void
+    Related::add_seed_words(const WordArray& words, WordWeightMap& weights)
+      throw(El::Exception)
+    {
+      size_t size = words.size();
+
+      for(size_t i = 0; i < size; ++i)
+      {
+        // Rank weighting as of SearcheableMessageMap::sort_cw
+        float& weight = weights[words[i]];
+        weight = std::max(weight, (float)(size - i) / size);
+      }
+    }
+
+    const Message::NumberSet*
+    Related::word_messages(El::Dictionary::Morphology::WordId id,
+                           const StoredMessageArray& seed_messages,
+                           const Message::SearcheableMessageMap& messages)
+      throw(El::Exception)
+    {
+      Message::WordIdToMessageNumberMap::const_iterator nit =
+        messages.norm_forms.find(id);
+
+      if(nit != messages.norm_forms.end())
+      {
+        return &nit->second->messages;
+      }
+
+      //
+      // Core word unknown to dictionary is identified by pseudo id of it's
+      // text, so looking for the text among seed message words. Such words
+      // are matched only in the bank storing the seed message.
+      //
+      for(StoredMessageArray::const_iterator i(seed_messages.begin()),
+            e(seed_messages.end()); i != e; ++i)
+      {
+        const Message::MessageWordPosition& word_positions =
+          (*i)->word_positions;
+
+        for(size_t j = 0; j < word_positions.size(); ++j)
+        {
+          const char* word = word_positions[j].first.c_str();
+
+          if(El::Dictionary::Morphology::pseudo_id(word) == id)
+          {
+            Message::WordToMessageNumberMap::const_iterator wit =
+              messages.words.find(word);
+
+            return wit == messages.words.end() ? 0 : &wit->second->messages;
+          }
+        }
+      }
+
+      return 0;
+    }
+
+    Condition::Result*
+    Related::evaluate(Context& context,
+                      MessageMatchInfoMap& match_info,
+                      unsigned long flags) const
+      throw(El::Exception)
+    {
+      El::Stat::TimeMeasurement measurement(evaluate_meter);
+
+      const Message::SearcheableMessageMap& messages = context.messages;
+      const Message::StoredMessageMap& stored_message = messages.messages;
+
+      const Message::IdToNumberMap& id_to_number = messages.id_to_number;
+
+      typedef __gnu_cxx::hash_set<El::Luid, El::Hash::Luid> EventSet;
+
+      StoredMessageArray seed_messages;
+      std::vector<Message::Number> seed_numbers;
+      EventSet events;
+      WordWeightMap seed_words;
+
+      add_seed_words(core_words, seed_words);
+
+      for(SeedArray::const_iterator i(seeds.begin()), e(seeds.end());
+          i != e; ++i)
+      {
+        if(i->event_id != El::Luid::null)
+        {
+          events.insert(i->event_id);
+        }
+
+        add_seed_words(i->core_words, seed_words);
+      }
+
+      for(Message::IdArray::const_iterator i(ids.begin()), e(ids.end());
+          i != e; ++i)
+      {
+        Message::IdToNumberMap::const_iterator iit = id_to_number.find(*i);
+
+        if(iit == id_to_number.end())
+        {
+          continue;
+        }
+
+        Message::StoredMessageMap::const_iterator mit =
+          stored_message.find(iit->second);
+
+        if(mit == stored_message.end())
+        {
+          continue;
+        }
+
+        const Message::StoredMessage* msg = mit->second;
+
+        seed_messages.push_back(msg);
+        seed_numbers.push_back(iit->second);
+
+        if(msg->event_id != El::Luid::null)
+        {
+          // Other messages of seed event are just retellings of it
+          events.insert(msg->event_id);
+        }
+
+        add_seed_words(msg->core_words, seed_words);
+      }
+
+      if(seed_words.empty())
+      {
+        return new Result();
+      }
+
+      typedef __gnu_cxx::hash_map<Message::Number,
+                                  Candidate,
+                                  El::Hash::Numeric<Message::Number> >
+        CandidateMap;
+
+      CandidateMap candidate_map;
+      size_t total_messages = stored_message.size();
+
+      //
+      // Score of a message sharing all seed words, each the rarest possible
+      // and at the same rank; used to scale candidate scores to [0, 1]
+      // for relevance sorting.
+      //
+      float max_score = 0;
+      float max_rareness = log((float)total_messages + 1);
+
+      for(WordWeightMap::const_iterator i(seed_words.begin()),
+            e(seed_words.end()); i != e; ++i)
+      {
+        El::Dictionary::Morphology::WordId id = i->first;
+
+        const Message::NumberSet* numbers =
+          word_messages(id, seed_messages, messages);
+
+        if(numbers == 0 || numbers->empty() ||
+           (total_messages > RELATED_WORD_SHARE_MIN_MESSAGES &&
+            numbers->size() > total_messages / RELATED_WORD_SHARE_DIVIDER))
+        {
+          // Too common word can't tell messages are related but would
+          // make the whole map a candidate
+          continue;
+        }
+
+        // The rarer word is the stronger relation it means
+        float weight =
+          i->second * log((float)total_messages / numbers->size() + 1);
+
+        max_score += i->second * max_rareness;
+
+        for(Message::NumberSet::const_iterator nit(numbers->begin()),
+              nie(numbers->end()); nit != nie; ++nit)
+        {
+          Message::StoredMessageMap::const_iterator mit =
+            stored_message.find(*nit);
+
+          if(mit == stored_message.end())
+          {
+            continue;
+          }
+
+          const Message::StoredMessage* msg = mit->second;
+          const Message::CoreWords& msg_core_words = msg->core_words;
+
+          unsigned char pos = 0;
+
+          if(!msg_core_words.find(id, &pos))
+          {
+            continue;
+          }
+
+          CandidateMap::iterator cit = candidate_map.find(*nit);
+
+          if(cit == candidate_map.end())
+          {
+            Candidate candidate;
+            candidate.number = *nit;
+            candidate.msg = msg;
+            candidate.score = 0;
+            candidate.shared_words = 0;
+
+            cit = candidate_map.insert(std::make_pair(*nit, candidate)).first;
+          }
+
+          Candidate& candidate = cit->second;
+
+          candidate.score += weight *
+            (msg_core_words.size() - pos) / msg_core_words.size();
+
+          ++candidate.shared_words;
+        }
+      }
+
+      uint32_t min_shared_words =
+        std::min((size_t)RELATED_MIN_SHARED_WORDS, seed_words.size());
+
+      CandidateArray candidates;
+      candidates.reserve(candidate_map.size());
+
+      for(CandidateMap::const_iterator i(candidate_map.begin()),
+            e(candidate_map.end()); i != e; ++i)
+      {
+        const Candidate& candidate = i->second;
+
+        if(candidate.shared_words >= min_shared_words &&
+           std::find(seed_numbers.begin(), seed_numbers.end(),
+                     candidate.number) == seed_numbers.end())
+        {
+          candidates.push_back(candidate);
+        }
+      }
+
+      std::sort(candidates.begin(), candidates.end());
+
+      ResultList::const_iterator intersect_list_begin =
+        context.intersect_list.begin();
+
+      ResultList::const_iterator intersect_list_end =
+        context.intersect_list.end();
+
+      ResultList::const_iterator skip_list_begin =
+        context.skip_list.begin();
+
+      ResultList::const_iterator skip_list_end =
+        context.skip_list.end();
+
+      MessageFilterList::const_iterator filters_begin =
+        context.filters.begin();
+
+      MessageFilterList::const_iterator filters_end =
+        context.filters.end();
+
+      bool search_hidden = (flags & EF_SEARCH_HIDDEN) == EF_SEARCH_HIDDEN;
+      bool fill_core_words = (flags & EF_FILL_CORE_WORDS) != 0;
+
+      size_t max_result_size =
+        max_count ? std::min((size_t)max_count, candidates.size()) :
+        candidates.size();
+
+      ResultPtr presult(new Result(max_result_size));
+      Result& result = *presult;
+
+      //
+      // Context is checked for best scored candidates only, till enough
+      // found.
+      //
+      for(CandidateArray::const_iterator i(candidates.begin()),
+            e(candidates.end()); i != e && result.size() < max_result_size;
+          ++i)
+      {
+        Message::Number number = i->number;
+        const Message::StoredMessage* msg = i->msg;
+
+        if(msg->hidden() != search_hidden ||
+           message_not_in_list(number,
+                               intersect_list_begin,
+                               intersect_list_end) ||
+           message_in_list(number, skip_list_begin, skip_list_end))
+        {
+          continue;
+        }
+
+        MessageFilterList::const_iterator fit = filters_begin;
+        for(; fit != filters_end && (*fit)->satisfy(*msg, context); fit++);
+
+        if(fit != filters_end)
+        {
+          // Filtered out
+          continue;
+        }
+
+        if(msg->event_id != El::Luid::null &&
+           !events.insert(msg->event_id).second)
+        {
+          // Better scored message of same event already taken
+          continue;
+        }
+
+        result.insert(std::make_pair(number, msg));
+
+        if(fill_core_words)
+        {
+          MessageMatchInfo& mmi = match_info[number];
+
+          mmi.similarity =
+            std::max(mmi.similarity, std::min(i->score / max_score, 1.0F));
+          
+          if(mmi.core_words.get() == 0)
+          {
+            mmi.core_words.reset(new CoreWordsSet());
+          }
+
+          for(WordWeightMap::const_iterator wi(seed_words.begin()),
+                we(seed_words.end()); wi != we; ++wi)
+          {
+            unsigned char pos = 0;
+
+            if(msg->core_words.find(wi->first, &pos))
+            {
+              mmi.core_words->insert(wi->first);
+            }
+          }
+        }
+      }
+
+      return presult.release();
+    }
+
     //
     // Event class
     //
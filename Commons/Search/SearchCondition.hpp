@@ -23,6 +23,7 @@
 #include <vector>
 #include <string>
 #include <stack>
+#include <algorithm>
 
 #include <ext/hash_map>
 
@@ -137,6 +138,7 @@ namespace NewsGate
       {
         PositionSetPtr positions;
         CoreWordsSetPtr core_words; // matched core words
+        float similarity; // Related condition score in [0, 1]
 
         MessageMatchInfo() throw(El::Exception);
         
@@ -233,7 +235,8 @@ namespace NewsGate
         TP_FEED_CLICKS,
         TP_FEED_CTR,
         TP_FEED_RCTR,
-        TP_VISITED
+        TP_VISITED,
+        TP_RELATED
       };
 
       struct LangSet :
@@ -896,7 +899,116 @@ namespace NewsGate
       Msg(const Msg&);
     };
 
-    typedef El::RefCount::SmartPtr<Msg> Msg_var;    
+    typedef El::RefCount::SmartPtr<Msg> Msg_var;
+
+    //
+    // Messages sharing core words with specified messages and core word
+    // vector. Candidates are picked from norm form (or word) posting lists
+    // of seed core words and scored by overlap of their core words with
+    // seed ones, each shared word weighted by its rank in seed and by
+    // rareness across the message map. Only max_count best scored
+    // messages are checked against the context and returned, one per
+    // event. Matched core words and the score relative to the best
+    // possible one are reported for relevance sorting.
+    //
+    // Seed messages are stored in one bank only, so the frontend resolves
+    // their core words and events into seeds, making other banks find
+    // messages related to them as well. Ids not resolved into seeds are
+    // looked up in the bank message map.
+    //
+    class Related : public virtual Condition,
+                    public virtual El::RefCount::DefaultImpl<
+                      El::Sync::ThreadPolicy>
+    {
+    public:
+
+      Related() throw() : max_count(DEFAULT_MAX_COUNT) {}
+      virtual ~Related() throw() {}
+
+      virtual void print(std::ostream& ostr) const throw(El::Exception);
+
+      virtual void dump(std::wostream& ostr, std::wstring& ident) const
+        throw(El::Exception);
+
+      virtual Type type() const throw();
+
+      virtual void write(El::BinaryOutStream& bstr) const throw(El::Exception);
+      virtual void read(El::BinaryInStream& bstr) throw(El::Exception);
+
+      virtual Result* evaluate(Context& context,
+                               MessageMatchInfoMap& match_info,
+                               unsigned long flags) const
+        throw(El::Exception);
+
+      virtual Result* evaluate_simple(Context& context,
+                                      MessageMatchInfoMap& match_info,
+                                      unsigned long flags) const
+        throw(El::Exception);
+
+      virtual void normalize(
+        const El::Dictionary::Morphology::WordInfoManager& word_info_manager)
+        throw(El::Exception) {}
+
+      struct Seed
+      {
+        Message::Id id;
+        El::Luid event_id;
+        Message::CoreWords core_words;
+
+        void write(El::BinaryOutStream& bstr) const throw(El::Exception);
+        void read(El::BinaryInStream& bstr) throw(El::Exception);
+      };
+
+      typedef std::vector<Seed> SeedArray;
+
+      Message::IdArray ids;
+      SeedArray seeds;
+      WordIdArray core_words; // Most significant first
+      uint32_t max_count;
+
+      static const uint32_t DEFAULT_MAX_COUNT = 1000;
+
+      static El::Stat::TimeMeter evaluate_meter;
+
+    private:
+
+      struct Candidate
+      {
+        Message::Number number;
+        const Message::StoredMessage* msg;
+        float score;
+        uint32_t shared_words;
+
+        bool operator<(const Candidate& val) const throw();
+      };
+
+      typedef std::vector<Candidate> CandidateArray;
+
+      typedef __gnu_cxx::hash_map<El::Dictionary::Morphology::WordId,
+                                  float,
+                                  El::Hash::Numeric<
+                                    El::Dictionary::Morphology::WordId> >
+      WordWeightMap;
+
+      template<typename WordArray>
+      static void add_seed_words(const WordArray& words,
+                                 WordWeightMap& weights)
+        throw(El::Exception);
+
+      typedef std::vector<const Message::StoredMessage*> StoredMessageArray;
+
+      static const Message::NumberSet* word_messages(
+        El::Dictionary::Morphology::WordId id,
+        const StoredMessageArray& seed_messages,
+        const Message::SearcheableMessageMap& messages)
+        throw(El::Exception);
+
+    private:
+      void operator=(const Related&);
+      Related(const Related&);
+    };
+
+    typedef El::RefCount::SmartPtr<Related> Related_var;
 
     typedef std::vector<El::Luid> LuidArray;
     
@@ -1593,6 +1705,17 @@ namespace NewsGate
 
       typedef std::vector<DomainRec> DomainList;
       DomainList domains;
+
+      struct DomainOptimizationInfo : public OptimizationInfo
+      {
+        Message::HostTrie domains;
+
+      protected:
+        ~DomainOptimizationInfo() throw() {}
+      };
+
+      DomainOptimizationInfo* optimization_info()
+        throw(Exception, El::Exception);
       
       static El::Stat::TimeMeter evaluate_meter;
       static El::Stat::TimeMeter evaluate_simple_meter;      
@@ -1974,6 +2097,7 @@ namespace NewsGate
     //
     inline
     Condition::MessageMatchInfo::MessageMatchInfo() throw(El::Exception)
+        : similarity(0)
     {
     }
     
@@ -2017,6 +2141,7 @@ namespace NewsGate
         core_words.reset(0);
       }
 
+      similarity = mmi.similarity;
       return *this;
     }
 
@@ -2025,7 +2150,7 @@ namespace NewsGate
     Condition::MessageMatchInfo::empty() throw(El::Exception)
     {
       return (core_words.get() == 0 || core_words->empty()) && 
-        (positions.get() == 0 || positions->empty());
+        (positions.get() == 0 || positions->empty()) && similarity == 0;
     }
     
     inline
@@ -2053,6 +2178,8 @@ namespace NewsGate
           
         positions->insert(mmi.positions->begin(), mmi.positions->end());
       }
+
+      similarity = std::max(similarity, mmi.similarity);
     }
 
     inline
@@ -2084,6 +2211,8 @@ namespace NewsGate
           positions->insert(mmi.positions->begin(), mmi.positions->end());
         }
       }
+
+      similarity = std::max(similarity, mmi.similarity);
     }
 
     //
@@ -2222,6 +2351,7 @@ namespace NewsGate
       case TP_SITE: return new Site();
       case TP_URL: return new Url();
       case TP_MSG: return new Msg();
+      case TP_RELATED: return new Related();
       case TP_EVENT: return new Event();
       case TP_EVERY: return new Every();
       case TP_NONE: return new None();
@@ -2534,7 +2664,10 @@ namespace NewsGate
       Message::WordPosition img_alt_pos = msg.img_alt_pos;
       Message::WordPosition keywords_pos = msg.keywords_pos;
       
-      const Message::WordPositionArray& word_positions = msg.positions;
+      Message::WordPositionArray positions_buffer;
+      
+      const Message::WordPositionArray& word_positions =
+        msg.get_positions(positions_buffer);
       size_t positions_count = positions.position_count();
 
       for(size_t i = 0; i < positions_count; i++)
@@ -2582,7 +2715,10 @@ namespace NewsGate
       }
       
       const WordIdArray& norm_forms = word.norm_forms;
-      const Message::WordPositionArray& word_positions = msg.positions;
+      Message::WordPositionArray positions_buffer;
+      
+      const Message::WordPositionArray& word_positions =
+        msg.get_positions(positions_buffer);
 
       bool fill_core_words = (flags & EF_FILL_CORE_WORDS) != 0;
       bool fill_positions = (flags & EF_FILL_POSITIONS) != 0;
@@ -4872,17 +5008,6 @@ namespace NewsGate
       bstr.read_container(domains);
     }
       
-    inline
-    Condition::Result*
-    Domain::evaluate(Context& context,
-                     MessageMatchInfoMap& match_info,
-                     unsigned long flags) const
-      throw(El::Exception)
-    {
-      El::Stat::TimeMeasurement measurement(evaluate_meter);
-      return Filter::evaluate(context, match_info, flags);
-    }
-
     inline
     Condition::Result*
     Domain::evaluate_simple(Context& context,
@@ -5531,8 +5656,8 @@ namespace NewsGate
       Domain* param = dynamic_cast<Domain*>(cond.in());
       assert(param != 0);
 
-      Domain::DomainList::const_iterator db(param->domains.begin()),
-        de(param->domains.end());
+      const Message::HostTrie& domains =
+        param->optimization_info()->domains;
 
       SizeArray& host_lengths = optimization_info()->host_lengths;
       SizeArray::iterator hli = host_lengths.begin();
@@ -5542,30 +5667,9 @@ namespace NewsGate
       for(HostNameList::iterator i(hostnames.begin()), e(hostnames.end());
           i != e; )
       {
-        size_t host_len = *hli;
-        Domain::DomainList::const_iterator j(db);
-          
-        for(; j != de; ++j)
-        {
-          size_t domain_len = j->len;
-              
-          if(domain_len > host_len)
-          {
-            continue;
-          }
+        bool in_domain = *hli && domains.covers(i->c_str());
 
-          size_t offset = host_len - domain_len;
-          const char* host = i->c_str();
-          const char* domain = j->name.c_str();
-            
-          if(strcmp(host + offset, domain) == 0 &&
-             (!offset || host[offset - 1] == '.'))
-          {
-            break;
-          }
-        }
-
-        if((j != de) == param->reversed)
+        if(in_domain == param->reversed)
         {
           i = hostnames.erase(i);
           e = hostnames.end();
@@ -5843,8 +5947,8 @@ namespace NewsGate
       Domain* param = dynamic_cast<Domain*>(cond.in());
       assert(param != 0);
 
-      Domain::DomainList::const_iterator db(param->domains.begin()),
-        de(param->domains.end());
+      const Message::HostTrie& domains =
+        param->optimization_info()->domains;
 
       UrlOptimizationInfo::UrlSiteArray& sites = optimization_info()->sites;
       UrlList::iterator ui(urls.begin());
@@ -5854,30 +5958,9 @@ namespace NewsGate
       for(UrlOptimizationInfo::UrlSiteArray::iterator i(sites.begin()),
             e(sites.end()); i != e; )
       {
-        size_t site_len = i->len;
-        Domain::DomainList::const_iterator j(db);
-          
-        for(; j != de; ++j)
-        {
-          size_t domain_len = j->len;
-              
-          if(domain_len > site_len)
-          {
-            continue;
-          }
-
-          size_t offset = site_len - domain_len;
-          const char* host = i->name.c_str();
-          const char* domain = j->name.c_str();
-            
-          if(strcmp(host + offset, domain) == 0 &&
-             (!offset || host[offset - 1] == '.'))
-          {
-            break;
-          }
-        }
+        bool in_domain = i->len && domains.covers(i->name.c_str());
 
-        if((j != de) == param->reversed)
+        if(in_domain == param->reversed)
         {
           i = sites.erase(i);
           e = sites.end();
@@ -6143,6 +6226,132 @@ namespace NewsGate
       bstr.read_array(ids);
     }
 
+    //
+    // Related class
+    //
+
+    inline
+    void
+    Related::dump(std::wostream& ostr, std::wstring& ident) const
+      throw(El::Exception)
+    {
+      ostr << ident << L"RELATED";
+
+      for(Message::IdArray::const_iterator i(ids.begin()),
+            e(ids.end()); i != e; ++i)
+      {
+        std::wstring id;
+        El::String::Manip::utf8_to_wchar(i->string().c_str(), id);
+        ostr << L" " << id;
+      }
+
+      if(!core_words.empty())
+      {
+        ostr << L" CORE";
+
+        for(size_t i = 0; i < core_words.size(); ++i)
+        {
+          ostr << L" " << core_words[i];
+        }
+      }
+
+      ostr << std::endl;
+
+      for(SeedArray::const_iterator i(seeds.begin()), e(seeds.end());
+          i != e; ++i)
+      {
+        std::wstring id;
+        El::String::Manip::utf8_to_wchar(i->id.string().c_str(), id);
+
+        std::wstring event_id;
+        El::String::Manip::utf8_to_wchar(i->event_id.string().c_str(),
+                                         event_id);
+        
+        ostr << ident << L"  SEED " << id << L" EVENT " << event_id
+             << L" CORE";
+
+        for(size_t j = 0; j < i->core_words.size(); ++j)
+        {
+          ostr << L" " << i->core_words[j];
+        }
+        
+        ostr << std::endl;
+      }
+    }
+
+    inline
+    Condition::Result*
+    Related::evaluate_simple(Context& context,
+                             MessageMatchInfoMap& match_info,
+                             unsigned long flags) const
+      throw(El::Exception)
+    {
+      return evaluate(context, match_info, flags);
+    }
+
+    inline
+    Condition::Type
+    Related::type() const throw()
+    {
+      return TP_RELATED;
+    }
+
+    inline
+    void
+    Related::write(El::BinaryOutStream& bstr) const throw(El::Exception)
+    {
+      Condition::write(bstr);
+      bstr.write_array(ids);
+      bstr.write_array(seeds);
+      bstr.write_array(core_words);
+      bstr << max_count;
+    }
+
+    inline
+    void
+    Related::read(El::BinaryInStream& bstr) throw(El::Exception)
+    {
+      Condition::read(bstr);
+      bstr.read_array(ids);
+      bstr.read_array(seeds);
+      bstr.read_array(core_words);
+      bstr >> max_count;
+    }
+
+    //
+    // Related::Seed struct
+    //
+
+    inline
+    void
+    Related::Seed::write(El::BinaryOutStream& bstr) const
+      throw(El::Exception)
+    {
+      bstr << id << event_id;
+      core_words.write(bstr);
+    }
+
+    inline
+    void
+    Related::Seed::read(El::BinaryInStream& bstr) throw(El::Exception)
+    {
+      bstr >> id >> event_id;
+      core_words.read(bstr);
+    }
+
+    //
+    // Related::Candidate struct
+    //
+
+    inline
+    bool
+    Related::Candidate::operator<(const Candidate& val) const throw()
+    {
+      // Better scored first
+      return score > val.score ||
+        (score == val.score && msg->fetched > val.msg->fetched);
+    }
+
     //
     // Event class
     //
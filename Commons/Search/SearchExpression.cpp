@@ -109,7 +109,8 @@ namespace
     L"DESCRIPTION",
     L"IMAGE-ALT",
     L"KEYWORDS",
-    L"VISITED"
+    L"VISITED",
+    L"RELATED"
   };
 }
 
@@ -161,7 +162,8 @@ namespace NewsGate
       NewsGate::Search::ExpressionParser::TT_DESC,
       NewsGate::Search::ExpressionParser::TT_IMG_ALT,
       NewsGate::Search::ExpressionParser::TT_KEYWORDS,
-      NewsGate::Search::ExpressionParser::TT_VISITED     
+      NewsGate::Search::ExpressionParser::TT_VISITED,
+      NewsGate::Search::ExpressionParser::TT_RELATED
     };    
   
     WeightedId WeightedId::zero;
@@ -634,6 +636,90 @@ namespace NewsGate
       return condition.retn();
     }
 
+    Condition*
+    ExpressionParser::read_related(std::wistream& istr)
+      throw(ParseError, Exception, El::Exception)
+    {
+      Related* related = new Related();
+      Condition_var condition = related;
+
+      std::vector<El::Dictionary::Morphology::WordId> core_words;
+      bool read_core_words = false;
+
+      TokenType type;
+      while((type = read_token(istr)) == TT_REGULAR ||
+            (type == TT_CORE && !read_core_words))
+      {
+        if(type == TT_CORE)
+        {
+          read_core_words = true;
+          continue;
+        }
+
+        if(read_core_words)
+        {
+          El::Dictionary::Morphology::WordId id = 0;
+
+          if(!El::String::Manip::numeric(last_token_.c_str(), id) || !id)
+          {
+            std::ostringstream ostr;
+            ostr << "NewsGate::Search::ExpressionParser::read_related: "
+              "bad core word id for RELATED condition at position "
+                 << last_token_begins_;
+
+            throw BadMessageId(ostr.str().c_str(), last_token_begins_);
+          }
+
+          core_words.push_back(id);
+          continue;
+        }
+
+        std::string message_id;
+        El::String::Manip::wchar_to_utf8(last_token_.c_str(), message_id);
+
+        try
+        {
+          size_t size = message_id.size();
+          bool dense = size > 0 && message_id[size - 1] == '=';
+
+          Message::Id id(message_id.c_str(), dense);
+          related->ids.push_back(id);
+        }
+        catch(const El::Exception& e)
+        {
+          std::ostringstream ostr;
+          ostr << "NewsGate::Search::ExpressionParser::read_related: "
+            "bad RELATED condition at position " << last_token_begins_;
+
+          throw BadMessageId(ostr.str().c_str(), last_token_begins_);
+        }
+      }
+
+      if(related->ids.empty() && core_words.empty())
+      {
+        std::ostringstream ostr;
+        ostr << "NewsGate::Search::ExpressionParser::read_related: "
+          "no message id or core word specified for RELATED condition at "
+          "position " << last_token_begins_;
+
+        throw NoMessageId(ostr.str().c_str(), last_token_begins_);
+      }
+
+      related->core_words.resize(core_words.size());
+
+      for(size_t i = 0; i < core_words.size(); ++i)
+      {
+        related->core_words[i] = core_words[i];
+      }
+
+      if(type != TT_UNDEFINED)
+      {
+        put_back();
+      }
+
+      return condition.retn();
+    }
+
     Condition*
     ExpressionParser::read_event(std::wistream& istr)
       throw(ParseError, Exception, El::Exception)
@@ -738,6 +824,7 @@ namespace NewsGate
       case TT_URL: condition = read_url(istr); break;
       case TT_CATEGORY: condition = read_category(istr); break;
       case TT_MSG: condition = read_msg(istr); break;
+      case TT_RELATED: condition = read_related(istr); break;
       case TT_EVENT: condition = read_event(istr); break;
       case TT_EVERY: condition = read_every(istr); break;
       case TT_NONE: condition = read_none(istr); break;
@@ -2871,6 +2958,13 @@ namespace NewsGate
                     (uint32_t)(coreness_factor * core_words_weight + 0.5);
                 }
               }
+
+              if(mm_info->similarity > 0)
+              {
+                // Related messages are ranked by similarity to the seeds
+                weight +=
+                  (uint32_t)(coreness_factor * mm_info->similarity + 0.5);
+              }
             }
             
 #           ifdef TRACE_WEIGHT
@@ -382,8 +382,11 @@ namespace NewsGate
                                 // be included into result
         RF_FEED_STAT = 0x8,     // Message-per-feed statistics should
                                 // be included into result
-        RF_CATEGORY_STAT = 0x10 // Message-per-category statistics should
+        RF_CATEGORY_STAT = 0x10,// Message-per-category statistics should
                                 // be included into result
+        RF_FUZZY_WORDS = 0x20   // Words not found in any bank index
+                                // should be replaced by the frontend
+                                // with similarly spelled ones
       };
       
       SortingPtr sorting;
@@ -919,7 +922,8 @@ namespace NewsGate
         TT_DESC,
         TT_IMG_ALT,
         TT_KEYWORDS,
-        TT_VISITED
+        TT_VISITED,
+        TT_RELATED
       };
 
       static const TokenType SPECIAL_WORD_TYPE[];
@@ -970,6 +974,9 @@ namespace NewsGate
       Condition* read_msg(std::wistream& istr)
         throw(ParseError, Exception, El::Exception);
       
+      Condition* read_related(std::wistream& istr)
+        throw(ParseError, Exception, El::Exception);
+      
       Condition* read_event(std::wistream& istr)
         throw(ParseError, Exception, El::Exception);
       
@@ -2999,6 +3006,7 @@ namespace NewsGate
       case TT_URL:
       case TT_CATEGORY:
       case TT_MSG:
+      case TT_RELATED:
       case TT_EVENT:
       case TT_EVERY:
       case TT_NONE:
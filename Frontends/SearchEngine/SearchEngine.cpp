@@ -21,6 +21,8 @@
 #include <sstream>
 #include <utility>
 #include <vector>
+#include <map>
+#include <algorithm>
 
 #include <El/Exception.hpp>
 #include <El/ArrayPtr.hpp>
@@ -71,6 +73,54 @@ const size_t LINE_DESC_CHARS = 75;
 const size_t DESC_CHAR_WIDTH = 8;
 const size_t DESC_CHAR_HEIGHT = 17;
 
+struct WordCompletionHeavier
+{
+  bool operator()(const NewsGate::Message::Transport::WordCompletion& a,
+                  const NewsGate::Message::Transport::WordCompletion& b) const
+    throw()
+  {
+    return a.count > b.count || (a.count == b.count && a.word < b.word);
+  }
+};
+
+struct TrendingTermRisesHigher
+{
+  bool operator()(const NewsGate::Message::Transport::TrendingTerm& a,
+                  const NewsGate::Message::Transport::TrendingTerm& b) const
+    throw()
+  {
+    return a.rise() > b.rise();
+  }
+};
+
+//
+// Banks are asked for more terms than required as term rising in a few
+// banks only can be outrun by one rising moderately in each
+//
+const size_t TRENDING_TERMS_BANK_FACTOR = 2;
+
+//
+// Fuzzy word lookup parameters: shorter words are not expanded,
+// words up to FUZZY_ONE_EDIT_MAX_LENGTH chars allow one edit, longer ones
+// two edits; standalone words of ANY condition get up to
+// FUZZY_ALTERNATIVES replacements, others just the best one
+//
+const size_t FUZZY_WORD_MIN_LENGTH = 3;
+const size_t FUZZY_ONE_EDIT_MAX_LENGTH = 5;
+const size_t FUZZY_ALTERNATIVES = 3;
+
+struct FuzzyWordCloser
+{
+  bool operator()(const NewsGate::Message::Transport::FuzzyWord& a,
+                  const NewsGate::Message::Transport::FuzzyWord& b) const
+    throw()
+  {
+    return a.distance < b.distance ||
+      (a.distance == b.distance &&
+       (a.count > b.count || (a.count == b.count && a.word < b.word)));
+  }
+};
+
 namespace NewsGate 
 {
   SearchMailer::Type SearchMailer::Type::instance;
@@ -334,6 +384,212 @@ namespace NewsGate
       e1.words_overlap(e2) >= merge_level(e1, e2);
   }
 
+  //
+  // SearchEngine::SearchCache class
+  //
+
+  SearchEngine::SearchCache::Entry::Entry() throw(El::Exception)
+      : total_matched_messages(0),
+        suppressed_messages(0),
+        counts_approximate(false),
+        etag(0)
+  {
+  }
+  
+  SearchEngine::SearchCache::SearchCache(size_t size,
+                                         const ACE_Time_Value& timeout)
+    throw(El::Exception)
+      : size_(size),
+        timeout_(timeout)
+  {
+  }
+
+  Message::Transport::StoredMessageArray*
+  SearchEngine::SearchCache::copy(
+    const Message::Transport::StoredMessageArray& messages)
+    throw(El::Exception)
+  {
+    Message::Transport::StoredMessageArrayPtr result(
+      new Message::Transport::StoredMessageArray(messages));
+
+    for(Message::Transport::StoredMessageArray::iterator
+          it(result->begin()), ie(result->end()); it != ie; ++it)
+    {
+      Message::StoredMessage& msg = it->message;
+
+      if(msg.content.in() != 0)
+      {
+        Message::StoredContent_var content = new Message::StoredContent();
+        content->copy(*msg.content);
+        msg.content = content;
+      }
+    }
+
+    return result.release();
+  }
+  
+  std::string
+  SearchEngine::SearchCache::key(const Search::Expression& expression,
+                                 const SearchContext& ctx,
+                                 const Strategy& strategy)
+    throw(El::Exception)
+  {
+    std::ostringstream ostr;
+    expression.condition->print(ostr);
+
+    const SearchContext::Filter& filter = *ctx.filter.in();
+    
+    ostr << "\n" << ctx.search_hint << "\n" << ctx.sorting_type << " "
+         << ctx.suppression->type << " " << strategy.msg_per_event << " "
+         << ctx.gm_flags << " " << ctx.sr_flags << " " << ctx.start_from << " "
+         << ctx.results_count << " " << ctx.locale->lang->el_code() << " "
+         << ctx.locale->country->el_code() << " " << ctx.category_locale
+         << "\n" << filter.lang->el_code() << " " << filter.country->el_code()
+         << " " << filter.event << " " << filter.feed << "\n"
+         << filter.category;
+
+    const SearchContext::Suppression::CoreWords* cwp =
+      ctx.suppression->core_words.in();
+      
+    if(cwp)
+    {
+      ostr << "\n" << cwp->intersection << " " << cwp->containment_level
+           << " " << cwp->min_count;
+    }
+
+    return ostr.str();
+  }
+
+  Message::SearchResult*
+  SearchEngine::SearchCache::get(const std::string& key,
+                                 uint64_t etag,
+                                 Search::Expression_var& expression)
+    throw(Exception, El::Exception)
+  {
+    Entry_var entry;
+    
+    {
+      ReadGuard guard(lock_);
+
+      EntryMap::const_iterator it = entries_.find(key);
+
+      if(it == entries_.end())
+      {
+        return 0;
+      }
+
+      entry = it->second;
+    }
+
+    if(entry->expiration < ACE_OS::gettimeofday())
+    {
+      return 0;
+    }
+    
+    Message::SearchResult_var result = new Message::SearchResult();
+    
+    result->nochanges = etag && etag == entry->etag;
+
+    result->messages =
+      new Message::Transport::StoredMessagePackImpl::Type(
+        result->nochanges ? new Message::Transport::StoredMessageArray() :
+        copy(*entry->messages));
+    
+    result->category_locale =
+      Message::Transport::CategoryLocaleImpl::Init::create(
+        new Message::Categorizer::Category::Locale(entry->category_locale));
+
+    result->stat =
+      Search::Transport::StatImpl::Init::create(new Search::Stat(entry->stat));
+
+    result->total_matched_messages = entry->total_matched_messages;
+    result->suppressed_messages = entry->suppressed_messages;
+    result->counts_approximate = entry->counts_approximate;
+    result->etag = entry->etag;
+    result->messages_loaded = 1;
+
+    expression = entry->expression;
+    
+    return result._retn();
+  }
+  
+  void
+  SearchEngine::SearchCache::set(const std::string& key,
+                                 const Message::SearchResult& result,
+                                 Search::Expression* expression)
+    throw(Exception, El::Exception)
+  {
+    if(result.nochanges || !result.messages_loaded)
+    {
+      return;
+    }
+    
+    Message::Transport::StoredMessagePackImpl::Type* messages =
+      dynamic_cast<Message::Transport::StoredMessagePackImpl::Type*>(
+        result.messages.in());
+      
+    Message::Transport::CategoryLocaleImpl::Type* category_locale =
+      dynamic_cast<Message::Transport::CategoryLocaleImpl::Type*>(
+        result.category_locale.in());
+    
+    Search::Transport::StatImpl::Type* stat =
+      dynamic_cast<Search::Transport::StatImpl::Type*>(result.stat.in());
+    
+    if(messages == 0 || category_locale == 0 || stat == 0)
+    {
+      throw Exception(
+        "NewsGate::SearchEngine::SearchCache::set: dynamic_cast failed");
+    }
+
+    ACE_Time_Value current_time = ACE_OS::gettimeofday();
+    
+    Entry_var entry = new Entry();
+
+    entry->messages.reset(copy(messages->entities()));
+    entry->category_locale = category_locale->entity();
+    entry->stat = stat->entity();
+    entry->total_matched_messages = result.total_matched_messages;
+    entry->suppressed_messages = result.suppressed_messages;
+    entry->counts_approximate = result.counts_approximate;
+    entry->etag = result.etag;
+    entry->expression = El::RefCount::add_ref(expression);
+    entry->expiration = current_time + timeout_;
+    
+    WriteGuard guard(lock_);
+
+    EntryMap::iterator it = entries_.find(key);
+
+    if(it != entries_.end())
+    {
+      expiration_queue_.erase(it->second->position);
+      entries_.erase(it);
+    }
+
+    // Dropping expired entries and the ones closest to expiration if
+    // no space left
+    while(!expiration_queue_.empty())
+    {
+      EntryMap::iterator oldest = entries_.find(expiration_queue_.front());
+
+      if(oldest->second->expiration >= current_time &&
+         entries_.size() < size_)
+      {
+        break;
+      }
+
+      entries_.erase(oldest);
+      expiration_queue_.pop_front();
+    }
+
+    if(size_)
+    {
+      entry->position =
+        expiration_queue_.insert(expiration_queue_.end(), key);
+      
+      entries_[key] = entry;
+    }
+  }
+
   //
   // NewsGate::SearchMailer::Type class
   //
@@ -816,6 +1072,7 @@ namespace NewsGate
         orb_adapter_(0),
         message_bank_clients_(0),
         message_bank_clients_max_threads_(0),
+        message_prefetch_count_(0),
         search_counter_(0)
   {
     throw Exception("NewsGate::SearchEngine::SearchEngine: "
@@ -828,6 +1085,7 @@ namespace NewsGate
         orb_adapter_(0),
         message_bank_clients_(0),
         message_bank_clients_max_threads_(0),
+        message_prefetch_count_(0),
         search_counter_(0),
         py_search_meter_("SearchEngine::py_search", false),
         search_meter_("SearchEngine::search", false)
@@ -917,6 +1175,20 @@ namespace NewsGate
       message_bank_clients_max_threads_ =
         config_->number("message_bank_client_session_max_threads");
 
+      if(config_->present("message_prefetch_count"))
+      {
+        message_prefetch_count_ = config_->number("message_prefetch_count");
+      }
+
+      if(config_->present("search_cache.size"))
+      {
+        El::PSP::Config_var conf = config_->config("search_cache");
+        
+        search_cache_.reset(
+          new SearchCache(conf->number("size"),
+                          ACE_Time_Value(conf->number("timeout"))));
+      }
+
       if(config_->present("segmentor"))
       {
         std::string segmentor_ref = config_->string("segmentor");
@@ -1199,6 +1471,110 @@ namespace NewsGate
     }
   }
 
+  PyObject*
+  SearchEngine::py_complete_word(PyObject* args) throw(El::Exception)
+  {
+    char* prefix = 0;
+    PyObject* lng = 0;
+    unsigned long count = 10;
+    
+    if(!PyArg_ParseTuple(args,
+                         "s|Ok:newsgate.search.SearchEngine.complete_word",
+                         &prefix,
+                         &lng,
+                         &count))
+    {
+      El::Python::handle_error("NewsGate::SearchEngine::py_complete_word");
+    }
+
+    if(lng == Py_None)
+    {
+      lng = 0;
+    }
+    
+    if(lng && !El::Python::Lang::Type::check_type(lng))
+    {
+      El::Python::report_error(
+        PyExc_TypeError,
+        "2nd argument of el.Lang type expected",
+        "NewsGate::SearchEngine::py_complete_word");
+    }
+
+    El::Lang lang = lng ? *El::Python::Lang::Type::down_cast(lng) :
+      El::Lang::null;
+
+    Message::Transport::WordCompletionArray completions;
+    
+    {
+      El::Python::AllowOtherThreads guard;
+      complete_word(prefix, lang, count, completions);
+    }
+
+    El::Python::Sequence_var result = new El::Python::Sequence();
+    result->reserve(completions.size());
+
+    for(Message::Transport::WordCompletionArray::const_iterator
+          i(completions.begin()), e(completions.end()); i != e; ++i)
+    {
+      result->push_back(PyString_FromString(i->word.c_str()));
+    }
+    
+    return result.retn();
+  }
+
+  PyObject*
+  SearchEngine::py_trending_terms(PyObject* args) throw(El::Exception)
+  {
+    PyObject* lng = 0;
+    unsigned long hours = 6;
+    unsigned long min_count = 3;
+    unsigned long count = 10;
+    
+    if(!PyArg_ParseTuple(args,
+                         "|Okkk:newsgate.search.SearchEngine.trending_terms",
+                         &lng,
+                         &hours,
+                         &min_count,
+                         &count))
+    {
+      El::Python::handle_error("NewsGate::SearchEngine::py_trending_terms");
+    }
+
+    if(lng == Py_None)
+    {
+      lng = 0;
+    }
+    
+    if(lng && !El::Python::Lang::Type::check_type(lng))
+    {
+      El::Python::report_error(
+        PyExc_TypeError,
+        "1st argument of el.Lang type expected",
+        "NewsGate::SearchEngine::py_trending_terms");
+    }
+
+    El::Lang lang = lng ? *El::Python::Lang::Type::down_cast(lng) :
+      El::Lang::null;
+
+    Message::Transport::TrendingTermArray terms;
+    
+    {
+      El::Python::AllowOtherThreads guard;
+      trending_terms(lang, hours, min_count, count, terms);
+    }
+
+    El::Python::Sequence_var result = new El::Python::Sequence();
+    result->reserve(terms.size());
+
+    for(Message::Transport::TrendingTermArray::const_iterator
+          i(terms.begin()), e(terms.end()); i != e; ++i)
+    {
+      result->push_back(PyString_FromString(i->text.c_str()));
+    }
+    
+    return result.retn();
+  }
+
   PyObject*
   SearchEngine::py_segment_text(PyObject* args) throw(El::Exception)
   {
@@ -3165,6 +3541,7 @@ namespace NewsGate
         search_result->total_matched_messages = 0;
         search_result->nochanges = 0;
         search_result->suppressed_messages = 0;
+        search_result->counts_approximate = 0;
         search_result->etag = 0;
 
         result->message_load_status = SearchResult::MLS_UNKNOWN;
@@ -3187,6 +3564,7 @@ namespace NewsGate
       result->etag = search_result->etag;
       result->total_matched_messages = search_result->total_matched_messages;
       result->suppressed_messages = search_result->suppressed_messages;
+      result->counts_approximate = search_result->counts_approximate;
 
       Message::Transport::CategoryLocaleImpl::Type* category_locale =
         dynamic_cast<Message::Transport::CategoryLocaleImpl::Type*>(
@@ -3989,6 +4367,37 @@ namespace NewsGate
                        ACE_Time_Value& search_duration)
     throw(CORBA::Exception, El::Exception)
   {
+    std::string cache_key;
+
+    if(search_cache_.get())
+    {
+      ACE_High_Res_Timer timer;
+      timer.start();
+      
+      cache_key = SearchCache::key(*expression, ctx, strategy);
+
+      Message::SearchResult_var search_result =
+        search_cache_->get(cache_key, ctx.etag, expression);
+
+      if(search_result.in())
+      {
+        timer.stop();
+        timer.elapsed_time(search_duration);
+        
+        return search_result._retn();
+      }
+    }
+
+    // Result for not normalized expression is not cached, so it is not
+    // served once word manager get ready
+    bool cacheable = true;
+
+    if(!resolve_related(expression->condition.in()))
+    {
+      // Seeds not found yet are looked up by banks locally meanwhile
+      cacheable = false;
+    }
+    
     Search::Strategy::SortingMode sorting_type =
       (Search::Strategy::SortingMode)ctx.sorting_type;
     
@@ -4238,6 +4647,29 @@ namespace NewsGate
           " Reason: " << e.reason.in();
         
         logger_->trace(ostr.str().c_str(), ASPECT, El::Logging::MIDDLE);
+
+        cacheable = false;
+      }
+    }
+    
+    if(ctx.sr_flags & Search::Strategy::RF_FUZZY_WORDS)
+    {
+      //
+      // Misspelled words are replaced here rather than by each bank,
+      // so all banks search for the same words
+      //
+      
+      if(expand_fuzzy_words(expression->condition.in()))
+      {
+        expression->add_ref();
+        
+        expression_transport =
+          Search::Transport::ExpressionImpl::Init::create(
+            new Search::Transport::ExpressionHolder(expression));
+      }
+      else
+      {
+        cacheable = false;
       }
     }
     
@@ -4280,6 +4712,7 @@ namespace NewsGate
     search_request->strategy = strategy_transport._retn();
     search_request->start_from = ctx.start_from;
     search_request->results_count = ctx.results_count;
+    search_request->prefetch_count = message_prefetch_count_;
       
     search_request->etag = ctx.etag;
 
@@ -4330,9 +4763,613 @@ namespace NewsGate
       }
     }
 
+    if(search_cache_.get() && cacheable)
+    {
+      search_cache_->set(cache_key, search_result.in(), expression.in());
+    }
+
     return search_result._retn();
   }
   
+  void
+  SearchEngine::complete_word(
+    const char* prefix,
+    const El::Lang& lang,
+    size_t count,
+    Message::Transport::WordCompletionArray& completions)
+    throw(Exception, El::Exception)
+  {
+    std::string lowered;
+    El::String::Manip::utf8_to_lower(prefix, lowered);
+
+    std::string trimmed;
+    El::String::Manip::trim(lowered.c_str(), trimmed);
+
+    if(trimmed.empty() || count == 0)
+    {
+      return;
+    }
+    
+    Message::Transport::WordCompletionRequestImpl::Var request =
+      Message::Transport::WordCompletionRequestImpl::Init::create(
+        new Message::Transport::WordCompletionRequestInfo());
+
+    Message::Transport::WordCompletionRequestInfo& info = request->entity();
+    
+    info.prefix = trimmed;
+    info.lang = lang;
+    info.count = count;
+
+    request->serialize();
+
+    Message::Transport::Response_var response;
+    Message::BankClientSession::RequestResult_var result;
+    
+    try
+    {
+      Message::BankClientSession_var session = bank_client_session();
+      result = session->send_request(request.in(), response.out());
+    }
+    catch(const Message::ImplementationException& e)
+    {
+      std::ostringstream ostr;
+      ostr << "NewsGate::SearchEngine::complete_word: "
+        "Message::ImplementationException caught. Description:\n"
+           << e.description.in();
+      
+      throw Exception(ostr.str());
+    }
+    catch(const CORBA::Exception& e)
+    {
+      std::ostringstream ostr;
+      ostr << "NewsGate::SearchEngine::complete_word: "
+        "CORBA::Exception caught. Description:\n" << e;
+      
+      throw Exception(ostr.str());
+    }
+
+    if(result->code == Message::BankClientSession::RRC_NOT_READY)
+    {
+      return;
+    }
+    
+    if(result->code != Message::BankClientSession::RRC_OK)
+    {
+      std::ostringstream ostr;
+      ostr << "NewsGate::SearchEngine::complete_word: send_request failed; "
+        "code " << result->code << ". Description:\n"
+           << result->description.in();
+      
+      throw Exception(ostr.str());
+    }
+    
+    Message::Transport::WordCompletionResponseImpl::Type* completion_response =
+      dynamic_cast<Message::Transport::WordCompletionResponseImpl::Type*>(
+        response.in());
+    
+    if(completion_response == 0)
+    {
+      throw Exception(
+        "NewsGate::SearchEngine::complete_word: dynamic_cast<Message::"
+        "Transport::WordCompletionResponseImpl::Type*> failed");
+    }
+
+    //
+    // Each bank reports counts for its own messages only,
+    // so summing them up for the same word
+    //
+
+    typedef __gnu_cxx::hash_map<std::string, size_t, El::Hash::String>
+      WordIndexMap;
+
+    WordIndexMap word_indexes;
+    
+    const Message::Transport::WordCompletionArray& bank_completions =
+      completion_response->entities();
+
+    completions.reserve(bank_completions.size());
+    
+    for(Message::Transport::WordCompletionArray::const_iterator
+          i(bank_completions.begin()), e(bank_completions.end()); i != e; ++i)
+    {
+      WordIndexMap::const_iterator wi = word_indexes.find(i->word);
+
+      if(wi == word_indexes.end())
+      {
+        word_indexes[i->word] = completions.size();
+        completions.push_back(*i);
+      }
+      else
+      {
+        completions[wi->second].count += i->count;
+      }
+    }
+
+    count = std::min(count, completions.size());
+
+    std::partial_sort(completions.begin(),
+                      completions.begin() + count,
+                      completions.end(),
+                      WordCompletionHeavier());
+
+    completions.resize(count);
+  }
+
+  bool
+  SearchEngine::resolve_related(Search::Condition* condition)
+    throw(Exception, El::Exception)
+  {
+    Search::Related* related = dynamic_cast<Search::Related*>(condition);
+
+    if(related == 0)
+    {
+      bool resolved = true;
+      Search::ConditionArray subconditions = condition->subconditions();
+
+      for(Search::ConditionArray::const_iterator i(subconditions.begin()),
+            e(subconditions.end()); i != e; ++i)
+      {
+        if(!resolve_related(i->in()))
+        {
+          resolved = false;
+        }
+      }
+
+      return resolved;
+    }
+
+    if(!related->seeds.empty())
+    {
+      return true;
+    }
+    
+    Message::BankClientSession_var session = bank_client_session();
+    bool resolved = true;
+
+    const Message::IdArray& ids = related->ids;
+    
+    for(Message::IdArray::const_iterator i(ids.begin()), e(ids.end());
+        i != e; ++i)
+    {
+      Message::Transport::IdImpl::Var msg_id =
+        new Message::Transport::IdImpl::Type(new Message::Id(*i));
+
+      Message::Transport::StoredMessage_var result;
+
+      try
+      {
+        result = session->get_message(msg_id.in(),
+                                      Message::Bank::GM_EVENT |
+                                      Message::Bank::GM_CORE_WORDS,
+                                      0,
+                                      0,
+                                      0);
+      }
+      catch(const Message::NotFound&)
+      {
+        continue;
+      }
+      catch(const Message::NotReady&)
+      {
+        resolved = false;
+        continue;
+      }
+      catch(const Message::ImplementationException& e)
+      {
+        std::ostringstream ostr;
+        ostr << "NewsGate::SearchEngine::resolve_related: "
+          "Message::ImplementationException caught. Description:\n"
+             << e.description.in();
+      
+        throw Exception(ostr.str());
+      }
+      catch(const CORBA::Exception& e)
+      {
+        std::ostringstream ostr;
+        ostr << "NewsGate::SearchEngine::resolve_related: "
+          "CORBA::Exception caught. Description:\n" << e;
+      
+        throw Exception(ostr.str());
+      }
+      
+      Message::Transport::StoredMessageImpl::Type* msg =
+        dynamic_cast<Message::Transport::StoredMessageImpl::Type*>(
+          result.in());
+      
+      if(msg == 0)
+      {
+        throw Exception(
+          "NewsGate::SearchEngine::resolve_related: dynamic_cast<Message::"
+          "Transport::StoredMessageImpl::Type*> failed");
+      }
+
+      const Message::StoredMessage& message = msg->entity().message;
+
+      related->seeds.push_back(Search::Related::Seed());
+      Search::Related::Seed& seed = *related->seeds.rbegin();
+
+      seed.id = *i;
+      seed.event_id = message.event_id;
+      seed.core_words = message.core_words;
+    }
+
+    return resolved;
+  }
+  
+  void
+  SearchEngine::collect_fuzzy_words(
+    Search::Condition* condition,
+    FuzzyWordRefArray& refs,
+    Message::Transport::FuzzyWordQueryArray& queries)
+    throw(El::Exception)
+  {
+    Search::Words* words = dynamic_cast<Search::Words*>(condition);
+
+    if(words == 0)
+    {
+      Search::Except* except = dynamic_cast<Search::Except*>(condition);
+
+      if(except != 0)
+      {
+        //
+        // Excluded misspelled words can't exclude anything,
+        // so not expanding them
+        //
+          
+        collect_fuzzy_words(except->left.in(), refs, queries);
+        return;
+      }
+        
+      Search::ConditionArray subconditions = condition->subconditions();
+
+      for(Search::ConditionArray::const_iterator i(subconditions.begin()),
+            e(subconditions.end()); i != e; ++i)
+      {
+        collect_fuzzy_words(i->in(), refs, queries);
+      }
+
+      return;
+    }
+
+    bool any_words = dynamic_cast<Search::AnyWords*>(words) != 0;
+    const Search::WordList& word_list = words->words;
+
+    for(size_t i = 0; i < word_list.size(); ++i)
+    {
+      const Search::Word& word = word_list[i];
+
+      if(word.exact())
+      {
+        continue;
+      }
+
+      std::wstring text;
+      El::String::Manip::utf8_to_wchar(word.text.c_str(), text);
+
+      if(text.length() < FUZZY_WORD_MIN_LENGTH)
+      {
+        continue;
+      }
+
+      refs.push_back(FuzzyWordRef(words, i));
+      queries.push_back(Message::Transport::FuzzyWordQuery());
+
+      Message::Transport::FuzzyWordQuery& query = *queries.rbegin();
+
+      query.text = word.text;
+      query.max_distance = text.length() > FUZZY_ONE_EDIT_MAX_LENGTH ? 2 : 1;
+      query.count = any_words && word.group() == 0 ? FUZZY_ALTERNATIVES : 1;
+
+      if(word.use_norm_forms())
+      {
+        query.norm_forms.assign(word.norm_forms.begin(),
+                                word.norm_forms.end());
+      }
+    }
+  }
+  
+  bool
+  SearchEngine::expand_fuzzy_words(Search::Condition* condition)
+    throw(Exception, El::Exception)
+  {
+    Message::Transport::FuzzyWordsRequestImpl::Var request =
+      Message::Transport::FuzzyWordsRequestImpl::Init::create(
+        new Message::Transport::FuzzyWordsRequestInfo());
+
+    Message::Transport::FuzzyWordQueryArray& queries =
+      request->entity().words;
+
+    FuzzyWordRefArray refs;
+    collect_fuzzy_words(condition, refs, queries);
+
+    if(queries.empty())
+    {
+      return true;
+    }
+
+    request->serialize();
+
+    Message::Transport::Response_var response;
+    Message::BankClientSession::RequestResult_var result;
+    
+    try
+    {
+      Message::BankClientSession_var session = bank_client_session();
+      result = session->send_request(request.in(), response.out());
+    }
+    catch(const Message::ImplementationException& e)
+    {
+      std::ostringstream ostr;
+      ostr << "NewsGate::SearchEngine::expand_fuzzy_words: "
+        "Message::ImplementationException caught. Description:\n"
+           << e.description.in();
+      
+      throw Exception(ostr.str());
+    }
+    catch(const CORBA::Exception& e)
+    {
+      std::ostringstream ostr;
+      ostr << "NewsGate::SearchEngine::expand_fuzzy_words: "
+        "CORBA::Exception caught. Description:\n" << e;
+      
+      throw Exception(ostr.str());
+    }
+
+    if(result->code == Message::BankClientSession::RRC_NOT_READY)
+    {
+      return false;
+    }
+    
+    if(result->code != Message::BankClientSession::RRC_OK)
+    {
+      std::ostringstream ostr;
+      ostr << "NewsGate::SearchEngine::expand_fuzzy_words: send_request "
+        "failed; code " << result->code << ". Description:\n"
+           << result->description.in();
+      
+      throw Exception(ostr.str());
+    }
+    
+    Message::Transport::FuzzyWordsResponseImpl::Type* fuzzy_response =
+      dynamic_cast<Message::Transport::FuzzyWordsResponseImpl::Type*>(
+        response.in());
+    
+    if(fuzzy_response == 0)
+    {
+      throw Exception(
+        "NewsGate::SearchEngine::expand_fuzzy_words: dynamic_cast<Message::"
+        "Transport::FuzzyWordsResponseImpl::Type*> failed");
+    }
+
+    //
+    // Word is misspelled only if no bank has it indexed. Similar words
+    // found by different banks are merged with counts summed up, so
+    // the same replacements are used for all banks.
+    //
+    
+    std::vector<bool> indexed(queries.size(), false);
+    
+    std::vector<Message::Transport::FuzzyWordArray> similar(queries.size());
+
+    const Message::Transport::FuzzyWordArray& bank_words =
+      fuzzy_response->entities();
+    
+    for(Message::Transport::FuzzyWordArray::const_iterator
+          i(bank_words.begin()), e(bank_words.end()); i != e; ++i)
+    {
+      if(i->query >= queries.size() || indexed[i->query])
+      {
+        continue;
+      }
+
+      if(i->distance == 0)
+      {
+        indexed[i->query] = true;
+        continue;
+      }
+
+      Message::Transport::FuzzyWordArray& words = similar[i->query];
+      
+      Message::Transport::FuzzyWordArray::iterator wit(words.begin());
+      
+      for(; wit != words.end() && wit->word != i->word; ++wit);
+
+      if(wit == words.end())
+      {
+        words.push_back(*i);
+      }
+      else
+      {
+        wit->count += i->count;
+      }
+    }
+
+    typedef std::map<Search::Words*, Search::WordList> AlternativeMap;
+    AlternativeMap alternatives;
+    
+    for(size_t i = 0; i < queries.size(); ++i)
+    {
+      Message::Transport::FuzzyWordArray& words = similar[i];
+      
+      if(indexed[i] || words.empty())
+      {
+        continue;
+      }
+
+      size_t count = std::min((size_t)queries[i].count, words.size());
+
+      std::partial_sort(words.begin(),
+                        words.begin() + count,
+                        words.end(),
+                        FuzzyWordCloser());
+
+      const FuzzyWordRef& ref = refs[i];
+      Search::Word& word = ref.words->words[ref.index];
+      
+      word.text = words[0].word;
+      word.norm_forms.resize(0);
+      word.set_norm_forms_flag();
+
+      for(size_t j = 1; j < count; ++j)
+      {
+        Search::WordList& word_list = alternatives[ref.words];
+        
+        word_list.push_back(word);
+        word_list.rbegin()->text = words[j].word;
+      }
+    }
+
+    for(AlternativeMap::const_iterator i(alternatives.begin()),
+          e(alternatives.end()); i != e; ++i)
+    {
+      Search::WordList& word_list = i->first->words;
+      
+      word_list.insert(word_list.end(), i->second.begin(), i->second.end());
+    }
+
+    return true;
+  }
+
+  void
+  SearchEngine::trending_terms(const El::Lang& lang,
+                               size_t hours,
+                               size_t min_count,
+                               size_t count,
+                               Message::Transport::TrendingTermArray& terms)
+    throw(Exception, El::Exception)
+  {
+    if(count == 0)
+    {
+      return;
+    }
+    
+    Message::Transport::TrendingTermsRequestImpl::Var request =
+      Message::Transport::TrendingTermsRequestImpl::Init::create(
+        new Message::Transport::TrendingTermsRequestInfo());
+
+    Message::Transport::TrendingTermsRequestInfo& info = request->entity();
+    
+    info.lang = lang;
+    info.hours = hours;
+    info.count = count * TRENDING_TERMS_BANK_FACTOR;
+
+    // Each bank counts a share of messages only, so min_count is
+    // applied to the merged counts
+    info.min_count = 1;
+
+    request->serialize();
+
+    Message::Transport::Response_var response;
+    Message::BankClientSession::RequestResult_var result;
+    
+    try
+    {
+      Message::BankClientSession_var session = bank_client_session();
+      result = session->send_request(request.in(), response.out());
+    }
+    catch(const Message::ImplementationException& e)
+    {
+      std::ostringstream ostr;
+      ostr << "NewsGate::SearchEngine::trending_terms: "
+        "Message::ImplementationException caught. Description:\n"
+           << e.description.in();
+      
+      throw Exception(ostr.str());
+    }
+    catch(const CORBA::Exception& e)
+    {
+      std::ostringstream ostr;
+      ostr << "NewsGate::SearchEngine::trending_terms: "
+        "CORBA::Exception caught. Description:\n" << e;
+      
+      throw Exception(ostr.str());
+    }
+
+    if(result->code == Message::BankClientSession::RRC_NOT_READY)
+    {
+      return;
+    }
+    
+    if(result->code != Message::BankClientSession::RRC_OK)
+    {
+      std::ostringstream ostr;
+      ostr << "NewsGate::SearchEngine::trending_terms: send_request failed; "
+        "code " << result->code << ". Description:\n"
+           << result->description.in();
+      
+      throw Exception(ostr.str());
+    }
+    
+    Message::Transport::TrendingTermsResponseImpl::Type* trending_response =
+      dynamic_cast<Message::Transport::TrendingTermsResponseImpl::Type*>(
+        response.in());
+    
+    if(trending_response == 0)
+    {
+      throw Exception(
+        "NewsGate::SearchEngine::trending_terms: dynamic_cast<Message::"
+        "Transport::TrendingTermsResponseImpl::Type*> failed");
+    }
+
+    //
+    // Summing up counts of the same term (of the same language if
+    // several) reported by different banks
+    //
+
+    typedef __gnu_cxx::hash_map<Message::WordPair,
+                                size_t,
+                                Message::WordPairHash>
+      TermIndexMap;
+
+    TermIndexMap term_indexes;
+    Message::Transport::TrendingTermArray merged_terms;
+    
+    const Message::Transport::TrendingTermArray& bank_terms =
+      trending_response->entities();
+
+    merged_terms.reserve(bank_terms.size());
+    
+    for(Message::Transport::TrendingTermArray::const_iterator
+          i(bank_terms.begin()), e(bank_terms.end()); i != e; ++i)
+    {
+      Message::WordPair words(i->word_id1, i->word_id2);
+      TermIndexMap::const_iterator ti = term_indexes.find(words);
+
+      if(ti == term_indexes.end())
+      {
+        term_indexes[words] = merged_terms.size();
+        merged_terms.push_back(*i);
+      }
+      else
+      {
+        Message::Transport::TrendingTerm& term = merged_terms[ti->second];
+        
+        term.recent += i->recent;
+        term.expected += i->expected;
+      }
+    }
+
+    terms.reserve(merged_terms.size());
+
+    for(Message::Transport::TrendingTermArray::const_iterator
+          i(merged_terms.begin()), e(merged_terms.end()); i != e; ++i)
+    {
+      if(i->recent >= min_count)
+      {
+        terms.push_back(*i);
+      }
+    }
+
+    count = std::min(count, terms.size());
+
+    std::partial_sort(terms.begin(),
+                      terms.begin() + count,
+                      terms.end(),
+                      TrendingTermRisesHigher());
+
+    terms.resize(count);
+  }
+  
   Message::BankClientSession*
   SearchEngine::bank_client_session() throw(Exception, El::Exception)
   {
@@ -4808,6 +5845,7 @@ namespace NewsGate
     RF_COUNTRY_STAT_ = PyLong_FromLong(Search::Strategy::RF_COUNTRY_STAT);
     RF_FEED_STAT_ = PyLong_FromLong(Search::Strategy::RF_FEED_STAT);
     RF_CATEGORY_STAT_ = PyLong_FromLong(Search::Strategy::RF_CATEGORY_STAT);
+    RF_FUZZY_WORDS_ = PyLong_FromLong(Search::Strategy::RF_FUZZY_WORDS);
 
     ST_NONE_ = PyLong_FromLong(Search::Strategy::ST_NONE);
     ST_DUPLICATES_ = PyLong_FromLong(Search::Strategy::ST_DUPLICATES);
@@ -17,6 +17,7 @@
 #include <stdint.h>
 
 #include <string>
+#include <list>
 #include <iostream>
 #include <ext/hash_map>
 
@@ -27,6 +28,7 @@
 
 #include <El/Exception.hpp>
 #include <El/Stat.hpp>
+#include <El/Hash/Hash.hpp>
 
 #include <El/Python/Exception.hpp>
 #include <El/Python/Object.hpp>
@@ -686,6 +688,11 @@ namespace NewsGate
       PY_TYPE_MEMBER_ULONG(suppressed_messages,
                            "suppressed_messages",
                            "Suppressed message count");
+
+      PY_TYPE_MEMBER_BOOL(counts_approximate,
+                          "counts_approximate",
+                          "Suppressed and total message counts are "
+                          "approximate");
 /*      
       PY_TYPE_MEMBER_ULONG(space_filtered,
                            "space_filtered",
@@ -781,6 +788,7 @@ namespace NewsGate
     bool nochanges;
     unsigned long total_matched_messages;
     unsigned long suppressed_messages;
+    bool counts_approximate;
 //    unsigned long space_filtered;
     unsigned long message_load_status;
     unsigned long long etag;
@@ -1536,6 +1544,7 @@ namespace NewsGate
       PY_TYPE_STATIC_MEMBER(RF_COUNTRY_STAT_, "RF_COUNTRY_STAT");
       PY_TYPE_STATIC_MEMBER(RF_FEED_STAT_, "RF_FEED_STAT");
       PY_TYPE_STATIC_MEMBER(RF_CATEGORY_STAT_, "RF_CATEGORY_STAT");
+      PY_TYPE_STATIC_MEMBER(RF_FUZZY_WORDS_, "RF_FUZZY_WORDS");
 
       PY_TYPE_STATIC_MEMBER(ST_NONE_, "ST_NONE");
       PY_TYPE_STATIC_MEMBER(ST_DUPLICATES_, "ST_DUPLICATES");
@@ -1589,6 +1598,7 @@ namespace NewsGate
       El::Python::Object_var RF_COUNTRY_STAT_;
       El::Python::Object_var RF_FEED_STAT_;
       El::Python::Object_var RF_CATEGORY_STAT_;
+      El::Python::Object_var RF_FUZZY_WORDS_;
 
       El::Python::Object_var ST_NONE_;
       El::Python::Object_var ST_DUPLICATES_;
@@ -1955,6 +1965,8 @@ namespace NewsGate
     PyObject* py_segment_text(PyObject* args) throw(El::Exception);      
     PyObject* py_segment_query(PyObject* args) throw(El::Exception);      
     PyObject* py_relax_query(PyObject* args) throw(El::Exception);      
+    PyObject* py_complete_word(PyObject* args) throw(El::Exception);      
+    PyObject* py_trending_terms(PyObject* args) throw(El::Exception);      
 
     class Type : public El::Python::ObjectTypeImpl<SearchEngine,
                                                    SearchEngine::Type>
@@ -1977,6 +1989,14 @@ namespace NewsGate
                              "relax_query",
                              "Relax search query");
 
+      PY_TYPE_METHOD_VARARGS(py_complete_word,
+                             "complete_word",
+                             "Suggests most frequent words for a prefix");
+
+      PY_TYPE_METHOD_VARARGS(py_trending_terms,
+                             "trending_terms",
+                             "Returns words and phrases rising in last hours");
+
       PY_TYPE_MEMBER_OBJECT(mailer_,
                             SearchMailer::Type,
                             "mailer",
@@ -2083,6 +2103,83 @@ namespace NewsGate
       };
     };
     
+    //
+    // Keeps bank client session search results for identical requests
+    // to be served without reaching banks
+    //
+    class SearchCache
+    {
+    public:
+      SearchCache(size_t size, const ACE_Time_Value& timeout)
+        throw(El::Exception);
+
+      static std::string key(const Search::Expression& expression,
+                             const SearchContext& ctx,
+                             const Strategy& strategy)
+        throw(El::Exception);
+
+      //
+      // Returns 0 if no valid result cached for the key;
+      // result with nochanges set if etag matches cached one
+      //
+      Message::SearchResult* get(const std::string& key,
+                                 uint64_t etag,
+                                 Search::Expression_var& expression)
+        throw(Exception, El::Exception);
+
+      void set(const std::string& key,
+               const Message::SearchResult& result,
+               Search::Expression* expression)
+        throw(Exception, El::Exception);
+
+    private:
+
+      //
+      // Message content is copied as well as frontend modifies images
+      //
+      static Message::Transport::StoredMessageArray* copy(
+        const Message::Transport::StoredMessageArray& messages)
+        throw(El::Exception);
+
+      // Keys in order of entry expiration, which is the order of insertion
+      // as all entries live for the same time
+      typedef std::list<std::string> KeyList;
+
+      struct Entry :
+        public virtual El::RefCount::DefaultImpl<El::Sync::ThreadPolicy>
+      {
+        Message::Transport::StoredMessageArrayPtr messages;
+        Message::Categorizer::Category::Locale category_locale;
+        Search::Stat stat;
+        uint32_t total_matched_messages;
+        uint32_t suppressed_messages;
+        bool counts_approximate;
+        uint64_t etag;
+        Search::Expression_var expression;
+        ACE_Time_Value expiration;
+        KeyList::iterator position;
+
+        Entry() throw(El::Exception);
+        virtual ~Entry() throw() {}
+      };
+
+      typedef El::RefCount::SmartPtr<Entry> Entry_var;
+
+      typedef __gnu_cxx::hash_map<std::string, Entry_var, El::Hash::String>
+      EntryMap;
+
+      typedef ACE_RW_Thread_Mutex Mutex;
+      typedef ACE_Read_Guard<Mutex> ReadGuard;
+      typedef ACE_Write_Guard<Mutex> WriteGuard;
+
+      mutable Mutex lock_;
+
+      size_t size_;
+      ACE_Time_Value timeout_;
+      EntryMap entries_;
+      KeyList expiration_queue_;
+    };
+
     Message::SearchResult* search(
       Search::Expression_var& expression,
       const SearchContext& ctx,
@@ -2090,7 +2187,7 @@ namespace NewsGate
       const Strategy& strategy,
       ACE_Time_Value& search_duration)
       throw(CORBA::Exception, El::Exception);
-    
+
     struct ImageExt
     {
       uint16_t orig_width;
@@ -2267,6 +2364,50 @@ namespace NewsGate
 
     Message::BankClientSession* bank_client_session()
       throw(Exception, El::Exception);
+
+    void complete_word(const char* prefix,
+                       const El::Lang& lang,
+                       size_t count,
+                       Message::Transport::WordCompletionArray& completions)
+      throw(Exception, El::Exception);
+
+    void trending_terms(const El::Lang& lang,
+                        size_t hours,
+                        size_t min_count,
+                        size_t count,
+                        Message::Transport::TrendingTermArray& terms)
+      throw(Exception, El::Exception);
+
+    //
+    // Resolves seed messages of RELATED conditions into their core words
+    // and events, so banks not storing seeds find related messages too.
+    // Returns false if some banks are not ready to tell.
+    //
+    bool resolve_related(Search::Condition* condition)
+      throw(Exception, El::Exception);
+
+    //
+    // Replaces words not indexed by any bank with similarly spelled ones.
+    // Returns false if banks are not ready to tell.
+    //
+    bool expand_fuzzy_words(Search::Condition* condition)
+      throw(Exception, El::Exception);
+
+    struct FuzzyWordRef
+    {
+      Search::Words* words;
+      size_t index;
+
+      FuzzyWordRef(Search::Words* words_val, size_t index_val) throw();
+    };
+
+    typedef std::vector<FuzzyWordRef> FuzzyWordRefArray;
+
+    static void collect_fuzzy_words(
+      Search::Condition* condition,
+      FuzzyWordRefArray& refs,
+      Message::Transport::FuzzyWordQueryArray& queries)
+      throw(El::Exception);
     
     Event::BankClientSession* event_bank_client_session()
       throw(Exception, El::Exception);
@@ -2279,6 +2420,7 @@ namespace NewsGate
     CORBA::ORB_var orb_;
     std::auto_ptr<Strategy> strategy_;
     std::auto_ptr<Debug::Event> debug_event_;
+    std::auto_ptr<SearchCache> search_cache_;
     SearchMailer_var mailer_;
 
     typedef El::Corba::SmartRef<Dictionary::WordManager> WordManagerRef;
@@ -2310,6 +2452,7 @@ namespace NewsGate
 
     unsigned long message_bank_clients_;
     unsigned long message_bank_clients_max_threads_;
+    unsigned long message_prefetch_count_;
     unsigned long long search_counter_;
     El::Stat::TimeMeter py_search_meter_;
     El::Stat::TimeMeter search_meter_;
@@ -2346,6 +2489,17 @@ namespace NewsGate
     tp_new = 0;
   }
 
+  //
+  // SearchEngine::FuzzyWordRef struct
+  //
+  inline
+  SearchEngine::FuzzyWordRef::FuzzyWordRef(Search::Words* words_val,
+                                           size_t index_val) throw()
+      : words(words_val),
+        index(index_val)
+  {
+  }
+
   //
   // SearchEngine::UINT32_ToStringMap class
   //
@@ -2975,6 +3129,7 @@ namespace NewsGate
         nochanges(false),
         total_matched_messages(0),
         suppressed_messages(0),
+        counts_approximate(false),
 //        space_filtered(0),
         message_load_status(MLS_UNKNOWN),
 //        search_time(0),
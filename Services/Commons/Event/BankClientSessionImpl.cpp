@@ -285,6 +285,17 @@ namespace NewsGate
         RequestMessageDigestsTask::MessageInfoMap& message_infos =
           task->message_infos;
 
+        {
+          RouteGuard guard(route_lock_);
+          
+          for(RequestMessageDigestsTask::MessageInfoMap::const_iterator
+                i(message_infos.begin()), e(message_infos.end()); i != e;
+              ++i)
+          {
+            set_event_bank(i->second.event_id, i->second.bank_hash);
+          }
+        }
+
         Transport::MessageDigestPackImpl::Var post_digests =
           new Transport::MessageDigestPackImpl::Type(
             new Transport::MessageDigestArray());
@@ -533,25 +544,18 @@ namespace NewsGate
             "dynamic_cast<Transport::EventIdRelPackImpl::Type*>(ids) failed");
         }
 
-        ids_impl->serialize();
-
-        RequestEventsTask_var task = new RequestEventsTask(callback_, ids);
-
         {
           WriteGuard guard(lock_);
           refresh_session();
         }
-        
-        bool execute_in_current_thread = true;
-        uint32_t banks_count = 0;
+
+        BankRecordArray banks;
+        El::Service::ThreadPool_var thread_pool;
         
         {
           ReadGuard guard(lock_);
 
-          execute_in_current_thread = thread_pool_.in() == 0;
-          banks_count = banks_.size();
-          
-          if(banks_count == 0)
+          if(banks_.empty())
           {
             NotReady e;
             
@@ -563,48 +567,205 @@ namespace NewsGate
             throw e;
           }
 
-          for(BankRecordArray::const_iterator it = banks_.begin();
-              it != banks_.end(); it++)
+          banks = banks_;
+          thread_pool = thread_pool_;
+        }
+
+        //
+        // Routing ids of events with known banks to these banks, others
+        // are requested from all banks
+        //
+        const Transport::EventIdRelArray& id_array = ids_impl->entities();
+        
+        std::vector<uint32_t> bank_hashes;
+        bank_hashes.reserve(banks.size());
+
+        for(BankRecordArray::const_iterator i(banks.begin()),
+              e(banks.end()); i != e; ++i)
+        {
+          bank_hashes.push_back(bank_hash(i->bank));
+        }
+
+        std::vector<Transport::EventIdRelArray> routed_ids(banks.size());
+        Transport::EventIdRelArray broadcast_ids;
+        
+        {
+          RouteGuard guard(route_lock_);
+
+          EventBankMap::const_iterator routes_end = event_banks_.end();
+          
+          for(Transport::EventIdRelArray::const_iterator
+                i(id_array.begin()), e(id_array.end()); i != e; ++i)
           {
-            task->add_bank(it->bank, thread_pool_.in());
+            EventBankMap::const_iterator rit = event_banks_.find(i->id);
+            size_t j = 0;
+
+            if(rit != routes_end)
+            {
+              for(; j < bank_hashes.size() && bank_hashes[j] != rit->second;
+                  ++j);
+            }
+
+            if(rit == routes_end || j == bank_hashes.size())
+            {
+              broadcast_ids.push_back(*i);
+            }
+            else
+            {
+              routed_ids[j].push_back(*i);
+            }
           }
         }
 
-        if(execute_in_current_thread)
+        RequestEventsTaskArray tasks;
+        std::vector<size_t> task_banks;
+          
+        if(broadcast_ids.size() == id_array.size())
         {
-          while(banks_count--)
+          ids_impl->serialize();
+          tasks.push_back(request_events(ids, banks, thread_pool.in()));
+        }
+        else
+        {
+          for(size_t i = 0; i < routed_ids.size(); ++i)
           {
-            task->execute();
+            if(routed_ids[i].empty())
+            {
+              continue;
+            }
+            
+            Transport::EventIdRelPackImpl::Var pack =
+              new Transport::EventIdRelPackImpl::Type(
+                new Transport::EventIdRelArray(routed_ids[i]));
+
+            pack->serialize();
+            
+            tasks.push_back(
+              request_events(pack.in(),
+                             BankRecordArray(1, banks[i]),
+                             thread_pool.in()));
+
+            task_banks.push_back(i);
           }
+
+          if(!broadcast_ids.empty())
+          {
+            Transport::EventIdRelPackImpl::Var pack =
+              new Transport::EventIdRelPackImpl::Type(
+                new Transport::EventIdRelArray(broadcast_ids));
+
+            pack->serialize();
+            
+            tasks.push_back(
+              request_events(pack.in(), banks, thread_pool.in()));
+          }
+        }
+
+        for(RequestEventsTaskArray::iterator i(tasks.begin()),
+              e(tasks.end()); i != e; ++i)
+        {
+          (*i)->wait();
         }
+
+        //
+        // Events moved to other bank are requested from all banks
+        //
+        Transport::EventIdRelArray missed_ids;
         
-        task->wait();
+        for(size_t i = 0; i < task_banks.size(); ++i)
+        {
+          const RequestEventsTask* task = tasks[i].in();
+          
+          if(task->result != RRC_OK)
+          {
+            continue;
+          }
+          
+          const Transport::EventIdRelArray& task_ids =
+            routed_ids[task_banks[i]];
+          
+          for(Transport::EventIdRelArray::const_iterator
+                j(task_ids.begin()), e(task_ids.end()); j != e; ++j)
+          {
+            if(task->event_infos.find(j->id) == task->event_infos.end())
+            {
+              missed_ids.push_back(*j);
+            }
+          }
+        }
 
+        if(!missed_ids.empty())
+        {
+          {
+            RouteGuard guard(route_lock_);
+            
+            for(Transport::EventIdRelArray::const_iterator
+                  i(missed_ids.begin()), e(missed_ids.end()); i != e; ++i)
+            {
+              event_banks_.erase(i->id);
+            }
+          }
+          
+          Transport::EventIdRelPackImpl::Var pack =
+            new Transport::EventIdRelPackImpl::Type(
+              new Transport::EventIdRelArray(missed_ids));
+
+          pack->serialize();
+            
+          tasks.push_back(request_events(pack.in(), banks, thread_pool.in()));
+          tasks.back()->wait();
+        }
+        
         Transport::EventObjectRelPackImpl::Var result =
           new Transport::EventObjectRelPackImpl::Type(
             new Transport::EventObjectRelArray());
 
-        if(task->result != RRC_OK)
+        RequestEventsTask::EventInfoMap event_infos;
+        
+        for(RequestEventsTaskArray::const_iterator i(tasks.begin()),
+              e(tasks.end()); i != e; ++i)
         {
-          events = result._retn();
+          const RequestEventsTask* task = i->in();
           
-          RequestResult_var res = new RequestResult();
+          if(task->result != RRC_OK)
+          {
+            events = result._retn();
+          
+            RequestResult_var res = new RequestResult();
         
-          res->code = task->result;
-          res->description = task->error_desc.c_str();
+            res->code = task->result;
+            res->description = task->error_desc.c_str();
 
-          return res._retn();
-        }
+            return res._retn();
+          }
 
-        RequestEventsTask::EventInfoMap& event_infos = task->event_infos;
+          for(RequestEventsTask::EventInfoMap::const_iterator
+                j(task->event_infos.begin()), je(task->event_infos.end());
+              j != je; ++j)
+          {
+            RequestEventsTask::EventInfoMap::const_iterator eit =
+              event_infos.find(j->first);
+              
+            if(eit == event_infos.end() ||
+               eit->second.bank_hash > j->second.bank_hash)
+            {
+              event_infos[j->first] = j->second;
+            }
+          }
+        }
 
         Transport::EventObjectRelArray& event_array = result->entities();
         event_array.reserve(event_infos.size());
-        
-        for(RequestEventsTask::EventInfoMap::const_iterator
-              i(event_infos.begin()), e(event_infos.end()); i != e; ++i)
+
         {
-          event_array.push_back(i->second.event_rel);
+          RouteGuard guard(route_lock_);
+          
+          for(RequestEventsTask::EventInfoMap::const_iterator
+                i(event_infos.begin()), e(event_infos.end()); i != e; ++i)
+          {
+            event_array.push_back(i->second.event_rel);
+            set_event_bank(i->first, i->second.bank_hash);
+          }
         }
 
         events = result._retn();
@@ -626,6 +787,32 @@ namespace NewsGate
         throw ex;
       }
     }
+
+    BankClientSessionImpl::RequestEventsTask_var
+    BankClientSessionImpl::request_events(
+      Transport::EventIdRelPack* ids,
+      const BankRecordArray& banks,
+      El::Service::ThreadPool* thread_pool)
+      throw(Exception, El::Exception)
+    {
+      RequestEventsTask_var task = new RequestEventsTask(callback_, ids);
+
+      for(BankRecordArray::const_iterator i(banks.begin()), e(banks.end());
+          i != e; ++i)
+      {
+        task->add_bank(i->bank, thread_pool);
+      }
+
+      if(thread_pool == 0)
+      {
+        for(size_t i = 0; i < banks.size(); ++i)
+        {
+          task->execute();
+        }
+      }
+
+      return task;
+    }
     
     void
     BankClientSessionImpl::init_threads(El::Service::Callback* callback,
@@ -271,6 +271,36 @@ namespace NewsGate
       typedef El::RefCount::SmartPtr<RequestEventsTask>
       RequestEventsTask_var;
 
+      typedef std::vector<RequestEventsTask_var> RequestEventsTaskArray;
+
+      //
+      // Banks of events known from bank responses, so event requests are
+      // routed to a bank holding the event rather than sent to all banks
+      //
+      class EventBankMap :
+        public google::sparse_hash_map<El::Luid, uint32_t, El::Hash::Luid>
+      {
+      public:
+        EventBankMap() throw(El::Exception);
+      };
+
+      enum { EVENT_ROUTES_MAX = 1000000 };
+
+      static uint32_t bank_hash(const BankRef& bank) throw(El::Exception);
+
+      //
+      // Requests events from banks specified, waiting for completion is
+      // up to the caller
+      //
+      RequestEventsTask_var request_events(
+        Transport::EventIdRelPack* ids,
+        const BankRecordArray& banks,
+        El::Service::ThreadPool* thread_pool)
+        throw(Exception, El::Exception);
+
+      void set_event_bank(const El::Luid& id, uint32_t bank_hash)
+        throw(El::Exception);
+
       RequestResult* post_message_digest(
         BankInfoList& requested_banks,
         Transport::MessageDigestPack* digests,
@@ -282,6 +312,9 @@ namespace NewsGate
       typedef ACE_RW_Thread_Mutex     Mutex_;
       typedef ACE_Read_Guard<Mutex_>  ReadGuard;
       typedef ACE_Write_Guard<Mutex_> WriteGuard;
+
+      typedef ACE_Thread_Mutex RouteMutex;
+      typedef ACE_Guard<RouteMutex> RouteGuard;
      
       mutable Mutex_ lock_;
       
@@ -295,6 +328,9 @@ namespace NewsGate
       unsigned long threads_;
 
       El::Service::ThreadPool_var thread_pool_;
+
+      RouteMutex route_lock_;
+      EventBankMap event_banks_;
     };
 
     typedef El::Corba::ValueVar<BankClientSessionImpl>
@@ -390,6 +426,37 @@ namespace NewsGate
       return res._retn();
     }  
 
+    inline
+    uint32_t
+    BankClientSessionImpl::bank_hash(const BankRef& bank)
+      throw(El::Exception)
+    {
+      uint32_t hash = 0;
+      std::string bank_ior = bank.reference();
+        
+      El::CRC(hash, (const unsigned char*)bank_ior.c_str(), bank_ior.length());
+      return hash;
+    }
+
+    //
+    // Should be called with route_lock_ acquired
+    //
+    inline
+    void
+    BankClientSessionImpl::set_event_bank(const El::Luid& id,
+                                          uint32_t bank_hash)
+      throw(El::Exception)
+    {
+      if(event_banks_.size() >= EVENT_ROUTES_MAX &&
+         event_banks_.find(id) == event_banks_.end())
+      {
+        // Relearning routes of events still requested
+        event_banks_.clear();
+      }
+
+      event_banks_[id] = bank_hash;
+    }
+    
     inline
     BankClientSessionImpl::BankRecordArray&
     BankClientSessionImpl::banks() throw()
@@ -470,12 +537,7 @@ namespace NewsGate
     {
       BankInfo bank_info;
       bank_info.bank = bank;
-
-      std::string bank_ior = bank.reference();
-        
-      El::CRC(bank_info.hash,
-              (const unsigned char*)bank_ior.c_str(),
-              bank_ior.length());
+      bank_info.hash = BankClientSessionImpl::bank_hash(bank);
       
       {
         WriteGuard guard(lock_);
@@ -605,6 +667,15 @@ namespace NewsGate
       set_deleted_key(Message::Id::zero);
     }
     
+    //
+    // BankClientSessionImpl::EventBankMap class
+    //
+    inline
+    BankClientSessionImpl::EventBankMap::EventBankMap() throw(El::Exception)
+    {
+      set_deleted_key(El::Luid::null);
+    }
+    
     //
     // BankClientSessionImpl::RequestEventsTask::EventInfoMap class
     //
@@ -15,6 +15,7 @@
 
 #include <string>
 #include <sstream>
+#include <algorithm>
 
 #include <ext/hash_map>
 
@@ -62,6 +63,22 @@ namespace NewsGate
     typedef std::vector<MessageInfoArrayIterator>
     MessageInfoArrayIteratorArray;
 
+    //
+    // MessageInfoArrayIteratorLess struct
+    //
+    struct MessageInfoArrayIteratorLess
+    {
+      // Heap top is the iterator pointing to the heaviest message
+      bool operator()(const MessageInfoArrayIterator& a,
+                      const MessageInfoArrayIterator& b) const throw();
+    };
+
+    //
+    // Number of top messages to be merged from bank results per each
+    // required one; the more messages can be suppressed the more are taken
+    //
+    size_t merge_overfetch_factor(const Search::Strategy& strategy) throw();
+
     inline
     MessageInfoArrayIterator::MessageInfoArrayIterator(
       const Search::MessageInfoArray* weigted_ids_val,
@@ -74,6 +91,29 @@ namespace NewsGate
     {
     }
 
+    inline
+    bool
+    MessageInfoArrayIteratorLess::operator()(
+      const MessageInfoArrayIterator& a,
+      const MessageInfoArrayIterator& b) const throw()
+    {
+      return (*b.weigted_ids)[b.index] < (*a.weigted_ids)[a.index];
+    }
+
+    inline
+    size_t
+    merge_overfetch_factor(const Search::Strategy& strategy) throw()
+    {
+      switch(strategy.suppression->type())
+      {
+      case Search::Strategy::ST_NONE: return 1;
+      case Search::Strategy::ST_DUPLICATES: return 2;
+      default: break;
+      }
+
+      return 4;
+    }
+
     //
     // BankClientSessionImpl class
     //
@@ -542,6 +582,7 @@ namespace NewsGate
       size_t& total_results_count,
       size_t& results_left,
       size_t& suppressed_messages,
+      bool& counts_approximate,
       bool& messages_loaded)
       throw(ImplementationException, CORBA::SystemException, El::Exception)
     {
@@ -549,6 +590,7 @@ namespace NewsGate
       total_results_count = 0;
       results_left = 0;
       suppressed_messages = 0;
+      counts_approximate = false;
 
       ::NewsGate::Search::Transport::StrategyImpl::Type*
           strategy_transport = dynamic_cast<
@@ -573,6 +615,18 @@ namespace NewsGate
       full_request.results_count =
         (request.start_from + request.results_count) * duplicate_factor;
 
+      // Messages are taken along with search result unless only ids
+      // requested, result is likely to be the same as client already have
+      // or not a first page requested, so each bank would send messages
+      // of previous pages
+      full_request.prefetch_count =
+        request.prefetch_count && request.etag == 0 &&
+        request.start_from == 0 &&
+        (request.gm_flags & ~(Bank::GM_ID | Bank::GM_PUB_DATE)) ?
+        std::min(request.prefetch_count,
+                 (CORBA::ULong)(request.start_from + request.results_count)) :
+        0;
+
       MessageSearch_var prev_search;
       
       if(search.in() != 0)
@@ -724,11 +778,6 @@ namespace NewsGate
 
       Search::ResultPtr joined_result(new Search::Result());
 
-      Search::MessageInfoArray& joined_message_infos =
-        *joined_result->message_infos;
-
-      joined_message_infos.reserve(top_results_count);
-
       unsigned long index = 0;
         
       MessageInfoArrayIteratorArray weighted_msg_ids_arrays;
@@ -772,47 +821,100 @@ namespace NewsGate
         joined_result->stat.absorb(sr.stat);        
       }
 
-      while(!weighted_msg_ids_arrays.empty())
-      {  
-        for(MessageInfoArrayIteratorArray::iterator it =
-              weighted_msg_ids_arrays.begin();
-            it != weighted_msg_ids_arrays.end(); )
+      const ::NewsGate::Search::Strategy& strategy = 
+        strategy_transport->entity();
+
+      //
+      // Each bank result is sorted by weight, so merging them through the
+      // heap and stopping as soon as enough messages collected for
+      // take_top to fill the page. If suppression eats too much,
+      // merge is continued with doubled limit.
+      //
+      
+      uint32_t min_weight = joined_result->min_weight;
+      uint32_t max_weight = joined_result->max_weight;
+
+      size_t merge_limit = (request.start_from + request.results_count) *
+        merge_overfetch_factor(strategy);
+
+      Search::MessageInfoArray merged_message_infos;
+
+      merged_message_infos.reserve(
+        std::min(top_results_count, merge_limit));
+
+      MessageInfoArrayIteratorLess cmp;
+      
+      std::make_heap(weighted_msg_ids_arrays.begin(),
+                     weighted_msg_ids_arrays.end(),
+                     cmp);
+      
+      size_t suppressed = 0;
+      
+      while(true)
+      {
+        while(!weighted_msg_ids_arrays.empty() &&
+              merged_message_infos.size() < merge_limit)
         {
-          Search::MessageInfoArray::const_iterator wit =
-            it->weigted_ids->begin() + it->index++;
+          std::pop_heap(weighted_msg_ids_arrays.begin(),
+                        weighted_msg_ids_arrays.end(),
+                        cmp);
+
+          MessageInfoArrayIterator& top = *weighted_msg_ids_arrays.rbegin();
+          const Search::MessageInfo& mi = (*top.weigted_ids)[top.index++];
 
-          joined_message_infos.push_back(Search::MessageInfo());
+          merged_message_infos.push_back(Search::MessageInfo());
 
 // It's important not to steal but copy as the original data
 // will be reused on probable send_message call with
 // duplicate_factor > 1
-//          joined_message_infos.rbegin()->steal(*wit);
           
-          *joined_message_infos.rbegin() = *wit;
-          
-          msg_id_map[wit->wid.id] = it->search_result_num;
+          *merged_message_infos.rbegin() = mi;
+          msg_id_map[mi.wid.id] = top.search_result_num;
               
-          if(it->index == it->weigted_ids->size())
+          if(top.index == top.weigted_ids->size())
           {
-            it = weighted_msg_ids_arrays.erase(it);
+            weighted_msg_ids_arrays.pop_back();
           }
           else
           {
-            ++it;
+            std::push_heap(weighted_msg_ids_arrays.begin(),
+                           weighted_msg_ids_arrays.end(),
+                           cmp);
           }
+        }
 
+        *joined_result->message_infos = merged_message_infos;
+        joined_result->min_weight = min_weight;
+        joined_result->max_weight = max_weight;
+
+        suppressed = 0;
+        
+        joined_result->take_top(request.start_from,
+                                request.results_count,
+                                strategy,
+                                &suppressed);
+
+        if(weighted_msg_ids_arrays.empty() ||
+           joined_result->message_infos->size() == request.results_count)
+        {
+          break;
         }
+
+        merge_limit *= 2;
       }
 
-      const ::NewsGate::Search::Strategy& strategy = 
-        strategy_transport->entity();
-      
-      size_t suppressed = 0;
+      if(!weighted_msg_ids_arrays.empty() && !merged_message_infos.empty())
+      {
+        // Messages left unmerged are not checked for suppression, so
+        // assuming them suppressed at the same rate as merged ones
+        suppressed = (size_t)((double)suppressed * top_results_count /
+                              merged_message_infos.size());
 
-      joined_result->take_top(request.start_from,
-                              request.results_count,
-                              strategy,
-                              &suppressed);
+        counts_approximate = true;
+      }
+
+      suppressed = std::min(suppressed, total_results_count);
+      
 /*
       std::cerr << "total_results_count " << total_results_count
                 << ", duplicates " << duplicates << std::endl;
@@ -831,6 +933,7 @@ namespace NewsGate
                                          CategoryLocalePtr& category_locale,
                                          size_t total_results_count,
                                          size_t suppressed_messages,
+                                         bool counts_approximate,
                                          bool messages_loaded)
       throw(El::Exception, CORBA::SystemException)
     {
@@ -841,6 +944,7 @@ namespace NewsGate
       
       res->total_matched_messages = total_results_count;
       res->suppressed_messages = suppressed_messages;
+      res->counts_approximate = counts_approximate;
       res->messages_loaded = messages_loaded;
 
       Search::Stat* search_stat = new Search::Stat();
@@ -937,12 +1041,54 @@ namespace NewsGate
         El::Hash::Numeric<unsigned long> >
         IdPackMap;
 
+      typedef __gnu_cxx::hash_map<Message::Id,
+        Transport::StoredMessageDebug*,
+        Message::MessageIdHash>
+        PrefetchedMessageMap;
+
       IdPackMap id_packs;
       size_t message_infos_count = message_infos.size();
         
       const MessageSearch::SearchResultArray& search_results =
         search->results;
 
+      PrefetchedMessageMap prefetched_messages;
+      
+      for(MessageSearch::SearchResultArray::const_iterator
+            it(search_results.begin()), ie(search_results.end()); it != ie;
+          ++it)
+      {
+        Transport::StoredMessagePack* messages = it->match->messages.in();
+
+        if(messages == 0)
+        {
+          continue;
+        }
+        
+        Transport::StoredMessagePackImpl::Type* msg_pack =
+          dynamic_cast<Transport::StoredMessagePackImpl::Type*>(messages);
+
+        if(msg_pack == 0)
+        {
+          throw Exception(
+            "BankClientSessionImpl::fetch_messages: dynamic_cast<"
+            "Transport::StoredMessagePackImpl::Type*> failed");
+        }
+
+        Transport::StoredMessageArray& pack_messages =
+          msg_pack->entities();
+
+        for(Transport::StoredMessageArray::iterator
+              mit(pack_messages.begin()), me(pack_messages.end());
+            mit != me; ++mit)
+        {
+          prefetched_messages[mit->get_id()] = &(*mit);
+        }
+      }
+
+      Transport::StoredMessageArrayPtr res_messages(
+        new Transport::StoredMessageArray(message_infos_count));
+        
       size_t reserve =
         (search_results.size() ? 
          message_infos_count / search_results.size() * 2 : 0) + 1;
@@ -953,6 +1099,21 @@ namespace NewsGate
       {
         const Message::Id& id = message_infos[i].wid.id;
 
+        PrefetchedMessageMap::iterator pmit = prefetched_messages.find(id);
+
+        if(pmit != prefetched_messages.end())
+        {
+          Transport::StoredMessageDebug& msg = (*res_messages)[i];
+          msg.steal(*pmit->second);
+
+          if(gm_flags & Bank::GM_DEBUG_INFO)
+          { 
+            msg.debug_info.match_weight = message_infos[i].wid.weight;
+          }
+
+          continue;
+        }
+
         msg_id_order_map[id] = i;
         MessageIdMap::const_iterator mit = msg_id_map.find(id);
 
@@ -980,87 +1141,87 @@ namespace NewsGate
         pit->second->entities().push_back(id);
       }
 
-      MessageFetch_var fetch = new MessageFetch(callback_,
-                                                id_packs.size(),
-                                                gm_flags,
-                                                img_index,
-                                                thumb_index);
+      if(!id_packs.empty())
+      {
+        MessageFetch_var fetch = new MessageFetch(callback_,
+                                                  id_packs.size(),
+                                                  gm_flags,
+                                                  img_index,
+                                                  thumb_index);
 
 //        std::cerr << id_packs.size() << " id packs\n";
         
-      for(IdPackMap::const_iterator it = id_packs.begin();
-          it != id_packs.end(); it++)
-      {
+        for(IdPackMap::const_iterator it = id_packs.begin();
+            it != id_packs.end(); it++)
+        {
 //          std::cerr << "Adding fetch request\n";
           
-        fetch->add_request(search_results[it->first].bank,
-                           it->second.in());
-      }
+          fetch->add_request(search_results[it->first].bank,
+                             it->second.in());
+        }
         
-      size_t requests_count = fetch->requests_count;
+        size_t requests_count = fetch->requests_count;
 
-      {
-        //Need lock to make CORBA-requests executed most close to each other
-        WriteGuard guard(lock_);
-        
-        while(requests_count--)
         {
+          //Need lock to make CORBA-requests executed most close to each other
+          WriteGuard guard(lock_);
+        
+          while(requests_count--)
+          {
 //          std::cerr << "Scheduling fetch\n";
-          thread_pool_->execute(fetch.in());
+            thread_pool_->execute(fetch.in());
+          }
         }
-      }
       
 //        std::cerr << "Waiting fetch\n";
         
-      fetch->wait();
+        fetch->wait();
 
 //        std::cerr << "Producing response\n";
 
-      Transport::StoredMessageArrayPtr res_messages(
-        new Transport::StoredMessageArray(message_infos_count));
-        
-      MessageFetch::ResultArray& fetch_results = fetch->results;
+        MessageFetch::ResultArray& fetch_results = fetch->results;
 
-      for(MessageFetch::ResultArray::iterator
-            it = fetch_results.begin(); it != fetch_results.end(); it++)
-      {
-        Transport::StoredMessagePackImpl::Type* msg_pack =
-          dynamic_cast<Transport::StoredMessagePackImpl::Type*>(it->in());
-
-        if(msg_pack == 0)
+        for(MessageFetch::ResultArray::iterator
+              it = fetch_results.begin(); it != fetch_results.end(); it++)
         {
-          throw Exception(
-            "BankClientSessionImpl::search: dynamic_cast<"
-            "Transport::StoredMessagePackImpl::Type*> failed");
-        }
-          
-        Transport::StoredMessageArray& pack_messages =
-          msg_pack->entities();
+          Transport::StoredMessagePackImpl::Type* msg_pack =
+            dynamic_cast<Transport::StoredMessagePackImpl::Type*>(it->in());
 
-        for(Transport::StoredMessageArray::iterator
-              mit = pack_messages.begin(); mit != pack_messages.end(); mit++)
-        {
-          MessageIdMap::const_iterator id_it =
-            msg_id_order_map.find(mit->get_id());
+          if(msg_pack == 0)
+          {
+            throw Exception(
+              "BankClientSessionImpl::search: dynamic_cast<"
+              "Transport::StoredMessagePackImpl::Type*> failed");
+          }
+          
+          Transport::StoredMessageArray& pack_messages =
+            msg_pack->entities();
 
-          if(id_it == msg_id_order_map.end())
+          for(Transport::StoredMessageArray::iterator
+                mit = pack_messages.begin(); mit != pack_messages.end(); mit++)
           {
-            std::ostringstream ostr;
-            ostr << "BankClientSessionImpl::search: can't find id "
-                 << mit->get_id().string() << " in msg_id_order_map";
+            MessageIdMap::const_iterator id_it =
+              msg_id_order_map.find(mit->get_id());
+
+            if(id_it == msg_id_order_map.end())
+            {
+              std::ostringstream ostr;
+              ostr << "BankClientSessionImpl::search: can't find id "
+                   << mit->get_id().string() << " in msg_id_order_map";
             
-            throw Exception(ostr.str());
-          }
+              throw Exception(ostr.str());
+            }
 
-          Transport::StoredMessageDebug& msg =
-            (*res_messages)[id_it->second];
+            Transport::StoredMessageDebug& msg =
+              (*res_messages)[id_it->second];
 
-          msg.steal(*mit);
+            msg.steal(*mit);
 
-          if(gm_flags & Bank::GM_DEBUG_INFO)
-          { 
-            msg.debug_info.match_weight =
-              message_infos[id_it->second].wid.weight;  
+            if(gm_flags & Bank::GM_DEBUG_INFO)
+            { 
+              msg.debug_info.match_weight =
+                message_infos[id_it->second].wid.weight;  
+            }
           }
         }
       }
@@ -1157,6 +1318,7 @@ namespace NewsGate
         size_t results_left = 0;
         size_t suppressed_messages = 0;
         size_t duplicate_factor = 1;
+        bool counts_approximate = false;
         bool messages_loaded = false;
         CategoryLocalePtr category_locale(new Categorizer::Category::Locale());
 
@@ -1172,6 +1334,7 @@ namespace NewsGate
                                               total_results_count,
                                               results_left,
                                               suppressed_messages,
+                                              counts_approximate,
                                               messages_loaded));
         
 /*
@@ -1213,6 +1376,7 @@ namespace NewsGate
                                              category_locale,
                                              total_results_count,
                                              suppressed_messages,
+                                             counts_approximate,
                                              messages_loaded);
 
         if(res->messages.in())
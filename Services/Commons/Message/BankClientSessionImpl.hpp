@@ -452,6 +452,7 @@ namespace NewsGate
         size_t& total_results_count,
         size_t& results_left,
         size_t& suppressed_messages,
+        bool& counts_approximate,
         bool& messages_loaded)
         throw(ImplementationException, CORBA::SystemException, El::Exception);
 
@@ -463,6 +464,7 @@ namespace NewsGate
                                   CategoryLocalePtr& category_locale,
                                   size_t total_results_count,
                                   size_t suppressed_messages,
+                                  bool counts_approximate,
                                   bool messages_loaded)
         throw(El::Exception, CORBA::SystemException);
       
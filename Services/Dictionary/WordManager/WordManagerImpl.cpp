@@ -66,22 +66,11 @@ namespace NewsGate
             NewsGate::Dictionary::ImplementationException,
             ::CORBA::SystemException)
     {
+      Dictionaries_var dicts =
+        dictionaries("WordManagerImpl::normalize_search_expression");
+      
       try
       {
-        ReadGuard guard(srv_lock_); 
-
-        if(word_info_manager_.get() == 0)
-        {
-          NewsGate::Dictionary::NotReady ex;
-        
-          ex.reason = "WordManagerImpl::normalize_search_expression: "
-            "dictionaries are not loaded yet";
-
-          throw ex;
-        }
-
-        guard.release();
-
         Search::Transport::ExpressionImpl::Type* pack =
           dynamic_cast<Search::Transport::ExpressionImpl::Type*>(expression);
 
@@ -99,7 +88,7 @@ namespace NewsGate
         NewsGate::Search::Expression_var expression =
           pack->entity().expression;
 
-        expression->normalize(*word_info_manager_);
+        expression->normalize(*dicts->word_info_manager);
 
         result = Search::Transport::ExpressionImpl::Init::create(
           new Search::Transport::ExpressionHolder(
@@ -117,7 +106,7 @@ namespace NewsGate
         throw ex;
       }
 
-      return word_info_manager_->hash();
+      return dicts->word_info_manager->hash();
     }
 
     ::CORBA::ULong
@@ -131,22 +120,10 @@ namespace NewsGate
     {
       Transport::NormalizedWordsPackImpl::Var result_pack;
       
+      Dictionaries_var dicts = dictionaries("WordManagerImpl::normalize_words");
+      
       try
       {
-        ReadGuard guard(srv_lock_); 
-
-        if(word_info_manager_.get() == 0)
-        {
-          NewsGate::Dictionary::NotReady ex;
-        
-          ex.reason = "WordManagerImpl::normalize_words: "
-            "dictionaries are not loaded yet";
-
-          throw ex;
-        }
-
-        guard.release();
-
         El::Lang lang;
 
         if(*language != '\0')
@@ -167,10 +144,11 @@ namespace NewsGate
           new Transport::NormalizedWordsPackImpl::Type(
             new El::Dictionary::Morphology::WordInfoArray());        
       
-        word_info_manager_->normal_form_ids(wrd,
-                                            result_pack->entities(),
-                                            lang == El::Lang::null ? 0 : &lang,
-                                            false);
+        dicts->word_info_manager->normal_form_ids(
+          wrd,
+          result_pack->entities(),
+          lang == El::Lang::null ? 0 : &lang,
+          false);
       }
       catch(const El::Exception& e)
       {
@@ -185,9 +163,7 @@ namespace NewsGate
       }
 
       result = result_pack._retn();
-      return word_info_manager_->hash();      
-
-      return 0;
+      return dicts->word_info_manager->hash();
     }
     
     ::CORBA::ULong
@@ -200,22 +176,11 @@ namespace NewsGate
     {
       Transport::NormalizedMessageWordsPackImpl::Var result_pack;
       
+      Dictionaries_var dicts =
+        dictionaries("WordManagerImpl::normalize_message_words");
+      
       try
       {
-        ReadGuard guard(srv_lock_); 
-
-        if(word_info_manager_.get() == 0)
-        {
-          NewsGate::Dictionary::NotReady ex;
-        
-          ex.reason = "WordManagerImpl::normalize_message_words: "
-            "dictionaries are not loaded yet";
-
-          throw ex;
-        }
-
-        guard.release();
-
         Transport::MessageWordsPackImpl::Type* word_pack =
           dynamic_cast<Transport::MessageWordsPackImpl::Type*>(words);
 
@@ -260,12 +225,12 @@ namespace NewsGate
 
             El::Dictionary::Morphology::WordInfoArray word_infos;
             
-            word_info_manager_->normal_form_ids(words,
-                                                word_infos,
-                                                &lang,
-//                                                false);
+            dicts->word_info_manager->normal_form_ids(words,
+                                                      word_infos,
+                                                      &lang,
+//                                                      false);
 // TODO: make "true" in final version
-                                                true);
+                                                      true);
             
             Message::StoredMessage::set_normal_forms(
               word_infos,
@@ -333,7 +298,7 @@ namespace NewsGate
       }
 
       result = result_pack._retn();
-      return word_info_manager_->hash();
+      return dicts->word_info_manager->hash();
     }
 
     void
@@ -346,22 +311,10 @@ namespace NewsGate
     {
       Transport::LemmaPackImpl::Var result_pack;
       
+      Dictionaries_var dicts = dictionaries("WordManagerImpl::get_lemmas");
+      
       try
       {
-        ReadGuard guard(srv_lock_); 
-
-        if(word_info_manager_.get() == 0)
-        {
-          NewsGate::Dictionary::NotReady ex;
-        
-          ex.reason = "WordManagerImpl::get_lemmas: "
-            "dictionaries are not loaded yet";
-
-          throw ex;
-        }
-
-        guard.release();
-
         Transport::GetLemmasParamsImpl::Type* params_impl =
           dynamic_cast<Transport::GetLemmasParamsImpl::Type*>(params);
 
@@ -393,7 +346,7 @@ namespace NewsGate
         El::Dictionary::Morphology::LemmaInfoArrayArray& res =
           result_pack->entities();
 
-        word_info_manager_->get_lemmas(
+        dicts->word_info_manager->get_lemmas(
           words,
           prm.lang == El::Lang::null ? 0 : &prm.lang,
           prm.guess_strategy,
@@ -420,16 +373,8 @@ namespace NewsGate
             NewsGate::Dictionary::ImplementationException,
             ::CORBA::SystemException)
     {
-      ReadGuard guard(srv_lock_); 
-
-      if(word_info_manager_.get() == 0)
-      {
-        NewsGate::Dictionary::NotReady ex;
-        ex.reason = "WordManagerImpl::hash: dictionaries are not loaded yet";
-        throw ex;
-      }
-      
-      return word_info_manager_->hash();
+      Dictionaries_var dicts = dictionaries("WordManagerImpl::hash");
+      return dicts->word_info_manager->hash();
     }
     
     ::CORBA::Boolean
@@ -438,7 +383,7 @@ namespace NewsGate
             ::CORBA::SystemException)
     {
       ReadGuard guard(srv_lock_); 
-      return word_info_manager_.get() != 0;
+      return dictionaries_.in() != 0;
     }
     
     bool
@@ -455,9 +400,120 @@ namespace NewsGate
         return true;
       }
 
+      if(dynamic_cast<CheckDicts*>(event) != 0)
+      {
+        check_dicts();
+        return true;
+      }
+
       return false;
     }
 
+    WordManagerImpl::Dictionaries*
+    WordManagerImpl::dictionaries(const char* function)
+      throw(NewsGate::Dictionary::NotReady, El::Exception)
+    {
+      Dictionaries_var dicts;
+      
+      {
+        ReadGuard guard(srv_lock_);
+        dicts = dictionaries_;
+      }
+
+      if(dicts.in() == 0)
+      {
+        std::ostringstream ostr;
+        ostr << function << ": dictionaries are not loaded yet";
+        
+        NewsGate::Dictionary::NotReady ex;
+        ex.reason = ostr.str().c_str();
+
+        throw ex;
+      }
+
+      return dicts.retn();
+    }
+
+    void
+    WordManagerImpl::dict_file_times(FileTimeArray& times)
+      throw(El::Exception)
+    {
+      typedef Server::Config::WordManagerDictionariesType::dict_sequence
+        DictsConf;
+
+      const DictsConf& dicts =
+        Application::instance()->config().dictionaries().dict();
+
+      times.clear();
+      times.reserve(dicts.size());
+      
+      for(DictsConf::const_iterator it = dicts.begin(); it != dicts.end();
+          it++)
+      {
+        ACE_stat stat;
+        
+        times.push_back(ACE_OS::stat(it->filename().c_str(), &stat) == 0 ?
+                        stat.st_mtime : 0);
+      }
+    }
+
+    void
+    WordManagerImpl::schedule_dicts_check() throw(El::Exception)
+    {
+      unsigned long period = Application::instance()->config().
+        dictionaries().reload_check_period();
+
+      if(period)
+      {
+        El::Service::CompoundServiceMessage_var msg = new CheckDicts(this);
+        
+        deliver_at_time(msg.in(),
+                        ACE_OS::gettimeofday() + ACE_Time_Value(period));
+      }
+    }
+    
+    void
+    WordManagerImpl::check_dicts() throw(El::Exception)
+    {
+      FileTimeArray times;
+      dict_file_times(times);
+      
+      bool changed = false;
+      
+      {
+        ReadGuard guard(srv_lock_);
+        changed = dictionaries_.in() == 0 || dictionaries_->file_times != times;
+      }
+
+      if(!changed)
+      {
+        schedule_dicts_check();
+        return;
+      }
+      
+      Application::logger()->info(
+        "WordManagerImpl::check_dicts: dictionary files changed, reloading",
+        ASPECT);
+      
+      try
+      {
+        load_dicts();
+      }
+      catch(const El::Exception& e)
+      {
+        // Keep serving with previously loaded dictionaries
+        
+        std::ostringstream ostr;
+        ostr << "WordManagerImpl::check_dicts: reloading failed. "
+          "El::Exception caught. Description:\n" << e;
+
+        El::Service::Error error(ostr.str(), this);
+        callback_->notify(&error);
+
+        schedule_dicts_check();
+      }
+    }
+
     void
     WordManagerImpl::load_dicts() throw(El::Exception)
     {
@@ -471,7 +527,10 @@ namespace NewsGate
 
       El::Logging::Logger* logger = Application::logger();
 
-      WordInfoManagerPtr word_info_manager(
+      FileTimeArray file_times;
+      dict_file_times(file_times);
+
+      Dictionaries::WordInfoManagerPtr word_info_manager(
         new El::Dictionary::Morphology::WordInfoManager(
           config.default_lang_validation_level(),
           config.guessing_default_lang_validation_level(),
@@ -528,12 +587,23 @@ namespace NewsGate
         prev_mem = mem;
       }
       
+      Dictionaries_var new_dicts =
+        new Dictionaries(word_info_manager.release(), file_times);
+
+      // Previous dictionaries are destroyed when the last request
+      // using them completes
+      Dictionaries_var old_dicts;
+      
       {
-        WriteGuard guard(srv_lock_); 
-        word_info_manager_ = word_info_manager;
+        WriteGuard guard(srv_lock_);
+        
+        old_dicts = dictionaries_;
+        dictionaries_ = new_dicts;
       }
       
       logger->info("WordManagerImpl::load_dicts: loading completed", ASPECT);
+
+      schedule_dicts_check();
     }
   }
   
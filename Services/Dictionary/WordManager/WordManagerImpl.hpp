@@ -14,7 +14,10 @@
 #ifndef _NEWSGATE_SERVER_SERVICES_DICTIONARY_WORDMANAGER_PULLERMANAGERIMPL_HPP_
 #define _NEWSGATE_SERVER_SERVICES_DICTIONARY_WORDMANAGER_PULLERMANAGERIMPL_HPP_
 
+#include <time.h>
+
 #include <memory>
+#include <vector>
 
 #include <ext/hash_map>
 
@@ -115,14 +118,48 @@ namespace NewsGate
         LoadDicts(WordManagerImpl* service) throw(El::Exception);
       };
       
+      struct CheckDicts : public El::Service::CompoundServiceMessage
+      {
+        CheckDicts(WordManagerImpl* service) throw(El::Exception);
+      };
+
+      typedef std::vector<time_t> FileTimeArray;
+
+      //
+      // Loaded dictionaries are never modified; reload creates new
+      // Dictionaries object and swaps it with the current one, so
+      // requests being served keep using the one they started with.
+      //
+      struct Dictionaries :
+        public El::RefCount::DefaultImpl<El::Sync::ThreadPolicy>
+      {
+        typedef std::auto_ptr<El::Dictionary::Morphology::WordInfoManager>
+        WordInfoManagerPtr;
+
+        WordInfoManagerPtr word_info_manager;
+        FileTimeArray file_times;
+
+        Dictionaries(El::Dictionary::Morphology::WordInfoManager* manager,
+                     const FileTimeArray& times)
+          throw(El::Exception);
+
+        virtual ~Dictionaries() throw() {}
+      };
+
+      typedef El::RefCount::SmartPtr<Dictionaries> Dictionaries_var;
+
+      Dictionaries* dictionaries(const char* function)
+        throw(NewsGate::Dictionary::NotReady, El::Exception);
+
       void load_dicts() throw(El::Exception);
+      void check_dicts() throw(El::Exception);
+      void schedule_dicts_check() throw(El::Exception);
+
+      static void dict_file_times(FileTimeArray& times) throw(El::Exception);
 
     private:
       
-      typedef std::auto_ptr<El::Dictionary::Morphology::WordInfoManager>
-      WordInfoManagerPtr;
-      
-      WordInfoManagerPtr word_info_manager_;
+      Dictionaries_var dictionaries_;
     };
 
     typedef El::RefCount::SmartPtr<WordManagerImpl> WordManagerImpl_var;
@@ -149,6 +186,30 @@ namespace NewsGate
     {
     }
     
+    //
+    // WordManagerImpl::CheckDicts class
+    //
+    inline
+    WordManagerImpl::CheckDicts::CheckDicts(WordManagerImpl* state)
+      throw(El::Exception)
+        : El__Service__CompoundServiceMessageBase(state, state, false),
+          El::Service::CompoundServiceMessage(state, state)
+    {
+    }
+    
+    //
+    // WordManagerImpl::Dictionaries struct
+    //
+    inline
+    WordManagerImpl::Dictionaries::Dictionaries(
+      El::Dictionary::Morphology::WordInfoManager* manager,
+      const FileTimeArray& times)
+      throw(El::Exception)
+        : word_info_manager(manager),
+          file_times(times)
+    {
+    }
+    
   }
 }
 
@@ -52,6 +52,11 @@
 
 namespace
 {
+  const uint32_t SNAPSHOT_VERSION = 1;
+
+  // Number of events core words are loaded for at once when revise or
+  // remake is limited by time budget
+  const size_t BUDGET_PREFETCH_CHUNK = 64;
 }
 /*
 struct ABC
@@ -354,6 +359,201 @@ namespace NewsGate
     const EventManager::HashPair
     EventManager::HashPair::unexistent(UINT32_MAX, 0, El::Lang::null);
 
+    //
+    // EventManager::MergeBlacklist class
+    //
+    EventManager::MergeBlacklist::MergeBlacklist(uint64_t cleanup_period)
+      throw(El::Exception)
+        : generation_period_(
+            std::max(cleanup_period / GENERATIONS_PER_CLEANUP, (uint64_t)1)),
+          filter_mask_(0),
+          filter_capacity_(0),
+          filter_pairs_(0)
+    {
+      rebuild_filter();
+    }
+
+    void
+    EventManager::MergeBlacklist::set(const HashPair& hp,
+                                      const MergeDenialInfo& info)
+      throw(El::Exception)
+    {
+      MergeDenialMap::iterator i = denials_.find(hp);
+
+      if(i == denials_.end())
+      {
+        add(hp, info);
+        return;
+      }
+
+      uint64_t old_generation = generation(i->second.timeout);
+      i->second = info;
+
+      if(generation(info.timeout) != old_generation)
+      {
+        // Old generation entry is skipped on expiration
+        generations_[generation(info.timeout)].push_back(hp);
+      }
+    }
+    
+    void
+    EventManager::MergeBlacklist::insert(const HashPair& hp,
+                                         const MergeDenialInfo& info)
+      throw(El::Exception)
+    {
+      if(denials_.find(hp) == denials_.end())
+      {
+        add(hp, info);
+      }
+    }
+
+    void
+    EventManager::MergeBlacklist::insert(const MergeDenialMap& denials)
+      throw(El::Exception)
+    {
+      for(MergeDenialMap::const_iterator i(denials.begin()),
+            e(denials.end()); i != e; ++i)
+      {
+        insert(i->first, i->second);
+      }
+    }
+    
+    void
+    EventManager::MergeBlacklist::add(const HashPair& hp,
+                                      const MergeDenialInfo& info)
+      throw(El::Exception)
+    {
+      denials_.insert(std::make_pair(hp, info));
+      generations_[generation(info.timeout)].push_back(hp);
+
+      if(filter_pairs_ < filter_capacity_)
+      {
+        filter_add(hp);
+      }
+      else
+      {
+        rebuild_filter();
+      }
+    }
+    
+    void
+    EventManager::MergeBlacklist::expire(uint64_t now,
+                                         MergeDenialMap& expired)
+      throw(El::Exception)
+    {
+      uint64_t current_generation = generation(now);
+      
+      while(!generations_.empty() &&
+            generations_.begin()->first < current_generation)
+      {
+        GenerationMap::iterator git = generations_.begin();
+        const HashPairArray& pairs = git->second;
+
+        for(HashPairArray::const_iterator i(pairs.begin()), e(pairs.end());
+            i != e; ++i)
+        {
+          MergeDenialMap::iterator dit = denials_.find(*i);
+
+          if(dit != denials_.end() &&
+             generation(dit->second.timeout) == git->first)
+          {
+            expired.insert(*dit);
+            denials_.erase(dit);
+          }
+        }
+
+        generations_.erase(git);
+      }
+
+      // Current generation is partially timed out; pairs removed or moved
+      // to other generations are dropped from it meanwhile
+      if(!generations_.empty() &&
+         generations_.begin()->first == current_generation)
+      {
+        HashPairArray& pairs = generations_.begin()->second;
+        HashPairArray::iterator j = pairs.begin();
+        
+        for(HashPairArray::const_iterator i(pairs.begin()), e(pairs.end());
+            i != e; ++i)
+        {
+          MergeDenialMap::iterator dit = denials_.find(*i);
+
+          if(dit == denials_.end() ||
+             generation(dit->second.timeout) != current_generation)
+          {
+            continue;
+          }
+          
+          if(dit->second.timeout < now)
+          {
+            expired.insert(*dit);
+            denials_.erase(dit);
+          }
+          else
+          {
+            *j++ = *i;
+          }
+        }
+
+        pairs.erase(j, pairs.end());
+      }
+
+      // Removed pairs stay in filter, so rebuilding it when they prevail
+      if(filter_pairs_ > FILTER_MIN_PAIRS &&
+         filter_pairs_ > denials_.size() * 2)
+      {
+        rebuild_filter();
+      }
+    }
+
+    void
+    EventManager::MergeBlacklist::clear() throw(El::Exception)
+    {
+      denials_.clear();
+      generations_.clear();
+      
+      rebuild_filter();
+    }
+    
+    void
+    EventManager::MergeBlacklist::optimize_mem_usage() throw(El::Exception)
+    {
+      denials_.resize(0);
+      generations_.clear();
+
+      for(MergeDenialMap::const_iterator i(denials_.begin()),
+            e(denials_.end()); i != e; ++i)
+      {
+        generations_[generation(i->second.timeout)].push_back(i->first);
+      }
+      
+      rebuild_filter();
+    }
+    
+    void
+    EventManager::MergeBlacklist::rebuild_filter() throw(El::Exception)
+    {
+      filter_capacity_ =
+        std::max((size_t)FILTER_MIN_PAIRS, denials_.size() * 2);
+
+      uint64_t bits = 64;
+
+      while(bits < (uint64_t)filter_capacity_ * FILTER_BITS_PER_PAIR)
+      {
+        bits <<= 1;
+      }
+
+      filter_.assign(bits / 64, 0);
+      filter_mask_ = bits - 1;
+      filter_pairs_ = 0;
+
+      for(MergeDenialMap::const_iterator i(denials_.begin()),
+            e(denials_.end()); i != e; ++i)
+      {
+        filter_add(i->first);
+      }
+    }
+
     EventManager::DBMutex EventManager::event_buff_lock_;
     EventManager::DBMutex EventManager::message_buff_lock_;
     
@@ -362,7 +562,8 @@ namespace NewsGate
       EventManagerCallback* callback,
       bool load,
       bool all_events_changed,
-      const Server::Config::BankEventManagerType& config)
+      const Server::Config::BankEventManagerType& config,
+      EventWriteLog* write_log)
       throw(El::Exception)
         : El::Service::CompoundService<
             El::Service::Service, // Threads for merge, traverse, remake
@@ -397,20 +598,37 @@ namespace NewsGate
           message_time_lower_boundary_(std::numeric_limits<time_t>::max()),
           msg_core_words_next_preemt_(0),
           merge_blacklist_cleanup_time_(0),
+          merge_blacklist_(
+            config_.event_cache().merge_blacklist_cleanup_period()),
           last_event_number_(0),
+          merge_candidates_(0),
+          merge_overlaps_(0),
+          merge_lag_start_(0),
+          merge_passes_(0),
+          merged_events_(0),
+          merge_pass_time_(0),
 //          next_revision_time_(ACE_Time_Value::zero),
+          revise_pass_time_(0),
           traverse_event_it_(traverse_event_.end()),
           remake_traverse_event_it_(remake_traverse_event_.end()),
           changed_events_sum_(0),
           changed_events_avg_(0),
           traverse_period_(config_.event_cache().traverse_period_min()),
-          dissenters_(0)
+          dissenters_(0),
+          snapshot_checked_(!load),
+          write_log_(write_log)
 //          cleanup_allowed_(false),
 //          traverse_period_increased_(false)
     {
 //      ACE_OS::sleep(20);
       
       memset(changed_events_counters_, 0, sizeof(changed_events_counters_));
+
+      if(config_.event_cache().lsh_bands())
+      {
+        lsh_index_.reset(new MinHashIndex(config_.event_cache().lsh_bands(),
+                                          config_.event_cache().lsh_rows()));
+      }
       
       if(merge_level_size_based_decrement_step_ <= 0 &&
          merge_level_time_based_increment_step_ >= 0 &&
@@ -484,6 +702,11 @@ namespace NewsGate
     
     EventManager::~EventManager() throw()
     {
+      for(SnapshotJournalMap::iterator i(snapshot_journals_.begin()),
+            e(snapshot_journals_.end()); i != e; ++i)
+      {
+        delete i->second;
+      }
     }
     
     El::Luid
@@ -517,8 +740,27 @@ namespace NewsGate
     void EventManager::add_lang(const El::Lang& lang) throw(El::Exception)
     {
       WriteGuard guard(srv_lock_);
+      StatusGuard status_guard(status_lock_);
+      
       langs_.insert(lang);
     }
+
+    bool
+    EventManager::serves(const LangSet& langs) const throw(El::Exception)
+    {
+      StatusGuard guard(status_lock_);
+
+      for(LangSet::const_iterator i(langs.begin()), e(langs.end()); i != e;
+          ++i)
+      {
+        if(langs_.find(*i) != langs_.end())
+        {
+          return true;
+        }
+      }
+
+      return false;
+    }
     
     void
     EventManager::load_events() throw()
@@ -528,14 +770,42 @@ namespace NewsGate
         bool load_finished = false;
         bool chunk_read = false;
 
-        typedef std::vector<El::Luid> EventIdArray;
         EventIdArray broken_events;
 
+        if(!snapshot_checked_)
+        {
+          snapshot_checked_ = true;
+
+          LangSet langs;
+
+          {
+            ReadGuard guard(srv_lock_);
+            langs = langs_;
+          }
+
+          for(LangSet::const_iterator it = langs.begin(); it != langs.end();
+              ++it)
+          {
+            if(config_.event_cache().snapshot_period())
+            {
+              load_snapshot(*it);
+            }
+            else
+            {
+              // Not journaled changes would make snapshot outdated
+              unlink(snapshot_filename(*it).c_str());
+            }
+          }
+        }
+
+        // Events changed after snapshots were taken are reloaded by id
+        bool reconcile = !snapshot_reload_ids_.empty();
+
         std::string lang_filter;
         
         {
           std::ostringstream ostr;
-          ostr << " and lang in ( ";
+          size_t lang_count = 0;
           
           {  
             ReadGuard guard(srv_lock_);
@@ -543,17 +813,30 @@ namespace NewsGate
             for(LangSet::const_iterator it = langs_.begin();
                 it != langs_.end(); ++it)
             {
-              if(it != langs_.begin())
+              if(snapshot_langs_.find(*it) != snapshot_langs_.end())
               {
-                ostr << ", ";
+                continue;
               }
-              
-              ostr << it->el_code();
+
+              ostr << (lang_count++ ? ", " : " and lang in ( ")
+                   << it->el_code();
             }
           }
-          
-          ostr << " )";
-          lang_filter = ostr.str();
+
+          if(lang_count)
+          {
+            ostr << " )";
+            lang_filter = ostr.str();
+          }
+          else if(!reconcile)
+          {
+            // All languages are loaded from snapshots
+            El::Service::CompoundServiceMessage_var msg =
+              new DeleteObsoleteMessages(this);
+
+            deliver_now(msg.in());
+            return;
+          }
         }
         
         try
@@ -565,9 +848,30 @@ namespace NewsGate
             Application::instance()->dbase()->connect();
           
           std::ostringstream ostr;
-          ostr << "select event_id, data from Event where event_id>"
-               << event_load_last_id_.data << lang_filter
-               << " order by event_id limit " << config_.read_chunk_size();
+          size_t reload_count = 0;
+
+          if(reconcile)
+          {
+            reload_count = std::min(snapshot_reload_ids_.size(),
+                                    (size_t)config_.read_chunk_size());
+            
+            ostr << "select event_id, data from Event where event_id in ( ";
+
+            for(EventIdArray::const_reverse_iterator
+                  i(snapshot_reload_ids_.rbegin()), b(i),
+                  e(i + reload_count); i != e; ++i)
+            {
+              ostr << (i != b ? ", " : "") << i->data;
+            }
+
+            ostr << " )";
+          }
+          else
+          {
+            ostr << "select event_id, data from Event where event_id>"
+                 << event_load_last_id_.data << lang_filter
+                 << " order by event_id limit " << config_.read_chunk_size();
+          }
 
           ACE_High_Res_Timer timer;
           timer.start();
@@ -772,6 +1076,11 @@ namespace NewsGate
                 it->second->insert(event_number);
               }
 
+              if(lsh_index_.get())
+              {
+                lsh_index_->add(event_number, event.words);
+              }
+
               dissenters_ += event.dissenters();
 
 //              assert_can_merge(event, "0", false);
@@ -782,7 +1091,10 @@ namespace NewsGate
                           << std::endl;
               }
 
-              event_load_last_id_ = event.id;
+              if(!reconcile)
+              {
+                event_load_last_id_ = event.id;
+              }
             }
           }
           
@@ -832,7 +1144,11 @@ namespace NewsGate
                                          El::Logging::MIDDLE);
           }
 
-          load_finished = loaded_events < config_.read_chunk_size();
+          load_finished =
+            !reconcile && loaded_events < config_.read_chunk_size();
+
+          snapshot_reload_ids_.resize(snapshot_reload_ids_.size() -
+                                      reload_count);
           
           if(load_finished && Application::will_trace(El::Logging::MIDDLE))
           {
@@ -1064,6 +1380,8 @@ namespace NewsGate
           if(load_finished)
           {
             schedule_merge(0);
+            schedule_snapshot();
+            schedule_view_publish();
             
             msg = new TraverseEvents(this);
             deliver_now(msg.in());
@@ -1109,92 +1427,803 @@ namespace NewsGate
       }     
     }
     
+    std::string
+    EventManager::snapshot_filename(const El::Lang& lang) const
+      throw(El::Exception)
+    {
+      return config_.cache_file() + ".snp." + lang.l3_code();
+    }
+    
     void
-    EventManager::get_events(const Transport::EventIdRelArray& ids,
-                             Transport::EventObjectRelArray& events)
-      throw(Exception, El::Exception)
+    EventManager::write_snapshot() throw()
     {
-      El::MySQL::Connection_var connection =
-        Application::instance()->dbase()->connect();
-      
-      WriteGuard guard(srv_lock_);
-
-      for(Transport::EventIdRelArray::const_iterator i(ids.begin()),
-            e(ids.end()); i != e; ++i)
+      try
       {
-        EventIdToEventNumberMap::const_iterator iit =
-          id_to_number_map_.find(i->id);
+        LangSet langs;
 
-        if(iit == id_to_number_map_.end())
         {
-          continue;
+          ReadGuard guard(srv_lock_);
+          langs = langs_;
         }
 
-        EventNumber event_number = iit->second;
-        const EventObject& event = *events_.find(event_number)->second;
+        ACE_High_Res_Timer timer;
+        timer.start();
         
-        Transport::EventObjectRel event_rel;
-        event_rel.rel.object1 = event;
-        event_rel.changed = changed_events_.contain(event_rel.rel.object1.id);
-
-        if(i->rel != El::Luid::null)
-        {
-          event_releations(event_number, i->rel, event_rel.rel, connection);
-        }        
-
-        if(i->split != Message::Id::zero)
+        for(LangSet::const_iterator it = langs.begin(); it != langs.end();
+            ++it)
         {
-          split_event(event_number, i->split, event_rel.split, connection);
+          save_snapshot(*it);
         }
 
-        if(i->separate)
+        timer.stop();
+        
+        ACE_Time_Value write_time;
+        timer.elapsed_time(write_time);
+
+        if(Application::will_trace(El::Logging::MIDDLE))
         {
-          separate_event(event_number,
-                         i->separate,
-                         i->narrow_separation,
-                         i->rel,
-                         event_rel.separate,
-                         connection);
+          std::ostringstream ostr;
+          ostr << "NewsGate::Event::EventManager::write_snapshot("
+               << lang_string() << "): write time "
+               << El::Moment::time(write_time);
+          
+          Application::logger()->trace(ostr.str(),
+                                       Aspect::EVENT_MANAGEMENT,
+                                       El::Logging::MIDDLE);
         }
+      }
+      catch(const El::Exception& e)
+      {
+        std::ostringstream ostr;
+        ostr << "NewsGate::Event::EventManager::write_snapshot("
+             << lang_string() << "): "
+          "El::Exception caught. Description:" << std::endl << e;
         
-/*        
-        std::cerr << event_rel.object.id.string() << ":"
-                  << ((event_rel.object.flags & EventObject::EF_REVISED) ?
-                      "R" : "-") << std::endl;
-*/
-        events.push_back(event_rel);
+        El::Service::Error error(ostr.str(), this);
+        callback_->notify(&error);
       }
-    }
-    
-    void
-    EventManager::event_releations(EventNumber event_number,
-                                   const El::Luid& related_event,
-                                   Transport::EventRel& event_rel,
-                                   El::MySQL::Connection* connection)
-      throw(El::Exception)
-    {
-      EventIdToEventNumberMap::const_iterator iit =
-        id_to_number_map_.find(related_event);
 
-      if(iit != id_to_number_map_.end())
+      try
       {
-        event_rel.colocated = 1;
-
-        EventNumber rel_event_number = iit->second;
-            
-        const EventObject& rel_event =
+        schedule_snapshot();
+      }
+      catch(const El::Exception& e)
+      {
+        std::ostringstream ostr;
+        ostr << "NewsGate::Event::EventManager::write_snapshot("
+             << lang_string() << "): "
+          "El::Exception caught while scheduling task. Description:"
+             << std::endl << e;
+        
+        El::Service::Error error(ostr.str(), this);
+        callback_->notify(&error);
+      }
+    }
+
+    void
+    EventManager::save_snapshot(const El::Lang& lang)
+      throw(Exception, El::Exception)
+    {
+      std::string filename = snapshot_filename(lang);
+      std::string tmp_filename = filename + ".tmp";
+
+      // Holding the lock till journal removal, so no event change can
+      // happen in between
+      ReadGuard guard(srv_lock_);
+
+      std::fstream file(tmp_filename.c_str(), ios::out);
+
+      if(!file.is_open())
+      {
+        std::ostringstream ostr;
+        ostr << "NewsGate::Event::EventManager::save_snapshot("
+             << lang.l3_code() << "): failed to open file '" << tmp_filename
+             << "' for write access";
+
+        throw Exception(ostr.str());
+      }
+
+      try
+      {
+        uint32_t event_count = 0;
+        
+        for(EventNumberToEventMap::const_iterator i(events_.begin()),
+              e(events_.end()); i != e; ++i)
+        {
+          if(i->second->lang == lang)
+          {
+            ++event_count;
+          }
+        }
+        
+        El::BinaryOutStream bstr(file);
+        
+        bstr << SNAPSHOT_VERSION << (uint64_t)ACE_OS::gettimeofday().sec()
+             << event_count;
+
+        typedef std::vector<MessageCoreWordsMap::const_iterator>
+          CoreWordsIteratorArray;
+        
+        CoreWordsIteratorArray core_words;
+        MessageCoreWordsMap::const_iterator core_words_end =
+          message_core_words_.end();
+
+        for(EventNumberToEventMap::const_iterator i(events_.begin()),
+              e(events_.end()); i != e; ++i)
+        {
+          const EventObject& event = *i->second;
+          
+          if(event.lang != lang)
+          {
+            continue;
+          }
+
+          // Dirty flags are not persistent but are to survive restart
+          bstr << event.flags << event;
+
+          for(MessageInfoArray::const_iterator j(event.messages().begin()),
+                je(event.messages().end()); j != je; ++j)
+          {
+            MessageCoreWordsMap::const_iterator it =
+              message_core_words_.find(j->id);
+
+            if(it != core_words_end)
+            {
+              core_words.push_back(it);
+            }
+          }
+        }
+
+        bstr << (uint32_t)core_words.size();
+
+        for(CoreWordsIteratorArray::const_iterator i(core_words.begin()),
+              e(core_words.end()); i != e; ++i)
+        {
+          const MessageCoreWords& words = *(*i)->second;
+          
+          bstr << (*i)->first << words.timestamp;
+          words.words.write(bstr);
+        }
+
+        MergeDenialMap merge_blacklist;
+
+        for(MergeDenialMap::const_iterator i(merge_blacklist_.begin()),
+              e(merge_blacklist_.end()); i != e; ++i)
+        {
+          if(i->first.lang == lang)
+          {
+            merge_blacklist.insert(*i);
+          }
+        }
+
+        bstr.write_map(merge_blacklist);
+
+        // Marks complete snapshot
+        bstr << (uint64_t)UINT64_MAX;
+
+        if(!file.fail())
+        {
+          file.flush();
+        }
+            
+        if(file.fail())
+        {
+          std::ostringstream ostr;
+          ostr << "NewsGate::Event::EventManager::save_snapshot("
+               << lang.l3_code() << "): failed to write into file '"
+               << tmp_filename << "'";
+
+          throw Exception(ostr.str());
+        }
+
+        file.close();
+        
+        if(rename(tmp_filename.c_str(), filename.c_str()) < 0)
+        {
+          int error = ACE_OS::last_error();
+          
+          std::ostringstream ostr;
+          ostr << "NewsGate::Event::EventManager::save_snapshot("
+               << lang.l3_code() << "): failed to rename '" << tmp_filename
+               << "' to '" << filename << "'. Error code " << error
+               << ". Description:\n" << ACE_OS::strerror(error);
+
+          throw Exception(ostr.str());
+        }
+      }
+      catch(...)
+      {
+        unlink(tmp_filename.c_str());
+        throw;
+      }
+
+      SnapshotGuard snapshot_guard(snapshot_lock_);
+
+      SnapshotJournalMap::iterator i = snapshot_journals_.find(lang);
+
+      if(i != snapshot_journals_.end())
+      {
+        delete i->second;
+        snapshot_journals_.erase(i);
+      }
+
+      unlink((filename + ".chg").c_str());
+    }
+
+    bool
+    EventManager::load_snapshot(const El::Lang& lang) throw(El::Exception)
+    {
+      std::string filename = snapshot_filename(lang);
+      std::fstream file(filename.c_str(), ios::in);
+
+      if(!file.is_open())
+      {
+        return false;
+      }
+
+      ACE_High_Res_Timer timer;
+      timer.start();
+      
+      // Ids of events changed in DB after the snapshot
+      EventIdToEventNumberMap journaled_events;
+      
+      {
+        std::string journal_filename = filename + ".chg";
+        std::fstream journal(journal_filename.c_str(), ios::in);
+
+        if(journal.is_open())
+        {
+          El::BinaryInStream bstr(journal);
+
+          try
+          {
+            while(journal.peek() != EOF)
+            {
+              El::Luid id;
+              bstr >> id;
+              
+              journaled_events[id] = NUMBER_ZERO;
+            }
+          }
+          catch(const El::Exception&)
+          {
+            // Entry partially written on crash, the event has not been
+            // saved to DB then
+          }
+        }
+      }
+      
+      typedef std::vector<EventObject*> EventObjectArray;
+      typedef std::vector<std::pair<Message::Id, MessageCoreWords*> >
+        CoreWordsArray;
+      
+      EventObjectArray events;
+      CoreWordsArray core_words;
+      MergeDenialMap merge_blacklist;
+      uint64_t snapshot_time = 0;
+
+      try
+      {
+        El::BinaryInStream bstr(file);
+
+        uint32_t version = 0;
+        uint32_t count = 0;
+        
+        bstr >> version;
+
+        if(version != SNAPSHOT_VERSION)
+        {
+          std::ostringstream ostr;
+          ostr << "unexpected version " << version;
+          throw Exception(ostr.str());
+        }
+        
+        bstr >> snapshot_time >> count;
+        events.reserve(count);
+
+        for(uint32_t i = 0; i < count; ++i)
+        {
+          std::auto_ptr<EventObject> event(new EventObject());
+
+          uint8_t flags = 0;
+          bstr >> flags >> *event;
+
+          event->flags |=
+            flags & (EventObject::EF_DIRTY | EventObject::EF_MEM_ONLY);
+          
+          events.push_back(event.release());
+        }
+
+        bstr >> count;
+        core_words.reserve(count);
+        
+        for(uint32_t i = 0; i < count; ++i)
+        {
+          Message::Id id;
+          std::auto_ptr<MessageCoreWords> words(new MessageCoreWords());
+
+          bstr >> id >> words->timestamp;
+          words->words.read(bstr);
+
+          core_words.push_back(std::make_pair(id, words.release()));
+        }
+
+        bstr.read_map(merge_blacklist);
+
+        uint64_t sign = 0;
+        bstr >> sign;
+
+        if(sign != UINT64_MAX)
+        {
+          throw Exception("incomplete snapshot");
+        }
+      }
+      catch(const El::Exception& e)
+      {
+        // It can be not just El::BinaryInStream::Exception but some
+        // STL exception like std::bad_alloc due to file corruption
+        
+        for(EventObjectArray::iterator i(events.begin()),
+              ie(events.end()); i != ie; ++i)
+        {
+          delete *i;
+        }
+
+        for(CoreWordsArray::iterator i(core_words.begin()),
+              ie(core_words.end()); i != ie; ++i)
+        {
+          delete i->second;
+        }
+        
+        std::ostringstream ostr;
+        ostr << "NewsGate::Event::EventManager::load_snapshot("
+             << lang.l3_code() << "): failed to read '" << filename
+             << "'; loading events from DB. Description:" << std::endl << e;
+        
+        El::Service::Error error(ostr.str(), this);
+        callback_->notify(&error);
+
+        return false;
+      }
+
+      size_t loaded_events = 0;
+
+      {
+        WriteGuard guard(srv_lock_);
+
+        for(EventObjectArray::iterator i(events.begin()), e(events.end());
+            i != e; ++i)
+        {
+          std::auto_ptr<EventObject> pevent(*i);
+          
+          if(journaled_events.find(pevent->id) != journaled_events.end() ||
+             id_to_number_map_.find(pevent->id) != id_to_number_map_.end())
+          {
+            continue;
+          }
+          
+          EventNumber event_number = get_event_number();
+              
+          EventObject& event =
+            *events_.insert(
+              std::make_pair(event_number, pevent.release())).first->second;
+
+          id_to_number_map_[event.id] = event_number;
+
+          for(size_t j = 0; j < event.messages().size(); j++)
+          {
+            message_events_[event.message(j).id] = event_number;
+          }
+          
+          for(size_t j = 0; j < event.words.size(); j++)
+          {
+            uint32_t word_id = event.words[j].word_id;
+
+            WordToEventNumberMap::iterator it = word_map_.find(word_id);
+                
+            if(it == word_map_.end())
+            {
+              it = word_map_.insert(
+                std::make_pair(word_id, new EventNumberSet())).first;
+            }
+                
+            it->second->insert(event_number);
+          }
+
+          if(lsh_index_.get())
+          {
+            lsh_index_->add(event_number, event.words);
+          }
+
+          dissenters_ += event.dissenters();
+
+          if(all_events_changed_ && set_merge(event))
+          {
+            changed_events_.insert(EventCardinality(event)); 
+          }
+          
+          ++loaded_events;
+        }
+
+        MessageIdToEventNumberMap::const_iterator message_events_end =
+          message_events_.end();
+        
+        for(CoreWordsArray::iterator i(core_words.begin()),
+              e(core_words.end()); i != e; ++i)
+        {
+          std::auto_ptr<MessageCoreWords> words(i->second);
+          
+          if(message_events_.find(i->first) != message_events_end &&
+             message_core_words_.find(i->first) == message_core_words_.end())
+          {
+            message_core_words_.insert(
+              std::make_pair(i->first, words.release()));
+          }
+        }
+
+        merge_blacklist_.insert(merge_blacklist);
+
+        for(EventIdToEventNumberMap::const_iterator
+              i(journaled_events.begin()), e(journaled_events.end());
+            i != e; ++i)
+        {
+          snapshot_reload_ids_.push_back(i->first);
+        }
+        
+        snapshot_langs_.insert(lang);
+      }
+
+      timer.stop();
+      
+      ACE_Time_Value load_time;
+      timer.elapsed_time(load_time);
+      
+      if(Application::will_trace(El::Logging::MIDDLE))
+      {
+        std::ostringstream ostr;
+        ostr << "NewsGate::Event::EventManager::load_snapshot("
+             << lang.l3_code() << "): " << loaded_events << " events, "
+             << core_words.size() << " message core words, "
+             << journaled_events.size() << " events to reload; snapshot of "
+             << El::Moment(ACE_Time_Value(snapshot_time)).iso8601()
+             << ", load time " << El::Moment::time(load_time);
+          
+        Application::logger()->trace(ostr.str(),
+                                     Aspect::EVENT_MANAGEMENT,
+                                     El::Logging::MIDDLE);
+      }
+
+      return true;
+    }
+
+    void
+    EventManager::journal_event_change(const EventObject& event) throw()
+    {
+      if(!config_.event_cache().snapshot_period())
+      {
+        return;
+      }
+      
+      std::string filename;
+      
+      try
+      {
+        filename = snapshot_filename(event.lang);
+        
+        SnapshotGuard guard(snapshot_lock_);
+
+        SnapshotJournalMap::iterator i = snapshot_journals_.find(event.lang);
+
+        if(i == snapshot_journals_.end())
+        {
+          std::string journal_filename = filename + ".chg";
+          
+          std::auto_ptr<std::fstream> file(
+            new std::fstream(journal_filename.c_str(), ios::out | ios::app));
+
+          if(!file->is_open())
+          {
+            std::ostringstream ostr;
+            ostr << "failed to open file '" << journal_filename
+                 << "' for write access";
+
+            throw Exception(ostr.str());
+          }
+
+          i = snapshot_journals_.insert(
+            std::make_pair(event.lang, file.release())).first;
+        }
+
+        std::fstream& file = *i->second;
+
+        El::BinaryOutStream bstr(file);
+        bstr << event.id;
+        
+        file.flush();
+
+        if(file.fail())
+        {
+          throw Exception("failed to write into journal");
+        }
+      }
+      catch(const El::Exception& e)
+      {
+        // Snapshot can't be reconciled with DB anymore
+        unlink(filename.c_str());
+        
+        std::ostringstream ostr;
+        ostr << "NewsGate::Event::EventManager::journal_event_change("
+             << lang_string() << "): snapshot dropped. Description:"
+             << std::endl << e;
+        
+        El::Service::Error error(ostr.str(), this);
+        callback_->notify(&error);
+      }
+    }
+    
+    void
+    EventManager::view_changed(const El::Luid& id) throw(El::Exception)
+    {
+      if(config_.event_cache().view_publish_period())
+      {
+        view_changed_events_.insert(id);
+      }
+    }
+
+    void
+    EventManager::schedule_view_publish() throw(El::Exception)
+    {
+      size_t period = config_.event_cache().view_publish_period();
+      
+      if(period)
+      {
+        El::Service::CompoundServiceMessage_var msg = new PublishView(this);
+
+        deliver_at_time(msg.in(),
+                        ACE_OS::gettimeofday() + ACE_Time_Value(period));
+      }
+    }
+    
+    void
+    EventManager::publish_view() throw()
+    {
+      try
+      {
+        ACE_High_Res_Timer timer;
+        timer.start();
+        
+        EventIdSet changed_events;
+
+        {
+          WriteGuard guard(srv_lock_);
+          changed_events.swap(view_changed_events_);
+        }
+
+        EventView_var view = event_view();
+        size_t updated = 0;
+
+        if(view.in() == 0 || !changed_events.empty())
+        {
+          ReadGuard guard(srv_lock_);
+
+          if(view.in() == 0)
+          {
+            view = new EventView();
+
+            for(EventNumberToEventMap::const_iterator i(events_.begin()),
+                  e(events_.end()); i != e; ++i)
+            {
+              const EventObject& event = *i->second;
+              view->set_event(event, changed_events_.contain(event.id));
+            }
+
+            updated = events_.size();
+          }
+          else
+          {
+            view = new EventView(*view);
+            
+            for(EventIdSet::const_iterator i(changed_events.begin()),
+                  e(changed_events.end()); i != e; ++i)
+            {
+              EventIdToEventNumberMap::const_iterator iit =
+                id_to_number_map_.find(*i);
+
+              if(iit == id_to_number_map_.end())
+              {
+                view->remove_event(*i);
+              }
+              else
+              {
+                view->set_event(*events_.find(iit->second)->second,
+                                changed_events_.contain(*i));
+              }
+            }
+
+            updated = changed_events.size();
+          }
+        }
+
+        if(view.in() != 0)
+        {
+          ViewGuard guard(view_lock_);
+          view_ = view;
+        }
+
+        timer.stop();
+
+        if(updated && Application::will_trace(El::Logging::HIGH))
+        {
+          ACE_Time_Value publish_time;
+          timer.elapsed_time(publish_time);
+          
+          std::ostringstream ostr;
+          ostr << "NewsGate::Event::EventManager::publish_view("
+               << lang_string() << "): " << updated << " of "
+               << view->event_count() << " events updated for "
+               << El::Moment::time(publish_time);
+          
+          Application::logger()->trace(ostr.str(),
+                                       Aspect::EVENT_MANAGEMENT,
+                                       El::Logging::HIGH);
+        }
+      }
+      catch(const El::Exception& e)
+      {
+        {
+          // Changes taken are lost, so the next view is built from scratch
+          ViewGuard guard(view_lock_);
+          view_ = 0;
+        }
+        
+        std::ostringstream ostr;
+        ostr << "NewsGate::Event::EventManager::publish_view("
+             << lang_string() << "): "
+          "El::Exception caught. Description:" << std::endl << e;
+        
+        El::Service::Error error(ostr.str(), this);
+        callback_->notify(&error);
+      }
+
+      try
+      {
+        schedule_view_publish();
+      }
+      catch(const El::Exception& e)
+      {
+        std::ostringstream ostr;
+        ostr << "NewsGate::Event::EventManager::publish_view("
+             << lang_string() << "): "
+          "El::Exception caught while scheduling task. Description:"
+             << std::endl << e;
+        
+        El::Service::Error error(ostr.str(), this);
+        callback_->notify(&error);
+      }
+    }
+    
+    void
+    EventManager::get_events(const Transport::EventIdRelArray& ids,
+                             Transport::EventObjectRelArray& events)
+      throw(Exception, El::Exception)
+    {
+      EventView_var view = event_view();
+      
+      if(view.in() != 0)
+      {
+        bool plain_lookup = true;
+        
+        for(Transport::EventIdRelArray::const_iterator i(ids.begin()),
+              e(ids.end()); i != e && plain_lookup; ++i)
+        {
+          plain_lookup = i->rel == El::Luid::null &&
+            i->split == Message::Id::zero && i->separate == 0;
+        }
+
+        if(plain_lookup)
+        {
+          for(Transport::EventIdRelArray::const_iterator i(ids.begin()),
+                e(ids.end()); i != e; ++i)
+          {
+            const EventView::Event* event = view->find_event(i->id);
+
+            if(event)
+            {
+              Transport::EventObjectRel event_rel;
+              event_rel.rel.object1 = event->object;
+              event_rel.changed = event->changed;
+              
+              events.push_back(event_rel);
+            }
+          }
+          
+          return;
+        }
+      }
+
+      // Relations, split and separation are calculated on live events
+      
+      El::MySQL::Connection_var connection =
+        Application::instance()->dbase()->connect();
+      
+      WriteGuard guard(srv_lock_);
+
+      for(Transport::EventIdRelArray::const_iterator i(ids.begin()),
+            e(ids.end()); i != e; ++i)
+      {
+        EventIdToEventNumberMap::const_iterator iit =
+          id_to_number_map_.find(i->id);
+
+        if(iit == id_to_number_map_.end())
+        {
+          continue;
+        }
+
+        EventNumber event_number = iit->second;
+        const EventObject& event = *events_.find(event_number)->second;
+        
+        Transport::EventObjectRel event_rel;
+        event_rel.rel.object1 = event;
+        event_rel.changed = changed_events_.contain(event_rel.rel.object1.id);
+
+        if(i->rel != El::Luid::null)
+        {
+          event_releations(event_number, i->rel, event_rel.rel, connection);
+        }        
+
+        if(i->split != Message::Id::zero)
+        {
+          split_event(event_number, i->split, event_rel.split, connection);
+        }
+
+        if(i->separate)
+        {
+          separate_event(event_number,
+                         i->separate,
+                         i->narrow_separation,
+                         i->rel,
+                         event_rel.separate,
+                         connection);
+        }
+        
+/*        
+        std::cerr << event_rel.object.id.string() << ":"
+                  << ((event_rel.object.flags & EventObject::EF_REVISED) ?
+                      "R" : "-") << std::endl;
+*/
+        events.push_back(event_rel);
+      }
+    }
+    
+    void
+    EventManager::event_releations(EventNumber event_number,
+                                   const El::Luid& related_event,
+                                   Transport::EventRel& event_rel,
+                                   El::MySQL::Connection* connection)
+      throw(El::Exception)
+    {
+      EventIdToEventNumberMap::const_iterator iit =
+        id_to_number_map_.find(related_event);
+
+      if(iit != id_to_number_map_.end())
+      {
+        event_rel.colocated = 1;
+
+        EventNumber rel_event_number = iit->second;
+            
+        const EventObject& rel_event =
           *events_.find(rel_event_number)->second;
 
         event_rel.object2 = rel_event;
 
-        MergeDenialMap::const_iterator it =
+        const MergeDenialInfo* denial =
           merge_blacklist_.find(HashPair(event_rel.object1.hash(),
                                          rel_event.hash(),
                                          event_rel.object1.lang));
 
-        if(it != merge_blacklist_.end())
+        if(denial)
         {
-          event_rel.merge_blacklist_timeout = it->second.timeout;
+          event_rel.merge_blacklist_timeout = denial->timeout;
         }
             
         EventNumberSet event_set;
@@ -1367,6 +2396,19 @@ namespace NewsGate
         state.changed_events = changed_events_.size();
         state.merge_blacklist_size = merge_blacklist_.size();
         state.task_queue_size = task_queue_size();
+
+        state.merge_lag = merge_lag_start_ ?
+          ACE_OS::gettimeofday().sec() - merge_lag_start_ : 0;
+        
+        state.merge_passes = merge_passes_;
+        state.merged_events = merged_events_;
+        state.merge_pass_time = merge_pass_time_;
+        state.revise_backlog = revise_backlog_.size();
+
+        state.revise_lag = revise_backlog_.empty() ? 0 :
+          ACE_OS::gettimeofday().sec() - revise_backlog_.front().queued;
+
+        state.revise_pass_time = revise_pass_time_;
       }
 
       state.loaded = loaded();
@@ -1376,7 +2418,7 @@ namespace NewsGate
     std::string
     EventManager::lang_string() const throw(El::Exception)
     {
-      ReadGuard guard(srv_lock_);
+      StatusGuard guard(status_lock_);
       return langs_.string();
     }
     
@@ -1391,6 +2433,43 @@ namespace NewsGate
     {
       size_t i = 0;
       
+      EventView_var view = event_view();
+      
+      if(view.in() != 0)
+      {
+        total_message_count += view->message_count();
+
+        for(Message::IdArray::const_iterator it = message_ids.begin();
+            it != message_ids.end(); ++it, ++i)
+        {
+          Message::Transport::MessageEvent& message_event = message_events[i];
+
+          if(message_event.event_id != El::Luid::null)
+          {
+            continue;
+          }
+          
+          const Message::Id& id = *it;
+          const EventView::Event* event = view->find_message_event(id);
+          
+          if(event)
+          {
+            message_event.event_id = event->object.id;
+            message_event.event_capacity = event->object.messages().size();
+
+            if(log_stream)
+            {
+              *log_stream << "\n    found msg " << id.string() << ":"
+                          << event->object.id.string();
+            }
+
+            found_messages++;
+          }
+        }
+
+        return true;
+      }
+      
       {
         ReadGuard guard(srv_lock_);
 
@@ -1526,6 +2605,7 @@ namespace NewsGate
             ~EventObject::EF_REVISED;
           
           id_to_number_map_[event_id] = event_number;
+          view_changed(event_id);
 
           accepted_messages += digest_ptrs.size();
 
@@ -1721,6 +2801,7 @@ namespace NewsGate
             EventObject& event = *eit->second;
           
             event.flags |= EventObject::EF_DIRTY;
+            view_changed(event.id);
             
             event.flags &=
               ~(EventObject::EF_REVISED | EventObject::EF_CAN_MERGE);
@@ -1845,6 +2926,20 @@ namespace NewsGate
       }
     }
     
+    void
+    EventManager::schedule_snapshot() throw(El::Exception)
+    {
+      time_t period = config_.event_cache().snapshot_period();
+
+      if(period)
+      {
+        El::Service::CompoundServiceMessage_var msg = new WriteSnapshot(this);
+
+        deliver_at_time(msg.in(),
+                        ACE_OS::gettimeofday() + ACE_Time_Value(period));
+      }
+    }
+    
     void
     EventManager::write_event_line(const EventObject& event,
                                    std::ostream& stream,
@@ -2101,6 +3196,7 @@ namespace NewsGate
         
       id_to_number_map_[event_id] = event_number;
       message_events_[message_digest.id] = event_number;
+      view_changed(event_id);
 
       if(log_stream)
       {
@@ -2191,6 +3287,18 @@ namespace NewsGate
         delete_obsolete_messages();
         return true;
       }
+
+      if(dynamic_cast<WriteSnapshot*>(event) != 0)
+      {
+        write_snapshot();
+        return true;
+      }
+
+      if(dynamic_cast<PublishView*>(event) != 0)
+      {
+        publish_view();
+        return true;
+      }
       
       std::ostringstream ostr;
       ostr << "NewsGate::Event::EventManager::notify("
@@ -2213,30 +3321,47 @@ namespace NewsGate
         MessageIdToEventInfoMapPtr message_event_updates;
         StringList defered_queries;
 
+        bool changed = false;
+        
+        {
+          ReadGuard guard(srv_lock_);
+          changed = !changed_events_.empty();
+        }
+        
+        if(changed)
+        {
+          try
+          {
+            do_merge_events(connection.in(), defered_queries);
+          }
+          catch(...)
+          {
+            schedule_merge(std::max(
+                             config_.event_cache().event_load_retry_delay(),
+                             config_.event_cache().merge_check_period()));
+            throw;
+          }
+            
+          schedule_merge(0);
+        }
+        else
+        {
+          schedule_merge(config_.event_cache().merge_check_period());
+        }
+
         {
           WriteGuard guard(srv_lock_);
-          
+
+          // Merge lag is how long changed events are waiting for merge
           if(changed_events_.empty())
           {
-            schedule_merge(config_.event_cache().merge_check_period());
+            merge_lag_start_ = 0;
           }
-          else
+          else if(merge_lag_start_ == 0)
           {
-            try
-            {
-              do_merge_events(connection.in(), defered_queries);
-            }
-            catch(...)
-            {
-              schedule_merge(std::max(
-                               config_.event_cache().event_load_retry_delay(),
-                               config_.event_cache().merge_check_period()));
-              throw;
-            }
-            
-            schedule_merge(0);
+            merge_lag_start_ = ACE_OS::gettimeofday().sec();
           }
-
+          
           if(changed_events_.empty() ||
              (message_event_updates_.get() != 0 &&
               message_event_updates_->size() >=
@@ -2254,6 +3379,11 @@ namespace NewsGate
           }
         }
 
+        if(write_log_)
+        {
+          write_log_->commit();
+        }
+
         execute_queries(connection, defered_queries, "merge_events");
         
         if(message_event_updates.get())
@@ -2383,6 +3513,9 @@ namespace NewsGate
       ACE_High_Res_Timer timer;
       timer.start();
 
+      size_t examined_events = 0;
+      size_t merged_events = 0;
+
       bool verbose = false;
       std::ostringstream log_stream;
       
@@ -2407,15 +3540,22 @@ namespace NewsGate
       
       uint64_t now = ACE_OS::gettimeofday().sec();
 
-      if(now >= merge_blacklist_cleanup_time_)
       {
-        for(MergeDenialMap::iterator it(merge_blacklist_.begin()),
-              ie(merge_blacklist_.end()); it != ie; ++it)
+        WriteGuard guard(srv_lock_);
+        
+        merge_candidates_ = 0;
+        merge_overlaps_ = 0;
+      
+        if(now >= merge_blacklist_cleanup_time_)
         {
-          const MergeDenialInfo& hpi = it->second;
+          MergeDenialMap expired;
+          merge_blacklist_.expire(now, expired);
           
-          if(hpi.timeout < now)
+          for(MergeDenialMap::const_iterator it(expired.begin()),
+                ie(expired.end()); it != ie; ++it)
           {
+            const MergeDenialInfo& hpi = it->second;
+
             if(hpi.event_id != El::Luid::null)
             {
               EventIdToEventNumberMap::const_iterator i =
@@ -2425,34 +3565,45 @@ namespace NewsGate
               {
                 const EventObject& e = *events_.find(i->second)->second;
 
-//                assert_can_merge(e, "1", false);
-                       
+//                  assert_can_merge(e, "1", false);
+                     
                 if((e.flags & EventObject::EF_CAN_MERGE) != 0 &&
                    e.dissenters() == 0)
                 {
                   uint32_t hash = e.hash();
                   const HashPair& hp = it->first;
-                
+              
                   if(hash == hp.first() || hash == hp.second())
                   {
                     changed_events_.insert(EventCardinality(e));
+                    view_changed(e.id);
                   }
                 }
               }
             }
-          
-            merge_blacklist_.erase(it);
           }
-        }
 
-        merge_blacklist_cleanup_time_ =
-          now + config_.event_cache().merge_blacklist_cleanup_period();
+          merge_blacklist_cleanup_time_ =
+            now + config_.event_cache().merge_blacklist_cleanup_period();
+        }
       }
+
+      //
+      // Lock is taken for a single changed event at a time, so event
+      // requests and message insertion are not blocked for the whole pass
+      //
       
-      while(!changed_events_.empty() &&
-            find_best_overlap_time < find_best_overlap_timeout)
+      while(find_best_overlap_time < find_best_overlap_timeout)
       {
+        WriteGuard guard(srv_lock_);
+
+        if(changed_events_.empty())
+        {
+          break;
+        }
+        
         EventCardinality cardinality = changed_events_.pop();
+        view_changed(cardinality.id);
         
         EventIdToEventNumberMap::iterator iit =
           id_to_number_map_.find(cardinality.id);
@@ -2467,6 +3618,8 @@ namespace NewsGate
         EventNumber best_overlap_event = 0;
         EventNumber denied_best_overlap_event = 0;
         uint32_t merge_deny_timeout = 0;
+
+        ++examined_events;
         
         {
           ACE_High_Res_Timer timer;
@@ -2528,6 +3681,7 @@ namespace NewsGate
           timer.elapsed_time(tm);
           
           merge_events_time += tm;
+          ++merged_events;
           break;
         }
         else if(denied_best_overlap_event)
@@ -2539,11 +3693,11 @@ namespace NewsGate
           EventObject& event2 = *eit->second;
           
           HashPair hp(event1.hash(), event2.hash(), event1.lang);
-          MergeDenialMap::iterator hit = merge_blacklist_.find(hp);
+          MergeDenialInfo* denial = merge_blacklist_.find(hp);
           
-          assert(hit != merge_blacklist_.end());
+          assert(denial != 0);
           
-          hit->second.event_id = event1.id;
+          denial->event_id = event1.id;
 
           if(Application::will_trace(El::Logging::MIDDLE))
           {
@@ -2565,8 +3719,18 @@ namespace NewsGate
       ACE_Time_Value tm;
       timer.elapsed_time(tm);
 
+      WriteGuard guard(srv_lock_);
+
+      ++merge_passes_;
+      merged_events_ += merged_events;
+      merge_pass_time_ = tm.msec();
+
       if(Application::will_trace(El::Logging::MIDDLE))
       {
+        double find_best_overlap_secs =
+          (double)find_best_overlap_time.sec() +
+          (double)find_best_overlap_time.usec() / 1000000;
+        
         log_stream << "\nmerge time: " << El::Moment::time(tm)
                    << " (" << El::Moment::time(find_best_overlap_time)
                    << " + " << El::Moment::time(merge_events_time)
@@ -2575,7 +3739,19 @@ namespace NewsGate
                    << ", merge blacklist size: "
                    << merge_blacklist_.size()
                    << "; tasks in queue "
-                   << task_queue_size();
+                   << task_queue_size()
+                   << "\nexamined events: " << examined_events
+                   << " (" << (find_best_overlap_secs > 0 ?
+                               (size_t)(examined_events /
+                                        find_best_overlap_secs) : 0)
+                   << " per sec), merged: " << merged_events
+                   << ", candidates: " << merge_candidates_
+                   << ", overlaps computed: " << merge_overlaps_;
+
+        if(lsh_index_.get())
+        {
+          log_stream << ", lsh buckets: " << lsh_index_->buckets();
+        }
         
         Application::logger()->trace(log_stream.str(),
                                      Aspect::EVENT_MANAGEMENT,
@@ -2664,356 +3840,515 @@ namespace NewsGate
       WordToEventNumberMap::const_iterator wit_end = word_map_.end();
       EventNumberToEventMap::const_iterator events_end = events_.end();
       
-      MergeDenialMap::const_iterator merge_blacklist_end =
-        merge_blacklist_.end();
-      
       const El::Lang& event_lang = event.lang;
 
       bool load_event = true;
-      
-      for(EventWordWeightArray::const_iterator i(event.words.begin()),
-            e(event.words.end()); i != e; ++i)
-      {        
-        WordToEventNumberMap::const_iterator wit = word_map_.find(i->word_id);
-        
-        if(wit == wit_end)
-        {
-          // Temporary event
-          continue;
-        }
 
-        const EventNumberSet& numbers = *wit->second;
+      MinHashIndex::EventNumberArray candidates;
 
-        for(EventNumberSet::const_iterator i(numbers.begin()),
-              e(numbers.end()); i != e; ++i)
-        {
-//          fbo_meter1.start();
-          
-          EventNumber number = *i;
-
-//          fbo_meter11.start();
-          
-          if(skip_events.find(number) != skip_events.end())
+      if(lsh_index_.get())
+      {
+        // Events with similar word sets only, rather than every event
+        // sharing a word, which can be a huge set for a common one
+        lsh_index_->candidates(event.words, skip_events, candidates);
+      }
+      else
+      {
+        for(EventWordWeightArray::const_iterator i(event.words.begin()),
+              e(event.words.end()); i != e; ++i)
+        {        
+          WordToEventNumberMap::const_iterator wit =
+            word_map_.find(i->word_id);
+        
+          if(wit == wit_end)
           {
-//            fbo_meter11.stop();
-//            fbo_meter1.stop();
+            // Temporary event
             continue;
           }
+
+          const EventNumberSet& numbers = *wit->second;
+
+          for(EventNumberSet::const_iterator i(numbers.begin()),
+                e(numbers.end()); i != e; ++i)
+          {
+            EventNumber number = *i;
           
-//          fbo_meter11.stop();
-          
-//          fbo_meter12.start();
-          skip_events.insert(number);
-//          fbo_meter12.stop();
+            if(skip_events.insert(number).second)
+            {
+              candidates.push_back(number);
+            }
+          }
+        }
+      }
+
+      merge_candidates_ += candidates.size();
+      
+      for(MinHashIndex::EventNumberArray::const_iterator
+            i(candidates.begin()), e(candidates.end()); i != e; ++i)
+      {
+//          fbo_meter1.start();
+        
+        EventNumber number = *i;
 
 //          fbo_meter13.start();
-          EventNumberToEventMap::const_iterator eit = events_.find(number);
+        EventNumberToEventMap::const_iterator eit = events_.find(number);
 //          fbo_meter13.stop();
-          
-          assert(eit != events_end);
+        
+        assert(eit != events_end);
 
-          const EventObject& candidate = *eit->second;
+        const EventObject& candidate = *eit->second;
 
-          if(candidate.size() < min_size)
-          {
-            continue;
-          }
+        if(candidate.size() < min_size)
+        {
+          continue;
+        }
 
 //          assert_can_merge(candidate, "3", false);
 
 //          fbo_meter14.start();
-          
-          uint64_t time_diff = event.time_diff(candidate);
+        
+        uint64_t time_diff = event.time_diff(candidate);
 
-          if(time_diff > merge_max_time_diff_)
-          {
+        if(time_diff > merge_max_time_diff_)
+        {
 //            fbo_meter14.stop();
 //            fbo_meter1.stop();
 /*
-            if(trace)
-            {
-              std::cerr << "  can't with " << candidate.id.string()
-                        << " due time_diff " << time_diff
-                        << "\n";
-            }
+          if(trace)
+          {
+            std::cerr << "  can't with " << candidate.id.string()
+                      << " due time_diff " << time_diff
+                      << "\n";
+          }
 */          
-            continue;
-          }          
+          continue;
+        }          
 
 //          fbo_meter14.stop();          
 //          fbo_meter15.start();
 
-          if(candidate.lang != event_lang ||
-             (candidate.flags & EventObject::EF_CAN_MERGE) == 0)
-          {
+        if(candidate.lang != event_lang ||
+           (candidate.flags & EventObject::EF_CAN_MERGE) == 0)
+        {
 //            fbo_meter15.stop();
 //            fbo_meter1.stop();
 /*
-            if(trace)
-            {
-              std::cerr << "  can't with " << candidate.id.string() << "\n";
-            }
-*/            
-            continue;
+          if(trace)
+          {
+            std::cerr << "  can't with " << candidate.id.string() << "\n";
           }
-            
+*/            
+          continue;
+        }
+          
 //          fbo_meter15.stop();
 //          fbo_meter16.start();
 
-            
-          uint64_t time_range = event.time_range(candidate);
-            
-          if(time_range > max_time_range_)
-          {
+          
+        uint64_t time_range = event.time_range(candidate);
+          
+        if(time_range > max_time_range_)
+        {
 //            fbo_meter16.stop();
 //            fbo_meter1.stop();
 /*
-            if(trace)
-            {
-              std::cerr << "  can't with " << candidate.id.string()
-                        << " due time_range " << time_range
-                        << "\n";
-            }
-*/            
-            continue;
+          if(trace)
+          {
+            std::cerr << "  can't with " << candidate.id.string()
+                      << " due time_range " << time_range
+                      << "\n";
           }
+*/            
+          continue;
+        }
 
 //          fbo_meter16.stop();          
 //          fbo_meter17.start();
-          
+        
 //          size_t candidate_size = candidate.messages().size();
 //          if(candidate_size > candidate_event_max_size)
-          if(candidate.messages().size() > candidate_event_max_size)
-          {
+        if(candidate.messages().size() > candidate_event_max_size)
+        {
 //            fbo_meter17.stop();
 //            fbo_meter1.stop();
 /*
-            if(trace)
-            {
-              std::cerr << "  can't with " << candidate.id.string()
-                        << " due candidate size "
-                        << candidate.messages().size()
-                        << "\n";
-            }
-*/            
-            continue;
+          if(trace)
+          {
+            std::cerr << "  can't with " << candidate.id.string()
+                      << " due candidate size "
+                      << candidate.messages().size()
+                      << "\n";
           }
+*/            
+          continue;
+        }
 
 //          fbo_meter17.stop();
 //          fbo_meter1.stop();
-          
+        
 //          fbo_meter2.start();
-          
-          size_t overlap = event.words_overlap(candidate);
-          
-          if(overlap < merge_level_min_)
-          {
+        
+        size_t overlap = event.words_overlap(candidate);
+        ++merge_overlaps_;
+        
+        if(overlap < merge_level_min_)
+        {
 //            fbo_meter2.stop();
 /*
-            if(trace)
-            {
-              std::cerr << "  can't with " << candidate.id.string()
-                        << " due to small overlap "
-                        << overlap
-                        << "\n";
-            }
-*/            
-            continue;
+          if(trace)
+          {
+            std::cerr << "  can't with " << candidate.id.string()
+                      << " due to small overlap "
+                      << overlap
+                      << "\n";
           }
+*/            
+          continue;
+        }
 
 //          fbo_meter2.stop();
 
 //          fbo_meter3.start();
+        
+        size_t merge_level =
+          event_merge_level(0, //std::max(event_size, candidate_size),
+                            std::max(event_strain, candidate.strain()),
+                            time_diff,
+                            time_range);
+        
+        if(overlap < merge_level)
+        {
+//            fbo_meter3.stop();
+/*
+          if(trace)
+          {
+            std::cerr << "  can't with " << candidate.id.string()
+                      << " due to not enough overlap "
+                      << overlap
+                      << "\n";
+          }
+*/            
+          continue;
+        }
+
+        float rel_overlap = (float)overlap / merge_level;
+        HashPair hp(event.hash(), candidate.hash(), event.lang);
+        
+        const MergeDenialInfo* denial = merge_blacklist_.find(hp);
+
+        bool merge_allowed = denial == 0 || denial->timeout < now;
+
+        float& max_rel_overlap = merge_allowed ?
+          max_allowed_rel_overlap : max_denied_rel_overlap;
+            
+        uint64_t& min_time_diff = merge_allowed ?
+          min_allowed_time_diff : min_denied_time_diff;
+          
+        if(rel_overlap > max_rel_overlap ||
+           (max_rel_overlap - rel_overlap > 0.001 &&
+            time_diff < min_time_diff))
+        {
+          // Can check here is event resulted from merge will have too high
+          // strain; goto next iteration is it does.
+
+          EventNumberSet event_set;
+
+          if(load_event)
+          {
+            event_set.insert(event_number);
+            load_event = false;
+          }
+
+          event_set.insert(number);
+
+          load_message_core_words(event_set, connection);
+
+          size_t candidate_size = candidate.messages().size();
+
+          MessageInfoArray messages(event_size + candidate_size);
           
-          size_t merge_level =
-            event_merge_level(0, //std::max(event_size, candidate_size),
-                              std::max(event_strain, candidate.strain()),
-                              time_diff,
-                              time_range);
+          messages.copy(event.messages(), 0, event_size);
+          messages.copy(candidate.messages(), event_size, candidate_size);
           
-          if(overlap < merge_level)
+          EventObject merged_event;
+          create_event(merged_event, messages, event.lang);
+
+          if(merged_event.strain() <= merge_max_strain_ ||
+             merged_event.dissenters() < 2 ||
+             merged_event.dissenters() < std::min(event_size,
+                                                  candidate_size))
           {
-//            fbo_meter3.stop();
-/*
+            if(rel_overlap > max_rel_overlap)
+            {
+              max_rel_overlap = rel_overlap;
+            }
+            
+            min_time_diff = time_diff;
+          }
+          else
+          {  
+/*              
             if(trace)
             {
               std::cerr << "  can't with " << candidate.id.string()
-                        << " due to not enough overlap "
-                        << overlap
+                        << " due to big strain "
+                        << merged_event.strain()
                         << "\n";
             }
-*/            
+*/              
             continue;
           }
+        }
+        else
+        {
+/*            
+          if(trace)
+          {
+            std::cerr << "  can't with " << candidate.id.string()
+                      << " as other is better "
+                      << "\n";
+          }
+*/            
+          continue;
+        }
 
-          float rel_overlap = (float)overlap / merge_level;
-          HashPair hp(event.hash(), candidate.hash(), event.lang);
-          
-          MergeDenialMap::const_iterator hit = merge_blacklist_.find(hp);
-
-          bool merge_allowed = hit == merge_blacklist_end ||
-            hit->second.timeout < now;
+        if(merge_allowed)
+        {   
+          max_overlap_event_number = number;
+/*
+          if(trace)
+          {
+            std::cerr << " allowed with " << candidate.id.string()
+                      << "\n";
+          }
+*/         
+        }
+        else if(!max_overlap_event_number)
+        {
+/*            
+          if(trace)
+          {
+            std::cerr << " denied with " << candidate.id.string()
+                      << "\n";
+          }
+*/            
+          max_denied_overlap_event_number = number;
 
-          float& max_rel_overlap = merge_allowed ?
-            max_allowed_rel_overlap : max_denied_rel_overlap;
+          uint32_t timeout = hit->second.timeout > now ?
+            (hit->second.timeout - now) : 0;
               
-          uint64_t& min_time_diff = merge_allowed ?
-            min_allowed_time_diff : min_denied_time_diff;
-            
-          if(rel_overlap > max_rel_overlap ||
-             (max_rel_overlap - rel_overlap > 0.001 &&
-              time_diff < min_time_diff))
+          merge_deny_timeout = timeout;
+                
+          if(log_stream)
           {
-            // Can check here is event resulted from merge will have too high
-            // strain; goto next iteration is it does.
+            *log_stream << "\n  denied 0x" << std::hex << hp.first()
+                        << " + 0x" << std::hex << hp.second()
+                        << std::dec << " (" << event.messages().size()
+                        << " + " << candidate.messages().size()
+                        << ") for " << timeout << " sec";
+          }
+        }
 
-            EventNumberSet event_set;
+//          fbo_meter3.stop();
+      }        
 
-            if(load_event)
-            {
-              event_set.insert(event_number);
-              load_event = false;
-            }
+      return max_overlap_event_number;
+    }
+
+    uint64_t
+    EventManager::merge_deny_timeout(const EventObject& e1,
+                                     const EventObject& e2)
+      throw(El::Exception)
+    {
+      uint64_t timeout = (e1.messages().size() + e2.messages().size()) *
+        merge_deny_size_factor_;
+
+      timeout = std::min(timeout, merge_deny_max_time_ / 2);
+      
+      timeout += (unsigned long long)rand() *
+        timeout / ((unsigned long long)RAND_MAX + 1);
+      
+      return timeout;
+    }
+
+    void
+    EventManager::set_messages(EventObject& event,
+                               MessageInfoArray& messages,
+                               const EventWordWeightMap* event_words_pw,
+                               std::ostream* log_stream,
+                               bool verbose)
+      throw(El::Exception)
+    {
+      event.messages(messages);
+
+      if(event_words_pw)
+      {
+        set_words(event, *event_words_pw);
+        cache_word_weights(event, *event_words_pw);
+      }
+      else
+      {
+        EventWordWeightMap event_words_pw;
+        
+        get_message_word_weights(event,
+                                 event_words_pw,
+                                 log_stream,
+                                 verbose);
 
-            event_set.insert(number);
+        set_words(event, event_words_pw);
+        cache_word_weights(event, event_words_pw);
+      }
+      
+    }
 
-            load_message_core_words(event_set, connection);
+    void
+    EventManager::update_messages(EventObject& event,
+                                  MessageInfoArray& messages,
+                                  const MessageInfoArray& added,
+                                  const MessageInfoArray& removed,
+                                  std::ostream* log_stream,
+                                  bool verbose)
+      throw(El::Exception)
+    {
+      EventNumberToWordWeightsMap::iterator it =
+        event_word_weights_.find(id_to_number_map_[event.id]);
 
-            size_t candidate_size = candidate.messages().size();
+      if(it != event_word_weights_.end())
+      {
+        EventWordWeights& word_weights = *it->second;
 
-            MessageInfoArray messages(event_size + candidate_size);
-            
-            messages.copy(event.messages(), 0, event_size);
-            messages.copy(candidate.messages(), event_size, candidate_size);
-            
-            EventObject merged_event;
-            create_event(merged_event, messages, event.lang);
+        if(word_weights.updates < config_.event().word_weights_max_updates() &&
+           messages.size() >= config_.event().word_weights_min_size() &&
+           add_message_word_weights(added, false, word_weights.weights) &&
+           add_message_word_weights(removed, true, word_weights.weights))
+        {
+          ++word_weights.updates;
+          
+          event.messages(messages);
+          set_words(event, word_weights.weights);
+          return;
+        }
+      }
+
+      // Recalculation also caches the weights anew
+      set_messages(event, messages, 0, log_stream, verbose);
+    }
+
+    bool
+    EventManager::add_message_word_weights(const MessageInfoArray& messages,
+                                           bool subtract,
+                                           EventWordWeightMap& event_words_pw)
+      const throw(El::Exception)
+    {
+      MessageCoreWordsMap::const_iterator message_core_words_end =
+        message_core_words_.end();
+      
+      for(MessageInfoArray::const_iterator i(messages.begin()),
+            e(messages.end()); i != e; ++i)
+      {
+        MessageCoreWordsMap::const_iterator it =
+          message_core_words_.find(i->id);
+
+        if(it == message_core_words_end)
+        {
+          return false;
+        }
+
+        const Message::CoreWords& msg_core_words = it->second->words;
+        unsigned long msg_core_words_count = msg_core_words.size();
+
+        for(size_t j = 0; j < msg_core_words_count; j++)
+        {
+          uint32_t word_id = msg_core_words[j];
+          
+          uint64_t weight =
+            EventObject::core_word_weight(j,
+                                          msg_core_words_count,
+                                          max_message_core_words_);
+          
+          EventWordWeightMap::iterator wit = event_words_pw.find(word_id);
 
-            if(merged_event.strain() <= merge_max_strain_ ||
-               merged_event.dissenters() < 2 ||
-               merged_event.dissenters() < std::min(event_size,
-                                                    candidate_size))
+          if(subtract)
+          {
+            if(wit == event_words_pw.end() || wit->second.weight < weight ||
+               (!j && wit->second.first_count == 0))
             {
-              if(rel_overlap > max_rel_overlap)
-              {
-                max_rel_overlap = rel_overlap;
-              }
-              
-              min_time_diff = time_diff;
-            }
-            else
-            {  
-/*              
-              if(trace)
-              {
-                std::cerr << "  can't with " << candidate.id.string()
-                          << " due to big strain "
-                          << merged_event.strain()
-                          << "\n";
-              }
-*/              
-              continue;
+              return false;
             }
-          }
-          else
-          {
-/*            
-            if(trace)
+
+            EventWordWC& wc = wit->second;
+            wc.weight -= weight;
+
+            if(!j)
             {
-              std::cerr << "  can't with " << candidate.id.string()
-                        << " as other is better "
-                        << "\n";
+              --wc.first_count;
             }
-*/            
-            continue;
-          }
 
-          if(merge_allowed)
-          {   
-            max_overlap_event_number = number;
-/*
-            if(trace)
+            if(wc.weight == 0 && wc.first_count == 0)
             {
-              std::cerr << " allowed with " << candidate.id.string()
-                        << "\n";
+              event_words_pw.erase(wit);
             }
-*/         
           }
-          else if(!max_overlap_event_number)
+          else if(wit == event_words_pw.end())
           {
-/*            
-            if(trace)
-            {
-              std::cerr << " denied with " << candidate.id.string()
-                        << "\n";
-            }
-*/            
-            max_denied_overlap_event_number = number;
+            event_words_pw[word_id] = EventWordWC(weight, j ? 0 : 1);
+          }
+          else
+          {
+            EventWordWC& wc = wit->second;
+            wc.weight += weight;
 
-            uint32_t timeout = hit->second.timeout > now ?
-              (hit->second.timeout - now) : 0;
-                
-            merge_deny_timeout = timeout;
-                  
-            if(log_stream)
+            if(!j)
             {
-              *log_stream << "\n  denied 0x" << std::hex << hp.first()
-                          << " + 0x" << std::hex << hp.second()
-                          << std::dec << " (" << event.messages().size()
-                          << " + " << candidate.messages().size()
-                          << ") for " << timeout << " sec";
-            }
+              ++wc.first_count;
+            }            
           }
-
-//          fbo_meter3.stop();
-        }        
+        }
       }
 
-      return max_overlap_event_number;
+      return true;
     }
 
-    uint64_t
-    EventManager::merge_deny_timeout(const EventObject& e1,
-                                     const EventObject& e2)
+    void
+    EventManager::cache_word_weights(const EventObject& event,
+                                     const EventWordWeightMap& event_words_pw)
       throw(El::Exception)
     {
-      uint64_t timeout = (e1.messages().size() + e2.messages().size()) *
-        merge_deny_size_factor_;
-
-      timeout = std::min(timeout, merge_deny_max_time_ / 2);
+      EventNumber number = id_to_number_map_[event.id];
+      size_t min_size = config_.event().word_weights_min_size();
       
-      timeout += (unsigned long long)rand() *
-        timeout / ((unsigned long long)RAND_MAX + 1);
+      if(min_size == 0 || event.messages().size() < min_size)
+      {
+        erase_word_weights(number);
+        return;
+      }
+
+      EventNumberToWordWeightsMap::iterator it =
+        event_word_weights_.find(number);
+
+      if(it == event_word_weights_.end())
+      {
+        it = event_word_weights_.insert(
+          std::make_pair(number, new EventWordWeights())).first;
+      }
+
+      EventWordWeights& word_weights = *it->second;
       
-      return timeout;
+      word_weights.weights = event_words_pw;
+      word_weights.updates = 0;
     }
 
     void
-    EventManager::set_messages(EventObject& event,
-                               MessageInfoArray& messages,
-                               const EventWordWeightMap* event_words_pw,
-                               std::ostream* log_stream,
-                               bool verbose)
-      throw(El::Exception)
+    EventManager::erase_word_weights(EventNumber number) throw()
     {
-      event.messages(messages);
+      EventNumberToWordWeightsMap::iterator it =
+        event_word_weights_.find(number);
 
-      if(event_words_pw)
-      {
-        set_words(event, *event_words_pw);
-      }
-      else
+      if(it != event_word_weights_.end())
       {
-        EventWordWeightMap event_words_pw;
-        
-        get_message_word_weights(event,
-                                 event_words_pw,
-                                 log_stream,
-                                 verbose);
-
-        set_words(event, event_words_pw);
+        delete it->second;
+        event_word_weights_.erase(it);
       }
-      
     }
       
     void
@@ -3040,6 +4375,11 @@ namespace NewsGate
                 
         it->second->insert(number);
       }
+
+      if(lsh_index_.get())
+      {
+        lsh_index_->add(number, words);
+      }
     }
       
     void
@@ -3128,6 +4468,11 @@ namespace NewsGate
           word_map_.erase(word_id);
         }
       }
+
+      if(lsh_index_.get())
+      {
+        lsh_index_->remove(number, words);
+      }
     }
 
     size_t
@@ -3201,9 +4546,9 @@ namespace NewsGate
       
 //      md_insert_meter.start();
       
-        merge_blacklist_[HashPair(src.hash(), dest.hash(), src.lang)] =
-          MergeDenialInfo(ACE_OS::gettimeofday().sec() +
-                          merge_deny_timeout(src, dest));
+        merge_blacklist_.set(HashPair(src.hash(), dest.hash(), src.lang),
+                             MergeDenialInfo(ACE_OS::gettimeofday().sec() +
+                                             merge_deny_timeout(src, dest)));
 
 //      md_insert_meter.stop();
 
@@ -3241,7 +4586,12 @@ namespace NewsGate
                           src_message_count,
                           dest_message_count);
 
-        set_messages(dest, new_messages, 0, &log_stream, verbose);
+        update_messages(dest,
+                        new_messages,
+                        src.messages(),
+                        MessageInfoArray(),
+                        &log_stream,
+                        verbose);
         
         uint32_t dis_val = 0;
         detach_message_candidate(dest, connection, 0, 0, &dis_val);
@@ -3253,6 +4603,7 @@ namespace NewsGate
         
         dest.flags |= EventObject::EF_DIRTY;
         dest.flags &= ~EventObject::EF_REVISED;
+        view_changed(dest.id);
 
         stage = "3";
         
@@ -3285,10 +4636,14 @@ namespace NewsGate
         bool delete_src = (src.flags & EventObject::EF_MEM_ONLY) == 0;
       
         id_to_number_map_.erase(src_id);
+        view_changed(src_id);
 
         EventNumberToEventMap::iterator eit = events_.find(src_number);
         assert(eit != events_.end());
 
+        journal_event_change(*eit->second);
+        erase_word_weights(src_number);
+
         delete eit->second;
         events_.erase(eit);
 
@@ -3299,9 +4654,16 @@ namespace NewsGate
       
         if(delete_src)
         {
-          std::ostringstream ostr;
-          ostr << "delete from Event where event_id=" << src_id.data;
-          defered_queries.push_back(ostr.str());
+          if(write_log_)
+          {
+            write_log_->remove(src_id);
+          }
+          else
+          {
+            std::ostringstream ostr;
+            ostr << "delete from Event where event_id=" << src_id.data;
+            defered_queries.push_back(ostr.str());
+          }
         }
       }
       catch(const El::Exception& e)
@@ -3346,7 +4708,6 @@ namespace NewsGate
         {
           EventNumberSet load_msg_events;
           EventNumberSet obsolete_events;
-          EventNumberSet events_to_revise;
           EventNumberSet flush_events;
           EventNumberSet push_out_events;
 
@@ -3481,6 +4842,13 @@ namespace NewsGate
                   traverse_period_ / (3600 * 100));
             }
 
+            // Events to revise are queued after ones left from previous
+            // traverses. When backlog is full they are left for the next
+            // pass over events.
+            size_t revise_backlog_max =
+              std::max(config_.event_cache().revise_backlog_max(),
+                       config_.event_cache().traverse_records());
+            
             for(size_t i = 0; i < config_.event_cache().traverse_records() &&
                   traverse_event_it_ != traverse_event_.end(); i++)
             {
@@ -3521,8 +4889,12 @@ namespace NewsGate
                 else if(to_revise_events &&
                         (event.flags & EventObject::EF_REVISED) == 0)
                 {
-                  events_to_revise.insert(event_number);
-                  load_msg_events.insert(event_number);
+                  if(revise_backlog_.size() < revise_backlog_max &&
+                     revise_backlog_events_.insert(event_number).second)
+                  {
+                    revise_backlog_.push_back(
+                      ReviseBacklogRecord(event_number, cur_time));
+                  }
                 }
                 
                 if(event.flags & EventObject::EF_DIRTY)
@@ -3533,14 +4905,25 @@ namespace NewsGate
             }
             
             load_message_core_words(load_msg_events, connection);
+
+            if(!revise_backlog_.empty())
+            {
+              ACE_High_Res_Timer revise_timer;
+              revise_timer.start();
             
-            revision_completed =
-              revise_events(events_to_revise,
-                            cur_time,
-                            expire_time,
-                            connection,
-                            trace_logger ? &revise_log_stream : 0,
-                            verbose);
+              revision_completed =
+                revise_backlog(cur_time,
+                               expire_time,
+                               connection,
+                               trace_logger ? &revise_log_stream : 0,
+                               verbose);
+
+              revise_timer.stop();
+              ACE_Time_Value revise_tm;
+              revise_timer.elapsed_time(revise_tm);
+
+              revise_pass_time_ = revise_tm.msec();
+            }
             
             cleanup_obsolete_events(obsolete_events,
                                     expire_time,
@@ -3708,6 +5091,7 @@ namespace NewsGate
                              config_.event_cache().traverse_period_min())
                          << "\n  cleanup allowed " << cleanup_allowed
                          << "\n  revision completed " << revision_completed
+                         << "\n  revise backlog " << revise_backlog_.size()
                          << "\n  * revision time: " << El::Moment::time(tm)
                          << "; end" << (end_reached ? "" : " not")
                          << " reached";
@@ -3821,11 +5205,63 @@ namespace NewsGate
                config_.event_cache().cleanup_allowed_change_events_count() &&
                traverse_period_ <= config_.event_cache().traverse_period_min())
             {
-              for(; traversed_events <
-                    config_.event_remake().traverse_records() &&
+              size_t traverse_records =
+                config_.event_remake().traverse_records();
+              
+              size_t time_budget =
+                config_.event_remake().traverse_time_budget();
+      
+              ACE_Time_Value deadline = time_budget ?
+                ACE_OS::gettimeofday() +
+                ACE_Time_Value(time_budget / 1000,
+                               time_budget % 1000 * 1000) :
+                ACE_Time_Value::zero;
+
+              // Core words are loaded for a chunk of events at once rather
+              // than by a query per event remake check. Without time budget
+              // chunk is the whole slice.
+              size_t prefetch_chunk = time_budget ?
+                BUDGET_PREFETCH_CHUNK : traverse_records;
+              
+              size_t prefetched = 0;
+              
+              for(; traversed_events < traverse_records &&
                     remake_traverse_event_it_ != remake_traverse_event_.end();
                   ++traversed_events)
               {
+                if(deadline != ACE_Time_Value::zero && traversed_events &&
+                   ACE_OS::gettimeofday() >= deadline)
+                {
+                  break;
+                }
+
+                if(traversed_events == prefetched)
+                {
+                  EventNumberSet chunk_events;
+                  
+                  for(EventNumberArray::const_iterator
+                        it(remake_traverse_event_it_),
+                        e(remake_traverse_event_.end());
+                      prefetched < traverse_records &&
+                        prefetched < traversed_events + prefetch_chunk &&
+                        it != e; ++prefetched)
+                  {
+                    EventNumberToEventMap::const_iterator eit =
+                      events_.find(*it++);
+
+                    if(eit != events_.end() &&
+                       remake_candidate(*eit->second,
+                                        recompose_time,
+                                        expire_time,
+                                        remake_min_size_))
+                    {
+                      chunk_events.insert(eit->first);
+                    }
+                  }
+              
+                  load_message_core_words(chunk_events, connection);
+                }
+                
                 EventNumber event_number = *remake_traverse_event_it_++;
 
                 EventNumberToEventMap::const_iterator it =
@@ -3866,10 +5302,10 @@ namespace NewsGate
 
                 std::cerr << "BBBBBB\n";
 */
-                if(event.published_max > recompose_time &&
-                   (event.flags & EventObject::EF_REVISED) != 0 &&
-                   event.published_min > expire_time &&
-                   (event.flags & EventObject::EF_PUSH_IN_PROGRESS) == 0)
+                if(remake_candidate(event,
+                                    recompose_time,
+                                    expire_time,
+                                    remake_min_size_))
                 {
                   if(remake_event(event_number,
                                   cur_time,
@@ -4020,12 +5456,17 @@ namespace NewsGate
         }
         
         word_map_.resize(0);
+
+        if(lsh_index_.get())
+        {
+          lsh_index_->optimize_mem_usage();
+        }
       
         events_.resize(0);
         id_to_number_map_.resize(0);
         message_events_.resize(0);
         changed_events_.optimize_mem_usage();
-        merge_blacklist_.resize(0);
+        merge_blacklist_.optimize_mem_usage();
         message_core_words_.resize(0);
       }
       
@@ -4098,6 +5539,11 @@ namespace NewsGate
         *remove_events_query << " )";
         defered_queries.push_back(remove_events_query->str());        
       }
+
+      if(write_log_)
+      {
+        write_log_->commit();
+      }
     }
     
     void
@@ -4199,7 +5645,9 @@ namespace NewsGate
       if(new_size)
       {
         MessageInfoArray new_messages(new_size);
+        MessageInfoArray removed_messages(messages.size() - new_size);
         size_t j = 0;
+        size_t k = 0;
 
         for(size_t i = 0; i < messages.size(); i++)
         {
@@ -4210,12 +5658,21 @@ namespace NewsGate
             new_messages[j++] = mi;
             assert(removed_ids.find(mi.id) == removed_ids.end());            
           }
+          else
+          {
+            removed_messages[k++] = mi;
+          }
         }
 
         size_t old_size = event.messages().size();
         size_t old_words_count = event.words.size();        
 
-        set_messages(event, new_messages, 0, log_stream, verbose);
+        update_messages(event,
+                        new_messages,
+                        MessageInfoArray(),
+                        removed_messages,
+                        log_stream,
+                        verbose);
 
         uint32_t dis_val = 0;
         detach_message_candidate(event, connection, 0, 0, &dis_val);
@@ -4225,6 +5682,7 @@ namespace NewsGate
         
         event.flags |= EventObject::EF_DIRTY;
         event.flags &= ~EventObject::EF_REVISED;
+        view_changed(event.id);
 
         if(set_merge(event))
         {
@@ -4253,17 +5711,24 @@ namespace NewsGate
       {
         if((event.flags & EventObject::EF_MEM_ONLY) == 0)
         {
-          if(remove_events_query.get() == 0)
+          if(write_log_)
           {
-            remove_events_query.reset(new std::ostringstream());
-            *remove_events_query << "delete from Event where event_id in ( ";
+            write_log_->remove(event.id);
           }
           else
           {
-            *remove_events_query << ", ";
-          }
+            if(remove_events_query.get() == 0)
+            {
+              remove_events_query.reset(new std::ostringstream());
+              *remove_events_query << "delete from Event where event_id in ( ";
+            }
+            else
+            {
+              *remove_events_query << ", ";
+            }
             
-          *remove_events_query << event.id.data;
+            *remove_events_query << event.id.data;
+          }
         }
  
         if(log_stream)
@@ -4272,7 +5737,10 @@ namespace NewsGate
                       << event.id.string() << "/" << number;
         }
 
+        journal_event_change(event);
+        erase_word_weights(number);
         id_to_number_map_.erase(event.id);
+        view_changed(event.id);
 
         EventNumberToEventMap::iterator eit = events_.find(number);
         assert(eit != events_.end());
@@ -4830,22 +6298,34 @@ namespace NewsGate
 
           if((event->flags & EventObject::EF_MEM_ONLY) == 0)
           {
-            if(remove_events_query.get() == 0)
+            if(write_log_)
             {
-              remove_events_query.reset(new std::ostringstream());
-              *remove_events_query << "delete from Event where event_id in ( ";
+              write_log_->remove(event->id);
             }
             else
             {
-              *remove_events_query << ", ";
-            }
+              if(remove_events_query.get() == 0)
+              {
+                remove_events_query.reset(new std::ostringstream());
+                
+                *remove_events_query
+                  << "delete from Event where event_id in ( ";
+              }
+              else
+              {
+                *remove_events_query << ", ";
+              }
             
-            *remove_events_query << event->id.data;
+              *remove_events_query << event->id.data;
+            }
           }
 
           dissenters_ -= event->dissenters();
 
+          journal_event_change(*event);
+          erase_word_weights(event_number);
           id_to_number_map_.erase(event->id);
+          view_changed(event->id);
 
           delete event;
           events_.erase(eit);
@@ -4864,6 +6344,11 @@ namespace NewsGate
           defered_queries.push_back(remove_events_query->str());          
         }
 
+        if(write_log_)
+        {
+          write_log_->commit();
+        }
+
         execute_queries(connection, defered_queries, "push_events");
         return true;
       }
@@ -4918,6 +6403,7 @@ namespace NewsGate
         if(set_merge(event))
         {
           changed_events_.insert(EventCardinality(event));
+          view_changed(event.id);
         }
       }
 
@@ -4932,6 +6418,7 @@ namespace NewsGate
     {
       std::string cache_filename;
       std::fstream file;
+      bool logged = false;
 
       try
       {
@@ -4950,6 +6437,20 @@ namespace NewsGate
 
           EventObject& event = *eit->second;
 
+          if(write_log_)
+          {
+            // Journaled ahead of logging, the same as of DB writing below
+            journal_event_change(event);
+
+            std::ostringstream line;
+            write_event_line(event, line, true);
+            
+            write_log_->save(event.id, line.str());
+            logged = true;
+            
+            continue;
+          }
+
           bool first_line = cache_filename.empty();
           
           if(first_line)
@@ -4995,9 +6496,28 @@ namespace NewsGate
         if(!cache_filename.empty())
         {
           file.close();
+
+          for(EventNumberSet::const_iterator it = events_to_flush.begin();
+              it != events_to_flush.end(); it++)
+          {
+            EventNumberToEventMap::iterator eit = events_.find(*it);
+            
+            if(eit != events_.end())
+            {
+              journal_event_change(*eit->second);
+            }
+          }
+          
           write_events_to_db(cache_filename.c_str());
           unlink(cache_filename.c_str());
+        }
+        else if(logged)
+        {
+          write_log_->commit();
+        }
 
+        if(logged || !cache_filename.empty())
+        {
           for(EventNumberSet::const_iterator it = events_to_flush.begin();
               it != events_to_flush.end(); it++)
           {
@@ -5034,9 +6554,105 @@ namespace NewsGate
     }
 
     size_t
-    EventManager::revise_events(const EventNumberSet& events_to_revise,
+    EventManager::revise_backlog(time_t now,
+                                 time_t expire_time,
+                                 El::MySQL::Connection* connection,
+                                 std::ostringstream* log_stream,
+                                 bool verbose)
+      throw(El::Exception)
+    {
+      size_t time_budget = config_.event_cache().revise_time_budget();
+      
+      ACE_Time_Value deadline = time_budget ?
+        ACE_OS::gettimeofday() + ACE_Time_Value(time_budget / 1000,
+                                                time_budget % 1000 * 1000) :
+        ACE_Time_Value::zero;
+
+      // Without time budget the whole backlog is revised at once,
+      // otherwise by chunks, so core words are not loaded for events
+      // budget is not enough for
+      size_t chunk_size = time_budget ?
+        BUDGET_PREFETCH_CHUNK : revise_backlog_.size();
+      
+      size_t revision_completed = 0;
+      bool first_chunk = true;
+
+      while(!revise_backlog_.empty())
+      {
+        if(!first_chunk && deadline != ACE_Time_Value::zero &&
+           ACE_OS::gettimeofday() >= deadline)
+        {
+          break;
+        }
+
+        std::vector<ReviseBacklogRecord> records;
+        EventNumberArray events_to_revise;
+        EventNumberSet load_msg_events;
+        
+        records.reserve(chunk_size);
+        events_to_revise.reserve(chunk_size);
+
+        while(records.size() < chunk_size && !revise_backlog_.empty())
+        {
+          const ReviseBacklogRecord& record = revise_backlog_.front();
+          EventNumberToEventMap::const_iterator it = events_.find(record.event);
+          
+          if(it != events_.end() && revise_candidate(*it->second, expire_time))
+          {
+            records.push_back(record);
+            events_to_revise.push_back(record.event);
+            load_msg_events.insert(record.event);
+          }
+          else
+          {
+            revise_backlog_events_.erase(record.event);
+          }
+
+          revise_backlog_.pop_front();
+        }
+
+        if(records.empty())
+        {
+          break;
+        }
+        
+        load_message_core_words(load_msg_events, connection);
+
+        size_t processed = 0;
+        
+        revision_completed += revise_events(events_to_revise,
+                                            now,
+                                            expire_time,
+                                            deadline,
+                                            processed,
+                                            connection,
+                                            log_stream,
+                                            verbose);
+
+        for(size_t i = 0; i < processed; ++i)
+        {
+          revise_backlog_events_.erase(records[i].event);
+        }
+
+        // Unprocessed events are returned to the backlog front in the
+        // original order
+        for(size_t i = records.size(); i > processed; --i)
+        {
+          revise_backlog_.push_front(records[i - 1]);
+        }
+
+        first_chunk = false;
+      }
+
+      return revision_completed;
+    }
+    
+    size_t
+    EventManager::revise_events(const EventNumberArray& events_to_revise,
                                 time_t now,
                                 time_t expire_time,
+                                const ACE_Time_Value& deadline,
+                                size_t& processed,
                                 El::MySQL::Connection* connection,
                                 std::ostringstream* log_stream,
                                 bool verbose)
@@ -5054,11 +6670,17 @@ namespace NewsGate
         uint64_t recompose_time =
           now > (time_t)config_.event_cache().recompose_timeout() ?
           now - config_.event_cache().recompose_timeout() : 0;      
-      
-      for(EventNumberSet::const_iterator it = events_to_revise.begin();
-          it != events_to_revise.end(); it++)
+
+      for(processed = 0; processed < events_to_revise.size(); ++processed)
       {
-        EventNumber event_number = *it;
+        // At least one event revised, so backlog do not stall
+        if(deadline != ACE_Time_Value::zero && processed &&
+           ACE_OS::gettimeofday() >= deadline)
+        {
+          break;
+        }
+
+        EventNumber event_number = events_to_revise[processed];
 
         EventNumberToEventMap::const_iterator eit = events_.find(event_number);
             
@@ -5524,6 +7146,7 @@ namespace NewsGate
         (event.flags & EventObject::EF_DISSENTERS_CLEANUP);
 
       id_to_number_map_[new_event_id] = new_event_number;
+      view_changed(new_event_id);
 
       for(MessageInfoVector::const_iterator i(new_event_msg_begin);
           i != new_event_msg_end; ++i)
@@ -5552,6 +7175,7 @@ namespace NewsGate
       }
 
       event.flags |= EventObject::EF_DIRTY;
+      view_changed(event.id);
       
       MessageInfoArray old_event_messages;
       
@@ -6051,12 +7675,9 @@ namespace NewsGate
           continue;
         }
 
-        MergeDenialMap::const_iterator it =
-          merge_blacklist_.find(HashPair(event1.hash(),
-                                         event2.hash(),
-                                         event.lang));
-        
-        if(it != merge_blacklist_.end())
+        if(merge_blacklist_.find(HashPair(event1.hash(),
+                                          event2.hash(),
+                                          event.lang)))
         {
 //          std::cerr << "AAA: " << event.id.string() << " " << word_id
 //                    << std::endl;
@@ -6194,10 +7815,10 @@ namespace NewsGate
             timeout *= 10;
           }
 */        
-          merge_blacklist_[HashPair(event.hash(),
-                                    new_event->hash(),
-                                    event.lang)] =
-            MergeDenialInfo(current_time + timeout);
+          merge_blacklist_.set(HashPair(event.hash(),
+                                        new_event->hash(),
+                                        event.lang),
+                               MergeDenialInfo(current_time + timeout));
           
           if(log_stream)
           {
@@ -6231,15 +7852,20 @@ namespace NewsGate
                          log_stream &&
                          Application::will_trace(El::Logging::HIGH));
 
-            merge_blacklist_[HashPair(event.hash(),
-                                      improve_candidate->hash(),
-                                      event.lang)] =
+            merge_blacklist_.set(
+              HashPair(event.hash(), improve_candidate->hash(), event.lang),
               MergeDenialInfo(current_time +
-                              merge_deny_timeout(event, *improve_candidate));
+                              merge_deny_timeout(event, *improve_candidate)));
 
 // No need to call as the only query is deletion of *new_event which is
 // redundunt as it is on memory only
 //            execute_queries(connection, defered_queries, "remake_events");
+
+            if(write_log_)
+            {
+              // Deletion of *new_event flushed above is logged by merge
+              write_log_->commit();
+            }
           }
         }
         
@@ -6433,6 +8059,7 @@ namespace NewsGate
       message_published = 0;
       event.flags |= EventObject::EF_DIRTY;
       event.flags &= ~EventObject::EF_CAN_MERGE;
+      view_changed(event.id);
       
       revised_events.insert(event_number);
 
@@ -6484,6 +8111,8 @@ namespace NewsGate
       if(loaded())
       {
         schedule_merge(0);
+        schedule_snapshot();
+        schedule_view_publish();
             
         msg = new TraverseEvents(this);
         deliver_now(msg.in());
@@ -6541,6 +8170,7 @@ namespace NewsGate
           else
           {
             changed_events_.insert(cardinality);
+            view_changed(cardinality.id);
           }
         }
 
@@ -6555,7 +8185,7 @@ namespace NewsGate
           if(langs_.find(hp.lang) != langs_.end())
           {
 //            md_insert_meter.start();
-            merge_blacklist_.insert(std::make_pair(hp, hpi));
+            merge_blacklist_.insert(hp, hpi);
 //            md_insert_meter.stop();
             merge_blacklist.erase(i);
           }
@@ -6663,6 +8293,22 @@ namespace NewsGate
                               Aspect::EVENT_MANAGEMENT,
                               El::Logging::MIDDLE);
         }
+
+        if(config_.event_cache().snapshot_period() && loaded())
+        {
+          LangSet langs;
+
+          {
+            ReadGuard guard(srv_lock_);
+            langs = langs_;
+          }
+          
+          for(LangSet::const_iterator it = langs.begin(); it != langs.end();
+              ++it)
+          {
+            save_snapshot(*it);
+          }
+        }
       }
       catch(const El::Exception& e)
       {
@@ -18,12 +18,15 @@
 #include <limits.h>
 
 #include <list>
+#include <deque>
 #include <vector>
 #include <set>
+#include <map>
 #include <iostream>
 #include <sstream>
 #include <memory>
 #include <utility>
+#include <fstream>
 
 #include <ext/hash_map>
 
@@ -50,6 +53,10 @@
 
 #include <Services/Commons/Message/MessageServices.hpp>
 
+#include "MinHashIndex.hpp"
+#include "EventWriteLog.hpp"
+#include "EventView.hpp"
+
 namespace NewsGate
 {
   namespace Event
@@ -201,6 +208,90 @@ namespace NewsGate
         MergeDenialMap() throw(El::Exception);
       };
 
+      //
+      // Merge denials grouped into generations by timeout, so expired ones
+      // are dropped a generation at a time instead of scanning all of
+      // them. Generations are several times finer than cleanup period, so
+      // only the one now falls into is checked denial by denial. Bloom
+      // filter in front of the denial map answers most checks
+      // for pairs not denied without the map lookup.
+      //
+      class MergeBlacklist
+      {
+      public:
+        typedef MergeDenialMap::const_iterator const_iterator;
+        
+        MergeBlacklist(uint64_t cleanup_period) throw(El::Exception);
+
+        const MergeDenialInfo* find(const HashPair& hp) const throw();
+
+        // Denial timeout should not be changed through the pointer
+        MergeDenialInfo* find(const HashPair& hp) throw();
+
+        // Replaces denial for the pair if exist
+        void set(const HashPair& hp, const MergeDenialInfo& info)
+          throw(El::Exception);
+
+        // Keeps denials for pairs already denied
+        void insert(const HashPair& hp, const MergeDenialInfo& info)
+          throw(El::Exception);
+        
+        void insert(const MergeDenialMap& denials) throw(El::Exception);
+
+        //
+        // Moves denials timed out by now to expired map
+        //
+        void expire(uint64_t now, MergeDenialMap& expired)
+          throw(El::Exception);
+
+        void clear() throw(El::Exception);
+        void optimize_mem_usage() throw(El::Exception);
+
+        size_t size() const throw();
+        const_iterator begin() const throw();
+        const_iterator end() const throw();
+
+      private:
+
+        typedef std::vector<HashPair> HashPairArray;
+        typedef std::map<uint64_t, HashPairArray> GenerationMap;
+        typedef std::vector<uint64_t> BitArray;
+
+        enum
+        {
+          GENERATIONS_PER_CLEANUP = 8,
+          FILTER_HASHES = 3,
+          FILTER_BITS_PER_PAIR = 16,
+          FILTER_MIN_PAIRS = 1024
+        };
+
+        uint64_t generation(uint64_t timeout) const throw();
+
+        void add(const HashPair& hp, const MergeDenialInfo& info)
+          throw(El::Exception);
+
+        bool filter_test(const HashPair& hp) const throw();
+        void filter_add(const HashPair& hp) throw();
+        void rebuild_filter() throw(El::Exception);
+        
+        static uint64_t filter_hash(const HashPair& hp) throw();
+        
+      private:
+        
+        uint64_t generation_period_;
+        MergeDenialMap denials_;
+        
+        // Generation may refer pairs moved to other generations or removed
+        GenerationMap generations_;
+        
+        BitArray filter_;
+        uint64_t filter_mask_;
+        size_t filter_capacity_;
+        
+        // Pairs added to filter since the last rebuild, including removed
+        size_t filter_pairs_;
+      };
+
       class LangSet : public google::dense_hash_set<El::Lang, El::Hash::Lang>
       {
       public:
@@ -217,6 +308,13 @@ namespace NewsGate
         uint64_t changed_events;
         uint64_t merge_blacklist_size;
         uint64_t task_queue_size;
+        uint64_t merge_lag;
+        uint64_t merge_passes;
+        uint64_t merged_events;
+        uint64_t merge_pass_time;
+        uint64_t revise_backlog;
+        uint64_t revise_lag;
+        uint64_t revise_pass_time;
 
         State() throw(El::Exception);
         
@@ -229,7 +327,8 @@ namespace NewsGate
                    EventManagerCallback* callback,
                    bool load,
                    bool all_events_changed,
-                   const Server::Config::BankEventManagerType& config)
+                   const Server::Config::BankEventManagerType& config,
+                   EventWriteLog* write_log)
         throw(El::Exception);
       
       virtual ~EventManager() throw();
@@ -300,7 +399,14 @@ namespace NewsGate
       State state() const throw(El::Exception);
 
       void add_lang(const El::Lang& lang) throw(El::Exception);
+
+      // Returns true if manager handles any of languages
+      bool serves(const LangSet& langs) const throw(El::Exception);
+      
       size_t event_count() const throw();
+
+      static void write_events_to_db(const char* cache_filename)
+        throw(Exception, El::Exception);
       
     private:
 
@@ -365,6 +471,34 @@ namespace NewsGate
       void remake_traverse_events() throw();
       void load_events() throw();
       void delete_obsolete_messages() throw();
+
+      //
+      // Events of a language are periodically saved into snapshot file.
+      // Ids of events changed in DB afterwards are appended to the
+      // snapshot journal file, so on start events are taken from the
+      // snapshot and only journaled ones are reloaded from DB.
+      //
+      void write_snapshot() throw();
+      void schedule_snapshot() throw(El::Exception);
+
+      void save_snapshot(const El::Lang& lang) throw(Exception, El::Exception);
+      bool load_snapshot(const El::Lang& lang) throw(El::Exception);
+
+      void journal_event_change(const EventObject& event) throw();
+
+      std::string snapshot_filename(const El::Lang& lang) const
+        throw(El::Exception);
+
+      //
+      // Lookups are served from the view published periodically, so are
+      // not blocked by merges. Ids of events changed since publishing
+      // are collected to update only those in the next view.
+      //
+      void publish_view() throw();
+      void schedule_view_publish() throw(El::Exception);
+      void view_changed(const El::Luid& id) throw(El::Exception);
+
+      EventView* event_view() const throw();
       
       void delete_messages(const Message::IdArray& ids)
         throw(El::Exception);
@@ -387,6 +521,35 @@ namespace NewsGate
                                     std::ostream* log_stream,
                                     bool verbose)
         const throw(El::Exception);
+
+      //
+      // Sets event messages updating cached event word weights by added
+      // and removed messages; if weights are not cached or due for
+      // recalculation does the same as set_messages
+      //
+      void update_messages(EventObject& event,
+                           MessageInfoArray& messages,
+                           const MessageInfoArray& added,
+                           const MessageInfoArray& removed,
+                           std::ostream* log_stream = 0,
+                           bool verbose = false)
+        throw(El::Exception);
+
+      //
+      // Adds (or subtracts) message core word weights; returns false
+      // if core words are unknown for some message or subtraction
+      // underflows, so the weights are inconsistent
+      //
+      bool add_message_word_weights(const MessageInfoArray& messages,
+                                    bool subtract,
+                                    EventWordWeightMap& event_words_pw)
+        const throw(El::Exception);
+
+      void cache_word_weights(const EventObject& event,
+                              const EventWordWeightMap& event_words_pw)
+        throw(El::Exception);
+
+      void erase_word_weights(EventNumber number) throw();
       
       void unreference_words(const EventObject& event)
         throw(Exception, El::Exception);
@@ -491,14 +654,42 @@ namespace NewsGate
                        std::string& error_desc)
         throw(Exception, El::Exception);
       
-      size_t revise_events(const EventNumberSet& events_to_revise,
+      typedef std::vector<EventNumber> EventNumberArray;
+
+      //
+      // Revises events in the order given until deadline reached (if not
+      // zero), at least one event is revised. Number of events examined
+      // is returned in processed.
+      //
+      size_t revise_events(const EventNumberArray& events_to_revise,
                            time_t now,
                            time_t expire_time,
+                           const ACE_Time_Value& deadline,
+                           size_t& processed,
                            El::MySQL::Connection* connection,
                            std::ostringstream* log_stream,
                            bool verbose)
         throw(El::Exception);
 
+      //
+      // Revises events from revise_backlog_ in the order queued, within
+      // revise_time_budget if set
+      //
+      size_t revise_backlog(time_t now,
+                            time_t expire_time,
+                            El::MySQL::Connection* connection,
+                            std::ostringstream* log_stream,
+                            bool verbose)
+        throw(El::Exception);
+
+      bool revise_candidate(const EventObject& event,
+                            uint64_t expire_time) const throw();
+
+      bool remake_candidate(const EventObject& event,
+                            uint64_t recompose_time,
+                            uint64_t expire_time,
+                            size_t min_size) const throw();
+
       void execute_queries(El::MySQL::Connection* connection,
                            const StringList& queries,
                            const char* caller)
@@ -534,9 +725,6 @@ namespace NewsGate
                             bool first_line)
         throw(Exception, El::Exception);
       
-      void write_events_to_db(const char* cache_filename)
-        throw(Exception, El::Exception);
-
       uint64_t merge_deny_timeout(const EventObject& e1, const EventObject& e2)
         throw(El::Exception);
 
@@ -632,6 +820,33 @@ namespace NewsGate
         
         ~EventNumberToEventMap() throw();
       };
+
+      //
+      // Word weights accumulated over messages of a big event; updated
+      // by added and removed messages instead of summing up all of them
+      //
+      struct EventWordWeights
+      {
+        EventWordWeightMap weights;
+        uint32_t updates; // Since recalculation from all messages
+
+        EventWordWeights() throw(El::Exception) : updates(0) {}
+      };
+
+      class EventNumberToWordWeightsMap :
+        public google::dense_hash_map<EventNumber,
+                                      EventWordWeights*,
+                                      El::Hash::Numeric<EventNumber> >
+      {
+      public:
+        EventNumberToWordWeightsMap() throw(El::Exception)
+        {
+          set_deleted_key(NUMBER_ZERO);
+          set_empty_key(NUMBER_UNEXISTENT);
+        }
+        
+        ~EventNumberToWordWeightsMap() throw();
+      };
       
       class EventIdToEventNumberMap :
         public google::sparse_hash_map<El::Luid, EventNumber, El::Hash::Luid>
@@ -669,6 +884,16 @@ namespace NewsGate
         DeleteObsoleteMessages(EventManager* state) throw(El::Exception);
       };
 
+      struct WriteSnapshot : public El::Service::CompoundServiceMessage
+      {
+        WriteSnapshot(EventManager* state) throw(El::Exception);
+      };
+
+      struct PublishView : public El::Service::CompoundServiceMessage
+      {
+        PublishView(EventManager* state) throw(El::Exception);
+      };
+
       struct DeleteMessages : public El::Service::CompoundServiceMessage
       {
         DeleteMessages(EventManager* state,
@@ -737,18 +962,46 @@ namespace NewsGate
       time_t msg_core_words_next_preemt_;
       uint64_t merge_blacklist_cleanup_time_;
 
-      LangSet langs_;
+      LangSet langs_; // Modified under both srv_lock_ and status_lock_
       WordToEventNumberMap word_map_;
+
+      typedef std::auto_ptr<MinHashIndex> MinHashIndexPtr;
+      MinHashIndexPtr lsh_index_;
+      
       EventNumberToEventMap events_;
       EventIdToEventNumberMap id_to_number_map_;
       MessageIdToEventNumberMap message_events_;
       EventCardinalities changed_events_;      
-      MergeDenialMap merge_blacklist_;
+      MergeBlacklist merge_blacklist_;
       MessageCoreWordsMap message_core_words_;
+      EventNumberToWordWeightsMap event_word_weights_;
       
       EventNumber last_event_number_;
+      size_t merge_candidates_;
+      size_t merge_overlaps_;
+      uint64_t merge_lag_start_;
+      uint64_t merge_passes_;
+      uint64_t merged_events_;
+      uint64_t merge_pass_time_;
       ACE_Time_Value next_revision_time_;
 
+      struct ReviseBacklogRecord
+      {
+        EventNumber event;
+        uint64_t queued;
+
+        ReviseBacklogRecord(EventNumber event_val, uint64_t queued_val)
+          throw();
+      };
+
+      typedef std::deque<ReviseBacklogRecord> ReviseBacklog;
+
+      // Events selected for revision but not revised yet due to time
+      // budget, in the order selected
+      ReviseBacklog revise_backlog_;
+      EventNumberSet revise_backlog_events_;
+      uint64_t revise_pass_time_;
+
       Message::BankClientSession_var bank_client_session_;
 
       typedef std::auto_ptr<MessageIdToEventInfoMap>
@@ -757,8 +1010,6 @@ namespace NewsGate
       MessageIdToEventInfoMapPtr message_event_updates_;
       ACE_Time_Value next_message_event_update_time_;
 
-      typedef std::vector<EventNumber> EventNumberArray;
-      
       EventNumberArray traverse_event_;
       EventNumberArray::const_iterator traverse_event_it_;
 
@@ -773,6 +1024,39 @@ namespace NewsGate
 
       El::Luid event_load_last_id_;
       Message::Id msg_load_last_id_;
+
+      typedef std::vector<El::Luid> EventIdArray;
+
+      bool snapshot_checked_;
+      LangSet snapshot_langs_; // Languages loaded from snapshot
+      EventIdArray snapshot_reload_ids_;
+
+      typedef __gnu_cxx::hash_map<El::Lang, std::fstream*, El::Hash::Lang>
+      SnapshotJournalMap;
+
+      typedef ACE_Thread_Mutex SnapshotMutex;
+      typedef ACE_Guard<SnapshotMutex> SnapshotGuard;
+
+      SnapshotMutex snapshot_lock_;
+      SnapshotJournalMap snapshot_journals_;
+
+      // Event table changes go there instead of DB, if not 0
+      EventWriteLog* write_log_;
+
+      class EventIdSet :
+        public google::dense_hash_set<El::Luid, El::Hash::Luid>
+      {
+      public:
+        EventIdSet() throw(El::Exception);
+      };
+
+      typedef ACE_Thread_Mutex ViewMutex;
+      typedef ACE_Guard<ViewMutex> ViewGuard;
+
+      mutable ViewMutex view_lock_;
+      EventView_var view_; // 0 till published first time
+      EventIdSet view_changed_events_;
+      
 //      bool cleanup_allowed_;
 //      bool traverse_period_increased_;
 /*
@@ -811,7 +1095,14 @@ namespace NewsGate
           messages(0),
           changed_events(0),
           merge_blacklist_size(0),
-          task_queue_size(0)
+          task_queue_size(0),
+          merge_lag(0),
+          merge_passes(0),
+          merged_events(0),
+          merge_pass_time(0),
+          revise_backlog(0),
+          revise_lag(0),
+          revise_pass_time(0)
     {
     }
 
@@ -824,7 +1115,13 @@ namespace NewsGate
            << "\n  messages: " << messages
            << "\n  merge blacklist size: " << merge_blacklist_size
            << "\n  loaded: " << (loaded ? "yes" : "no")
-           << "\n  tasks: " << task_queue_size;
+           << "\n  tasks: " << task_queue_size
+           << "\n  merge lag: " << merge_lag << " sec"
+           << "\n  merges: " << merged_events << " in " << merge_passes
+           << " passes, last pass " << merge_pass_time << " msec"
+           << "\n  revise backlog: " << revise_backlog << ", lag "
+           << revise_lag << " sec, last pass " << revise_pass_time
+           << " msec";
     }
     
     //
@@ -838,6 +1135,16 @@ namespace NewsGate
       return events_loaded_;
     }
 
+    inline
+    EventView*
+    EventManager::event_view() const throw()
+    {
+      ViewGuard guard(view_lock_);
+      
+      EventView_var view = view_;
+      return view.retn();
+    }
+
     inline
     size_t
     EventManager::event_merge_level(size_t event_size,
@@ -883,6 +1190,30 @@ namespace NewsGate
       return res;
     }
 
+    inline
+    bool
+    EventManager::revise_candidate(const EventObject& event,
+                                   uint64_t expire_time) const throw()
+    {
+      return (event.flags & (EventObject::EF_PUSH_IN_PROGRESS |
+                             EventObject::EF_REVISED)) == 0 &&
+        event.published_min >= expire_time;
+    }
+
+    inline
+    bool
+    EventManager::remake_candidate(const EventObject& event,
+                                   uint64_t recompose_time,
+                                   uint64_t expire_time,
+                                   size_t min_size) const throw()
+    {
+      return event.published_max > recompose_time &&
+        (event.flags & EventObject::EF_REVISED) != 0 &&
+        event.published_min > expire_time &&
+        (event.flags & EventObject::EF_PUSH_IN_PROGRESS) == 0 &&
+        event.messages().size() >= min_size;
+    }
+
     inline
     void
     EventManager::create_event(EventObject& event,
@@ -944,6 +1275,38 @@ namespace NewsGate
     {  
     }
 
+    //
+    // NewsGate::Event::EventManager::WriteSnapshot class
+    //
+    inline
+    EventManager::WriteSnapshot::WriteSnapshot(EventManager* state)
+      throw(El::Exception)
+        : El__Service__CompoundServiceMessageBase(state, state, false),
+          El::Service::CompoundServiceMessage(state, state)
+    {  
+    }
+
+    //
+    // NewsGate::Event::EventManager::PublishView class
+    //
+    inline
+    EventManager::PublishView::PublishView(EventManager* state)
+      throw(El::Exception)
+        : El__Service__CompoundServiceMessageBase(state, state, false),
+          El::Service::CompoundServiceMessage(state, state)
+    {  
+    }
+
+    //
+    // NewsGate::Event::EventManager::EventIdSet class
+    //
+    inline
+    EventManager::EventIdSet::EventIdSet() throw(El::Exception)
+    {
+      set_empty_key(El::Luid::null);
+      set_deleted_key(El::Luid::nonexistent);
+    }
+
     //
     // NewsGate::Event::EventManager::DeleteMessages class
     //
@@ -1221,6 +1584,19 @@ namespace NewsGate
         delete it->second;
       }
     }
+
+    //
+    // EventManager::EventNumberToWordWeightsMap struct
+    //
+    inline
+    EventManager::EventNumberToWordWeightsMap::~EventNumberToWordWeightsMap()
+      throw()
+    {
+      for(iterator it = begin(); it != end(); ++it)
+      {
+        delete it->second;
+      }
+    }
 /*    
     //
     // EventManager::MergeRelOverlapMap struct
@@ -1242,6 +1618,18 @@ namespace NewsGate
       set_deleted_key(HashPair::zero);
     }
     
+    //
+    // EventManager::ReviseBacklogRecord struct
+    //
+  
+    inline
+    EventManager::ReviseBacklogRecord::ReviseBacklogRecord(
+      EventNumber event_val, uint64_t queued_val) throw()
+        : event(event_val),
+          queued(queued_val)
+    {
+    }
+    
     //
     // EventManager::EventInfo struct
     //
@@ -1327,6 +1715,117 @@ namespace NewsGate
     {
     }
 
+    //
+    // EventManager::MergeBlacklist class
+    //
+    inline
+    uint64_t
+    EventManager::MergeBlacklist::generation(uint64_t timeout) const throw()
+    {
+      return timeout / generation_period_;
+    }
+
+    inline
+    uint64_t
+    EventManager::MergeBlacklist::filter_hash(const HashPair& hp) throw()
+    {
+      uint64_t h = (((uint64_t)hp.first()) << 32) ^ hp.second() ^
+        (((uint64_t)El::Hash::Lang()(hp.lang)) << 16);
+
+      // Mixing bits, so all of them depend on each of the pair hashes
+      h ^= h >> 33;
+      h *= 0xFF51AFD7ED558CCDULL;
+      h ^= h >> 33;
+      h *= 0xC4CEB9FE1A85EC53ULL;
+      h ^= h >> 33;
+      
+      return h;
+    }
+    
+    inline
+    bool
+    EventManager::MergeBlacklist::filter_test(const HashPair& hp) const
+      throw()
+    {
+      uint64_t h = filter_hash(hp);
+      uint64_t step = (h >> 32) | 1;
+
+      for(size_t i = 0; i < FILTER_HASHES; ++i, h += step)
+      {
+        uint64_t bit = h & filter_mask_;
+        
+        if((filter_[bit >> 6] & (1ULL << (bit & 63))) == 0)
+        {
+          return false;
+        }
+      }
+
+      return true;
+    }
+
+    inline
+    void
+    EventManager::MergeBlacklist::filter_add(const HashPair& hp) throw()
+    {
+      uint64_t h = filter_hash(hp);
+      uint64_t step = (h >> 32) | 1;
+
+      for(size_t i = 0; i < FILTER_HASHES; ++i, h += step)
+      {
+        uint64_t bit = h & filter_mask_;
+        filter_[bit >> 6] |= 1ULL << (bit & 63);
+      }
+
+      ++filter_pairs_;
+    }
+    
+    inline
+    const EventManager::MergeDenialInfo*
+    EventManager::MergeBlacklist::find(const HashPair& hp) const throw()
+    {
+      if(!filter_test(hp))
+      {
+        return 0;
+      }
+      
+      MergeDenialMap::const_iterator i = denials_.find(hp);
+      return i == denials_.end() ? 0 : &i->second;
+    }
+    
+    inline
+    EventManager::MergeDenialInfo*
+    EventManager::MergeBlacklist::find(const HashPair& hp) throw()
+    {
+      if(!filter_test(hp))
+      {
+        return 0;
+      }
+      
+      MergeDenialMap::iterator i = denials_.find(hp);
+      return i == denials_.end() ? 0 : &i->second;
+    }
+    
+    inline
+    size_t
+    EventManager::MergeBlacklist::size() const throw()
+    {
+      return denials_.size();
+    }
+    
+    inline
+    EventManager::MergeBlacklist::const_iterator
+    EventManager::MergeBlacklist::begin() const throw()
+    {
+      return denials_.begin();
+    }
+    
+    inline
+    EventManager::MergeBlacklist::const_iterator
+    EventManager::MergeBlacklist::end() const throw()
+    {
+      return denials_.end();
+    }
+    
     //
     // EventManager::MergeDenialInfo struct
     //
@@ -0,0 +1,169 @@
+/*
+ * product   : NewsGate - news search WEB server
+ * copyright : Copyright (c) 2005-2016 Karen Arutyunov
+ * licenses  : CC BY-NC-SA 3.0; see accompanying LICENSE file
+ *             Commercial; contact karen.arutyunov@gmail.com
+ */
+
+/**
+ * @file NewsGate/Server/Services/Event/Bank/EventView.cpp
+ * @author Karen Aroutiounov
+ * $Id: $
+ */
+
+#include <El/Exception.hpp>
+
+#include "EventView.hpp"
+
+namespace NewsGate
+{
+  namespace Event
+  {
+    //
+    // EventView class
+    //
+    EventView::EventView() throw(El::Exception)
+        : event_count_(0),
+          message_count_(0)
+    {
+      for(size_t i = 0; i < PARTITIONS; ++i)
+      {
+        event_partitions_[i] = new EventPartition();
+        message_partitions_[i] = new MessagePartition();
+
+        own_event_partitions_[i] = true;
+        own_message_partitions_[i] = true;
+      }
+    }
+
+    EventView::EventView(const EventView& src) throw(El::Exception)
+        : El::RefCount::DefaultImpl<El::Sync::ThreadPolicy>(),
+          event_count_(src.event_count_),
+          message_count_(src.message_count_)
+    {
+      for(size_t i = 0; i < PARTITIONS; ++i)
+      {
+        event_partitions_[i] = src.event_partitions_[i];
+        message_partitions_[i] = src.message_partitions_[i];
+
+        own_event_partitions_[i] = false;
+        own_message_partitions_[i] = false;
+      }
+    }
+
+    EventView::EventMap&
+    EventView::events(size_t index) throw(El::Exception)
+    {
+      if(!own_event_partitions_[index])
+      {
+        event_partitions_[index] =
+          new EventPartition(*event_partitions_[index]);
+
+        own_event_partitions_[index] = true;
+      }
+
+      return event_partitions_[index]->events;
+    }
+
+    EventView::MessageMap&
+    EventView::messages(size_t index) throw(El::Exception)
+    {
+      if(!own_message_partitions_[index])
+      {
+        message_partitions_[index] =
+          new MessagePartition(*message_partitions_[index]);
+
+        own_message_partitions_[index] = true;
+      }
+
+      return message_partitions_[index]->messages;
+    }
+
+    void
+    EventView::set_event(const EventObject& event, bool changed)
+      throw(El::Exception)
+    {
+      EventMap& event_map = events(partition(event.id));
+      EventMap::iterator i = event_map.find(event.id);
+
+      if(i == event_map.end())
+      {
+        i = event_map.insert(std::make_pair(event.id, Event_var())).first;
+        ++event_count_;
+      }
+      else
+      {
+        unreference_messages(i->second->object);
+      }
+
+      i->second = new Event(event, changed);
+
+      const MessageInfoArray& event_messages = event.messages();
+
+      for(MessageInfoArray::const_iterator j(event_messages.begin()),
+            e(event_messages.end()); j != e; ++j)
+      {
+        MessageMap& message_map = messages(partition(j->id));
+        MessageMap::iterator mit = message_map.find(j->id);
+
+        if(mit == message_map.end())
+        {
+          message_map.insert(std::make_pair(j->id, event.id));
+          ++message_count_;
+        }
+        else
+        {
+          // Message can come from other event not updated in view yet
+          mit->second = event.id;
+        }
+      }
+    }
+
+    void
+    EventView::remove_event(const El::Luid& id) throw(El::Exception)
+    {
+      size_t p = partition(id);
+
+      if(event_partitions_[p]->events.find(id) ==
+         event_partitions_[p]->events.end())
+      {
+        return;
+      }
+
+      EventMap& event_map = events(p);
+      EventMap::iterator i = event_map.find(id);
+
+      unreference_messages(i->second->object);
+
+      event_map.erase(i);
+      --event_count_;
+    }
+
+    void
+    EventView::unreference_messages(const EventObject& event)
+      throw(El::Exception)
+    {
+      const MessageInfoArray& event_messages = event.messages();
+
+      for(MessageInfoArray::const_iterator i(event_messages.begin()),
+            e(event_messages.end()); i != e; ++i)
+      {
+        size_t p = partition(i->id);
+        const MessageMap& current = message_partitions_[p]->messages;
+
+        MessageMap::const_iterator cit = current.find(i->id);
+
+        // Message could already be moved to other event
+        if(cit == current.end() || cit->second != event.id)
+        {
+          continue;
+        }
+
+        MessageMap& message_map = messages(p);
+        message_map.erase(i->id);
+
+        --message_count_;
+      }
+    }
+  }
+}
@@ -0,0 +1,269 @@
+/*
+ * product   : NewsGate - news search WEB server
+ * copyright : Copyright (c) 2005-2016 Karen Arutyunov
+ * licenses  : CC BY-NC-SA 3.0; see accompanying LICENSE file
+ *             Commercial; contact karen.arutyunov@gmail.com
+ */
+
+/**
+ * @file NewsGate/Server/Services/Event/Bank/EventView.hpp
+ * @author Karen Aroutiounov
+ * $Id: $
+ */
+
+#ifndef _NEWSGATE_SERVER_SERVICES_EVENT_BANK_EVENTVIEW_HPP_
+#define _NEWSGATE_SERVER_SERVICES_EVENT_BANK_EVENTVIEW_HPP_
+
+#include <stdint.h>
+
+#include <google/dense_hash_map>
+
+#include <El/Exception.hpp>
+#include <El/Luid.hpp>
+#include <El/Hash/Hash.hpp>
+#include <El/RefCount/All.hpp>
+
+#include <Commons/Message/Message.hpp>
+#include <Commons/Event/Event.hpp>
+
+namespace NewsGate
+{
+  namespace Event
+  {
+    //
+    // Immutable view of events published by event manager, so lookups
+    // do not wait for its lock. View is split into partitions by event
+    // and message ids. View copy shares partitions with the original, so
+    // on modification only the partitions changed get copied.
+    //
+    class EventView :
+      public virtual El::RefCount::DefaultImpl<El::Sync::ThreadPolicy>
+    {
+    public:
+      EL_EXCEPTION(Exception, El::ExceptionBase);
+
+      struct Event :
+        public virtual El::RefCount::DefaultImpl<El::Sync::ThreadPolicy>
+      {
+        EventObject object;
+        bool changed;
+
+        Event(const EventObject& object_val, bool changed_val)
+          throw(El::Exception);
+
+        virtual ~Event() throw() {}
+      };
+
+      typedef El::RefCount::SmartPtr<Event> Event_var;
+
+      EventView() throw(El::Exception);
+      EventView(const EventView& src) throw(El::Exception);
+
+      virtual ~EventView() throw() {}
+
+      const Event* find_event(const El::Luid& id) const throw();
+
+      const Event* find_message_event(const Message::Id& id) const
+        throw();
+
+      size_t event_count() const throw();
+      size_t message_count() const throw();
+
+      //
+      // Modifiers are for a view not published yet
+      //
+      void set_event(const EventObject& event, bool changed)
+        throw(El::Exception);
+
+      void remove_event(const El::Luid& id) throw(El::Exception);
+
+    private:
+
+      enum { PARTITIONS = 256 };
+
+      class EventMap :
+        public google::dense_hash_map<El::Luid, Event_var, El::Hash::Luid>
+      {
+      public:
+        EventMap() throw(El::Exception);
+      };
+
+      class MessageMap :
+        public google::dense_hash_map<Message::Id,
+                                      El::Luid,
+                                      Message::MessageIdHash>
+      {
+      public:
+        MessageMap() throw(El::Exception);
+      };
+
+      struct EventPartition :
+        public virtual El::RefCount::DefaultImpl<El::Sync::ThreadPolicy>
+      {
+        EventMap events;
+
+        EventPartition() throw(El::Exception) {}
+        EventPartition(const EventPartition& src) throw(El::Exception);
+
+        virtual ~EventPartition() throw() {}
+      };
+
+      typedef El::RefCount::SmartPtr<EventPartition> EventPartition_var;
+
+      struct MessagePartition :
+        public virtual El::RefCount::DefaultImpl<El::Sync::ThreadPolicy>
+      {
+        MessageMap messages;
+
+        MessagePartition() throw(El::Exception) {}
+        MessagePartition(const MessagePartition& src) throw(El::Exception);
+
+        virtual ~MessagePartition() throw() {}
+      };
+
+      typedef El::RefCount::SmartPtr<MessagePartition> MessagePartition_var;
+
+      static size_t partition(const El::Luid& id) throw();
+      static size_t partition(const Message::Id& id) throw();
+
+      EventMap& events(size_t index) throw(El::Exception);
+      MessageMap& messages(size_t index) throw(El::Exception);
+
+      void unreference_messages(const EventObject& event)
+        throw(El::Exception);
+
+    private:
+
+      EventPartition_var event_partitions_[PARTITIONS];
+      MessagePartition_var message_partitions_[PARTITIONS];
+
+      // Partitions copied for this view, so can be modified
+      bool own_event_partitions_[PARTITIONS];
+      bool own_message_partitions_[PARTITIONS];
+
+      size_t event_count_;
+      size_t message_count_;
+
+    private:
+      void operator=(const EventView&);
+    };
+
+    typedef El::RefCount::SmartPtr<EventView> EventView_var;
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Inlines
+///////////////////////////////////////////////////////////////////////////////
+
+namespace NewsGate
+{
+  namespace Event
+  {
+    //
+    // EventView::Event struct
+    //
+    inline
+    EventView::Event::Event(const EventObject& object_val, bool changed_val)
+      throw(El::Exception)
+        : object(object_val),
+          changed(changed_val)
+    {
+    }
+
+    //
+    // EventView::EventMap class
+    //
+    inline
+    EventView::EventMap::EventMap() throw(El::Exception)
+    {
+      set_empty_key(El::Luid::null);
+      set_deleted_key(El::Luid::nonexistent);
+    }
+
+    //
+    // EventView::MessageMap class
+    //
+    inline
+    EventView::MessageMap::MessageMap() throw(El::Exception)
+    {
+      set_empty_key(Message::Id::nonexistent);
+      set_deleted_key(Message::Id::zero);
+    }
+
+    //
+    // EventView::EventPartition struct
+    //
+    inline
+    EventView::EventPartition::EventPartition(const EventPartition& src)
+      throw(El::Exception)
+        : El::RefCount::DefaultImpl<El::Sync::ThreadPolicy>(),
+          events(src.events)
+    {
+    }
+
+    //
+    // EventView::MessagePartition struct
+    //
+    inline
+    EventView::MessagePartition::MessagePartition(
+      const MessagePartition& src) throw(El::Exception)
+        : El::RefCount::DefaultImpl<El::Sync::ThreadPolicy>(),
+          messages(src.messages)
+    {
+    }
+
+    //
+    // EventView class
+    //
+    inline
+    size_t
+    EventView::partition(const El::Luid& id) throw()
+    {
+      return El::Hash::Luid()(id) % PARTITIONS;
+    }
+
+    inline
+    size_t
+    EventView::partition(const Message::Id& id) throw()
+    {
+      return Message::MessageIdHash()(id) % PARTITIONS;
+    }
+
+    inline
+    const EventView::Event*
+    EventView::find_event(const El::Luid& id) const throw()
+    {
+      const EventMap& events = event_partitions_[partition(id)]->events;
+      EventMap::const_iterator i = events.find(id);
+      return i == events.end() ? 0 : i->second.in();
+    }
+
+    inline
+    const EventView::Event*
+    EventView::find_message_event(const Message::Id& id) const throw()
+    {
+      const MessageMap& messages =
+        message_partitions_[partition(id)]->messages;
+
+      MessageMap::const_iterator i = messages.find(id);
+      return i == messages.end() ? 0 : find_event(i->second);
+    }
+
+    inline
+    size_t
+    EventView::event_count() const throw()
+    {
+      return event_count_;
+    }
+
+    inline
+    size_t
+    EventView::message_count() const throw()
+    {
+      return message_count_;
+    }
+  }
+}
+
+#endif // _NEWSGATE_SERVER_SERVICES_EVENT_BANK_EVENTVIEW_HPP_
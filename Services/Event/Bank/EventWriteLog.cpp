@@ -0,0 +1,435 @@
+/*
+ * product   : NewsGate - news search WEB server
+ * copyright : Copyright (c) 2005-2016 Karen Arutyunov
+ * licenses  : CC BY-NC-SA 3.0; see accompanying LICENSE file
+ *             Commercial; contact karen.arutyunov@gmail.com
+ */
+
+/**
+ * @file NewsGate/Server/Services/Event/Bank/EventWriteLog.cpp
+ * @author Karen Aroutiounov
+ * $Id: $
+ */
+
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <vector>
+
+#include <ace/OS.h>
+
+#include <El/Exception.hpp>
+#include <El/BinaryStream.hpp>
+#include <El/MySQL/DB.hpp>
+
+#include "BankMain.hpp"
+#include "EventManager.hpp"
+#include "EventWriteLog.hpp"
+
+namespace NewsGate
+{
+  namespace Event
+  {
+    //
+    // EventWriteLog class
+    //
+    EventWriteLog::EventWriteLog(const char* filename)
+      throw(Exception, El::Exception)
+        : filename_(filename),
+          fd_(-1)
+    {
+      std::fstream file(filename, std::ios::in);
+
+      if(file.is_open())
+      {
+        El::BinaryInStream bstr(file);
+
+        try
+        {
+          // Reading till the end of file or a record truncated by crash
+          while(true)
+          {
+            El::Luid id;
+            uint32_t len = 0;
+
+            bstr >> id >> len;
+
+            std::vector<unsigned char> line(len);
+
+            if(len)
+            {
+              bstr.read_raw_bytes(&line[0], len);
+            }
+
+            changes_[id].assign(line.begin(), line.end());
+          }
+        }
+        catch(const El::Exception&)
+        {
+        }
+
+        file.close();
+      }
+
+      // Rewriting the file, so no truncated record remains in the middle
+      compact();
+    }
+
+    EventWriteLog::~EventWriteLog() throw()
+    {
+      if(fd_ >= 0)
+      {
+        ::close(fd_);
+      }
+    }
+
+    void
+    EventWriteLog::log(const El::Luid& id, const std::string& line)
+      throw(Exception, El::Exception)
+    {
+      Guard guard(lock_);
+
+      El::BinaryOutStream bstr(file_);
+      bstr << id << (uint32_t)line.length();
+
+      if(!line.empty())
+      {
+        bstr.write_raw_bytes((const unsigned char*)line.c_str(),
+                             line.length());
+      }
+
+      if(file_.fail())
+      {
+        std::ostringstream ostr;
+        ostr << "NewsGate::Event::EventWriteLog::log: "
+          "failed to write into file '" << filename_ << "'";
+
+        throw Exception(ostr.str());
+      }
+
+      changes_[id] = line;
+    }
+
+    void
+    EventWriteLog::commit() throw(Exception, El::Exception)
+    {
+      Guard guard(lock_);
+
+      if(!file_.fail())
+      {
+        file_.flush();
+      }
+
+      if(file_.fail())
+      {
+        std::ostringstream ostr;
+        ostr << "NewsGate::Event::EventWriteLog::commit: "
+          "failed to write into file '" << filename_ << "'";
+
+        throw Exception(ostr.str());
+      }
+
+      sync(fd_, filename_.c_str());
+    }
+
+    size_t
+    EventWriteLog::apply() throw(Exception, El::Exception)
+    {
+      Guard apply_guard(apply_lock_);
+
+      ChangeMap changes;
+
+      {
+        Guard guard(lock_);
+        changes.swap(changes_);
+      }
+
+      if(changes.empty())
+      {
+        return 0;
+      }
+
+      try
+      {
+        write_to_db(changes);
+      }
+      catch(...)
+      {
+        Guard guard(lock_);
+
+        // Changes are still in the file, so just getting back ones not
+        // superseded while writing
+        for(ChangeMap::const_iterator i(changes.begin()), e(changes.end());
+            i != e; ++i)
+        {
+          changes_.insert(*i);
+        }
+
+        throw;
+      }
+
+      Guard guard(lock_);
+      compact();
+
+      return changes.size();
+    }
+
+    void
+    EventWriteLog::compact() throw(Exception, El::Exception)
+    {
+      std::string tmp_filename = filename_ + ".tmp";
+
+      if(file_.is_open())
+      {
+        file_.close();
+      }
+
+      if(fd_ >= 0)
+      {
+        ::close(fd_);
+        fd_ = -1;
+      }
+
+      // Closed stream can stay failed after unsuccessful write
+      file_.clear();
+
+      {
+        std::fstream file(tmp_filename.c_str(), std::ios::out);
+
+        if(!file.is_open())
+        {
+          std::ostringstream ostr;
+          ostr << "NewsGate::Event::EventWriteLog::compact: "
+            "failed to open file '" << tmp_filename << "' for write access";
+
+          throw Exception(ostr.str());
+        }
+
+        El::BinaryOutStream bstr(file);
+
+        for(ChangeMap::const_iterator i(changes_.begin()), e(changes_.end());
+            i != e; ++i)
+        {
+          const std::string& line = i->second;
+          bstr << i->first << (uint32_t)line.length();
+
+          if(!line.empty())
+          {
+            bstr.write_raw_bytes((const unsigned char*)line.c_str(),
+                                 line.length());
+          }
+        }
+
+        if(!file.fail())
+        {
+          file.flush();
+        }
+
+        if(file.fail())
+        {
+          unlink(tmp_filename.c_str());
+
+          std::ostringstream ostr;
+          ostr << "NewsGate::Event::EventWriteLog::compact: "
+            "failed to write into file '" << tmp_filename << "'";
+
+          throw Exception(ostr.str());
+        }
+      }
+
+      try
+      {
+        sync(tmp_filename.c_str());
+      }
+      catch(...)
+      {
+        unlink(tmp_filename.c_str());
+        throw;
+      }
+
+      if(rename(tmp_filename.c_str(), filename_.c_str()) < 0)
+      {
+        int error = ACE_OS::last_error();
+        unlink(tmp_filename.c_str());
+
+        std::ostringstream ostr;
+        ostr << "NewsGate::Event::EventWriteLog::compact: failed to rename '"
+             << tmp_filename << "' to '" << filename_ << "'. Error code "
+             << error << ". Description:\n" << ACE_OS::strerror(error);
+
+        throw Exception(ostr.str());
+      }
+
+      // Syncing directory, so the rename survives host crash
+      
+      std::string::size_type pos = filename_.rfind('/');
+      
+      sync(pos == std::string::npos ? "." :
+           (pos ? filename_.substr(0, pos).c_str() : "/"));
+
+      file_.open(filename_.c_str(), std::ios::out | std::ios::app);
+
+      if(!file_.is_open())
+      {
+        std::ostringstream ostr;
+        ostr << "NewsGate::Event::EventWriteLog::compact: "
+          "failed to open file '" << filename_ << "' for write access";
+
+        throw Exception(ostr.str());
+      }
+
+      fd_ = ::open(filename_.c_str(), O_RDONLY);
+
+      if(fd_ < 0)
+      {
+        int error = ACE_OS::last_error();
+        
+        std::ostringstream ostr;
+        ostr << "NewsGate::Event::EventWriteLog::compact: failed to open '"
+             << filename_ << "' for sync. Error code " << error
+             << ". Description:\n" << ACE_OS::strerror(error);
+
+        throw Exception(ostr.str());
+      }
+    }
+
+    void
+    EventWriteLog::sync(const char* filename) throw(Exception, El::Exception)
+    {
+      int fd = ::open(filename, O_RDONLY);
+
+      if(fd < 0)
+      {
+        int error = ACE_OS::last_error();
+        
+        std::ostringstream ostr;
+        ostr << "NewsGate::Event::EventWriteLog::sync: failed to open '"
+             << filename << "'. Error code " << error << ". Description:\n"
+             << ACE_OS::strerror(error);
+
+        throw Exception(ostr.str());
+      }
+
+      try
+      {
+        sync(fd, filename);
+      }
+      catch(...)
+      {
+        ::close(fd);
+        throw;
+      }
+
+      ::close(fd);
+    }
+
+    void
+    EventWriteLog::sync(int fd, const char* filename)
+      throw(Exception, El::Exception)
+    {
+      if(fd < 0 || ::fsync(fd) < 0)
+      {
+        int error = fd < 0 ? EBADF : ACE_OS::last_error();
+        
+        std::ostringstream ostr;
+        ostr << "NewsGate::Event::EventWriteLog::sync: failed to sync '"
+             << filename << "'. Error code " << error << ". Description:\n"
+             << ACE_OS::strerror(error);
+
+        throw Exception(ostr.str());
+      }
+    }
+
+    void
+    EventWriteLog::write_to_db(const ChangeMap& changes)
+      throw(Exception, El::Exception)
+    {
+      std::string cache_filename = filename_ + ".ld";
+      std::ostringstream remove_query;
+
+      bool first_line = true;
+      bool first_removal = true;
+
+      std::fstream file(cache_filename.c_str(), std::ios::out);
+
+      if(!file.is_open())
+      {
+        std::ostringstream ostr;
+        ostr << "NewsGate::Event::EventWriteLog::write_to_db: "
+          "failed to open file '" << cache_filename << "' for write access";
+
+        throw Exception(ostr.str());
+      }
+
+      try
+      {
+        for(ChangeMap::const_iterator i(changes.begin()), e(changes.end());
+            i != e; ++i)
+        {
+          const std::string& line = i->second;
+
+          if(line.empty())
+          {
+            remove_query << (first_removal ?
+                             "delete from Event where event_id in ( " : ", ")
+                         << i->first.data;
+
+            first_removal = false;
+            continue;
+          }
+
+          if(!first_line)
+          {
+            file << std::endl;
+          }
+
+          file.write(line.c_str(), line.length());
+          first_line = false;
+        }
+
+        if(!file.fail())
+        {
+          file.flush();
+        }
+
+        if(file.fail())
+        {
+          std::ostringstream ostr;
+          ostr << "NewsGate::Event::EventWriteLog::write_to_db: "
+            "failed to write into file '" << cache_filename << "'";
+
+          throw Exception(ostr.str());
+        }
+
+        file.close();
+
+        if(!first_line)
+        {
+          EventManager::write_events_to_db(cache_filename.c_str());
+        }
+      }
+      catch(...)
+      {
+        unlink(cache_filename.c_str());
+        throw;
+      }
+
+      unlink(cache_filename.c_str());
+
+      if(!first_removal)
+      {
+        remove_query << " )";
+
+        El::MySQL::Connection_var connection =
+          Application::instance()->dbase()->connect();
+
+        El::MySQL::Result_var result =
+          connection->query(remove_query.str().c_str());
+      }
+    }
+  }
+}
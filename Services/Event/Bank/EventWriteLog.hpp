@@ -0,0 +1,152 @@
+/*
+ * product   : NewsGate - news search WEB server
+ * copyright : Copyright (c) 2005-2016 Karen Arutyunov
+ * licenses  : CC BY-NC-SA 3.0; see accompanying LICENSE file
+ *             Commercial; contact karen.arutyunov@gmail.com
+ */
+
+/**
+ * @file NewsGate/Server/Services/Event/Bank/EventWriteLog.hpp
+ * @author Karen Aroutiounov
+ * $Id: $
+ */
+
+#ifndef _NEWSGATE_SERVER_SERVICES_EVENT_BANK_EVENTWRITELOG_HPP_
+#define _NEWSGATE_SERVER_SERVICES_EVENT_BANK_EVENTWRITELOG_HPP_
+
+#include <string>
+#include <fstream>
+
+#include <ext/hash_map>
+
+#include <ace/Synch.h>
+#include <ace/Guard_T.h>
+
+#include <El/Exception.hpp>
+#include <El/Luid.hpp>
+#include <El/Hash/Hash.hpp>
+
+namespace NewsGate
+{
+  namespace Event
+  {
+    //
+    // Write-ahead log of Event table changes. Changes are appended to a
+    // local file and so are acknowledged without waiting for DB, which is
+    // updated by apply calls. Changes are coalesced per event, so only
+    // the last one gets to DB. Changes left in the file by a crash (of
+    // the process or the host, as commit and compaction sync the file to
+    // disk) are read on construction and so are applied by the first apply
+    // call.
+    //
+    class EventWriteLog
+    {
+    public:
+      EL_EXCEPTION(Exception, El::ExceptionBase);
+
+      EventWriteLog(const char* filename) throw(Exception, El::Exception);
+      ~EventWriteLog() throw();
+
+      //
+      // Logs event saving; line is the one for EventBuff table loading as
+      // produced by EventManager::write_event_line
+      //
+      void save(const El::Luid& id, const std::string& line)
+        throw(Exception, El::Exception);
+
+      void remove(const El::Luid& id) throw(Exception, El::Exception);
+
+      //
+      // Flushes changes logged by save and remove calls to the file and
+      // syncs it to disk
+      //
+      void commit() throw(Exception, El::Exception);
+
+      //
+      // Writes changes to DB and drops them from the file. Returns the
+      // number of events written. If fails, changes are kept for the
+      // next call unless superseded by newer ones.
+      //
+      size_t apply() throw(Exception, El::Exception);
+
+      size_t pending() const throw();
+
+    private:
+
+      // Empty line means event removal
+      typedef __gnu_cxx::hash_map<El::Luid, std::string, El::Hash::Luid>
+      ChangeMap;
+
+      void log(const El::Luid& id, const std::string& line)
+        throw(Exception, El::Exception);
+
+      void compact() throw(Exception, El::Exception);
+
+      void write_to_db(const ChangeMap& changes)
+        throw(Exception, El::Exception);
+
+      //
+      // Opens file or directory read-only and syncs it to disk
+      //
+      static void sync(const char* filename) throw(Exception, El::Exception);
+
+      static void sync(int fd, const char* filename)
+        throw(Exception, El::Exception);
+
+    private:
+
+      typedef ACE_Thread_Mutex Mutex;
+      typedef ACE_Guard<Mutex> Guard;
+
+      mutable Mutex lock_;
+      Mutex apply_lock_;
+
+      std::string filename_;
+      std::fstream file_;
+      int fd_; // Same file opened for sync as std::fstream gives no fd
+      ChangeMap changes_;
+
+    private:
+      EventWriteLog(const EventWriteLog&);
+      void operator=(const EventWriteLog&);
+    };
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Inlines
+///////////////////////////////////////////////////////////////////////////////
+
+namespace NewsGate
+{
+  namespace Event
+  {
+    //
+    // EventWriteLog class
+    //
+    inline
+    void
+    EventWriteLog::save(const El::Luid& id, const std::string& line)
+      throw(Exception, El::Exception)
+    {
+      log(id, line);
+    }
+
+    inline
+    void
+    EventWriteLog::remove(const El::Luid& id) throw(Exception, El::Exception)
+    {
+      log(id, std::string());
+    }
+
+    inline
+    size_t
+    EventWriteLog::pending() const throw()
+    {
+      Guard guard(lock_);
+      return changes_.size();
+    }
+  }
+}
+
+#endif // _NEWSGATE_SERVER_SERVICES_EVENT_BANK_EVENTWRITELOG_HPP_
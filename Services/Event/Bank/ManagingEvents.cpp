@@ -20,8 +20,10 @@
 #include <vector>
 
 #include <ace/OS.h>
+#include <ace/High_Res_Timer.h>
 
 #include <El/Exception.hpp>
+#include <El/Moment.hpp>
 
 #include <Commons/Event/TransportImpl.hpp>
 
@@ -60,6 +62,11 @@ namespace NewsGate
       session->_add_ref();
       session_ = session;
 
+      // Created even if not used to apply changes left by previous run
+      write_log_.reset(
+        new EventWriteLog(
+          (config_.event_manager().cache_file() + ".wal").c_str()));
+
       create_managers();
       
       El::Service::CompoundServiceMessage_var msg = new ReportPresence(this);
@@ -69,6 +76,12 @@ namespace NewsGate
 
       msg = new Monitoring(this);
       deliver_now(msg.in());
+
+      if(config_.event_manager().event_cache().write_log_period())
+      {
+        msg = new ApplyWriteLog(this);
+        deliver_now(msg.in());
+      }
     }
     
     ManagingEvents::~ManagingEvents() throw()
@@ -100,7 +113,8 @@ namespace NewsGate
                              this,
                              false,
                              false,
-                             config_.event_manager());
+                             config_.event_manager(),
+                             manager_write_log());
 
           event_manager->add_lang(lang);
           event_manager_langs_.insert(lang);
@@ -145,6 +159,9 @@ namespace NewsGate
       
       EventManager::EventCardinalities changed_events;
       EventManager::MergeDenialMap merge_blacklist;
+
+      // Events are counted and loaded from DB, so it should be up to date
+      write_log_->apply();
       
       std::string cache_filename = config_.event_manager().cache_file() +
         ".chn";
@@ -243,7 +260,8 @@ namespace NewsGate
                            this,
                            true,
                            all_events_changed,
-                           config_.event_manager());
+                           config_.event_manager(),
+                           manager_write_log());
 
         ostr << std::endl;
         const EventManager::LangSet& langs = it->first;
@@ -299,7 +317,7 @@ namespace NewsGate
       return res;
     }
     
-    void
+    bool
     ManagingEvents::destroy_managers() throw(Exception, El::Exception)
     {
       EventManager::EventCardinalities changed_events;
@@ -311,7 +329,7 @@ namespace NewsGate
         
         if(!ready_)
         {
-          return;
+          return true;
         }
         
         ready_ = false;
@@ -339,6 +357,25 @@ namespace NewsGate
         event_managers_.clear();
         event_manager_langs_.clear();
       }
+
+      bool applied = true;
+      
+      try
+      {
+        write_log_->apply();
+      }
+      catch(const El::Exception& e)
+      {
+        applied = false;
+        
+        std::ostringstream ostr;
+        ostr << "NewsGate::Event::ManagingEvents::destroy_managers: "
+          "changes left in write log. El::Exception caught. Description:"
+             << std::endl << e;
+        
+        El::Service::Error error(ostr.str(), this);
+        callback_->notify(&error);
+      }
       
       std::string cache_filename = config_.event_manager().cache_file() +
         ".chn";
@@ -366,6 +403,8 @@ namespace NewsGate
         unlink(cache_filename.c_str());
         throw;
       }
+
+      return applied;
     }
     
     void
@@ -724,6 +763,12 @@ namespace NewsGate
             it != managers.end(); it++)
         {
           EventManager_var manager = *it;
+
+          if(!manager->serves(langs))
+          {
+            // Not to wait for a manager busy with other languages
+            continue;
+          }
           
           if(do_log)
           {
@@ -841,6 +886,11 @@ namespace NewsGate
             it != managers.end(); it++)
         {
           EventManager_var manager = *it;
+
+          if(!manager->serves(langs))
+          {
+            continue;
+          }
           
           if(do_log)
           {
@@ -1029,21 +1079,134 @@ namespace NewsGate
       
       if(count < event_count_threshold)
       {
-        El::Service::CompoundServiceMessage_var msg =
-          new RecreateManagers(event_count_threshold, this);
+        schedule_recreate_managers(event_count_threshold);
+        return;
+      }
+
+      // New managers load events from Event table, so it should be up to
+      // date; recreation is postponed while write log can't be applied
+      
+      try
+      {
+        write_log_->apply();
+      }
+      catch(const El::Exception& e)
+      {
+        std::ostringstream ostr;
+        ostr << "NewsGate::Event::ManagingEvents::recreate_managers: "
+          "recreation postponed as failed to apply write log. "
+          "El::Exception caught. Description:" << std::endl << e;
         
-        deliver_at_time(
-          msg.in(),
-          ACE_OS::gettimeofday() +
-          ACE_Time_Value(config_.recreate_managers().check_period()));
+        El::Service::Error error(ostr.str(), this);
+        callback_->notify(&error);
 
+        schedule_recreate_managers(event_count_threshold);
         return;
       }
 
-      destroy_managers();
-      create_managers();
+      // Changes logged while destroying still can fail to be applied;
+      // managers are created by later attempt then (managers being
+      // absent threshold 0 passes right away)
+      
+      if(destroy_managers())
+      {
+        try
+        {
+          create_managers();
+          return;
+        }
+        catch(const El::Exception& e)
+        {
+          std::ostringstream ostr;
+          ostr << "NewsGate::Event::ManagingEvents::recreate_managers: "
+            "failed to create managers. El::Exception caught. Description:"
+               << std::endl << e;
+        
+          El::Service::Error error(ostr.str(), this);
+          callback_->notify(&error);
+        }
+      }
+
+      schedule_recreate_managers(0);
+    }
+
+    void
+    ManagingEvents::schedule_recreate_managers(size_t event_count_threshold)
+      throw(El::Exception)
+    {
+      El::Service::CompoundServiceMessage_var msg =
+        new RecreateManagers(event_count_threshold, this);
+        
+      deliver_at_time(
+        msg.in(),
+        ACE_OS::gettimeofday() +
+        ACE_Time_Value(config_.recreate_managers().check_period()));
     }
     
+    void
+    ManagingEvents::apply_write_log() throw()
+    {
+      if(!started())
+      {
+        return;
+      }
+
+      try
+      {
+        ACE_High_Res_Timer timer;
+        timer.start();
+        
+        size_t applied = write_log_->apply();
+
+        timer.stop();
+        
+        if(applied && Application::will_trace(El::Logging::HIGH))
+        {
+          ACE_Time_Value time;
+          timer.elapsed_time(time);
+          
+          std::ostringstream ostr;
+          ostr << "ManagingEvents::apply_write_log: " << applied
+               << " events written to DB for " << El::Moment::time(time)
+               << "; " << write_log_->pending() << " pending";
+      
+          Application::logger()->trace(ostr.str(),
+                                       Aspect::STATE,
+                                       El::Logging::HIGH);
+        }
+      }
+      catch(const El::Exception& e)
+      {
+        std::ostringstream ostr;
+        ostr << "NewsGate::Event::ManagingEvents::apply_write_log: "
+          "El::Exception caught. Description:" << std::endl << e;
+        
+        El::Service::Error error(ostr.str(), this);
+        callback_->notify(&error);
+      }
+
+      try
+      {
+        El::Service::CompoundServiceMessage_var msg = new ApplyWriteLog(this);
+
+        deliver_at_time(
+          msg.in(),
+          ACE_OS::gettimeofday() +
+          ACE_Time_Value(
+            config_.event_manager().event_cache().write_log_period()));
+      }
+      catch(const El::Exception& e)
+      {
+        std::ostringstream ostr;
+        ostr << "NewsGate::Event::ManagingEvents::apply_write_log: "
+          "El::Exception caught while scheduling task. Description:"
+             << std::endl << e;
+        
+        El::Service::Error error(ostr.str(), this);
+        callback_->notify(&error);
+      }
+    }
+
     bool
     ManagingEvents::notify(El::Service::Event* event) throw(El::Exception)
     {
@@ -1072,6 +1235,12 @@ namespace NewsGate
         return true;
       }
 
+      if(dynamic_cast<const ApplyWriteLog*>(event) != 0)
+      {
+        apply_write_log();
+        return true;
+      }
+
       std::ostringstream ostr;
       ostr << "NewsGate::Event::ManagingEvents::notify: unknown " << *event;
       
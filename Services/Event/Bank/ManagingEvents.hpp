@@ -30,6 +30,7 @@
 
 #include "SubService.hpp"
 #include "EventManager.hpp"
+#include "EventWriteLog.hpp"
 
 namespace NewsGate
 {
@@ -87,7 +88,10 @@ namespace NewsGate
     private:
 
       void create_managers() throw(Exception, El::Exception);
-      void destroy_managers() throw(Exception, El::Exception);
+
+      // Returns false if changes are left in write log, so Event table is
+      // not up to date for managers to be created
+      bool destroy_managers() throw(Exception, El::Exception);
       
       bool ready() const throw();
       size_t event_count() const throw(El::Exception);
@@ -101,6 +105,14 @@ namespace NewsGate
       
       void recreate_managers(size_t event_count_threshold)
         throw(El::Exception);
+
+      void schedule_recreate_managers(size_t event_count_threshold)
+        throw(El::Exception);
+
+      void apply_write_log() throw();
+
+      // Write log for event managers; 0 if they are to write DB directly
+      EventWriteLog* manager_write_log() const throw();
       
       typedef std::vector<EventManager_var> EventManagerArray;
       
@@ -136,6 +148,11 @@ namespace NewsGate
                          ManagingEvents* state) throw(El::Exception);
       };
 
+      struct ApplyWriteLog : public El::Service::CompoundServiceMessage
+      {
+        ApplyWriteLog(ManagingEvents* state) throw(El::Exception);
+      };
+
       EventManagerArray event_managers_;
       EventManager::LangSet event_manager_langs_;
       
@@ -147,6 +164,7 @@ namespace NewsGate
       
       bool ready_;
       const Server::Config::EventBankType& config_;
+      std::auto_ptr<EventWriteLog> write_log_;
     };
     
   }
@@ -172,6 +190,14 @@ namespace NewsGate
       return event_managers_;
     }
  
+    inline
+    EventWriteLog*
+    ManagingEvents::manager_write_log() const throw()
+    {
+      return config_.event_manager().event_cache().write_log_period() ?
+        write_log_.get() : 0;
+    }
+ 
     //
     // ManagingEvents::ReportPresence class
     //
@@ -219,6 +245,17 @@ namespace NewsGate
           event_count_threshold(event_count_threshold_val)
     {
     }
+
+    //
+    // ManagingEvents::ApplyWriteLog class
+    //
+    inline
+    ManagingEvents::ApplyWriteLog::ApplyWriteLog(
+      ManagingEvents* state) throw(El::Exception)
+        : El__Service__CompoundServiceMessageBase(state, state, false),
+          El::Service::CompoundServiceMessage(state, state)
+    {
+    }
   }
 }
 
@@ -0,0 +1,184 @@
+/*
+ * product   : NewsGate - news search WEB server
+ * copyright : Copyright (c) 2005-2016 Karen Arutyunov
+ * licenses  : CC BY-NC-SA 3.0; see accompanying LICENSE file
+ *             Commercial; contact karen.arutyunov@gmail.com
+ */
+
+/**
+ * @file NewsGate/Server/Services/Event/Bank/MinHashIndex.cpp
+ * @author Karen Aroutiounov
+ * $Id: $
+ */
+
+#include "MinHashIndex.hpp"
+
+namespace NewsGate
+{
+  namespace Event
+  {
+    //
+    // MinHashIndex class
+    //
+    MinHashIndex::MinHashIndex(size_t bands, size_t rows)
+      throw(El::Exception)
+        : bands_(bands),
+          rows_(rows ? rows : 1)
+    {
+      seeds_.resize(bands_ * rows_);
+
+      uint64_t seed = 0x9E3779B97F4A7C15ULL;
+      
+      for(KeyArray::iterator i(seeds_.begin()), e(seeds_.end()); i != e;
+          ++i)
+      {
+        seed += 0x9E3779B97F4A7C15ULL;
+        *i = mix(seed);
+      }
+    }
+
+    MinHashIndex::~MinHashIndex() throw()
+    {
+    }
+    
+    void
+    MinHashIndex::band_keys(const EventWordWeightArray& words,
+                            KeyArray& keys) const
+      throw(El::Exception)
+    {
+      keys.clear();
+
+      if(words.empty())
+      {
+        return;
+      }
+
+      keys.reserve(bands_);
+      
+      for(size_t band = 0; band < bands_; ++band)
+      {
+        uint64_t key = band + 1;
+        
+        for(size_t row = 0; row < rows_; ++row)
+        {
+          uint64_t seed = seeds_[band * rows_ + row];
+          uint64_t min_hash = UINT64_MAX;
+
+          for(EventWordWeightArray::const_iterator i(words.begin()),
+                e(words.end()); i != e; ++i)
+          {
+            uint64_t hash = mix(seed ^ i->word_id);
+
+            if(hash < min_hash)
+            {
+              min_hash = hash;
+            }
+          }
+
+          key = mix(key ^ min_hash) + row;
+        }
+
+        // 0 is a deleted key
+        keys.push_back(key ? key : 1);
+      }
+    }
+
+    void
+    MinHashIndex::add(EventNumber number, const EventWordWeightArray& words)
+      throw(El::Exception)
+    {
+      KeyArray keys;
+      band_keys(words, keys);
+
+      for(KeyArray::const_iterator i(keys.begin()), e(keys.end()); i != e;
+          ++i)
+      {
+        BucketMap::iterator it = buckets_.find(*i);
+
+        if(it == buckets_.end())
+        {
+          it = buckets_.insert(std::make_pair(*i, new EventNumberSet())).first;
+        }
+
+        it->second->insert(number);
+      }
+    }
+
+    void
+    MinHashIndex::remove(EventNumber number,
+                         const EventWordWeightArray& words)
+      throw(El::Exception)
+    {
+      KeyArray keys;
+      band_keys(words, keys);
+
+      for(KeyArray::const_iterator i(keys.begin()), e(keys.end()); i != e;
+          ++i)
+      {
+        BucketMap::iterator it = buckets_.find(*i);
+
+        if(it == buckets_.end())
+        {
+          continue;
+        }
+
+        EventNumberSet* numbers = it->second;
+        numbers->erase(number);
+
+        if(numbers->empty())
+        {
+          delete numbers;
+          buckets_.erase(it);
+        }
+      }
+    }
+
+    void
+    MinHashIndex::candidates(const EventWordWeightArray& words,
+                             EventNumberFastSet& skip,
+                             EventNumberArray& candidates) const
+      throw(El::Exception)
+    {
+      KeyArray keys;
+      band_keys(words, keys);
+
+      BucketMap::const_iterator buckets_end = buckets_.end();
+
+      for(KeyArray::const_iterator i(keys.begin()), e(keys.end()); i != e;
+          ++i)
+      {
+        BucketMap::const_iterator it = buckets_.find(*i);
+
+        if(it == buckets_end)
+        {
+          continue;
+        }
+
+        const EventNumberSet& numbers = *it->second;
+
+        for(EventNumberSet::const_iterator j(numbers.begin()),
+              je(numbers.end()); j != je; ++j)
+        {
+          EventNumber number = *j;
+
+          if(skip.insert(number).second)
+          {
+            candidates.push_back(number);
+          }
+        }
+      }
+    }
+
+    void
+    MinHashIndex::optimize_mem_usage() throw(El::Exception)
+    {
+      for(BucketMap::iterator i(buckets_.begin()), e(buckets_.end()); i != e;
+          ++i)
+      {
+        i->second->resize(0);
+      }
+
+      buckets_.resize(0);
+    }
+  }
+}
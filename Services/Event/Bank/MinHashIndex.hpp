@@ -0,0 +1,144 @@
+/*
+ * product   : NewsGate - news search WEB server
+ * copyright : Copyright (c) 2005-2016 Karen Arutyunov
+ * licenses  : CC BY-NC-SA 3.0; see accompanying LICENSE file
+ *             Commercial; contact karen.arutyunov@gmail.com
+ */
+
+/**
+ * @file NewsGate/Server/Services/Event/Bank/MinHashIndex.hpp
+ * @author Karen Aroutiounov
+ * $Id: $
+ */
+
+#ifndef _NEWSGATE_SERVER_SERVICES_EVENT_BANK_MINHASHINDEX_HPP_
+#define _NEWSGATE_SERVER_SERVICES_EVENT_BANK_MINHASHINDEX_HPP_
+
+#include <stdint.h>
+
+#include <vector>
+#include <utility>
+
+#include <google/sparse_hash_map>
+
+#include <El/Exception.hpp>
+#include <El/Hash/Hash.hpp>
+
+#include <Commons/Event/Event.hpp>
+
+namespace NewsGate
+{
+  namespace Event
+  {
+    //
+    // Locality sensitive hashing index of event word sets. Word set
+    // MinHash signature of bands * rows values is split into bands, each
+    // band hashed into a bucket key. Events sharing a bucket are likely to
+    // have high words Jaccard similarity, so are merge candidates; with
+    // 2 rows in 20 bands event with similarity 0.3 is found with
+    // probability 0.85 and with 0.5 - with probability 0.997.
+    //
+    class MinHashIndex
+    {
+    public:
+      typedef std::vector<EventNumber> EventNumberArray;
+
+      MinHashIndex(size_t bands, size_t rows) throw(El::Exception);
+      ~MinHashIndex() throw();
+
+      void add(EventNumber number, const EventWordWeightArray& words)
+        throw(El::Exception);
+
+      //
+      // Words are to be the same as event was added with
+      //
+      void remove(EventNumber number, const EventWordWeightArray& words)
+        throw(El::Exception);
+
+      //
+      // Appends to candidates events sharing a bucket with words, skipping
+      // ones in skip set; added events are put into the set
+      //
+      void candidates(const EventWordWeightArray& words,
+                      EventNumberFastSet& skip,
+                      EventNumberArray& candidates) const
+        throw(El::Exception);
+
+      size_t buckets() const throw();
+
+      void optimize_mem_usage() throw(El::Exception);
+
+    private:
+
+      typedef std::vector<uint64_t> KeyArray;
+
+      void band_keys(const EventWordWeightArray& words, KeyArray& keys) const
+        throw(El::Exception);
+
+      static uint64_t mix(uint64_t val) throw();
+
+      class BucketMap :
+        public google::sparse_hash_map<uint64_t,
+                                       EventNumberSet*,
+                                       El::Hash::Numeric<uint64_t> >
+      {
+      public:
+        BucketMap() throw(El::Exception) { set_deleted_key(0); }
+        ~BucketMap() throw();
+      };
+
+      size_t bands_;
+      size_t rows_;
+      KeyArray seeds_;
+      BucketMap buckets_;
+
+    private:
+      MinHashIndex(const MinHashIndex&);
+      void operator=(const MinHashIndex&);
+    };
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Inlines
+///////////////////////////////////////////////////////////////////////////////
+
+namespace NewsGate
+{
+  namespace Event
+  {
+    //
+    // MinHashIndex class
+    //
+    inline
+    size_t
+    MinHashIndex::buckets() const throw()
+    {
+      return buckets_.size();
+    }
+
+    inline
+    uint64_t
+    MinHashIndex::mix(uint64_t val) throw()
+    {
+      // SplitMix64 finalizer
+      val = (val ^ (val >> 30)) * 0xBF58476D1CE4E5B9ULL;
+      val = (val ^ (val >> 27)) * 0x94D049BB133111EBULL;
+      return val ^ (val >> 31);
+    }
+
+    //
+    // MinHashIndex::BucketMap class
+    //
+    inline
+    MinHashIndex::BucketMap::~BucketMap() throw()
+    {
+      for(iterator i(begin()), e(end()); i != e; ++i)
+      {
+        delete i->second;
+      }
+    }
+  }
+}
+
+#endif // _NEWSGATE_SERVER_SERVICES_EVENT_BANK_MINHASHINDEX_HPP_
@@ -16,6 +16,7 @@
 #include <stdint.h>
 
 #include <utility>
+#include <algorithm>
 #include <sstream>
 #include <fstream>
 
@@ -64,7 +65,10 @@ namespace NewsGate
           trace_search_duration_(Application::instance()->config().
                                  message_manager().trace_search_duration()),
           search_meter_("ManagingMessages::search", false),
-          get_messages_meter_("ManagingMessages::get_messages", false)
+          get_messages_meter_("ManagingMessages::get_messages", false),
+          pipeline_size_(Application::instance()->config().message_manager().
+                         preparing_queue_size()),
+          prepared_packs_(0)
     {
 /*
       {
@@ -119,6 +123,14 @@ namespace NewsGate
       
       state(message_manager.in());
 
+      unsigned long preparing_threads =
+        config.message_manager().preparing_threads();
+
+      if(preparing_threads)
+      {
+        preparing_messages_ = new PreparingMessages(this, preparing_threads);
+      }
+
 #   ifdef SEARCH_PROFILING
       search_meter_.active(true);
       get_messages_meter_.active(true);
@@ -171,6 +183,11 @@ namespace NewsGate
         return false;
       }
 
+      if(preparing_messages_.in() != 0 && !preparing_messages_->start())
+      {
+        return false;
+      }
+
       El::Service::CompoundServiceMessage_var msg = new ReportPresence(this);
       
       deliver_at_time(msg.in(),
@@ -182,6 +199,17 @@ namespace NewsGate
       return true;
     }
 
+    bool
+    ManagingMessages::stop() throw(Exception, El::Exception)
+    {
+      if(preparing_messages_.in() != 0)
+      {
+        preparing_messages_->stop();
+      }
+
+      return BankState::stop();
+    }
+
     void
     ManagingMessages::flush_messages() throw(Exception, El::Exception)
     {
@@ -896,6 +924,35 @@ namespace NewsGate
         res->total_matched_messages = total_matched_messages;
         res->suppressed_messages = suppressed_messages;
 
+        if(request.prefetch_count && search_result->message_infos->size())
+        {
+          const NewsGate::Search::MessageInfoArray& message_infos =
+            *search_result->message_infos;
+
+          size_t count =
+            std::min((size_t)request.prefetch_count, message_infos.size());
+          
+          IdArray ids(count);
+
+          for(size_t i = 0; i < count; ++i)
+          {
+            ids[i] = message_infos[i].wid.id;
+          }
+
+          IdArray notfound_msg_ids;
+
+          Transport::StoredMessagePackImpl::Var messages_transport =
+            new Transport::StoredMessagePackImpl::Type(
+              manager->get_messages(ids,
+                                    request.gm_flags,
+                                    request.img_index,
+                                    request.thumb_index,
+                                    notfound_msg_ids));
+
+          messages_transport->serialize();
+          res->messages = messages_transport._retn();
+        }
+
         ::NewsGate::Search::Transport::ResultImpl::Var result_transport =
             new ::NewsGate::Search::Transport::ResultImpl::Type(
               search_result.release());
@@ -1101,6 +1158,45 @@ namespace NewsGate
           return;
         }
 
+        Transport::WordCompletionRequestImpl::Type* completion_request =
+          dynamic_cast<Transport::WordCompletionRequestImpl::Type*>(req);
+
+        if(completion_request != 0)
+        {
+          type = "complete_word";
+
+          MessageManager_var manager = message_manager();
+          resp = manager->complete_word(completion_request->entity());
+        
+          return;
+        }
+
+        Transport::FuzzyWordsRequestImpl::Type* fuzzy_request =
+          dynamic_cast<Transport::FuzzyWordsRequestImpl::Type*>(req);
+
+        if(fuzzy_request != 0)
+        {
+          type = "fuzzy_words";
+
+          MessageManager_var manager = message_manager();
+          resp = manager->fuzzy_words(fuzzy_request->entity());
+        
+          return;
+        }
+
+        Transport::TrendingTermsRequestImpl::Type* trending_request =
+          dynamic_cast<Transport::TrendingTermsRequestImpl::Type*>(req);
+
+        if(trending_request != 0)
+        {
+          type = "trending_terms";
+
+          MessageManager_var manager = message_manager();
+          resp = manager->trending_terms(trending_request->entity());
+        
+          return;
+        }
+
         Transport::CheckMirroredMessagesRequestImpl::Type* cmm_request =
           dynamic_cast<Transport::CheckMirroredMessagesRequestImpl::Type*>(
             req);
@@ -1445,6 +1541,7 @@ namespace NewsGate
           bool loaded = manager->loaded();
           
           PendingMessagePack pending_pack;
+          bool pipelined = false;
           
           {
             WriteGuard guard(srv_lock_);
@@ -1466,7 +1563,31 @@ namespace NewsGate
               return;
             }
             
+            pipelined = preparing_messages_.in() != 0 &&
+              dynamic_cast<Transport::RawMessagePackImpl::Type*>(
+                pending_message_packs_.front().pack.in()) != 0;
+
+            if(pipelined && pipelined_packs_.size() >= pipeline_size_)
+            {
+              // Will be accepted when one of pipelined packs is inserted
+              return;
+            }
+            
             pending_pack = pending_message_packs_.pop_front();
+
+            if(pipelined)
+            {
+              pipelined_packs_.push_back(pending_pack);
+            }
+          }
+
+          if(pipelined)
+          {
+            El::Service::CompoundServiceMessage_var msg =
+              new PrepareMessages(this, pending_pack);
+
+            preparing_messages_->deliver_now(msg.in());
+            return;
           }
 
           Transport::RawMessagePackImpl::Type* raw_msg_pack =
@@ -1646,10 +1767,13 @@ namespace NewsGate
       return 0;
     }
 
-    void
-    ManagingMessages::process_messages(
+    bool
+    ManagingMessages::prepare_messages(
       Transport::RawMessagePackImpl::Type* pack,
-      ::NewsGate::Message::PostMessageReason reason)
+      ::NewsGate::Message::PostMessageReason reason,
+      bool normalize,
+      StoredMessageList& messages,
+      bool& dict_not_changed)
       throw(Exception, El::Exception, CORBA::Exception)
     {
       {
@@ -1721,7 +1845,7 @@ namespace NewsGate
       if(Application::will_trace(El::Logging::HIGH))
       {
         std::ostringstream ostr;
-        ostr << "NewsGate::Message::ManagingMessages::process_messages: "
+        ostr << "NewsGate::Message::ManagingMessages::prepare_messages: "
           "global messages:";
         
         for(Transport::RawMessagePackImpl::MessageArray::const_iterator it =
@@ -1767,7 +1891,7 @@ namespace NewsGate
 
       if(entities.empty())
       {
-        return;
+        return true;
       }
 
       ACE_Time_Value segmentation_time;
@@ -1806,7 +1930,6 @@ namespace NewsGate
 
       if(!processing_failed)
       { 
-        StoredMessageList messages;
         Segmentation::Transport::SegmentedMessageArray* segmented_messages = 0;
           
         if(segmented_message_components.in())
@@ -1904,7 +2027,7 @@ namespace NewsGate
 
           std::ostringstream ostr;
           
-          ostr << "NewsGate::Message::ManagingMessages::process_messages: "
+          ostr << "NewsGate::Message::ManagingMessages::prepare_messages: "
                << ent_count << " messages segmentation time "
                << El::Moment::time(segmentation_time)
                << ", breakdown time " << El::Moment::time(breakdown_time);
@@ -1914,63 +2037,351 @@ namespace NewsGate
                                        El::Logging::HIGH);          
         }
         
-        try
+        if(normalize)
         {
-          MessageManager_var manager = message_manager();
+          try
+          {
+            MessageManager_var manager = message_manager();
+            dict_not_changed = manager->normalize_words(messages);
+
+            WriteGuard guard(srv_lock_);
+            word_manager_failed_ = false;
+          }
+          catch(const MessageManager::WordManagerNotReady& e)
+          {
+            {
+              WriteGuard guard(srv_lock_);
+              word_manager_failed_ = true;
+            }
+          
+            processing_failed = true;
+          
+            std::ostringstream ostr;
+            ostr << "NewsGate::Message::ManagingMessages::prepare_messages: "
+              "MessageManager::WordManagerNotReady caught. Description:\n"
+                 << e;
+          
+            El::Service::Error
+              error(ostr.str(), this, El::Service::Error::NOTICE);
+          
+            callback_->notify(&error);
+          }
+        }
+      }
 
-          set_fetched_time(messages);
-          manager->insert(messages, reason);
+      return !processing_failed;
+    }
 
+    void
+    ManagingMessages::process_messages(
+      Transport::RawMessagePackImpl::Type* pack,
+      ::NewsGate::Message::PostMessageReason reason)
+      throw(Exception, El::Exception, CORBA::Exception)
+    {
+      StoredMessageList messages;
+      bool dict_not_changed = true;
+      
+      if(!prepare_messages(pack, reason, false, messages, dict_not_changed) ||
+         !insert_messages(messages, reason, dict_not_changed))
+      {
+        postpone_messages(PendingMessagePack(pack, reason));
+      }
+    }
+
+    bool
+    ManagingMessages::insert_messages(
+      StoredMessageList& messages,
+      ::NewsGate::Message::PostMessageReason reason,
+      bool dict_not_changed)
+      throw(Exception, El::Exception)
+    {
+      try
+      {
+        MessageManager_var manager = message_manager();
+
+        set_fetched_time(messages);
+        manager->insert(messages, reason);
+
+        WriteGuard guard(srv_lock_);
+        word_manager_failed_ = false;
+      }
+      catch(const MessageManager::WordManagerNotReady& e)
+      {
+        {
           WriteGuard guard(srv_lock_);
-          word_manager_failed_ = false;
+          word_manager_failed_ = true;
         }
-        catch(const MessageManager::WordManagerNotReady& e)
+          
+        std::ostringstream ostr;
+        ostr << "NewsGate::Message::ManagingMessages::insert_messages: "
+          "MessageManager::WordManagerNotReady caught. Description:\n"
+             << e;
+          
+        El::Service::Error
+          error(ostr.str(), this, El::Service::Error::NOTICE);
+          
+        callback_->notify(&error);
+        return false;
+      }
+      catch(const El::Exception& e)
+      {
+        std::ostringstream ostr;
+        ostr << "NewsGate::Message::ManagingMessages::insert_messages: "
+          "El::Exception caught. Description:\n" << e;
+          
+        El::Service::Error
+          error(ostr.str(), this, El::Service::Error::NOTICE);
+          
+        callback_->notify(&error);
+        return false;
+      }
+
+      if(!dict_not_changed)
+      {
+        // Dictionary change was detected while preparing messages
+        dictionary_hash_changed();
+      }
+
+      return true;
+    }
+
+    void
+    ManagingMessages::postpone_messages(const PendingMessagePack& pack)
+      throw(El::Exception)
+    {
+      El::Service::CompoundServiceMessage_var msg = new AcceptMessages(this);
+
+      WriteGuard guard(srv_lock_);
+      pending_message_packs_.push_back(pack);
+        
+      deliver_at_time(
+        msg.in(),
+        ACE_OS::gettimeofday() +
+        ACE_Time_Value(Application::instance()->config().word_management().
+                       retry_period()));
+    }
+
+    void
+    ManagingMessages::prepare_messages(PrepareMessages* pm) throw()
+    {
+      bool release = true;
+      bool prepared = false;
+      bool postpone = false;
+      
+      try
+      {
+        try
         {
+          Transport::RawMessagePackImpl::Type* pack =
+            dynamic_cast<Transport::RawMessagePackImpl::Type*>(
+              pm->pending_pack.pack.in());
+
+          if(pack == 0)
           {
-            WriteGuard guard(srv_lock_);
-            word_manager_failed_ = true;
+            throw Exception(
+              "NewsGate::Message::ManagingMessages::prepare_messages: "
+              "dynamic_cast<Transport::RawMessagePackImpl::Type*> failed");
           }
           
-          processing_failed = true;
+          ACE_High_Res_Timer timer;
+          timer.start();
+
+          InsertMessages* im = new InsertMessages(this, pm->pending_pack);
+          El::Service::CompoundServiceMessage_var msg = im;
+
+          PostMessageReason reason = pm->pending_pack.reason;
           
+          if(!prepare_messages(pack,
+                               reason,
+                               reason == PMR_NEW_MESSAGES,
+                               im->messages,
+                               im->dict_not_changed))
+          {
+            postpone = true;
+          }
+          else
+          {
+            timer.stop();
+
+            ACE_Time_Value time;
+            timer.elapsed_time(time);
+
+            {
+              WriteGuard guard(srv_lock_);
+              
+              ++prepared_packs_;
+              preparation_stat_.add(im->messages.size(), time);
+            }
+
+            prepared = true;
+            
+            deliver_now(msg.in());
+            release = false;
+          }
+        }
+        catch(const El::Exception& e)
+        {
           std::ostringstream ostr;
-          ostr << "NewsGate::Message::ManagingMessages::process_messages: "
-            "MessageManager::WordManagerNotReady caught. Description:\n"
-               << e;
-          
-          El::Service::Error
-            error(ostr.str(), this, El::Service::Error::NOTICE);
-          
+          ostr << "NewsGate::Message::ManagingMessages::prepare_messages: "
+            "El::Exception caught. Description:" << std::endl << e;
+        
+          El::Service::Error error(ostr.str(), this);
           callback_->notify(&error);
+
+          postpone = release;
         }
-        catch(const El::Exception& e)
+        catch(const CORBA::Exception& e)
         {
-          processing_failed = true;
-          
           std::ostringstream ostr;
-          ostr << "NewsGate::Message::ManagingMessages::process_messages: "
-            "El::Exception caught. Description:\n" << e;
+          ostr << "NewsGate::Message::ManagingMessages::prepare_messages: "
+            "CORBA::Exception caught. Description:" << std::endl << e;
+        
+          El::Service::Error error(ostr.str(), this);
+          callback_->notify(&error);
+
+          postpone = release;
+        }
+
+        if(release)
+        {
+          release_pipelined_pack(pm->pending_pack.pack.in(), prepared);
+        }
+
+        // Pack not passed to insertion is retried later, so transient
+        // WordManager or DB failures do not lose messages
+        if(postpone)
+        {
+          postpone_messages(pm->pending_pack);
+        }
+      }
+      catch(...)
+      {
+        El::Service::Error error(
+          "NewsGate::Message::ManagingMessages::prepare_messages: "
+          "unexpected exception caught.",
+          this);
+          
+        callback_->notify(&error);
+      }
+    }
+
+    void
+    ManagingMessages::insert_messages(InsertMessages* im) throw()
+    {
+      try
+      {
+        try
+        {
+          release_pipelined_pack(im->pending_pack.pack.in(), true);
+
+          ACE_High_Res_Timer timer;
+          timer.start();
           
-          El::Service::Error
-            error(ostr.str(), this, El::Service::Error::NOTICE);
+          if(!insert_messages(im->messages,
+                              im->pending_pack.reason,
+                              im->dict_not_changed))
+          {
+            postpone_messages(im->pending_pack);
+            return;
+          }
+
+          timer.stop();
           
+          ACE_Time_Value time;
+          timer.elapsed_time(time);
+
+          bool pending_packs = false;
+          
+          {
+            WriteGuard guard(srv_lock_);
+            
+            insertion_stat_.add(im->messages.size(), time);
+            pending_packs = !pending_message_packs_.empty();
+          }
+
+          trace_pipeline();
+
+          if(pending_packs)
+          {
+            El::Service::CompoundServiceMessage_var msg =
+              new AcceptMessages(this);
+            
+            deliver_now(msg.in());
+          }
+        }
+        catch(const El::Exception& e)
+        {
+          std::ostringstream ostr;
+          ostr << "NewsGate::Message::ManagingMessages::insert_messages: "
+            "El::Exception caught. Description:" << std::endl << e;
+        
+          El::Service::Error error(ostr.str(), this);
           callback_->notify(&error);
         }
-      }      
+      }
+      catch(...)
+      {
+        El::Service::Error error(
+          "NewsGate::Message::ManagingMessages::insert_messages: "
+          "unexpected exception caught.",
+          this);
+          
+        callback_->notify(&error);
+      }
+    }
+
+    void
+    ManagingMessages::release_pipelined_pack(Transport::MessagePack* pack,
+                                             bool prepared)
+      throw(El::Exception)
+    {
+      WriteGuard guard(srv_lock_);
+
+      for(PendingMessagePackList::iterator i(pipelined_packs_.begin()),
+            e(pipelined_packs_.end()); i != e; ++i)
+      {
+        if(i->pack.in() == pack)
+        {
+          pipelined_packs_.erase(i);
+          break;
+        }
+      }
+
+      if(prepared && prepared_packs_)
+      {
+        --prepared_packs_;
+      }
+    }
+
+    void
+    ManagingMessages::trace_pipeline() throw(El::Exception)
+    {
+      if(!Application::will_trace(El::Logging::MIDDLE))
+      {
+        return;
+      }
       
-      if(processing_failed)
+      std::ostringstream ostr;
+      ostr << "NewsGate::Message::ManagingMessages::trace_pipeline: ";
+        
       {
-        El::Service::CompoundServiceMessage_var msg = new AcceptMessages(this);
+        ReadGuard guard(srv_lock_);
 
-        WriteGuard guard(srv_lock_);
-        pending_message_packs_.push_back(PendingMessagePack(pack, reason));
+        ostr << pipelined_packs_.size() << " packs in pipeline ("
+             << pipelined_packs_.size() - prepared_packs_ << " preparing, "
+             << prepared_packs_ << " waiting for insertion), "
+             << pending_message_packs_.new_message_packs()
+             << " new message packs pending\n  preparation: ";
+
+        preparation_stat_.dump(ostr);
         
-        deliver_at_time(
-          msg.in(),
-          ACE_OS::gettimeofday() +
-          ACE_Time_Value(Application::instance()->config().word_management().
-                         retry_period()));
+        ostr << "\n  insertion: ";
+        insertion_stat_.dump(ostr);
       }
+        
+      Application::logger()->trace(ostr.str(),
+                                   Aspect::MSG_MANAGEMENT,
+                                   El::Logging::MIDDLE);
     }
 
     void
@@ -2387,6 +2798,11 @@ namespace NewsGate
     {
       BankState::wait();
 
+      if(preparing_messages_.in() != 0)
+      {
+        preparing_messages_->wait();
+      }
+
       try
       {
         Message::BankManager_var bank_manager =
@@ -2406,6 +2822,20 @@ namespace NewsGate
       
       {
         WriteGuard guard(srv_lock_);
+
+        //
+        // Packs being prepared or waiting for insertion are saved as well
+        //
+        
+        for(PendingMessagePackList::const_iterator
+              i(pipelined_packs_.begin()), e(pipelined_packs_.end());
+            i != e; ++i)
+        {
+          pending_message_packs_.push_back(*i);
+        }
+
+        pipelined_packs_.clear();
+        prepared_packs_ = 0;
       
         while(!pending_message_packs_.empty())
         {
@@ -2513,6 +2943,22 @@ namespace NewsGate
         return "accept_messages";
       }
 
+      PrepareMessages* pm = dynamic_cast<PrepareMessages*>(event);
+      
+      if(pm != 0)
+      {
+        prepare_messages(pm);
+        return "prepare_messages";
+      }
+
+      InsertMessages* im = dynamic_cast<InsertMessages*>(event);
+      
+      if(im != 0)
+      {
+        insert_messages(im);
+        return "insert_messages";
+      }
+
       SetMessageFetchFilter* smf = dynamic_cast<SetMessageFetchFilter*>(event);
       
       if(smf != 0)
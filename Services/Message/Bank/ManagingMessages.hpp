@@ -14,7 +14,11 @@
 #ifndef _NEWSGATE_SERVER_SERVICES_MESSAGE_BANK_MANAGINGMESSAGES_HPP_
 #define _NEWSGATE_SERVER_SERVICES_MESSAGE_BANK_MANAGINGMESSAGES_HPP_
 
+#include <stdint.h>
+
 #include <string>
+#include <list>
+#include <iostream>
 #include <ext/hash_map>
 #include <memory>
 
@@ -23,6 +27,7 @@
 #include <El/Exception.hpp>
 #include <El/Hash/Hash.hpp>
 #include <El/Stat.hpp>
+#include <El/Moment.hpp>
 
 #include <Commons/Message/TransportImpl.hpp>
 
@@ -119,6 +124,7 @@ namespace NewsGate
       virtual void wait() throw(Exception, El::Exception);
       virtual bool notify(El::Service::Event* event) throw(El::Exception);
       virtual bool start() throw(Exception, El::Exception);
+      virtual bool stop() throw(Exception, El::Exception);
       
       void flush_messages() throw(Exception, El::Exception);
       
@@ -138,6 +144,15 @@ namespace NewsGate
       void set_message_categorizer(CategorizerPtr& categorizer,
                                    size_t retry) throw();
 
+      //
+      // Raw message packs are prepared (segmented, broken down and
+      // normalized) by the pool of PreparingMessages threads; prepared
+      // packs are inserted by ManagingMessages thread, so next packs are
+      // prepared while previous ones are inserted
+      //
+      class PreparingMessages;
+      typedef El::RefCount::SmartPtr<PreparingMessages> PreparingMessages_var;
+
       struct ExitApplication : public El::Service::CompoundServiceMessage
       {
         ExitApplication(ManagingMessages* state) throw(El::Exception);
@@ -156,6 +171,30 @@ namespace NewsGate
         AcceptMessages(ManagingMessages* state) throw(El::Exception);
       };
 
+      struct PrepareMessages : public El::Service::CompoundServiceMessage
+      {
+        PendingMessagePack pending_pack;
+
+        PrepareMessages(ManagingMessages* state,
+                        const PendingMessagePack& pending_pack_val)
+          throw(El::Exception);
+
+        ~PrepareMessages() throw() {}
+      };
+
+      struct InsertMessages : public El::Service::CompoundServiceMessage
+      {
+        PendingMessagePack pending_pack;
+        StoredMessageList messages;
+        bool dict_not_changed;
+
+        InsertMessages(ManagingMessages* state,
+                       const PendingMessagePack& pending_pack_val)
+          throw(El::Exception);
+
+        ~InsertMessages() throw() {}
+      };
+
       struct AcceptCachedMessages :
         public El::Service::CompoundServiceMessage
       {
@@ -202,6 +241,29 @@ namespace NewsGate
       void process_messages(Transport::RawMessagePackImpl::Type* pack,
                             ::NewsGate::Message::PostMessageReason reason)
         throw(Exception, El::Exception, CORBA::Exception);
+
+      void prepare_messages(PrepareMessages* pm) throw();
+      void insert_messages(InsertMessages* im) throw();
+
+      bool prepare_messages(Transport::RawMessagePackImpl::Type* pack,
+                            ::NewsGate::Message::PostMessageReason reason,
+                            bool normalize,
+                            StoredMessageList& messages,
+                            bool& dict_not_changed)
+        throw(Exception, El::Exception, CORBA::Exception);
+
+      bool insert_messages(StoredMessageList& messages,
+                           ::NewsGate::Message::PostMessageReason reason,
+                           bool dict_not_changed)
+        throw(Exception, El::Exception);
+
+      void postpone_messages(const PendingMessagePack& pack)
+        throw(El::Exception);
+
+      void release_pipelined_pack(Transport::MessagePack* pack, bool prepared)
+        throw(El::Exception);
+
+      void trace_pipeline() throw(El::Exception);
       
       void process_messages(Transport::StoredMessagePackImpl::Type* pack,
                             ::NewsGate::Message::PostMessageReason reason)
@@ -264,11 +326,49 @@ namespace NewsGate
       bool has_event_bank_;
       ACE_Time_Value trace_search_duration_;
 
+      struct StageStat
+      {
+        uint64_t packs;
+        uint64_t messages;
+        ACE_Time_Value time;
+
+        StageStat() throw() : packs(0), messages(0) {}
+
+        void add(size_t message_count, const ACE_Time_Value& duration)
+          throw();
+
+        void dump(std::ostream& ostr) const throw(El::Exception);
+      };
+
+      typedef std::list<PendingMessagePack> PendingMessagePackList;
+
+      PreparingMessages_var preparing_messages_;
+      size_t pipeline_size_;
+      PendingMessagePackList pipelined_packs_;
+      size_t prepared_packs_;
+      StageStat preparation_stat_;
+      StageStat insertion_stat_;
+
       El::Stat::TimeMeter search_meter_;
       El::Stat::TimeMeter get_messages_meter_;
     };
     
     typedef El::RefCount::SmartPtr<ManagingMessages> ManagingMessages_var;
+
+    //
+    // ManagingMessages::PreparingMessages class
+    //
+    class ManagingMessages::PreparingMessages :
+      public El::Service::CompoundService<El::Service::Service,
+                                          ManagingMessages>
+    {
+    public:
+
+      EL_EXCEPTION(Exception, ManagingMessages::Exception);
+
+      PreparingMessages(ManagingMessages* callback, unsigned long threads)
+        throw(Exception, El::Exception);
+    };
   }
 }
 
@@ -351,6 +451,74 @@ namespace NewsGate
     {
     }
 
+    //
+    // ManagingMessages::PrepareMessages class
+    //
+    inline
+    ManagingMessages::PrepareMessages::PrepareMessages(
+      ManagingMessages* state,
+      const PendingMessagePack& pending_pack_val) throw(El::Exception)
+        : El__Service__CompoundServiceMessageBase(state, state, false),
+          El::Service::CompoundServiceMessage(state, state),
+          pending_pack(pending_pack_val)
+    {
+    }
+
+    //
+    // ManagingMessages::InsertMessages class
+    //
+    inline
+    ManagingMessages::InsertMessages::InsertMessages(
+      ManagingMessages* state,
+      const PendingMessagePack& pending_pack_val) throw(El::Exception)
+        : El__Service__CompoundServiceMessageBase(state, state, false),
+          El::Service::CompoundServiceMessage(state, state),
+          pending_pack(pending_pack_val),
+          dict_not_changed(true)
+    {
+    }
+
+    //
+    // ManagingMessages::PreparingMessages class
+    //
+    inline
+    ManagingMessages::PreparingMessages::PreparingMessages(
+      ManagingMessages* callback,
+      unsigned long threads)
+      throw(Exception, El::Exception)
+        : El::Service::CompoundService<El::Service::Service,
+                                       ManagingMessages>(
+                                         callback,
+                                         "ManagingMessages::PreparingMessages",
+                                         threads)
+    {
+    }
+
+    //
+    // ManagingMessages::StageStat struct
+    //
+    inline
+    void
+    ManagingMessages::StageStat::add(size_t message_count,
+                                     const ACE_Time_Value& duration) throw()
+    {
+      ++packs;
+      messages += message_count;
+      time += duration;
+    }
+
+    inline
+    void
+    ManagingMessages::StageStat::dump(std::ostream& ostr) const
+      throw(El::Exception)
+    {
+      double sec = (double)time.sec() + (double)time.usec() / 1000000;
+
+      ostr << packs << " packs, " << messages << " messages in "
+           << El::Moment::time(time) << " ("
+           << (sec > 0 ? (uint64_t)(messages / sec) : 0) << " msg/sec)";
+    }
+
     //
     // ManagingMessages::SetMessageFetchFilter class
     //
@@ -30,6 +30,7 @@
 #include <El/Moment.hpp>
 #include <El/MySQL/DB.hpp>
 #include <El/String/ListParser.hpp>
+#include <El/String/Manip.hpp>
 #include <El/Utility.hpp>
 #include <El/CRC.hpp>
 #include <El/Guid.hpp>
@@ -51,6 +52,10 @@
 
 namespace
 {
+  //
+  // Max number of dictionary entries scanned for word completion
+  //
+  const size_t WORD_DICTIONARY_TOP_THRESHOLD = 256;
 }
 /*
 struct ABC
@@ -128,6 +133,12 @@ namespace NewsGate
                               (1.0 - config_.message_cache().room())),
           traverse_message_it_(traverse_message_.end()),
           traverse_prio_message_it_(traverse_prio_message_.end()),
+          expiration_schedule_(config_.message_cache().traverse_period()),
+          preemption_schedule_(config_.message_cache().traverse_period()),
+          packing_schedule_(config_.message_cache().traverse_period()),
+          trending_terms_(config_.message_cache().trending_window(),
+                          config_.message_cache().trending_windows(),
+                          config_.message_cache().trending_terms()),
           loaded_(false),
           flushed_(false)
     {
@@ -147,6 +158,22 @@ namespace NewsGate
       session->_add_ref();
       bank_client_session->_add_ref();
 
+      if(config.morphology_cache_size())
+      {
+        morphology_cache_.reset(
+          new MorphologyCache(config.morphology_cache_size()));
+      }
+
+      if(config.message_filter().threads() > 1)
+      {
+        filter_thread_pool_ =
+          new El::Service::ThreadPool(callback,
+                                      "MessageFilterThreadPool",
+                                      config.message_filter().threads());
+
+        filter_thread_pool_->start();
+      }
+
       if(capacity_threshold_ < config_.message_cache().capacity())
       {
         Search::ExpressionParser parser;
@@ -637,10 +664,26 @@ namespace NewsGate
       }
     }
     
+    bool
+    MessageManager::stop() throw(Exception, El::Exception)
+    {
+      if(filter_thread_pool_.in() != 0)
+      {
+        filter_thread_pool_->stop();
+      }
+
+      return BaseClass::stop();
+    }
+    
     void
     MessageManager::wait() throw(Exception, El::Exception)
     {
       BaseClass::wait();
+
+      if(filter_thread_pool_.in() != 0)
+      {
+        filter_thread_pool_->wait();
+      }
       
       MgrWriteGuard guard(mgr_lock_);
 
@@ -1569,13 +1612,27 @@ namespace NewsGate
       }
     }
     
+    bool
+    MessageManager::normalize_words(StoredMessageList& messages)
+      throw(WordManagerNotReady, Exception, El::Exception)
+    {
+      return normalize_words(messages, dictionary_hash());
+    }
+
     bool
     MessageManager::normalize_words(StoredMessageList& messages,
                                     uint32_t dict_hash,
                                     IdSet* changed_norm_forms)
       throw(WordManagerNotReady, Exception, El::Exception)
     {
-      bool dict_not_changed = true;
+      // Messages which language was already guessed by WordManager
+      // normalizing them as a whole are normalized word by word using
+      // the bank-local morphology cache. Others go to WordManager
+      // as before, so it guesses their language.
+      bool use_cache = morphology_cache_.get() != 0;
+      
+      bool dict_not_changed = !use_cache ||
+        normalize_cached_words(messages, dict_hash, changed_norm_forms);
       
       try
       {
@@ -1594,7 +1651,7 @@ namespace NewsGate
           const StoredMessage& msg = *it;
 
           if((msg.content.in() != 0 && msg.content->dict_hash == dict_hash) ||
-             msg.hidden())
+             msg.hidden() || (use_cache && language_settled(msg)))
           {
             continue;
           }
@@ -1645,7 +1702,7 @@ namespace NewsGate
             StoredMessage& msg = *it;
 
             if((msg.content.in() != 0 && msg.content->dict_hash == dict_hash) ||
-               msg.hidden())
+               msg.hidden() || (use_cache && language_settled(msg)))
             {
               continue;
             }
@@ -1680,16 +1737,7 @@ namespace NewsGate
 */            
             }
 
-            if((msg.content.in() != 0 && msg.content->dict_hash == 0) ||
-               msg.word_hash(false) != new_msg.word_hash(false))
-            {
-              msg.steal(new_msg);
-              
-              if(changed_norm_forms)
-              {
-                changed_norm_forms->insert(msg.id);
-              }
-            }
+            set_normalized(msg, new_msg, dict_hash, changed_norm_forms);
 /*
             std::cerr << "ID " << msg.id.string() << "\npositions:\n";
             
@@ -1731,11 +1779,6 @@ namespace NewsGate
               std::cerr << std::endl;
             }
 */          
-            if(msg.content.in() != 0)
-            {
-              msg.content->dict_hash = dict_hash;
-            }
-
             i++;
           }
           
@@ -1771,6 +1814,120 @@ namespace NewsGate
       return dict_not_changed;
     }
 
+    bool
+    MessageManager::normalize_cached_words(StoredMessageList& messages,
+                                           uint32_t dict_hash,
+                                           IdSet* changed_norm_forms)
+      throw(WordManagerNotReady, Exception, El::Exception)
+    {
+      typedef std::vector<StoredMessage*> StoredMessagePtrArray;
+      
+      StoredMessagePtrArray cached_messages;
+      cached_messages.reserve(messages.size());
+      
+      MorphologyCache::MessageWordsArray words;
+      words.reserve(messages.size());
+
+      for(StoredMessageList::iterator it = messages.begin();
+          it != messages.end(); it++)
+      {
+        StoredMessage& msg = *it;
+        
+        if((msg.content.in() != 0 && msg.content->dict_hash == dict_hash) ||
+           msg.hidden() || !language_settled(msg))
+        {
+          continue;
+        }
+
+        cached_messages.push_back(&msg);
+        
+        words.push_back(
+          MorphologyCache::MessageWords(msg.lang, &msg.word_positions));
+      }
+
+      if(words.empty())
+      {
+        return true;
+      }
+      
+      bool dict_not_changed = true;
+      
+      try
+      {
+        dict_not_changed = morphology_cache_->normalize(words, dict_hash);
+      }
+      catch(const MorphologyCache::WordManagerNotReady& e)
+      {
+        std::ostringstream ostr;
+        ostr << "MessageManager::normalize_cached_words: " << e;
+        
+        throw WordManagerNotReady(ostr.str());
+      }
+      
+      for(size_t i = 0; i < cached_messages.size(); ++i)
+      {
+        StoredMessage& msg = *cached_messages[i];
+        
+        const El::Dictionary::Morphology::WordInfoArray& word_infos =
+          words[i].word_infos;
+        
+        StoredMessage new_msg = msg;
+
+        StoredMessage::set_normal_forms(word_infos,
+                                        msg.word_positions,
+                                        msg.positions,
+                                        new_msg.norm_form_positions,
+                                        new_msg.positions);
+
+        MessageWordPosition& word_positions = new_msg.word_positions;
+        assert(word_positions.size() == word_infos.size());
+            
+        for(size_t j = 0; j < word_positions.size(); j++)
+        {
+          word_positions[j].second.lang = word_infos[j].lang;
+        }
+
+        set_normalized(msg, new_msg, dict_hash, changed_norm_forms);
+      }
+
+      return dict_not_changed;
+    }
+
+    bool
+    MessageManager::language_settled(const StoredMessage& msg) throw()
+    {
+      //
+      // Message was normalized as a whole before, so its language is the
+      // one WordManager guessed for it
+      //
+      return msg.lang != El::Lang::null && msg.content.in() != 0 &&
+        msg.content->dict_hash != 0;
+    }
+
+    void
+    MessageManager::set_normalized(StoredMessage& msg,
+                                   StoredMessage& new_msg,
+                                   uint32_t dict_hash,
+                                   IdSet* changed_norm_forms)
+      throw(El::Exception)
+    {
+      if((msg.content.in() != 0 && msg.content->dict_hash == 0) ||
+         msg.word_hash(false) != new_msg.word_hash(false))
+      {
+        msg.steal(new_msg);
+              
+        if(changed_norm_forms)
+        {
+          changed_norm_forms->insert(msg.id);
+        }
+      }
+
+      if(msg.content.in() != 0)
+      {
+        msg.content->dict_hash = dict_hash;
+      }
+    }
+
     bool
     MessageManager::insert(
       const StoredMessageList& message_list,
@@ -1929,6 +2086,8 @@ namespace NewsGate
             }
 
             msg->hide();
+            schedule_msg_operations(*msg);
+            trending_terms_.add(*msg);
             
 //            inserted_message_ptr.push_back(msg);
             inserted_messages.insert(std::make_pair(msg->id, msg->published));
@@ -2502,6 +2661,8 @@ namespace NewsGate
 
             if(msg)
             {
+              schedule_msg_operations(*msg);
+
               dict_hash_update_str << (dict_hash_updated++ ? ", " : " ")
                                    << msg->id.data;
             }
@@ -2649,6 +2810,8 @@ namespace NewsGate
 
           if(msg)
           {
+            schedule_msg_operations(*msg);
+            
             if(dict_hash_updated++)
             {
               dic_file << std::endl;
@@ -2855,6 +3018,8 @@ namespace NewsGate
       size_t skipped_count = 0;
       
       IdTimeMap removed_msg;
+      IdTimeMap inserted_messages;
+      MessageFetchFilterMap_var filters;
       
       {
         uint64_t expired = ACE_OS::gettimeofday().sec() -
@@ -2910,9 +3075,18 @@ namespace NewsGate
           else
           {
             msg.content = 0;
+
+            const StoredMessage* inserted_msg =
+              messages_.insert(msg, 0, 0/*, false*/);
             
-            if(messages_.insert(msg, 0, 0/*, false*/))
+            if(inserted_msg)
             {
+              schedule_msg_operations(*inserted_msg);
+              trending_terms_.add(*inserted_msg);
+
+              inserted_messages.insert(
+                std::make_pair(inserted_msg->id, inserted_msg->published));
+              
               ++inserted_count;
             }
             else
@@ -2927,17 +3101,70 @@ namespace NewsGate
         {
           timer.stop();
           timer.elapsed_time(insert_time);
-            
+        }
+
+        recent_msg_deletions(removed_msg);
+
+        if(message_filters_.in() != 0 && !inserted_messages.empty())
+        {
+          filters = new MessageFetchFilterMap(*message_filters_);
+        }
+      }
+
+      if(filters.in() != 0)
+      {
+        //
+        // Filters are checked against just inserted messages only
+        // rather than the whole cache
+        //
+        
+        if(Application::will_trace(El::Logging::HIGH))
+        {
           timer.start();
         }
-          
-        apply_message_fetch_filters(messages_,
-                                    message_filters_.in(),
+
+        SearcheableMessageMap temp_messages(
+          false,
+          true,
+          config_.impression_respected_level(),
+          0);
+
+        {
+          MgrReadGuard guard(mgr_lock_);
+
+          for(IdTimeMap::const_iterator i(inserted_messages.begin()),
+                e(inserted_messages.end()); i != e; ++i)
+          {
+            const StoredMessage* msg = messages_.find(i->first);
+
+            if(msg)
+            {
+              temp_messages.insert(*msg, 0, 0/*, false*/);
+            }
+          }
+        }
+
+        IdTimeMap filtered_msg;
+        
+        apply_message_fetch_filters(temp_messages,
+                                    filters.in(),
                                     0,
-                                    removed_msg,
+                                    filtered_msg,
                                     SIZE_MAX);
 
-        recent_msg_deletions(removed_msg);
+        if(!filtered_msg.empty())
+        {
+          MgrWriteGuard guard(mgr_lock_);
+          
+          remove_filtered_messages(filtered_msg);
+          recent_msg_deletions(filtered_msg);
+        }
+
+        for(IdTimeMap::const_iterator i(filtered_msg.begin()),
+              e(filtered_msg.end()); i != e; ++i)
+        {
+          removed_msg.insert(*i);
+        }
         
         if(Application::will_trace(El::Logging::HIGH))
         {
@@ -4072,6 +4299,12 @@ namespace NewsGate
       msg = new TraverseCache(this);
       deliver_now(msg.in());
 
+      if(config_.message_cache().word_dictionary_period())
+      {
+        msg = new UpdateWordDictionary(this);
+        deliver_now(msg.in());
+      }
+
       if(config_.message_filter().reapply_period())
       {
         msg = new ReapplyMsgFetchFilters(this);
@@ -4740,6 +4973,75 @@ namespace NewsGate
       return search_result.release();
     }
 
+    Transport::Response*
+    MessageManager::fuzzy_words(
+      const Transport::FuzzyWordsRequestInfo& request) const
+      throw(El::Exception)
+    {
+      Transport::FuzzyWordsResponseImpl::Var response =
+        Transport::FuzzyWordsResponseImpl::Init::create(
+          new Transport::FuzzyWordArray());
+
+      WordDictionary_var dict = word_dictionary();
+
+      if(dict.in() == 0)
+      {
+        return response._retn();
+      }
+
+      Transport::FuzzyWordArray& words = response->entities();
+      const Transport::FuzzyWordQueryArray& queries = request.words;
+
+      MgrReadGuard guard(mgr_lock_);
+
+      for(size_t i = 0; i < queries.size(); ++i)
+      {
+        const Transport::FuzzyWordQuery& query = queries[i];
+
+        //
+        // Reporting indexed word with zero distance, so the frontend
+        // doesn't replace it if any bank knows the word
+        //
+        
+        if(indexed(query))
+        {
+          words.push_back(Transport::FuzzyWord(i, query.text.c_str(), 0, 0));
+          continue;
+        }
+
+        dict->fuzzy(query.text.c_str(),
+                    query.max_distance,
+                    query.count,
+                    i,
+                    words);
+      }
+
+      return response._retn();
+    }
+
+    bool
+    MessageManager::indexed(const Transport::FuzzyWordQuery& query)
+      const throw()
+    {
+      if(messages_.words.find(query.text.c_str()) != messages_.words.end())
+      {
+        return true;
+      }
+
+      const std::vector<uint32_t>& norm_forms = query.norm_forms;
+        
+      for(std::vector<uint32_t>::const_iterator i(norm_forms.begin()),
+            e(norm_forms.end()); i != e; ++i)
+      {
+        if(messages_.norm_forms.find(*i) != messages_.norm_forms.end())
+        {
+          return true;
+        }
+      }
+
+      return false;
+    }
+    
     struct MessagePerWordDistrCounter
     {
       size_t count;
@@ -4808,10 +5110,15 @@ namespace NewsGate
           norm_form_positions_size += msg.norm_form_positions.size() *
             sizeof(msg.norm_form_positions[0]);
 
+          WordPositionArray positions_buffer;
+          
+          const WordPositionArray& positions =
+            msg.get_positions(positions_buffer);
+          
           positions_size += msg.positions.size() * sizeof(msg.positions[0]);
 
-          positions_stat[msg.positions.size() < positions_stat_size ?
-                         msg.positions.size() : positions_stat_size]++;
+          positions_stat[positions.size() < positions_stat_size ?
+                         positions.size() : positions_stat_size]++;
 
           bool long_message = false;
 
@@ -4825,7 +5132,7 @@ namespace NewsGate
 
             for(size_t j = 0; j < wpos_count; j++)
             {
-              WordPosition p = wp.position(msg.positions, j);
+              WordPosition p = wp.position(positions, j);
               
               if(p >= 256)
               {
@@ -5233,6 +5540,95 @@ namespace NewsGate
       return response._retn();
     }
 
+    Transport::Response*
+    MessageManager::complete_word(
+      const Transport::WordCompletionRequestInfo& request) const
+      throw(El::Exception)
+    {
+      Transport::WordCompletionResponseImpl::Var response =
+        Transport::WordCompletionResponseImpl::Init::create(
+          new Transport::WordCompletionArray());
+
+      WordDictionary_var dict = word_dictionary();
+
+      if(dict.in() != 0)
+      {
+        dict->complete(request.prefix.c_str(),
+                       request.lang,
+                       request.count,
+                       response->entities());
+      }
+
+      return response._retn();
+    }
+
+    Transport::Response*
+    MessageManager::trending_terms(
+      const Transport::TrendingTermsRequestInfo& request) const
+      throw(El::Exception)
+    {
+      Transport::TrendingTermsResponseImpl::Var response =
+        Transport::TrendingTermsResponseImpl::Init::create(
+          new Transport::TrendingTermArray());
+
+      TrendingTerms::TermArray terms;
+
+      trending_terms_.rising(request.lang,
+                             ACE_OS::gettimeofday().sec(),
+                             request.hours,
+                             request.min_count,
+                             request.count,
+                             terms);
+
+      if(terms.empty())
+      {
+        return response._retn();
+      }
+
+      Transport::TrendingTermArray& result = response->entities();
+      result.reserve(terms.size());
+
+      MgrReadGuard guard(mgr_lock_);
+
+      for(TrendingTerms::TermArray::const_iterator i(terms.begin()),
+            e(terms.end()); i != e; ++i)
+      {
+        const StoredMessage* msg = messages_.find(i->sample_message);
+
+        if(msg == 0)
+        {
+          // Can't tell the term text as the message is gone
+          continue;
+        }
+
+        std::string text;
+        std::string text2;
+
+        if(!TrendingTerms::word_text(*msg, i->words.word2, text) ||
+           (i->words.word1 &&
+            !TrendingTerms::word_text(*msg, i->words.word1, text2)))
+        {
+          continue;
+        }
+
+        if(!text2.empty())
+        {
+          text = text2 + " " + text;
+        }
+
+        Transport::TrendingTerm term;
+        term.word_id1 = i->words.word1;
+        term.word_id2 = i->words.word2;
+        term.text = text;
+        term.recent = i->recent;
+        term.expected = i->expected;
+
+        result.push_back(term);
+      }
+
+      return response._retn();
+    }
+
     Transport::Response*
     MessageManager::check_mirrored_messages(IdArray& message_ids,
                                             bool ready) const
@@ -5339,7 +5735,7 @@ namespace NewsGate
           msg.keywords_pos = stored_msg->keywords_pos;
           msg.event_id = stored_msg->event_id;
           msg.event_capacity = stored_msg->event_capacity;
-          msg.flags = stored_msg->flags;
+          msg.flags = stored_msg->flags & ~StoredMessage::MF_PACKED_POSITIONS;
           msg.impressions = stored_msg->impressions;
           msg.clicks = stored_msg->clicks;
           msg.published = stored_msg->published;
@@ -5374,7 +5770,15 @@ namespace NewsGate
           
           if(get_positions)
           {
-            msg.positions = stored_msg->positions;
+            if(stored_msg->positions_packed())
+            {
+              StoredMessage::unpack_positions(stored_msg->positions,
+                                              msg.positions);
+            }
+            else
+            {
+              msg.positions = stored_msg->positions;
+            }
           }
 
           if(get_core_words)
@@ -5566,6 +5970,7 @@ namespace NewsGate
               if(msg->visible())
               {
                 msg->content = it->second.retn();
+                schedule_preemption(*msg);
               }
             }
           }
@@ -5665,24 +6070,189 @@ namespace NewsGate
     }
         
     void
-    MessageManager::traverse_messages(bool prio_msg) throw(El::Exception)
+    MessageManager::schedule_msg_operations(const StoredMessage& msg)
+      throw(El::Exception)
     {
-      if(prio_msg)
-      { 
-        MgrReadGuard guard(mgr_lock_);
-        
-        if(traverse_prio_message_it_ == traverse_prio_message_.end())
-        {
-          return;
-        }
-      }
+      expiration_schedule_.add(msg.id,
+                               msg.published +
+                               config_.message_expiration_time() + 1);
 
-      const char* context = prio_msg ? "prio traverse" : "regular traverse";
+      uint64_t pack_positions_age =
+        config_.message_cache().pack_positions_age();
       
-      MessageCategorizer_var categorizer = get_message_categorizer();
-        
-      MessageOperationList operations;
-
+      if(pack_positions_age && !msg.positions_packed())
+      {
+        packing_schedule_.add(msg.id, msg.published + pack_positions_age);
+      }
+      
+      schedule_preemption(msg);
+    }
+    
+    void
+    MessageManager::schedule_preemption(const StoredMessage& msg)
+      throw(El::Exception)
+    {
+      if(msg.content.in() != 0)
+      {
+        preemption_schedule_.add(msg.id,
+                                 msg.content->timestamp() +
+                                 config_.message_cache().timeout() + 1);
+      }
+    }
+    
+    void
+    MessageManager::exec_scheduled_operations() throw(El::Exception)
+    {
+      ACE_Time_Value current_time = ACE_OS::gettimeofday();
+      time_t cur_time = current_time.sec();
+
+      IdArray expired_ids;
+      expiration_schedule_.take_due(cur_time, expired_ids);
+
+      IdArray preempted_ids;
+      preemption_schedule_.take_due(cur_time, preempted_ids);
+
+      IdArray packed_ids;
+      packing_schedule_.take_due(cur_time, packed_ids);
+
+      if(expired_ids.empty() && preempted_ids.empty() && packed_ids.empty())
+      {
+        return;
+      }
+      
+      time_t expire_time =
+        cur_time > (time_t)config_.message_expiration_time() ?
+        cur_time - config_.message_expiration_time() : 0;
+          
+      time_t preempt_time =
+        cur_time > (time_t)config_.message_cache().timeout() ?
+        cur_time - config_.message_cache().timeout() : 0;
+
+      MessageOperationList operations;
+      
+      {
+        MgrReadGuard guard(mgr_lock_);
+
+        for(IdArray::const_iterator i(expired_ids.begin()),
+              e(expired_ids.end()); i != e; ++i)
+        {
+          const StoredMessage* msg = messages_.find(*i);
+
+          if(msg == 0)
+          {
+            continue;
+          }
+          
+          if(msg->hidden())
+          {
+            // Message is being inserted or changed; will check it later
+            expiration_schedule_.add(msg->id, cur_time + 1);
+          }
+          else if((time_t)msg->published < expire_time)
+          {
+            operations.push_back(std::make_pair(msg->id, MO_DELETE));
+          }
+          else
+          {
+            expiration_schedule_.add(msg->id,
+                                     msg->published +
+                                     config_.message_expiration_time() + 1);
+          }
+        }
+
+        for(IdArray::const_iterator i(preempted_ids.begin()),
+              e(preempted_ids.end()); i != e; ++i)
+        {
+          const StoredMessage* msg = messages_.find(*i);
+
+          if(msg == 0 || msg->content.in() == 0)
+          {
+            continue;
+          }
+          
+          if(msg->hidden())
+          {
+            preemption_schedule_.add(msg->id, cur_time + 1);
+          }
+          else if((time_t)msg->content->timestamp() < preempt_time)
+          {
+            operations.push_back(std::make_pair(msg->id, MO_PREEMPT));
+          }
+          else
+          {
+            // Content was used since scheduled, so postpone preemption
+            schedule_preemption(*msg);
+          }
+        }
+
+        for(IdArray::const_iterator i(packed_ids.begin()),
+              e(packed_ids.end()); i != e; ++i)
+        {
+          const StoredMessage* msg = messages_.find(*i);
+
+          if(msg == 0 || msg->positions_packed())
+          {
+            continue;
+          }
+          
+          if(msg->hidden())
+          {
+            packing_schedule_.add(msg->id, cur_time + 1);
+          }
+          else
+          {
+            operations.push_back(std::make_pair(msg->id, MO_PACK_POSITIONS));
+          }
+        }
+      }
+
+      std::ostringstream log_ostr;
+
+      if(Application::will_trace(El::Logging::HIGH))
+      {
+        log_ostr << "NewsGate::Message::MessageManager::"
+          "exec_scheduled_operations: " << expired_ids.size()
+                 << " expiration, " << preempted_ids.size()
+                 << " preemption and " << packed_ids.size()
+                 << " packing candidates, " << operations.size()
+                 << " operations; " << expiration_schedule_.size()
+                 << "/" << preemption_schedule_.size() << "/"
+                 << packing_schedule_.size() << " scheduled\n";
+      }
+      
+      exec_msg_operations(operations,
+                          cur_time,
+                          preempt_time,
+                          expire_time,
+                          log_ostr);
+
+      if(Application::will_trace(El::Logging::HIGH))
+      {
+        Application::logger()->trace(log_ostr.str(),
+                                     Aspect::MSG_MANAGEMENT,
+                                     El::Logging::HIGH);
+      }
+    }
+    
+    void
+    MessageManager::traverse_messages(bool prio_msg) throw(El::Exception)
+    {
+      if(prio_msg)
+      { 
+        MgrReadGuard guard(mgr_lock_);
+        
+        if(traverse_prio_message_it_ == traverse_prio_message_.end())
+        {
+          return;
+        }
+      }
+
+      const char* context = prio_msg ? "prio traverse" : "regular traverse";
+      
+      MessageCategorizer_var categorizer = get_message_categorizer();
+        
+      MessageOperationList operations;
+
       ACE_Time_Value current_time = ACE_OS::gettimeofday();
       time_t cur_time = current_time.sec();
           
@@ -5802,6 +6372,11 @@ namespace NewsGate
             continue;
           }
 
+          //
+          // Expiration and preemption are normally scheduled on insertion
+          // and done by exec_scheduled_operations; checks here catch up
+          // with messages the schedule has missed
+          //
           if((time_t)msg.published <= expire_time)
           {
             operations.push_back(std::make_pair(msg.id, MO_DELETE));
@@ -5971,6 +6546,8 @@ namespace NewsGate
 
         try
         {
+          exec_scheduled_operations();
+          
           traverse_messages(false);
           traverse_messages(true);
           
@@ -6202,6 +6779,97 @@ namespace NewsGate
       }      
     }
     
+    void
+    MessageManager::update_word_dictionary() throw()
+    {
+      try
+      {
+        try
+        {
+          WordDictionary_var dict =
+            new WordDictionary(config_.message_cache().word_completions(),
+                               WORD_DICTIONARY_TOP_THRESHOLD);
+
+          ACE_Time_Value load_time;
+          ACE_Time_Value index_time;
+          
+          ACE_High_Res_Timer timer;
+          timer.start();
+
+          {
+            MgrReadGuard guard(mgr_lock_);
+            dict->load(messages_.words, messages_.messages);
+          }
+
+          timer.stop();
+          timer.elapsed_time(load_time);
+
+          timer.start();
+          dict->index();
+          timer.stop();
+          timer.elapsed_time(index_time);
+
+          {
+            Guard guard(word_dictionary_lock_);
+            word_dictionary_ = dict;
+          }
+
+          if(Application::will_trace(El::Logging::HIGH))
+          {
+            std::ostringstream ostr;
+            ostr << "NewsGate::Message::MessageManager::"
+              "update_word_dictionary: " << dict->word_count()
+                 << " words, " << dict->top_count()
+                 << " prefixes; load time: " << El::Moment::time(load_time)
+                 << ", index time: " << El::Moment::time(index_time);
+            
+            Application::logger()->trace(ostr.str(),
+                                         Aspect::MSG_MANAGEMENT,
+                                         El::Logging::HIGH);
+          }
+        }
+        catch(const El::Exception& e)
+        {
+          std::ostringstream ostr;
+          ostr << "NewsGate::Message::MessageManager::update_word_dictionary: "
+            "El::Exception caught. Description:" << std::endl << e;
+        
+          El::Service::Error error(ostr.str(), this);
+          callback_->notify(&error);
+        }
+
+        try
+        {
+          El::Service::CompoundServiceMessage_var msg =
+            new UpdateWordDictionary(this);
+          
+          ACE_Time_Value delay(
+            config_.message_cache().word_dictionary_period());
+
+          deliver_at_time(msg.in(), ACE_OS::gettimeofday() + delay);
+        }
+        catch(const El::Exception& e)
+        {
+          std::ostringstream ostr;
+          ostr << "NewsGate::Message::MessageManager::update_word_dictionary: "
+            "El::Exception caught while scheduling task. Description:"
+               << std::endl << e;
+        
+          El::Service::Error error(ostr.str(), this);
+          callback_->notify(&error);
+        }
+      }
+      catch(...)
+      {
+        El::Service::Error error(
+          "NewsGate::Message::MessageManager::update_word_dictionary: "
+          "unexpected exception caught.",
+          this);
+          
+        callback_->notify(&error);
+      }      
+    }
+    
     MessageManager::MessageFetchFilterMap*
     MessageManager::get_message_fetch_filters() const throw()
     {
@@ -6266,15 +6934,22 @@ namespace NewsGate
       MessageFetchFilterMap_var filters = get_message_fetch_filters();
 
       {
-        MgrWriteGuard guard(mgr_lock_);
+        // Search is not blocked while filters evaluated
+        MgrReadGuard guard(mgr_lock_);
         
-        apply_message_fetch_filters(
+        select_filtered_messages(
           messages_,
           filters.in(),
           capacity_filter_.in(),
           removed_msg,
           config_.message_cache().delete_message_pack());
+      }
 
+      if(!removed_msg.empty())
+      {
+        MgrWriteGuard guard(mgr_lock_);
+        
+        remove_filtered_messages(removed_msg);
         recent_msg_deletions(removed_msg);        
       }
 
@@ -6649,14 +7324,20 @@ namespace NewsGate
         timer.start();
         
         {
-          MgrWriteGuard guard(mgr_lock_);
+          MgrReadGuard guard(mgr_lock_);
           
-          apply_message_fetch_filters(messages_,
-                                      filters.in(),
-                                      capacity_filter_.in(),
-                                      removed_msg,
-                                      SIZE_MAX);
+          select_filtered_messages(messages_,
+                                   filters.in(),
+                                   capacity_filter_.in(),
+                                   removed_msg,
+                                   SIZE_MAX);
+        }
 
+        if(!removed_msg.empty())
+        {
+          MgrWriteGuard guard(mgr_lock_);
+          
+          remove_filtered_messages(removed_msg);
           recent_msg_deletions(removed_msg);
         }
         
@@ -7176,7 +7857,63 @@ namespace NewsGate
       size_t max_remove_count)
       throw(Exception, El::Exception)
     {
-      size_t removed_count = 0;
+      IdTimeMap selected_msg;
+      
+      size_t removed_count = select_filtered_messages(messages,
+                                                      filters,
+                                                      capacity_filter,
+                                                      selected_msg,
+                                                      max_remove_count);
+
+      for(IdTimeMap::const_iterator i(selected_msg.begin()),
+            e(selected_msg.end()); i != e; ++i)
+      {
+        messages.remove(i->first);
+        removed_msg.insert(*i);
+      }
+      
+      return removed_count;
+    }
+
+    size_t
+    MessageManager::select_filtered_messages(
+      const SearcheableMessageMap& messages,
+      MessageFetchFilterMap* filters,
+      Search::Expression* capacity_filter,
+      IdTimeMap& removed_msg,
+      size_t max_remove_count)
+      throw(Exception, El::Exception)
+    {
+      ConditionArray conditions;
+
+      if(filters)
+      {
+        conditions.reserve(filters->size());
+        
+        for(MessageFetchFilterMap::const_iterator i(filters->begin()),
+              e(filters->end()); i != e; ++i)
+        {
+          conditions.push_back(i->second.condition.in());
+        }
+      }
+
+      size_t message_count = messages.messages.size();
+      
+      size_t capacity_excess =
+        capacity_filter && capacity_threshold_ < message_count ?
+        message_count - capacity_threshold_ : 0;
+      
+      FilterTask_var task = new FilterTask(messages,
+                                           conditions,
+                                           capacity_filter,
+                                           capacity_excess);
+
+      size_t jobs = task->jobs();
+
+      if(jobs == 0)
+      {
+        return 0;
+      }
       
       ACE_High_Res_Timer timer;
 
@@ -7184,52 +7921,152 @@ namespace NewsGate
       {
         timer.start();
       }
+
+      if(filter_thread_pool_.in() != 0 && jobs > 1)
+      {
+        for(size_t i = 0; i < jobs; ++i)
+        {
+          filter_thread_pool_->execute(task.in());
+        }
+
+        task->wait(filter_thread_pool_.in());
+      }
+      else
+      {
+        for(size_t i = 0; i < jobs; ++i)
+        {
+          task->run(i);
+        }
+      }
+
+      //
+      // Merging job results in filter order, so messages matching several
+      // filters counted once
+      //
       
+      size_t removed_count = 0;
       std::ostringstream removed_messages_ostr;
 
-      if(filters)
+      for(size_t i = 0;
+          i < conditions.size() && removed_count < max_remove_count; ++i)
       {
-        for(MessageFetchFilterMap::const_iterator it = filters->begin();
-            it != filters->end() && removed_count < max_remove_count; it++)
-        {
-          const MessageFetchFilter& filter = it->second;
-          
-          Search::Condition::Context context(messages);
-          Search::Condition::MessageMatchInfoMap match_info;
-          
-          Search::Condition::ResultPtr result(
-            filter.condition->evaluate(context, match_info, 0));
-          
-          size_t count =
-            std::min(max_remove_count - removed_count, result->size());
-          
-          removed_msg.resize(removed_msg.size() + count);
+        const IdTimeArray& result = task->result(i);
 
-          for(Search::Condition::Result::const_iterator it = result->begin();
-              it != result->end() && removed_count < max_remove_count;
-              it++, removed_count++)
+        for(IdTimeArray::const_iterator j(result.begin()), e(result.end());
+            j != e && removed_count < max_remove_count; ++j)
+        {
+          if(removed_msg.insert(*j).second)
           {
-            const StoredMessage* msg = it->second;
+            removed_messages_ostr << std::endl << j->first.string() << " "
+                                  << j->second;
             
-            const Id& id = msg->id;
+            ++removed_count;
+          }
+        }
+      }
 
-            removed_messages_ostr << std::endl << id.string() << " "
-                                  << msg->published;
-          
-            removed_msg.insert(std::make_pair(id, msg->published));
-            messages.remove(id);
+      if(capacity_excess > removed_count && removed_count < max_remove_count)
+      {
+        // Capacity filter result (oldest messages first) covers messages
+        // removed by fetch filters, so has enough of the rest
+        
+        size_t count = std::min(capacity_excess - removed_count,
+                                max_remove_count - removed_count);
+
+        const IdTimeArray& result = task->result(conditions.size());
+        
+        removed_messages_ostr << "\n*******";
+
+        for(IdTimeArray::const_iterator i(result.begin()), e(result.end());
+            i != e && count; ++i)
+        {
+          if(removed_msg.insert(*i).second)
+          {
+            removed_messages_ostr << std::endl << i->first.string() << " "
+                                  << i->second;
+            
+            ++removed_count;
+            --count;
           }
         }
       }
+         
+      if(removed_count && Application::will_trace(El::Logging::HIGH))
+      {
+        timer.stop();
+        ACE_Time_Value tm;
+        timer.elapsed_time(tm);
+            
+        std::ostringstream ostr;
+        ostr << "NewsGate::Message::MessageManager::"
+          "select_filtered_messages: " << removed_count
+             << " messages filtered out of " << message_count << " by "
+             << jobs << " jobs; time " << El::Moment::time(tm) << ":"
+             << removed_messages_ostr.str();
+
+        Application::logger()->trace(ostr.str(),
+                                     Aspect::DB_PERFORMANCE,
+                                     El::Logging::HIGH);
+      }
       
-      if(capacity_filter && removed_count < max_remove_count &&
-         capacity_threshold_ < messages.messages.size())
+      return removed_count;
+    }
+
+    void
+    MessageManager::remove_filtered_messages(IdTimeMap& removed_msg)
+      throw(El::Exception)
+    {
+      IdArray gone;
+      
+      for(IdTimeMap::const_iterator i(removed_msg.begin()),
+            e(removed_msg.end()); i != e; ++i)
       {
-        size_t count =
-          std::min(messages.messages.size() - capacity_threshold_,
-                   max_remove_count - removed_count);
+        const Id& id = i->first;
+        
+        if(messages_.find(id))
+        {
+          messages_.remove(id);
+        }
+        else
+        {
+          gone.push_back(id);
+        }
+      }
 
+      for(IdArray::const_iterator i(gone.begin()), e(gone.end()); i != e;
+          ++i)
+      {
+        removed_msg.erase(*i);
+      }
+    }
 
+    //
+    // MessageManager::FilterTask class
+    //
+    void
+    MessageManager::FilterTask::run(size_t job) throw(El::Exception)
+    {
+      IdTimeArray& result = results_[job];
+      
+      if(job < conditions_.size())
+      {
+        Search::Condition::Context context(messages_);
+        Search::Condition::MessageMatchInfoMap match_info;
+          
+        Search::Condition::ResultPtr res(
+          conditions_[job]->evaluate(context, match_info, 0));
+
+        result.reserve(res->size());
+        
+        for(Search::Condition::Result::const_iterator i(res->begin()),
+              e(res->end()); i != e; ++i)
+        {
+          const StoredMessage* msg = i->second;
+          result.push_back(std::make_pair(msg->id, msg->published));
+        }
+      }
+      else
+      {
         Search::Strategy strategy(new Search::Strategy::SortByPubDateAcs(),
                                   new Search::Strategy::SuppressNone(),
                                   false,
@@ -7237,51 +8074,127 @@ namespace NewsGate
                                   Search::Strategy::RF_MESSAGES);
 
         Search::ResultPtr res(
-          capacity_filter->search(messages, false, strategy));
+          capacity_filter_->search(messages_, false, strategy));
 
-        res->take_top(0, count, strategy);
-
-        removed_messages_ostr << "\n*******";
+        res->take_top(0, capacity_excess_, strategy);
 
+        result.reserve(res->message_infos->size());
+        
         for(Search::MessageInfoArray::const_iterator
               i(res->message_infos->begin()), e(res->message_infos->end());
             i != e; ++i)
         {
-          const Search::MessageInfo& mi(*i);
-          
-          const Id& id = mi.wid.id;
-          const StoredMessage* msg = messages.find(id);
+          const Id& id = i->wid.id;
+          const StoredMessage* msg = messages_.find(id);
 
           assert(msg);
+          result.push_back(std::make_pair(id, msg->published));
+        }
+      }
+    }
+    
+    void
+    MessageManager::FilterTask::execute() throw(El::Exception)
+    {
+      size_t job = 0;
+      
+      {
+        Guard guard(lock_);
+
+        if(cancelled_)
+        {
+          return;
+        }
+        
+        job = next_job_++;
+      }
+
+      std::string error;
+      
+      try
+      {
+        run(job);
+      }
+      catch(const El::Exception& e)
+      {
+        error = e.what();
+      }
+      catch(const std::exception& e)
+      {
+        error = e.what();
+      }
+      catch(...)
+      {
+        error = "unknown exception caught";
+      }
+
+      Guard guard(lock_);
+
+      if(!error.empty() && error_.empty())
+      {
+        error_ = error;
+      }
+
+      if(++completed_jobs_ == (cancelled_ ? next_job_ : results_.size()))
+      {
+        completed_.signal();
+      }
+    }
+
+    void
+    MessageManager::FilterTask::wait(El::Service::ThreadPool* thread_pool)
+      throw(Exception, El::Exception)
+    {
+      Guard guard(lock_);
+      
+      while(completed_jobs_ < (cancelled_ ? next_job_ : results_.size()))
+      {
+        // Waits by 1 second to check if thread pool is stopped and
+        // jobs not taken yet will never be executed
+        
+        ACE_Time_Value timeout = ACE_OS::gettimeofday() + ACE_Time_Value(1);
+        
+        if(completed_.wait(&timeout) == 0)
+        {
+          continue;
+        }
+
+        int error = ACE_OS::last_error();
+
+        if(error != ETIME)
+        {
+          std::ostringstream ostr;
+          ostr << "NewsGate::Message::MessageManager::FilterTask::wait: "
+            "completed_.wait() failed. Errno " << error
+               << ". Description:" << std::endl << ACE_OS::strerror(error);
           
-          removed_messages_ostr << std::endl << id.string() << " "
-                                << msg->published;
-          
-          removed_msg.insert(std::make_pair(id, msg->published));
-          messages.remove(id);        
+          throw Exception(ostr.str());
         }
 
-        removed_count += res->message_infos->size();
+        if(!thread_pool->started())
+        {
+          cancelled_ = true;
+        }
       }
-         
-      if(removed_count && Application::will_trace(El::Logging::HIGH))
+
+      if(completed_jobs_ < results_.size())
       {
-        timer.stop();
-        ACE_Time_Value tm;
-        timer.elapsed_time(tm);
-            
         std::ostringstream ostr;
-        ostr << "NewsGate::Message::MessageManager::"
-          "apply_message_fetch_filters: " << removed_count
-             << " messages removed; time " << El::Moment::time(tm) << ":"
-             << removed_messages_ostr.str();
+        ostr << "NewsGate::Message::MessageManager::FilterTask::wait: "
+          "thread pool stopped; " << results_.size() - completed_jobs_
+             << " of " << results_.size() << " jobs not executed";
+        
+        throw Exception(ostr.str());
+      }
 
-        Application::logger()->trace(ostr.str(),
-                                     Aspect::DB_PERFORMANCE,
-                                     El::Logging::HIGH);
+      if(!error_.empty())
+      {
+        std::ostringstream ostr;
+        ostr << "NewsGate::Message::MessageManager::FilterTask::wait: "
+          "filter evaluation failed. Reason:\n" << error_;
+
+        throw Exception(ostr.str());
       }
-      
-      return removed_count;
     }
 
     MessageManager::AssignResult
@@ -7957,6 +8870,7 @@ namespace NewsGate
         
         size_t dirty_messages = 0;
         size_t flushed_messages = 0;
+        size_t packed_messages = 0;
 
         unsigned long max_flush_pack_size =
           config_.message_cache().max_flush_pack_size();
@@ -8069,6 +8983,15 @@ namespace NewsGate
                 flush_msg_stat(file, *msg, flushed_messages++);
               }
               
+              break;
+            }
+          case MO_PACK_POSITIONS:
+            {
+              if(msg->pack_positions())
+              {
+                ++packed_messages;
+              }
+              
               break;
             }
             
@@ -8077,6 +9000,12 @@ namespace NewsGate
 
         guard.release();
 
+        if(packed_messages && Application::will_trace(El::Logging::HIGH))
+        {
+          log_ostr << " * packed positions of " << packed_messages
+                   << " messages\n";
+        }
+
         El::MySQL::Connection_var connection =
           Application::instance()->dbase()->connect();
 
@@ -8917,6 +9846,12 @@ namespace NewsGate
         traverse_cache();
         return "traverse_cache";
       }
+
+      if(dynamic_cast<UpdateWordDictionary*>(event) != 0)
+      {
+        update_word_dictionary();
+        return "update_word_dictionary";
+      }
       
       SaveMsgStat* sms = dynamic_cast<SaveMsgStat*>(event);
       
@@ -37,6 +37,7 @@
 #include <El/Exception.hpp>
 #include <El/RefCount/All.hpp>
 #include <El/Service/CompoundService.hpp>
+#include <El/Service/ThreadPool.hpp>
 #include <El/String/StringPtr.hpp>
 #include <El/String/LightString.hpp>
 #include <El/Locale.hpp>
@@ -59,6 +60,10 @@
 #include "MessageLoader.hpp"
 #include "MessagePack.hpp"
 #include "WordPairManager.hpp"
+#include "WordDictionary.hpp"
+#include "MorphologyCache.hpp"
+#include "MessageSchedule.hpp"
+#include "TrendingTerms.hpp"
 
 namespace NewsGate
 {
@@ -196,6 +201,14 @@ namespace NewsGate
                   ::NewsGate::Message::PostMessageReason reason)
         throw(WordManagerNotReady, Exception, El::Exception);
 
+      //
+      // Normalizes words of messages with the current dictionary, so
+      // insert has nothing to normalize for them; can be called
+      // concurrently with insert. Returns false if dictionary changed.
+      //
+      bool normalize_words(StoredMessageList& messages)
+        throw(WordManagerNotReady, Exception, El::Exception);
+
       void process_message_events(
         Transport::MessageEventPackImpl::Type* pack,
         ::NewsGate::Message::PostMessageReason reason)
@@ -283,6 +296,82 @@ namespace NewsGate
         size_t max_remove_count)
         throw(Exception, El::Exception);
 
+      //
+      // Collects into removed_msg messages matching filters or exceeding
+      // capacity threshold without modifying messages, so messages_ can be
+      // processed under read lock. If capacity_filter specified, the lock
+      // is to be held as capacity_threshold_ is used.
+      //
+      size_t select_filtered_messages(
+        const SearcheableMessageMap& messages,
+        MessageFetchFilterMap* filters,
+        Search::Expression* capacity_filter,
+        IdTimeMap& removed_msg,
+        size_t max_remove_count)
+        throw(Exception, El::Exception);
+
+      //
+      // Removes selected messages from messages_ under write lock;
+      // messages gone since selection are excluded from removed_msg
+      //
+      void remove_filtered_messages(IdTimeMap& removed_msg)
+        throw(El::Exception);
+
+      typedef std::vector<std::pair<Id, uint64_t> > IdTimeArray;
+      typedef std::vector<const Search::Condition*> ConditionArray;
+
+      //
+      // Evaluates message fetch filters (a job per filter) and capacity
+      // filter (last job) against message map using pool threads
+      //
+      class FilterTask : public virtual El::Service::ThreadPool::TaskBase
+      {
+      public:
+        FilterTask(const SearcheableMessageMap& messages,
+                   const ConditionArray& conditions,
+                   Search::Expression* capacity_filter,
+                   size_t capacity_excess)
+          throw(El::Exception);
+
+        virtual ~FilterTask() throw() {}
+
+        size_t jobs() const throw();
+
+        // Executes job in calling thread
+        void run(size_t job) throw(El::Exception);
+
+        //
+        // If thread pool stops before all jobs are taken, waits for
+        // the taken ones and throws Exception
+        //
+        void wait(El::Service::ThreadPool* thread_pool)
+          throw(Exception, El::Exception);
+
+        virtual void execute() throw(El::Exception);
+
+        const IdTimeArray& result(size_t job) const throw();
+
+      private:
+        typedef ACE_Thread_Mutex Mutex;
+        typedef ACE_Guard<Mutex> Guard;
+        typedef ACE_Condition<ACE_Thread_Mutex> Condition;
+
+        Mutex lock_;
+        Condition completed_;
+
+        const SearcheableMessageMap& messages_;
+        const ConditionArray& conditions_;
+        Search::Expression* capacity_filter_;
+        size_t capacity_excess_;
+        std::vector<IdTimeArray> results_;
+        size_t next_job_;
+        size_t completed_jobs_;
+        bool cancelled_;
+        std::string error_;
+      };
+
+      typedef El::RefCount::SmartPtr<FilterTask> FilterTask_var;
+
       void delete_messages(const IdTimeMap& ids,
                            El::MySQL::Connection* connection,
                            bool event_bank_notify = true)
@@ -363,8 +452,23 @@ namespace NewsGate
       Transport::Response* message_stat(
         Transport::MessageStatRequestInfo* stat) throw(El::Exception);
 
+      Transport::Response* complete_word(
+        const Transport::WordCompletionRequestInfo& request) const
+        throw(El::Exception);
+
+      WordDictionary* word_dictionary() const throw();
+
+      Transport::Response* trending_terms(
+        const Transport::TrendingTermsRequestInfo& request) const
+        throw(El::Exception);
+
+      Transport::Response* fuzzy_words(
+        const Transport::FuzzyWordsRequestInfo& request) const
+        throw(El::Exception);
+
       virtual bool notify(El::Service::Event* event) throw(El::Exception);
       virtual bool start() throw(Exception, El::Exception);
+      virtual bool stop() throw(Exception, El::Exception);
       virtual void wait() throw(Exception, El::Exception);
 
       void flush_messages() throw(Exception, El::Exception);
@@ -414,6 +518,19 @@ namespace NewsGate
       bool renormalize_words(StoredMessageList& messages,
                              uint32_t dict_hash)
         throw(WordManagerNotReady, Exception, El::Exception);
+
+      bool normalize_cached_words(StoredMessageList& messages,
+                                  uint32_t dict_hash,
+                                  IdSet* changed_norm_forms)
+        throw(WordManagerNotReady, Exception, El::Exception);
+
+      static bool language_settled(const StoredMessage& msg) throw();
+
+      static void set_normalized(StoredMessage& msg,
+                                 StoredMessage& new_msg,
+                                 uint32_t dict_hash,
+                                 IdSet* changed_norm_forms)
+        throw(El::Exception);
       
       void insert_loaded_messages() throw(El::Exception);
       
@@ -423,6 +540,9 @@ namespace NewsGate
         throw(Exception, El::Exception);
 
       void traverse_cache() throw();
+      void update_word_dictionary() throw();
+
+      bool indexed(const Transport::FuzzyWordQuery& query) const throw();
       void apply_message_fetch_filters() throw(Exception, El::Exception);
       void reapply_message_fetch_filters() throw(Exception, El::Exception);
 
@@ -450,6 +570,11 @@ namespace NewsGate
         TraverseCache(MessageManager* state) throw(El::Exception);
       };
 
+      struct UpdateWordDictionary : public El::Service::CompoundServiceMessage
+      {
+        UpdateWordDictionary(MessageManager* state) throw(El::Exception);
+      };
+
       struct ApplyMsgFetchFilters :
         public El::Service::CompoundServiceMessage
       {
@@ -539,7 +664,8 @@ namespace NewsGate
       {
         MO_PREEMPT,
         MO_DELETE,
-        MO_FLUSH_STATE
+        MO_FLUSH_STATE,
+        MO_PACK_POSITIONS
       };
 
       typedef std::list<std::pair<Message::Id, MessageOperation> >
@@ -680,6 +806,12 @@ namespace NewsGate
       void schedule_load() throw(El::Exception);
 
       void traverse_messages(bool prio_msg) throw(El::Exception);
+      void exec_scheduled_operations() throw(El::Exception);
+
+      void schedule_msg_operations(const StoredMessage& msg)
+        throw(El::Exception);
+      
+      void schedule_preemption(const StoredMessage& msg) throw(El::Exception);
       void import_messages(ImportMsg* im) throw(El::Exception);
 
       enum ImportMessagesResult
@@ -780,6 +912,12 @@ namespace NewsGate
       
       SearcheableMessageMap messages_;
       ContentCache content_cache_;
+
+      mutable ThreadMutex word_dictionary_lock_;
+      WordDictionary_var word_dictionary_;
+
+      typedef std::auto_ptr<MorphologyCache> MorphologyCachePtr;
+      MorphologyCachePtr morphology_cache_;
       
       std::string cache_filename_;
       ACE_Time_Value next_sharing_time_;
@@ -805,6 +943,14 @@ namespace NewsGate
 
       NumberSet traverse_prio_message_;
       NumberSet::const_iterator traverse_prio_message_it_;
+
+      MessageSchedule expiration_schedule_;
+      MessageSchedule preemption_schedule_;
+      MessageSchedule packing_schedule_;
+
+      TrendingTerms trending_terms_;
+
+      El::Service::ThreadPool_var filter_thread_pool_;
       
       MessageFetchFilterMap_var message_filters_;
       MessageCategorizer_var message_categorizer_;
@@ -1077,6 +1223,16 @@ namespace NewsGate
       MgrReadGuard guard(mgr_lock_);
       return messages_.messages.size();
     }
+
+    inline
+    WordDictionary*
+    MessageManager::word_dictionary() const throw()
+    {
+      Guard guard(word_dictionary_lock_);
+      
+      WordDictionary_var dict = word_dictionary_;
+      return dict.retn();
+    }
     
     inline
     bool
@@ -1129,6 +1285,44 @@ namespace NewsGate
     {
     }
 
+    //
+    // NewsGate::Message::MessageManager::FilterTask class
+    //
+    inline
+    MessageManager::FilterTask::FilterTask(
+      const SearcheableMessageMap& messages,
+      const ConditionArray& conditions,
+      Search::Expression* capacity_filter,
+      size_t capacity_excess)
+      throw(El::Exception)
+        : TaskBase(false),
+          completed_(lock_),
+          messages_(messages),
+          conditions_(conditions),
+          capacity_filter_(capacity_filter),
+          capacity_excess_(capacity_excess),
+          next_job_(0),
+          completed_jobs_(0),
+          cancelled_(false)
+    {
+      results_.resize(jobs());
+    }
+
+    inline
+    size_t
+    MessageManager::FilterTask::jobs() const throw()
+    {
+      return conditions_.size() +
+        (capacity_filter_ && capacity_excess_ ? 1 : 0);
+    }
+
+    inline
+    const MessageManager::IdTimeArray&
+    MessageManager::FilterTask::result(size_t job) const throw()
+    {
+      return results_[job];
+    }
+
     //
     // NewsGate::Message::MessageManager::ImportMsg class
     //
@@ -1162,6 +1356,18 @@ namespace NewsGate
     {
     }
 
+    //
+    // NewsGate::Message::MessageManager::UpdateWordDictionary class
+    //
+    inline
+    MessageManager::UpdateWordDictionary::UpdateWordDictionary(
+      MessageManager* state)
+      throw(El::Exception)
+        : El__Service__CompoundServiceMessageBase(state, state, false),
+          El::Service::CompoundServiceMessage(state, state)
+    {
+    }
+
     //
     // NewsGate::Message::MessageManager::MsgDeleteNotification class
     //
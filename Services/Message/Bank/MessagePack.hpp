@@ -96,6 +96,7 @@ namespace NewsGate
       bool empty() const throw();        
 
       PendingMessagePack pop_front() throw(El::Exception);
+      const PendingMessagePack& front() const throw();
 
       size_t pending_new_messages() const throw();
       size_t pending_shared_messages() const throw();
@@ -488,6 +489,14 @@ namespace NewsGate
       low_prio_queue_.clear();
     }
     
+    inline
+    const PendingMessagePack&
+    PendingMessagePackQueue::front() const throw()
+    {
+      return high_prio_queue_.empty() ?
+        low_prio_queue_.front() : high_prio_queue_.front();
+    }
+
     inline
     PendingMessagePack
     PendingMessagePackQueue::pop_front() throw(El::Exception)
@@ -0,0 +1,136 @@
+/*
+ * product   : NewsGate - news search WEB server
+ * copyright : Copyright (c) 2005-2016 Karen Arutyunov
+ * licenses  : CC BY-NC-SA 3.0; see accompanying LICENSE file
+ *             Commercial; contact karen.arutyunov@gmail.com
+ */
+
+/**
+ * @file NewsGate/Server/Services/Message/Bank/MessageSchedule.hpp
+ * @author Karen Aroutiounov
+ * $Id: $
+ */
+
+#ifndef _NEWSGATE_SERVER_SERVICES_MESSAGE_BANK_MESSAGESCHEDULE_HPP_
+#define _NEWSGATE_SERVER_SERVICES_MESSAGE_BANK_MESSAGESCHEDULE_HPP_
+
+#include <stdint.h>
+
+#include <map>
+
+#include <ace/OS.h>
+#include <ace/Synch.h>
+#include <ace/Guard_T.h>
+
+#include <El/Exception.hpp>
+
+#include <Commons/Message/Message.hpp>
+
+namespace NewsGate
+{
+  namespace Message
+  {
+    //
+    // Message ids grouped into time buckets by the time some operation
+    // on message becomes due. Lets to pick messages the operation is due
+    // for without traversing whole message cache. Id can be scheduled
+    // multiple times or for a removed message, so the operation
+    // conditions are to be rechecked on execution.
+    //
+    class MessageSchedule
+    {
+    public:
+      MessageSchedule(uint64_t bucket_period) throw(El::Exception);
+
+      void add(const Id& id, uint64_t time) throw(El::Exception);
+
+      //
+      // Moves into ids messages scheduled for time not later than
+      // specified one
+      //
+      void take_due(uint64_t time, IdArray& ids) throw(El::Exception);
+
+      size_t size() const throw();
+      void clear() throw();
+
+    private:
+      typedef ACE_Thread_Mutex Mutex;
+      typedef ACE_Guard<Mutex> Guard;
+
+      typedef std::map<uint64_t, IdArray> BucketMap;
+
+      mutable Mutex lock_;
+      uint64_t bucket_period_;
+      BucketMap buckets_;
+      size_t size_;
+    };
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Inlines
+///////////////////////////////////////////////////////////////////////////////
+
+namespace NewsGate
+{
+  namespace Message
+  {
+    //
+    // MessageSchedule class
+    //
+    inline
+    MessageSchedule::MessageSchedule(uint64_t bucket_period)
+      throw(El::Exception)
+        : bucket_period_(bucket_period ? bucket_period : 1),
+          size_(0)
+    {
+    }
+
+    inline
+    void
+    MessageSchedule::add(const Id& id, uint64_t time) throw(El::Exception)
+    {
+      Guard guard(lock_);
+
+      buckets_[(time + bucket_period_ - 1) / bucket_period_].push_back(id);
+      ++size_;
+    }
+
+    inline
+    void
+    MessageSchedule::take_due(uint64_t time, IdArray& ids)
+      throw(El::Exception)
+    {
+      Guard guard(lock_);
+
+      uint64_t last_bucket = time / bucket_period_;
+
+      for(BucketMap::iterator i(buckets_.begin());
+          i != buckets_.end() && i->first <= last_bucket; buckets_.erase(i++))
+      {
+        ids.insert(ids.end(), i->second.begin(), i->second.end());
+        size_ -= i->second.size();
+      }
+    }
+
+    inline
+    size_t
+    MessageSchedule::size() const throw()
+    {
+      Guard guard(lock_);
+      return size_;
+    }
+
+    inline
+    void
+    MessageSchedule::clear() throw()
+    {
+      Guard guard(lock_);
+
+      buckets_.clear();
+      size_ = 0;
+    }
+  }
+}
+
+#endif // _NEWSGATE_SERVER_SERVICES_MESSAGE_BANK_MESSAGESCHEDULE_HPP_
@@ -0,0 +1,259 @@
+/*
+ * product   : NewsGate - news search WEB server
+ * copyright : Copyright (c) 2005-2016 Karen Arutyunov
+ * licenses  : CC BY-NC-SA 3.0; see accompanying LICENSE file
+ *             Commercial; contact karen.arutyunov@gmail.com
+ */
+
+/**
+ * @file NewsGate/Server/Services/Message/Bank/MorphologyCache.cpp
+ * @author Karen Aroutiounov
+ * $Id: $
+ */
+
+#include <El/CORBA/Corba.hpp>
+
+#include <utility>
+#include <sstream>
+
+#include <Services/Dictionary/Commons/DictionaryServices.hpp>
+#include <Services/Dictionary/Commons/TransportImpl.hpp>
+
+#include "BankMain.hpp"
+#include "MorphologyCache.hpp"
+
+namespace NewsGate
+{
+  namespace Message
+  {
+    //
+    // MorphologyCache class
+    //
+    bool
+    MorphologyCache::normalize(MessageWordsArray& messages, uint32_t dict_hash)
+      throw(WordManagerNotReady, Exception, El::Exception)
+    {
+      typedef std::vector<std::pair<size_t, size_t> > MissedWordArray;
+
+      MissedWordArray missed_words;
+      LangWordInfoMap words;
+
+      {
+        ReadGuard guard(lock_);
+
+        bool valid = dict_hash_ == dict_hash;
+
+        for(size_t i = 0; i < messages.size(); ++i)
+        {
+          MessageWords& msg = messages[i];
+
+          const MessageWordPosition& word_positions = *msg.word_positions;
+          msg.word_infos.resize(word_positions.size());
+
+          LangWordInfoMap::const_iterator li =
+            valid ? words_.find(msg.lang) : words_.end();
+
+          for(size_t j = 0; j < word_positions.size(); ++j)
+          {
+            const char* word = word_positions[j].first.c_str();
+
+            if(li != words_.end())
+            {
+              WordInfoMap::const_iterator wi = li->second.find(word);
+
+              if(wi != li->second.end())
+              {
+                msg.word_infos[j] = wi->second;
+                continue;
+              }
+            }
+
+            words[msg.lang][word] = El::Dictionary::Morphology::WordInfo();
+            missed_words.push_back(std::make_pair(i, j));
+          }
+        }
+      }
+
+      if(missed_words.empty())
+      {
+        return true;
+      }
+
+      bool dict_not_changed = normalize(words, dict_hash);
+
+      for(MissedWordArray::const_iterator i(missed_words.begin()),
+            e(missed_words.end()); i != e; ++i)
+      {
+        MessageWords& msg = messages[i->first];
+
+        msg.word_infos[i->second] =
+          words[msg.lang][(*msg.word_positions)[i->second].first.c_str()];
+      }
+
+      if(dict_not_changed)
+      {
+        save(words, dict_hash);
+      }
+
+      if(Application::will_trace(El::Logging::HIGH))
+      {
+        size_t word_count = 0;
+
+        for(LangWordInfoMap::const_iterator i(words.begin()), e(words.end());
+            i != e; ++i)
+        {
+          word_count += i->second.size();
+        }
+
+        std::ostringstream ostr;
+        ostr << "NewsGate::Message::MorphologyCache::normalize: "
+             << word_count << " words of " << messages.size()
+             << " messages normalized by WordManager; " << size()
+             << " words cached";
+
+        Application::logger()->trace(ostr.str(),
+                                     Aspect::MSG_MANAGEMENT,
+                                     El::Logging::HIGH);
+      }
+
+      return dict_not_changed;
+    }
+
+    bool
+    MorphologyCache::normalize(LangWordInfoMap& words, uint32_t dict_hash)
+      throw(WordManagerNotReady, Exception, El::Exception)
+    {
+      bool dict_not_changed = true;
+
+      try
+      {
+        Dictionary::WordManager_var word_manager =
+          Application::instance()->word_manager();
+
+        for(LangWordInfoMap::iterator i(words.begin()), e(words.end());
+            i != e; ++i)
+        {
+          WordInfoMap& lang_words = i->second;
+
+          Dictionary::WordManager::WordSeq word_seq;
+          word_seq.length(lang_words.size());
+
+          size_t j = 0;
+
+          for(WordInfoMap::const_iterator wi(lang_words.begin()),
+                we(lang_words.end()); wi != we; ++wi)
+          {
+            word_seq[j++] = CORBA::string_dup(wi->first.c_str());
+          }
+
+          Dictionary::Transport::NormalizedWordsPack_var result;
+
+          if(word_manager->normalize_words(word_seq,
+                                           i->first.l3_code(),
+                                           result.out()) != dict_hash)
+          {
+            dict_not_changed = false;
+          }
+
+          Dictionary::Transport::NormalizedWordsPackImpl::Type* impl =
+            dynamic_cast<Dictionary::Transport::NormalizedWordsPackImpl::Type*>(
+              result.in());
+
+          if(impl == 0)
+          {
+            throw Exception(
+              "NewsGate::Message::MorphologyCache::normalize: "
+              "dynamic_cast<Dictionary::Transport::"
+              "NormalizedWordsPackImpl::Type*> failed");
+          }
+
+          El::Dictionary::Morphology::WordInfoArray& word_infos =
+            impl->entities();
+
+          if(word_infos.size() != lang_words.size())
+          {
+            std::ostringstream ostr;
+            ostr << "NewsGate::Message::MorphologyCache::normalize: "
+              "unexpected result size " << word_infos.size()
+                 << " instead of " << lang_words.size();
+
+            throw Exception(ostr.str());
+          }
+
+          j = 0;
+
+          for(WordInfoMap::iterator wi(lang_words.begin()),
+                we(lang_words.end()); wi != we; ++wi)
+          {
+            wi->second = word_infos[j++];
+          }
+        }
+      }
+      catch(const Dictionary::NotReady& e)
+      {
+        std::ostringstream ostr;
+        ostr << "NewsGate::Message::MorphologyCache::normalize: word manager "
+          "not ready. Reason:\n" << e.reason.in();
+
+        throw WordManagerNotReady(ostr.str());
+      }
+      catch(const Dictionary::ImplementationException& e)
+      {
+        std::ostringstream ostr;
+        ostr << "NewsGate::Message::MorphologyCache::normalize: "
+          "Dictionary::WordManager::ImplementationException caught. "
+          "Description:\n" << e.description.in();
+
+        throw Exception(ostr.str());
+      }
+      catch(const CORBA::Exception& e)
+      {
+        std::ostringstream ostr;
+        ostr << "NewsGate::Message::MorphologyCache::normalize: word manager "
+          "not ready. Reason: CORBA::Exception caught. "
+          "Description:\n" << e;
+
+        throw WordManagerNotReady(ostr.str());
+      }
+
+      return dict_not_changed;
+    }
+
+    void
+    MorphologyCache::save(const LangWordInfoMap& words, uint32_t dict_hash)
+      throw(El::Exception)
+    {
+      WriteGuard guard(lock_);
+
+      if(dict_hash_ != dict_hash)
+      {
+        words_.clear();
+        size_ = 0;
+        dict_hash_ = dict_hash;
+      }
+
+      for(LangWordInfoMap::const_iterator i(words.begin()), e(words.end());
+          i != e; ++i)
+      {
+        const WordInfoMap& lang_words = i->second;
+
+        if(size_ + lang_words.size() > max_size_)
+        {
+          words_.clear();
+          size_ = 0;
+        }
+
+        WordInfoMap& cached_words = words_[i->first];
+
+        for(WordInfoMap::const_iterator wi(lang_words.begin()),
+              we(lang_words.end()); wi != we; ++wi)
+        {
+          if(cached_words.insert(*wi).second)
+          {
+            ++size_;
+          }
+        }
+      }
+    }
+  }
+}
@@ -0,0 +1,153 @@
+/*
+ * product   : NewsGate - news search WEB server
+ * copyright : Copyright (c) 2005-2016 Karen Arutyunov
+ * licenses  : CC BY-NC-SA 3.0; see accompanying LICENSE file
+ *             Commercial; contact karen.arutyunov@gmail.com
+ */
+
+/**
+ * @file NewsGate/Server/Services/Message/Bank/MorphologyCache.hpp
+ * @author Karen Aroutiounov
+ * $Id: $
+ */
+
+#ifndef _NEWSGATE_SERVER_SERVICES_MESSAGE_BANK_MORPHOLOGYCACHE_HPP_
+#define _NEWSGATE_SERVER_SERVICES_MESSAGE_BANK_MORPHOLOGYCACHE_HPP_
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include <ext/hash_map>
+
+#include <ace/OS.h>
+#include <ace/Synch.h>
+#include <ace/Guard_T.h>
+
+#include <El/Exception.hpp>
+#include <El/Hash/Hash.hpp>
+#include <El/Lang.hpp>
+#include <El/Dictionary/Morphology.hpp>
+
+#include <Commons/Message/StoredMessage.hpp>
+
+namespace NewsGate
+{
+  namespace Message
+  {
+    //
+    // Bank-local cache of word normal forms by language. Words missed in
+    // the cache are normalized by WordManager with a single request per
+    // language. Cache is bound to the dictionary hash, so gets cleared on
+    // hash change, and also when grows above max_size words. Used only for
+    // messages with the language already guessed by WordManager, as
+    // per word normalization doesn't guess it.
+    //
+    class MorphologyCache
+    {
+    public:
+
+      EL_EXCEPTION(Exception, El::ExceptionBase);
+      EL_EXCEPTION(WordManagerNotReady, Exception);
+
+      struct MessageWords
+      {
+        El::Lang lang;
+        const MessageWordPosition* word_positions;
+        El::Dictionary::Morphology::WordInfoArray word_infos;
+
+        MessageWords(const El::Lang& lang_val,
+                     const MessageWordPosition* word_positions_val)
+          throw(El::Exception);
+      };
+
+      typedef std::vector<MessageWords> MessageWordsArray;
+
+      MorphologyCache(size_t max_size) throw(El::Exception);
+
+      //
+      // Fills word_infos of each messages element. Returns false if
+      // WordManager dictionary hash differs from dict_hash; results are
+      // not cached in this case.
+      //
+      bool normalize(MessageWordsArray& messages, uint32_t dict_hash)
+        throw(WordManagerNotReady, Exception, El::Exception);
+
+      size_t size() const throw();
+
+    private:
+
+      typedef __gnu_cxx::hash_map<std::string,
+                                  El::Dictionary::Morphology::WordInfo,
+                                  El::Hash::String>
+      WordInfoMap;
+
+      typedef __gnu_cxx::hash_map<El::Lang, WordInfoMap, El::Hash::Lang>
+      LangWordInfoMap;
+
+      bool normalize(LangWordInfoMap& words, uint32_t dict_hash)
+        throw(WordManagerNotReady, Exception, El::Exception);
+
+      void save(const LangWordInfoMap& words, uint32_t dict_hash)
+        throw(El::Exception);
+
+    private:
+
+      typedef ACE_RW_Thread_Mutex Mutex;
+      typedef ACE_Read_Guard<Mutex> ReadGuard;
+      typedef ACE_Write_Guard<Mutex> WriteGuard;
+
+      mutable Mutex lock_;
+
+      size_t max_size_;
+      size_t size_;
+      uint32_t dict_hash_;
+      LangWordInfoMap words_;
+    };
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Inlines
+///////////////////////////////////////////////////////////////////////////////
+
+namespace NewsGate
+{
+  namespace Message
+  {
+    //
+    // MorphologyCache::MessageWords struct
+    //
+    inline
+    MorphologyCache::MessageWords::MessageWords(
+      const El::Lang& lang_val,
+      const MessageWordPosition* word_positions_val)
+      throw(El::Exception)
+        : lang(lang_val),
+          word_positions(word_positions_val)
+    {
+    }
+
+    //
+    // MorphologyCache class
+    //
+    inline
+    MorphologyCache::MorphologyCache(size_t max_size) throw(El::Exception)
+        : max_size_(max_size),
+          size_(0),
+          dict_hash_(0)
+    {
+    }
+
+    inline
+    size_t
+    MorphologyCache::size() const throw()
+    {
+      ReadGuard guard(lock_);
+      return size_;
+    }
+  }
+}
+
+#endif // _NEWSGATE_SERVER_SERVICES_MESSAGE_BANK_MORPHOLOGYCACHE_HPP_
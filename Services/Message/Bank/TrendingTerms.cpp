@@ -0,0 +1,419 @@
+/*
+ * product   : NewsGate - news search WEB server
+ * copyright : Copyright (c) 2005-2016 Karen Arutyunov
+ * licenses  : CC BY-NC-SA 3.0; see accompanying LICENSE file
+ *             Commercial; contact karen.arutyunov@gmail.com
+ */
+
+/**
+ * @file NewsGate/Server/Services/Message/Bank/TrendingTerms.cpp
+ * @author Karen Aroutiounov
+ * $Id: $
+ */
+
+#include <algorithm>
+#include <utility>
+
+#include <El/Dictionary/Morphology.hpp>
+
+#include <Commons/Message/TransportImpl.hpp>
+
+#include "TrendingTerms.hpp"
+
+namespace
+{
+  struct TermRisesHigher
+  {
+    bool operator()(const NewsGate::Message::TrendingTerms::Term& a,
+                    const NewsGate::Message::TrendingTerms::Term& b) const
+      throw()
+    {
+      return rise(a) > rise(b);
+    }
+
+    static float rise(const NewsGate::Message::TrendingTerms::Term& term)
+      throw()
+    {
+      NewsGate::Message::Transport::TrendingTerm t;
+      t.recent = term.recent;
+      t.expected = term.expected;
+
+      return t.rise();
+    }
+  };
+}
+
+namespace NewsGate
+{
+  namespace Message
+  {
+    //
+    // TrendingTerms::Summary class
+    //
+    void
+    TrendingTerms::Summary::increment(const WordPair& words, const Id& msg_id)
+      throw(El::Exception)
+    {
+      CounterIndex::iterator i = index_.find(words);
+      CounterList::iterator counter;
+
+      if(i != index_.end())
+      {
+        counter = i->second;
+      }
+      else
+      {
+        if(index_.size() < capacity_)
+        {
+          // Zero count bucket is temporary, the counter is moved to the
+          // next one below
+          if(buckets_.empty() || buckets_.begin()->count)
+          {
+            buckets_.push_front(Bucket(0));
+          }
+
+          CounterList& counters = buckets_.begin()->counters;
+          counters.push_back(Counter());
+
+          counter = --counters.end();
+          counter->bucket = buckets_.begin();
+          counter->error = 0;
+        }
+        else
+        {
+          // Replacing one of the least counted terms
+          counter = buckets_.begin()->counters.begin();
+          index_.erase(counter->words);
+          counter->error = buckets_.begin()->count;
+        }
+
+        counter->words = words;
+        index_.insert(std::make_pair(words, counter));
+      }
+
+      counter->sample_message = msg_id;
+
+      BucketList::iterator bucket = counter->bucket;
+      BucketList::iterator next = bucket;
+
+      uint32_t count = bucket->count + 1;
+
+      if(++next == buckets_.end() || next->count != count)
+      {
+        next = buckets_.insert(next, Bucket(count));
+      }
+
+      next->counters.splice(next->counters.end(), bucket->counters, counter);
+      counter->bucket = next;
+
+      if(bucket->counters.empty())
+      {
+        buckets_.erase(bucket);
+      }
+    }
+
+    uint32_t
+    TrendingTerms::Summary::max_count(const WordPair& words) const throw()
+    {
+      CounterIndex::const_iterator i = index_.find(words);
+
+      if(i != index_.end())
+      {
+        return i->second->bucket->count;
+      }
+
+      return index_.size() < capacity_ || buckets_.empty() ? 0 :
+        buckets_.begin()->count;
+    }
+
+    //
+    // TrendingTerms class
+    //
+    TrendingTerms::TrendingTerms(uint32_t window_period,
+                                 uint32_t windows,
+                                 uint32_t capacity)
+      throw(El::Exception)
+        : window_period_(window_period ? window_period : 1),
+          windows_(windows),
+          capacity_(capacity)
+    {
+    }
+
+    TrendingTerms::~TrendingTerms() throw()
+    {
+      for(LangWindowsMap::iterator i(lang_windows_.begin()),
+            e(lang_windows_.end()); i != e; ++i)
+      {
+        WindowArray& windows = *i->second;
+
+        for(WindowArray::iterator j(windows.begin()), je(windows.end());
+            j != je; ++j)
+        {
+          delete *j;
+        }
+
+        delete i->second;
+      }
+    }
+
+    void
+    TrendingTerms::add(const StoredMessage& msg) throw(El::Exception)
+    {
+      const CoreWords& core_words = msg.core_words;
+
+      if(capacity_ == 0 || windows_ < 2 || core_words.empty())
+      {
+        return;
+      }
+
+      uint64_t window = msg.fetched / window_period_;
+      uint64_t now_window = ACE_OS::gettimeofday().sec() / window_period_;
+
+      if(window > now_window || window + windows_ <= now_window)
+      {
+        return;
+      }
+
+      Guard guard(lock_);
+
+      LangWindowsMap::iterator i = lang_windows_.find(msg.lang);
+
+      if(i == lang_windows_.end())
+      {
+        WindowArray* windows = new WindowArray(windows_);
+
+        for(WindowArray::iterator j(windows->begin()), e(windows->end());
+            j != e; ++j)
+        {
+          *j = new Window(capacity_);
+        }
+
+        i = lang_windows_.insert(std::make_pair(msg.lang, windows)).first;
+      }
+
+      Window& win = *(*i->second)[window % windows_];
+
+      if(win.index != window)
+      {
+        if(win.index > window)
+        {
+          return;
+        }
+
+        // Window slot reused for a new time period
+        win.summary.clear();
+        win.index = window;
+      }
+
+      Summary& summary = win.summary;
+
+      for(size_t j = 0; j < core_words.size(); ++j)
+      {
+        summary.increment(WordPair(core_words[j], 0), msg.id);
+
+        for(size_t k = j + 1; k < core_words.size(); ++k)
+        {
+          summary.increment(WordPair(core_words[j], core_words[k]), msg.id);
+        }
+      }
+    }
+
+    void
+    TrendingTerms::rising(const El::Lang& lang,
+                          uint64_t now,
+                          uint32_t hours,
+                          uint32_t min_count,
+                          size_t count,
+                          TermArray& terms) const
+      throw(El::Exception)
+    {
+      if(capacity_ == 0 || windows_ < 2 || count == 0)
+      {
+        return;
+      }
+
+      uint32_t recent_windows =
+        std::min((uint64_t)windows_ - 1,
+                 std::max((uint64_t)1,
+                          ((uint64_t)hours * 3600 + window_period_ - 1) /
+                          window_period_));
+
+      uint64_t now_window = now / window_period_;
+
+      {
+        Guard guard(lock_);
+
+        if(lang == El::Lang::null)
+        {
+          for(LangWindowsMap::const_iterator i(lang_windows_.begin()),
+                e(lang_windows_.end()); i != e; ++i)
+          {
+            rising(*i->second, now_window, recent_windows, min_count, terms);
+          }
+        }
+        else
+        {
+          LangWindowsMap::const_iterator i = lang_windows_.find(lang);
+
+          if(i != lang_windows_.end())
+          {
+            rising(*i->second, now_window, recent_windows, min_count, terms);
+          }
+        }
+      }
+
+      count = std::min(count, terms.size());
+
+      std::partial_sort(terms.begin(),
+                        terms.begin() + count,
+                        terms.end(),
+                        TermRisesHigher());
+
+      terms.resize(count);
+    }
+
+    void
+    TrendingTerms::rising(const WindowArray& windows,
+                          uint64_t now_window,
+                          uint32_t recent_windows,
+                          uint32_t min_count,
+                          TermArray& terms) const
+      throw(El::Exception)
+    {
+      std::vector<const Summary*> recent;
+      std::vector<const Summary*> preceding;
+
+      for(uint64_t i = 0; i < windows_ && i <= now_window; ++i)
+      {
+        uint64_t index = now_window - i;
+        const Window& win = *windows[index % windows_];
+
+        if(win.index == index)
+        {
+          (i < recent_windows ? recent : preceding).push_back(&win.summary);
+        }
+      }
+
+      if(recent.empty() || preceding.empty())
+      {
+        // Nothing to compare with
+        return;
+      }
+
+      TermMap term_map;
+
+      for(std::vector<const Summary*>::const_iterator i(recent.begin()),
+            e(recent.end()); i != e; ++i)
+      {
+        const Summary::BucketList& buckets = (*i)->buckets();
+
+        for(Summary::BucketList::const_iterator b(buckets.begin()),
+              be(buckets.end()); b != be; ++b)
+        {
+          for(Summary::CounterList::const_iterator c(b->counters.begin()),
+                ce(b->counters.end()); c != ce; ++c)
+          {
+            Term& term = term_map[c->words];
+
+            if(term.recent == 0)
+            {
+              // Most recent window comes first
+              term.words = c->words;
+              term.sample_message = c->sample_message;
+            }
+
+            term.recent += b->count - c->error;
+          }
+        }
+      }
+
+      float expectation_factor = (float)recent_windows / preceding.size();
+
+      for(TermMap::iterator i(term_map.begin()), e(term_map.end()); i != e;
+          ++i)
+      {
+        Term& term = i->second;
+
+        if(term.recent < min_count || term.recent == 0)
+        {
+          continue;
+        }
+
+        uint64_t preceding_count = 0;
+
+        for(std::vector<const Summary*>::const_iterator
+              j(preceding.begin()), je(preceding.end()); j != je; ++j)
+        {
+          preceding_count += (*j)->max_count(term.words);
+        }
+
+        term.expected = expectation_factor * preceding_count;
+
+        if(TermRisesHigher::rise(term) > 0)
+        {
+          terms.push_back(term);
+        }
+      }
+    }
+
+    bool
+    TrendingTerms::word_text(const StoredMessage& msg,
+                             uint32_t word_id,
+                             std::string& text)
+      throw(El::Exception)
+    {
+      const MessageWordPosition& word_positions = msg.word_positions;
+
+      const NormFormPosition::KeyValue* norm_form =
+        msg.norm_form_positions.find(word_id);
+
+      if(norm_form == 0)
+      {
+        // Word unknown to dictionary is identified by pseudo id
+        for(size_t i = 0; i < word_positions.size(); ++i)
+        {
+          const char* word = word_positions[i].first.c_str();
+
+          if(El::Dictionary::Morphology::pseudo_id(word) == word_id)
+          {
+            text = word;
+            return true;
+          }
+        }
+
+        return false;
+      }
+
+      if(norm_form->second.position_count() == 0)
+      {
+        return false;
+      }
+
+      //
+      // Taking the word occupying first position of the norm form
+      //
+
+      WordPositionArray positions_buffer;
+      const WordPositionArray& positions = msg.get_positions(positions_buffer);
+
+      WordPosition position = norm_form->second.position(positions, 0);
+
+      for(size_t i = 0; i < word_positions.size(); ++i)
+      {
+        const WordPositions& wpos = word_positions[i].second;
+        WordPositionNumber count = wpos.position_count();
+
+        for(WordPositionNumber j = 0; j < count; ++j)
+        {
+          if(wpos.position(positions, j) == position)
+          {
+            text = word_positions[i].first.c_str();
+            return true;
+          }
+        }
+      }
+
+      return false;
+    }
+  }
+}
@@ -0,0 +1,229 @@
+/*
+ * product   : NewsGate - news search WEB server
+ * copyright : Copyright (c) 2005-2016 Karen Arutyunov
+ * licenses  : CC BY-NC-SA 3.0; see accompanying LICENSE file
+ *             Commercial; contact karen.arutyunov@gmail.com
+ */
+
+/**
+ * @file NewsGate/Server/Services/Message/Bank/TrendingTerms.hpp
+ * @author Karen Aroutiounov
+ * $Id: $
+ */
+
+#ifndef _NEWSGATE_SERVER_SERVICES_MESSAGE_BANK_TRENDINGTERMS_HPP_
+#define _NEWSGATE_SERVER_SERVICES_MESSAGE_BANK_TRENDINGTERMS_HPP_
+
+#include <stdint.h>
+
+#include <list>
+#include <vector>
+#include <string>
+
+#include <ext/hash_map>
+
+#include <ace/OS.h>
+#include <ace/Synch.h>
+#include <ace/Guard_T.h>
+
+#include <El/Exception.hpp>
+#include <El/Hash/Hash.hpp>
+#include <El/Lang.hpp>
+
+#include <Commons/Message/Message.hpp>
+#include <Commons/Message/StoredMessage.hpp>
+
+namespace NewsGate
+{
+  namespace Message
+  {
+    //
+    // Streaming heavy hitters among message core words and core word
+    // pairs, tracked per language and time window. Each window has a
+    // bounded number of counters maintained with Space-Saving algorithm:
+    // when counters are exhausted the least counted term is replaced by a
+    // new one, which inherits the count as an overestimation error.
+    // Counters of equal count are grouped into buckets ordered by count,
+    // so each update costs O(1).
+    //
+    class TrendingTerms
+    {
+    public:
+
+      struct Term
+      {
+        WordPair words; // word1 is 0 for a single word
+        Id sample_message;
+        uint64_t recent;
+        float expected;
+
+        Term() throw() : recent(0), expected(0) {}
+      };
+
+      typedef std::vector<Term> TermArray;
+
+      TrendingTerms(uint32_t window_period,
+                    uint32_t windows,
+                    uint32_t capacity)
+        throw(El::Exception);
+
+      ~TrendingTerms() throw();
+
+      void add(const StoredMessage& msg) throw(El::Exception);
+
+      //
+      // Fills terms with up to count terms of the language (of any if
+      // El::Lang::null) met in messages fetched during last hours more
+      // often than expected from the preceding windows. Term is to be met
+      // at least min_count times. Recent counts are taken with Space-Saving
+      // errors subtracted and preceding ones with errors included, so
+      // overestimation can't make a term trending.
+      //
+      void rising(const El::Lang& lang,
+                  uint64_t now,
+                  uint32_t hours,
+                  uint32_t min_count,
+                  size_t count,
+                  TermArray& terms) const
+        throw(El::Exception);
+
+      //
+      // Finds text of core word in the message it comes from
+      //
+      static bool word_text(const StoredMessage& msg,
+                            uint32_t word_id,
+                            std::string& text)
+        throw(El::Exception);
+
+    private:
+
+      class Summary
+      {
+      public:
+        struct Bucket;
+        typedef std::list<Bucket> BucketList;
+
+        struct Counter
+        {
+          WordPair words;
+          Id sample_message;
+          uint32_t error;
+          BucketList::iterator bucket;
+        };
+
+        typedef std::list<Counter> CounterList;
+
+        struct Bucket
+        {
+          uint32_t count;
+          CounterList counters;
+
+          Bucket(uint32_t count_val) throw() : count(count_val) {}
+        };
+
+        Summary(uint32_t capacity) throw(El::Exception);
+
+        void increment(const WordPair& words, const Id& msg_id)
+          throw(El::Exception);
+
+        //
+        // Max count of the term; for untracked term it is the least
+        // count of tracked ones if all counters are in use
+        //
+        uint32_t max_count(const WordPair& words) const throw();
+
+        const BucketList& buckets() const throw() { return buckets_; }
+
+        void clear() throw();
+
+      private:
+
+        typedef __gnu_cxx::hash_map<WordPair,
+                                    CounterList::iterator,
+                                    WordPairHash>
+        CounterIndex;
+
+        uint32_t capacity_;
+        BucketList buckets_; // In count ascending order
+        CounterIndex index_;
+      };
+
+      struct Window
+      {
+        uint64_t index;
+        Summary summary;
+
+        Window(uint32_t capacity) throw(El::Exception);
+      };
+
+      typedef std::vector<Window*> WindowArray;
+
+      typedef __gnu_cxx::hash_map<El::Lang, WindowArray*, El::Hash::Lang>
+      LangWindowsMap;
+
+      typedef __gnu_cxx::hash_map<WordPair, Term, WordPairHash> TermMap;
+
+      void rising(const WindowArray& windows,
+                  uint64_t now_window,
+                  uint32_t recent_windows,
+                  uint32_t min_count,
+                  TermArray& terms) const
+        throw(El::Exception);
+
+    private:
+
+      typedef ACE_Thread_Mutex Mutex;
+      typedef ACE_Guard<Mutex> Guard;
+
+      mutable Mutex lock_;
+
+      uint32_t window_period_;
+      uint32_t windows_;
+      uint32_t capacity_;
+      LangWindowsMap lang_windows_;
+
+    private:
+      TrendingTerms(const TrendingTerms&);
+      void operator=(const TrendingTerms&);
+    };
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Inlines
+///////////////////////////////////////////////////////////////////////////////
+
+namespace NewsGate
+{
+  namespace Message
+  {
+    //
+    // TrendingTerms::Summary class
+    //
+    inline
+    TrendingTerms::Summary::Summary(uint32_t capacity) throw(El::Exception)
+        : capacity_(capacity)
+    {
+    }
+
+    inline
+    void
+    TrendingTerms::Summary::clear() throw()
+    {
+      index_.clear();
+      buckets_.clear();
+    }
+
+    //
+    // TrendingTerms::Window struct
+    //
+    inline
+    TrendingTerms::Window::Window(uint32_t capacity) throw(El::Exception)
+        : index(0),
+          summary(capacity)
+    {
+    }
+  }
+}
+
+#endif // _NEWSGATE_SERVER_SERVICES_MESSAGE_BANK_TRENDINGTERMS_HPP_
@@ -0,0 +1,493 @@
+/*
+ * product   : NewsGate - news search WEB server
+ * copyright : Copyright (c) 2005-2016 Karen Arutyunov
+ * licenses  : CC BY-NC-SA 3.0; see accompanying LICENSE file
+ *             Commercial; contact karen.arutyunov@gmail.com
+ */
+
+/**
+ * @file NewsGate/Server/Services/Message/Bank/WordDictionary.cpp
+ * @author Karen Aroutiounov
+ * $Id: $
+ */
+
+#include <string.h>
+
+#include <utility>
+#include <sstream>
+#include <vector>
+#include <algorithm>
+
+#include <El/String/Manip.hpp>
+
+#include "WordDictionary.hpp"
+
+namespace
+{
+  wchar_t
+  next_char(const char*& text) throw()
+  {
+    unsigned char chr = *text++;
+
+    if(chr < 0x80)
+    {
+      return chr;
+    }
+
+    size_t tail = chr >= 0xF0 ? 3 : (chr >= 0xE0 ? 2 : (chr >= 0xC0 ? 1 : 0));
+    wchar_t res = chr & (0x3F >> tail);
+
+    for(; tail && (*text & 0xC0) == 0x80; --tail)
+    {
+      res = (res << 6) | (*text++ & 0x3F);
+    }
+
+    return res;
+  }
+
+  struct FuzzyCandidate
+  {
+    size_t distance;
+    uint32_t count;
+    uint32_t word;
+
+    FuzzyCandidate(size_t distance_val, uint32_t count_val, uint32_t word_val)
+      throw()
+        : distance(distance_val),
+          count(count_val),
+          word(word_val)
+    {
+    }
+
+    bool operator<(const FuzzyCandidate& val) const throw()
+    {
+      return distance < val.distance ||
+        (distance == val.distance && (count > val.count ||
+                                      (count == val.count && word < val.word)));
+    }
+  };
+
+  typedef std::vector<FuzzyCandidate> FuzzyCandidateArray;
+}
+
+namespace NewsGate
+{
+  namespace Message
+  {
+    //
+    // WordDictionary class
+    //
+    void
+    WordDictionary::load(const WordToMessageNumberMap& words,
+                         const StoredMessageMap& messages)
+      throw(Exception, El::Exception)
+    {
+      //
+      // Only copying here as done under the lock blocking message
+      // insertion; sorting is left for index
+      //
+      
+      loaded_buffer_.clear();
+      loaded_words_.clear();
+      loaded_langs_.clear();
+      
+      loaded_words_.reserve(words.size());
+
+      for(WordToMessageNumberMap::const_iterator i(words.begin()),
+            e(words.end()); i != e; ++i)
+      {
+        const WordMessages& word_messages = *i->second;
+
+        if(word_messages.messages.empty())
+        {
+          continue;
+        }
+
+        uint32_t langs_begin = loaded_langs_.size();
+
+        if(word_messages.lang_counter.get() == 0)
+        {
+          StoredMessageMap::const_iterator mi =
+            messages.find(*word_messages.messages.begin());
+
+          if(mi == messages.end())
+          {
+            std::ostringstream ostr;
+            ostr << "NewsGate::Message::WordDictionary::load: no message "
+              "found for word '" << i->first.c_str() << "'";
+
+            throw Exception(ostr.str());
+          }
+
+          loaded_langs_.push_back(
+            std::make_pair(mi->second->lang,
+                           (uint32_t)word_messages.messages.size()));
+        }
+        else
+        {
+          const LangCounterMap& lang_counter = *word_messages.lang_counter;
+
+          for(LangCounterMap::const_iterator li(lang_counter.begin()),
+                le(lang_counter.end()); li != le; ++li)
+          {
+            if(li->second.messages)
+            {
+              loaded_langs_.push_back(
+                std::make_pair(li->first, li->second.messages));
+            }
+          }
+        }
+
+        const char* text = i->first.c_str();
+        
+        loaded_words_.push_back(
+          LoadedWord(loaded_buffer_.size(),
+                     word_messages.messages.size(),
+                     langs_begin,
+                     loaded_langs_.size()));
+        
+        loaded_buffer_.append(text, strlen(text) + 1);
+      }
+    }
+
+    void
+    WordDictionary::index() throw(Exception, El::Exception)
+    {
+      std::sort(loaded_words_.begin(),
+                loaded_words_.end(),
+                LoadedWordLess(loaded_buffer_.c_str()));
+
+      buffer_.clear();
+      buffer_.reserve(loaded_buffer_.size());
+
+      offsets_.clear();
+      offsets_.reserve(loaded_words_.size());
+
+      all_.entries.clear();
+      all_.entries.reserve(loaded_words_.size());
+
+      langs_.clear();
+
+      for(LoadedWordArray::const_iterator i(loaded_words_.begin()),
+            e(loaded_words_.end()); i != e; ++i)
+      {
+        uint32_t index = offsets_.size();
+        const char* text = loaded_buffer_.c_str() + i->offset;
+
+        offsets_.push_back(buffer_.size());
+        buffer_.append(text, strlen(text) + 1);
+
+        all_.entries.push_back(Entry(index, i->count));
+
+        for(LangCountArray::const_iterator li(loaded_langs_.begin() +
+                                              i->langs_begin),
+              le(loaded_langs_.begin() + i->langs_end); li != le; ++li)
+        {
+          langs_[li->first].entries.push_back(Entry(index, li->second));
+        }
+      }
+
+      std::string().swap(loaded_buffer_);
+      LoadedWordArray().swap(loaded_words_);
+      LangCountArray().swap(loaded_langs_);
+      
+      top_count_ = 0;
+
+      all_.top.clear();
+      index(all_, 0, all_.entries.size(), 0);
+
+      for(LangWordsMap::iterator i(langs_.begin()), e(langs_.end()); i != e;
+          ++i)
+      {
+        LangWords& lang_words = i->second;
+
+        lang_words.top.clear();
+        index(lang_words, 0, lang_words.entries.size(), 0);
+      }
+    }
+
+    void
+    WordDictionary::index(LangWords& lang_words,
+                          size_t begin,
+                          size_t end,
+                          size_t depth)
+      throw(El::Exception)
+    {
+      if(end - begin <= top_threshold_)
+      {
+        return;
+      }
+
+      const EntryArray& entries = lang_words.entries;
+
+      IndexArray& top =
+        lang_words.top[std::string(word(entries[begin].word), depth)];
+
+      select_top(entries, begin, end, top_words_, top);
+      ++top_count_;
+
+      //
+      // Word equal to the prefix goes first in the range
+      //
+
+      size_t i = begin;
+
+      if(word(entries[i].word)[depth] == '\0')
+      {
+        ++i;
+      }
+
+      while(i < end)
+      {
+        char c = word(entries[i].word)[depth];
+        size_t j = i + 1;
+
+        for(; j < end && word(entries[j].word)[depth] == c; ++j);
+
+        index(lang_words, i, j, depth + 1);
+        i = j;
+      }
+    }
+
+    void
+    WordDictionary::select_top(const EntryArray& entries,
+                               size_t begin,
+                               size_t end,
+                               size_t count,
+                               IndexArray& top) const
+      throw(El::Exception)
+    {
+      top.clear();
+      top.reserve(end - begin);
+
+      for(size_t i = begin; i < end; ++i)
+      {
+        top.push_back(i);
+      }
+
+      count = std::min(count, top.size());
+
+      std::partial_sort(top.begin(),
+                        top.begin() + count,
+                        top.end(),
+                        EntryHeavier(entries));
+
+      top.resize(count);
+
+      IndexArray(top).swap(top);
+    }
+
+    void
+    WordDictionary::complete(const char* prefix,
+                             const El::Lang& lang,
+                             size_t count,
+                             Transport::WordCompletionArray& completions) const
+      throw(El::Exception)
+    {
+      const LangWords* lang_words = this->lang_words(lang);
+
+      // Precalculated top lists are not longer than top_words_
+      count = std::min(count, top_words_);
+
+      if(lang_words == 0 || count == 0)
+      {
+        return;
+      }
+
+      const EntryArray& entries = lang_words->entries;
+      TopMap::const_iterator ti = lang_words->top.find(prefix);
+
+      IndexArray range_top;
+      const IndexArray* top = 0;
+
+      if(ti == lang_words->top.end())
+      {
+        EntryArray::const_iterator b =
+          std::lower_bound(entries.begin(),
+                           entries.end(),
+                           prefix,
+                           EntryPrefixLess(*this));
+
+        size_t len = strlen(prefix);
+        EntryArray::const_iterator e = b;
+
+        for(; e != entries.end() && strncmp(word(e->word), prefix, len) == 0;
+            ++e);
+
+        select_top(entries,
+                   b - entries.begin(),
+                   e - entries.begin(),
+                   count,
+                   range_top);
+
+        top = &range_top;
+      }
+      else
+      {
+        top = &ti->second;
+      }
+
+      count = std::min(count, top->size());
+      completions.reserve(completions.size() + count);
+
+      for(IndexArray::const_iterator i(top->begin()), e(top->begin() + count);
+          i != e; ++i)
+      {
+        const Entry& entry = entries[*i];
+        completions.push_back(
+          Transport::WordCompletion(word(entry.word), entry.count));
+      }
+    }
+
+    void
+    WordDictionary::fuzzy(const char* text,
+                          size_t max_distance,
+                          size_t count,
+                          uint32_t query,
+                          Transport::FuzzyWordArray& words) const
+      throw(El::Exception)
+    {
+      std::wstring query;
+      El::String::Manip::utf8_to_wchar(text, query);
+
+      if(query.empty() || count == 0)
+      {
+        return;
+      }
+
+      size_t columns = query.length() + 1;
+
+      //
+      // Row i of Levenshtein matrix corresponds to the prefix of the current
+      // word consisting of i characters, which ends at byte offsets[i]
+      //
+      
+      std::vector<size_t> rows(columns);
+      std::vector<size_t> offsets(1, 0);
+
+      for(size_t j = 0; j < columns; ++j)
+      {
+        rows[j] = j;
+      }
+
+      FuzzyCandidateArray candidates;
+
+      const char* prev = "";
+      size_t word_count = offsets_.size();
+
+      for(size_t i = 0; i < word_count; )
+      {
+        const char* current = word(i);
+
+        //
+        // Reusing rows for the prefix shared with the previous word
+        //
+        
+        size_t depth = offsets.size() - 1;
+
+        for(; depth && strncmp(current, prev, offsets[depth]) != 0; --depth);
+
+        offsets.resize(depth + 1);
+        rows.resize((depth + 1) * columns);
+        prev = current;
+
+        bool pruned = false;
+        const char* ptr = current + offsets[depth];
+
+        while(*ptr != '\0')
+        {
+          wchar_t chr = next_char(ptr);
+
+          rows.resize((depth + 2) * columns);
+
+          const size_t* up = &rows[depth * columns];
+          size_t* row = &rows[(depth + 1) * columns];
+
+          row[0] = up[0] + 1;
+          size_t row_min = row[0];
+
+          for(size_t j = 1; j < columns; ++j)
+          {
+            size_t val = std::min(std::min(up[j], row[j - 1]) + 1,
+                                  up[j - 1] + (query[j - 1] == chr ? 0 : 1));
+
+            row[j] = val;
+            row_min = std::min(row_min, val);
+          }
+
+          offsets.push_back(ptr - current);
+          ++depth;
+
+          if(row_min > max_distance)
+          {
+            //
+            // No word with such a prefix can match
+            //
+            
+            i = prefix_end(i, current, offsets[depth]);
+            pruned = true;
+            break;
+          }
+        }
+
+        if(!pruned)
+        {
+          size_t distance = rows[depth * columns + columns - 1];
+
+          if(distance && distance <= max_distance)
+          {
+            candidates.push_back(
+              FuzzyCandidate(distance, all_.entries[i].count, i));
+          }
+
+          ++i;
+        }
+      }
+
+      count = std::min(count, candidates.size());
+
+      std::partial_sort(candidates.begin(),
+                        candidates.begin() + count,
+                        candidates.end());
+
+      words.reserve(words.size() + count);
+
+      for(size_t i = 0; i < count; ++i)
+      {
+        const FuzzyCandidate& candidate = candidates[i];
+        
+        words.push_back(
+          Transport::FuzzyWord(query,
+                               word(candidate.word),
+                               candidate.distance,
+                               candidate.count));
+      }
+    }
+
+    size_t
+    WordDictionary::prefix_end(size_t index,
+                               const char* prefix,
+                               size_t len) const
+      throw()
+    {
+      size_t begin = index + 1;
+      size_t end = offsets_.size();
+
+      while(begin < end)
+      {
+        size_t middle = begin + (end - begin) / 2;
+
+        if(strncmp(word(middle), prefix, len) == 0)
+        {
+          begin = middle + 1;
+        }
+        else
+        {
+          end = middle;
+        }
+      }
+
+      return begin;
+    }
+  }
+}
@@ -0,0 +1,356 @@
+/*
+ * product   : NewsGate - news search WEB server
+ * copyright : Copyright (c) 2005-2016 Karen Arutyunov
+ * licenses  : CC BY-NC-SA 3.0; see accompanying LICENSE file
+ *             Commercial; contact karen.arutyunov@gmail.com
+ */
+
+/**
+ * @file NewsGate/Server/Services/Message/Bank/WordDictionary.hpp
+ * @author Karen Aroutiounov
+ * $Id: $
+ */
+
+#ifndef _NEWSGATE_SERVER_SERVICES_MESSAGE_BANK_WORDDICTIONARY_HPP_
+#define _NEWSGATE_SERVER_SERVICES_MESSAGE_BANK_WORDDICTIONARY_HPP_
+
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include <ext/hash_map>
+
+#include <El/Exception.hpp>
+#include <El/RefCount/All.hpp>
+#include <El/Hash/Hash.hpp>
+#include <El/Lang.hpp>
+
+#include <Commons/Message/StoredMessage.hpp>
+#include <Commons/Message/TransportImpl.hpp>
+
+namespace NewsGate
+{
+  namespace Message
+  {
+    //
+    // Sorted snapshot of words indexed by bank. Word texts are packed
+    // into a single buffer; per language entry arrays refer to words by
+    // their index in the sorted word array, so are sorted too and allow
+    // prefix range lookups with binary search. For prefixes covering
+    // more than top_threshold entries most frequent words are
+    // precalculated, so completion never scans more than top_threshold
+    // entries. Completion count is limited to top_words for the same
+    // reason.
+    //
+    class WordDictionary :
+      public El::RefCount::DefaultImpl<El::Sync::ThreadPolicy>
+    {
+    public:
+      EL_EXCEPTION(Exception, El::ExceptionBase);
+
+      typedef std::vector<uint32_t> IndexArray;
+
+      WordDictionary(size_t top_words, size_t top_threshold)
+        throw(El::Exception);
+
+      virtual ~WordDictionary() throw() {}
+
+      //
+      // Copies words with their message counts; requires words and
+      // messages to be locked for read
+      //
+      void load(const WordToMessageNumberMap& words,
+                const StoredMessageMap& messages)
+        throw(Exception, El::Exception);
+
+      //
+      // Sorts words loaded and calculates most frequent words for heavy
+      // prefixes; can be called after load without a lock
+      //
+      void index() throw(Exception, El::Exception);
+
+      //
+      // Returns at most top_words completions
+      //
+      void complete(const char* prefix,
+                    const El::Lang& lang,
+                    size_t count,
+                    Transport::WordCompletionArray& completions) const
+        throw(El::Exception);
+
+      //
+      // Finds words within max_distance edits from the text. Sorted word
+      // array is walked as a trie, so word ranges sharing a prefix which
+      // can't lead to a match are skipped with binary search. Found words
+      // are appended to words array ordered by distance and frequency,
+      // query is the text position in the fuzzy words request.
+      //
+      void fuzzy(const char* text,
+                 size_t max_distance,
+                 size_t count,
+                 uint32_t query,
+                 Transport::FuzzyWordArray& words) const
+        throw(El::Exception);
+
+      size_t word_count() const throw();
+      size_t top_count() const throw();
+
+      const char* word(uint32_t index) const throw();
+
+    private:
+
+      struct Entry
+      {
+        uint32_t word;
+        uint32_t count;
+
+        Entry(uint32_t word_val, uint32_t count_val) throw();
+      };
+
+      typedef std::vector<Entry> EntryArray;
+
+      struct LoadedWord
+      {
+        uint32_t offset;
+        uint32_t count;
+        uint32_t langs_begin;
+        uint32_t langs_end;
+
+        LoadedWord(uint32_t offset_val,
+                   uint32_t count_val,
+                   uint32_t langs_begin_val,
+                   uint32_t langs_end_val) throw();
+      };
+
+      typedef std::vector<LoadedWord> LoadedWordArray;
+      typedef std::vector<std::pair<El::Lang, uint32_t> > LangCountArray;
+
+      struct LoadedWordLess
+      {
+        const char* buffer;
+
+        LoadedWordLess(const char* buffer_val) throw();
+
+        bool operator()(const LoadedWord& a, const LoadedWord& b) const
+          throw();
+      };
+
+      typedef __gnu_cxx::hash_map<std::string, IndexArray, El::Hash::String>
+      TopMap;
+
+      struct LangWords
+      {
+        EntryArray entries;
+        TopMap top;
+      };
+
+      typedef __gnu_cxx::hash_map<El::Lang, LangWords, El::Hash::Lang>
+      LangWordsMap;
+
+      struct EntryPrefixLess
+      {
+        const WordDictionary& dict;
+
+        EntryPrefixLess(const WordDictionary& dict_val) throw();
+
+        bool operator()(const Entry& entry, const char* prefix) const
+          throw();
+      };
+
+      struct EntryHeavier
+      {
+        const EntryArray& entries;
+
+        EntryHeavier(const EntryArray& entries_val) throw();
+
+        bool operator()(uint32_t a, uint32_t b) const throw();
+      };
+
+      void index(LangWords& lang_words,
+                 size_t begin,
+                 size_t end,
+                 size_t depth)
+        throw(El::Exception);
+
+      void select_top(const EntryArray& entries,
+                      size_t begin,
+                      size_t end,
+                      size_t count,
+                      IndexArray& top) const
+        throw(El::Exception);
+
+      const LangWords* lang_words(const El::Lang& lang) const throw();
+
+      size_t prefix_end(size_t index, const char* prefix, size_t len) const
+        throw();
+
+    private:
+      size_t top_words_;
+      size_t top_threshold_;
+      size_t top_count_;
+
+      std::string buffer_;
+      IndexArray offsets_;
+
+      // Words copied by load in the map order, sorted by index
+      std::string loaded_buffer_;
+      LoadedWordArray loaded_words_;
+      LangCountArray loaded_langs_;
+
+      LangWords all_;
+      LangWordsMap langs_;
+
+    private:
+      WordDictionary(const WordDictionary&);
+      void operator=(const WordDictionary&);
+    };
+
+    typedef El::RefCount::SmartPtr<WordDictionary> WordDictionary_var;
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Inlines
+///////////////////////////////////////////////////////////////////////////////
+
+namespace NewsGate
+{
+  namespace Message
+  {
+    //
+    // WordDictionary::Entry struct
+    //
+    inline
+    WordDictionary::Entry::Entry(uint32_t word_val, uint32_t count_val)
+      throw()
+        : word(word_val),
+          count(count_val)
+    {
+    }
+
+    //
+    // WordDictionary::LoadedWord struct
+    //
+    inline
+    WordDictionary::LoadedWord::LoadedWord(uint32_t offset_val,
+                                           uint32_t count_val,
+                                           uint32_t langs_begin_val,
+                                           uint32_t langs_end_val) throw()
+        : offset(offset_val),
+          count(count_val),
+          langs_begin(langs_begin_val),
+          langs_end(langs_end_val)
+    {
+    }
+
+    //
+    // WordDictionary::LoadedWordLess struct
+    //
+    inline
+    WordDictionary::LoadedWordLess::LoadedWordLess(const char* buffer_val)
+      throw()
+        : buffer(buffer_val)
+    {
+    }
+
+    inline
+    bool
+    WordDictionary::LoadedWordLess::operator()(const LoadedWord& a,
+                                               const LoadedWord& b) const
+      throw()
+    {
+      return strcmp(buffer + a.offset, buffer + b.offset) < 0;
+    }
+
+    //
+    // WordDictionary::EntryPrefixLess struct
+    //
+    inline
+    WordDictionary::EntryPrefixLess::EntryPrefixLess(
+      const WordDictionary& dict_val) throw()
+        : dict(dict_val)
+    {
+    }
+
+    inline
+    bool
+    WordDictionary::EntryPrefixLess::operator()(const Entry& entry,
+                                                const char* prefix) const
+      throw()
+    {
+      return strcmp(dict.word(entry.word), prefix) < 0;
+    }
+
+    //
+    // WordDictionary::EntryHeavier struct
+    //
+    inline
+    WordDictionary::EntryHeavier::EntryHeavier(const EntryArray& entries_val)
+      throw()
+        : entries(entries_val)
+    {
+    }
+
+    inline
+    bool
+    WordDictionary::EntryHeavier::operator()(uint32_t a, uint32_t b) const
+      throw()
+    {
+      uint32_t ca = entries[a].count;
+      uint32_t cb = entries[b].count;
+
+      return ca > cb || (ca == cb && a < b);
+    }
+
+    //
+    // WordDictionary class
+    //
+    inline
+    WordDictionary::WordDictionary(size_t top_words, size_t top_threshold)
+      throw(El::Exception)
+        : top_words_(top_words),
+          top_threshold_(std::max(top_threshold, top_words)),
+          top_count_(0)
+    {
+    }
+
+    inline
+    const char*
+    WordDictionary::word(uint32_t index) const throw()
+    {
+      return buffer_.c_str() + offsets_[index];
+    }
+
+    inline
+    size_t
+    WordDictionary::word_count() const throw()
+    {
+      return offsets_.size();
+    }
+
+    inline
+    size_t
+    WordDictionary::top_count() const throw()
+    {
+      return top_count_;
+    }
+
+    inline
+    const WordDictionary::LangWords*
+    WordDictionary::lang_words(const El::Lang& lang) const throw()
+    {
+      if(lang == El::Lang::null)
+      {
+        return &all_;
+      }
+
+      LangWordsMap::const_iterator i = langs_.find(lang);
+      return i == langs_.end() ? 0 : &i->second;
+    }
+  }
+}
+
+#endif // _NEWSGATE_SERVER_SERVICES_MESSAGE_BANK_WORDDICTIONARY_HPP_
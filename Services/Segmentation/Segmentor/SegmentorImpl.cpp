@@ -17,8 +17,13 @@
 
 #include <string>
 #include <sstream>
+#include <iomanip>
+#include <algorithm>
 
 #include <ace/OS.h>
+#include <ace/High_Res_Timer.h>
+
+#include <El/Moment.hpp>
 
 #include <Commons/Message/StoredMessage.hpp>
 #include <Services/Segmentation/Commons/TransportImpl.hpp>
@@ -40,10 +45,41 @@ namespace NewsGate
     //
     SegmentorImpl::SegmentorImpl(El::Service::Callback* callback)
       throw(InvalidArgument, Exception, El::Exception)
-        : El::Service::CompoundService<>(callback, "SegmentorImpl")
+        : El::Service::CompoundService<>(callback, "SegmentorImpl"),
+          threads_(0),
+          packs_(0),
+          messages_(0),
+          stat_start_time_(ACE_OS::gettimeofday())
     {
+      const Server::Config::SegmentorType& config =
+        Application::instance()->config();
+
+      threads_ = config.threads();
+
+      if(threads_ > 1)
+      {
+        thread_pool_ =
+          new El::Service::ThreadPool(callback,
+                                      "SegmentorThreadPool",
+                                      threads_);
+
+        thread_pool_->start();
+      }
+
+      if(config.title_cache_size())
+      {
+        title_cache_.reset(new TextCache(config.title_cache_size()));
+      }
+
+      if(config.query_cache_size())
+      {
+        query_cache_.reset(new TextCache(config.query_cache_size()));
+      }
+      
       El::Service::CompoundServiceMessage_var msg = new LoadSegmentors(this);
       deliver_now(msg.in());
+
+      schedule_log_stat();
     }
 
     SegmentorImpl::~SegmentorImpl() throw()
@@ -53,6 +89,28 @@ namespace NewsGate
       segmentors_.reset(0);
     }
 
+    bool
+    SegmentorImpl::stop() throw(Exception, El::Exception)
+    {
+      if(thread_pool_.in() != 0)
+      {
+        thread_pool_->stop();
+      }
+
+      return El::Service::CompoundService<>::stop();
+    }
+
+    void
+    SegmentorImpl::wait() throw(Exception, El::Exception)
+    {
+      El::Service::CompoundService<>::wait();
+
+      if(thread_pool_.in() != 0)
+      {
+        thread_pool_->wait();
+      }
+    }
+
     char*
     SegmentorImpl::segment_text(
       const char* text,
@@ -160,7 +218,21 @@ namespace NewsGate
         }
 
         guard.release();
-        result = segmentors_->segment_query(text).c_str();
+
+        std::string segmented;
+
+        if(query_cache_.get() == 0 || segmentors_->empty() ||
+           !query_cache_->get(text, segmented))
+        {
+          segmented = segmentors_->segment_query(text);
+
+          if(query_cache_.get() != 0 && !segmentors_->empty())
+          {
+            query_cache_->set(text, segmented);
+          }
+        }
+        
+        result = segmented.c_str();
       }
       catch(const InvalidArgument& e)
       {
@@ -249,35 +321,43 @@ namespace NewsGate
         Transport::SegmentedMessageArray& res = result_pack->entities();
         res.resize(message_array.size());
 
-        for(size_t i = 0; i < message_array.size(); i++)
-        {
-          const Transport::Message& message = message_array[i];
-          Transport::SegmentedMessage& result = res[i];
-
-          const char* title = message.title.c_str();
-          result.title.set(segmentors_->segment_text(title).c_str(), title);
+        ACE_High_Res_Timer timer;
+        timer.start();
 
-          const char* description = message.description.c_str();
+        size_t chunk_size = threads_ > 1 ?
+          (message_array.size() + threads_ - 1) / threads_ : 0;
 
-          result.description.set(
-            segmentors_->segment_text(description).c_str(),
-            description);
-
-          const char* keywords = message.keywords.c_str();
-          
-          result.keywords.set(segmentors_->segment_text(keywords).c_str(),
-                              keywords);
-          
-          result.images.resize(message.images.size());
+        if(thread_pool_.in() != 0 && chunk_size &&
+           chunk_size < message_array.size())
+        {
+          SegmentPackTask_var task =
+            new SegmentPackTask(this,
+                                *segmentors_,
+                                message_array,
+                                res,
+                                chunk_size);
+
+          for(size_t i = 0; i < task->chunks(); i++)
+          {
+            thread_pool_->execute(task.in());
+          }
 
-          for(size_t i = 0; i < result.images.size(); i++)
+          task->wait(thread_pool_.in());
+        }
+        else
+        {
+          for(size_t i = 0; i < message_array.size(); i++)
           {
-            const char* alt = message.images[i].alt.c_str();
-              
-            result.images[i].alt.set(segmentors_->segment_text(alt).c_str(),
-                                     alt);
+            segment_message(*segmentors_, message_array[i], res[i]);
           }
         }
+
+        timer.stop();
+
+        ACE_Time_Value time;
+        timer.elapsed_time(time);
+
+        count_pack(message_array.size(), time);
       }
       catch(const InvalidArgument& e)
       {
@@ -325,6 +405,59 @@ namespace NewsGate
       return segmentors_.get() != 0;
     }
     
+    void
+    SegmentorImpl::segment_message(const SegmentorInfoArray& segmentors,
+                                   const Transport::Message& message,
+                                   Transport::SegmentedMessage& result)
+      throw(InvalidArgument, Transport::Exception, El::Exception)
+    {
+      const char* title = message.title.c_str();
+      std::string segmented;
+
+      if(title_cache_.get() == 0 || segmentors.empty() ||
+         !title_cache_->get(title, segmented))
+      {
+        segmented = segmentors.segment_text(title);
+
+        if(title_cache_.get() != 0 && !segmentors.empty())
+        {
+          title_cache_->set(title, segmented);
+        }
+      }
+      
+      result.title.set(segmented.c_str(), title);
+
+      const char* description = message.description.c_str();
+
+      result.description.set(segmentors.segment_text(description).c_str(),
+                             description);
+
+      const char* keywords = message.keywords.c_str();
+          
+      result.keywords.set(segmentors.segment_text(keywords).c_str(),
+                          keywords);
+          
+      result.images.resize(message.images.size());
+
+      for(size_t i = 0; i < result.images.size(); i++)
+      {
+        const char* alt = message.images[i].alt.c_str();
+              
+        result.images[i].alt.set(segmentors.segment_text(alt).c_str(), alt);
+      }
+    }
+
+    void
+    SegmentorImpl::count_pack(size_t messages, const ACE_Time_Value& time)
+      throw()
+    {
+      StatGuard guard(stat_lock_);
+
+      ++packs_;
+      messages_ += messages;
+      segmentation_time_ += time;
+    }
+    
     bool
     SegmentorImpl::notify(El::Service::Event* event) throw(El::Exception)
     {
@@ -339,9 +472,97 @@ namespace NewsGate
         return true;
       }
 
+      if(dynamic_cast<LogStat*>(event) != 0)
+      {
+        log_stat();
+        return true;
+      }
+
       return false;
     }
 
+    void
+    SegmentorImpl::schedule_log_stat() throw(El::Exception)
+    {
+      unsigned long period =
+        Application::instance()->config().stat_log_period();
+
+      if(period)
+      {
+        El::Service::CompoundServiceMessage_var msg = new LogStat(this);
+        
+        deliver_at_time(msg.in(),
+                        ACE_OS::gettimeofday() + ACE_Time_Value(period));
+      }
+    }
+
+    void
+    SegmentorImpl::log_stat() throw(El::Exception)
+    {
+      ACE_Time_Value now = ACE_OS::gettimeofday();
+      
+      unsigned long long packs = 0;
+      unsigned long long messages = 0;
+      ACE_Time_Value segmentation_time;
+      ACE_Time_Value period;
+      
+      {
+        StatGuard guard(stat_lock_);
+
+        packs = packs_;
+        messages = messages_;
+        segmentation_time = segmentation_time_;
+        period = now - stat_start_time_;
+
+        packs_ = 0;
+        messages_ = 0;
+        segmentation_time_ = ACE_Time_Value::zero;
+        stat_start_time_ = now;
+      }
+
+      double period_sec =
+        (double)period.sec() + (double)period.usec() / 1000000;
+      
+      double segmentation_sec = (double)segmentation_time.sec() +
+        (double)segmentation_time.usec() / 1000000;
+      
+      std::ostringstream ostr;
+      ostr << "SegmentorImpl::log_stat: for " << El::Moment::time(period)
+           << " segmented " << packs << " packs, " << messages
+           << " messages; " << std::fixed << std::setprecision(2)
+           << (period_sec > 0 ? messages / period_sec : 0.0)
+           << " msg/sec; segmentation time "
+           << El::Moment::time(segmentation_time) << " ("
+           << (segmentation_sec > 0 ? messages / segmentation_sec : 0.0)
+           << " msg/sec)";
+
+      const char* cache_names[] = { "title", "query" };
+      TextCache* caches[] = { title_cache_.get(), query_cache_.get() };
+
+      for(size_t i = 0; i < sizeof(caches) / sizeof(caches[0]); i++)
+      {
+        if(caches[i] == 0)
+        {
+          continue;
+        }
+        
+        unsigned long long hits = 0;
+        unsigned long long misses = 0;
+        size_t size = 0;
+        
+        caches[i]->take_stat(hits, misses, size);
+        
+        ostr << "; " << cache_names[i] << " cache: " << size << " entries, "
+             << hits << " hits, " << misses << " misses ("
+             << (hits + misses ? hits * 100.0 / (hits + misses) : 0.0)
+             << "% hit rate)";
+      }
+
+      Application::logger()->info(ostr.str().c_str(), ASPECT);
+
+      schedule_log_stat();
+    }
+
     void
     SegmentorImpl::load_segmentors() throw(El::Exception)
     {
@@ -384,12 +605,155 @@ namespace NewsGate
       {
         WriteGuard guard(srv_lock_); 
         segmentors_.reset(segmentors.release());
+
+        // Texts cached were segmented by former segmentors
+        
+        if(title_cache_.get() != 0)
+        {
+          title_cache_->clear();
+        }
+
+        if(query_cache_.get() != 0)
+        {
+          query_cache_->clear();
+        }
       }
       
       logger->info("SegmentorImpl::load_segmentors: loading completed",
                    ASPECT);
     }
 
+    //
+    // SegmentorImpl::SegmentPackTask class
+    //
+    void
+    SegmentorImpl::SegmentPackTask::execute() throw(El::Exception)
+    {
+      size_t begin = 0;
+      size_t end = 0;
+      
+      {
+        Guard guard(lock_);
+
+        if(cancelled_)
+        {
+          return;
+        }
+
+        begin = next_chunk_++ * chunk_size_;
+        end = std::min(begin + chunk_size_, messages_.size());
+      }
+
+      std::string error;
+      bool invalid_argument = false;
+      
+      try
+      {
+        for(size_t i = begin; i < end; i++)
+        {
+          segmentor_->segment_message(segmentors_, messages_[i], result_[i]);
+        }
+      }
+      catch(const InvalidArgument& e)
+      {
+        error = e.what();
+        invalid_argument = true;
+      }
+      catch(const Transport::InvalidArgument& e)
+      {
+        error = e.what();
+        invalid_argument = true;
+      }
+      catch(const El::Exception& e)
+      {
+        error = e.what();
+      }
+      catch(const std::exception& e)
+      {
+        error = e.what();
+      }
+      catch(...)
+      {
+        error = "unknown exception caught";
+      }
+
+      Guard guard(lock_);
+
+      if(!error.empty() && error_.empty())
+      {
+        error_ = error;
+        invalid_argument_ = invalid_argument;
+      }
+
+      if(++completed_chunks_ == (cancelled_ ? next_chunk_ : chunks_))
+      {
+        completed_.signal();
+      }
+    }
+
+    void
+    SegmentorImpl::SegmentPackTask::wait(El::Service::ThreadPool* thread_pool)
+      throw(InvalidArgument, Exception, El::Exception)
+    {
+      Guard guard(lock_);
+      
+      while(completed_chunks_ < (cancelled_ ? next_chunk_ : chunks_))
+      {
+        // Waits by 1 second to check if thread pool is stopped and
+        // chunks not taken yet will never be executed
+        
+        ACE_Time_Value timeout = ACE_OS::gettimeofday() + ACE_Time_Value(1);
+        
+        if(completed_.wait(&timeout) == 0)
+        {
+          continue;
+        }
+
+        int error = ACE_OS::last_error();
+
+        if(error != ETIME)
+        {
+          std::ostringstream ostr;
+          ostr << "SegmentorImpl::SegmentPackTask::wait: "
+            "completed_.wait() failed. Errno " << error
+               << ". Description:" << std::endl << ACE_OS::strerror(error);
+          
+          throw Exception(ostr.str());
+        }
+
+        if(!thread_pool->started())
+        {
+          cancelled_ = true;
+        }
+      }
+
+      if(completed_chunks_ < chunks_)
+      {
+        std::ostringstream ostr;
+        ostr << "SegmentorImpl::SegmentPackTask::wait: thread pool stopped; "
+             << chunks_ - completed_chunks_ << " of " << chunks_
+             << " chunks not executed";
+        
+        throw Exception(ostr.str());
+      }
+      
+      if(error_.empty())
+      {
+        return;
+      }
+      
+      std::ostringstream ostr;
+      ostr << "SegmentorImpl::SegmentPackTask::wait: segmentation failed. "
+        "Reason:\n" << error_;
+
+      if(invalid_argument_)
+      {
+        throw InvalidArgument(ostr.str());
+      }
+      
+      throw Exception(ostr.str());
+    }
+    
     //
     // SegmentorImpl::SegmentorInfo struct
     //
@@ -15,21 +15,28 @@
 #define _NEWSGATE_SERVER_SERVICES_SEGMENTATION_SEGMENTOR_SEGMENTORIMPL_HPP_
 
 #include <memory>
+#include <string>
 #include <vector>
+#include <list>
 
 #include <ext/hash_map>
 
 #include <ace/OS.h>
+#include <ace/Synch.h>
+#include <ace/Guard_T.h>
 
 #include <El/Exception.hpp>
 #include <El/RefCount/All.hpp>
+#include <El/Hash/Hash.hpp>
 
 #include <NewsGate/Segmentation.hpp>
 
 #include <El/Service/Service.hpp>
 #include <El/Service/CompoundService.hpp>
+#include <El/Service/ThreadPool.hpp>
 
 #include <Services/Segmentation/Commons/SegmentationServices_s.hpp>
+#include <Services/Segmentation/Commons/TransportImpl.hpp>
 
 namespace NewsGate
 {
@@ -50,6 +57,9 @@ namespace NewsGate
 
       virtual ~SegmentorImpl() throw();
 
+      virtual bool stop() throw(Exception, El::Exception);
+      virtual void wait() throw(Exception, El::Exception);
+
     protected:
 
       //
@@ -99,7 +109,14 @@ namespace NewsGate
         LoadSegmentors(SegmentorImpl* service) throw(El::Exception);
       };
       
+      struct LogStat : public El::Service::CompoundServiceMessage
+      {
+        LogStat(SegmentorImpl* service) throw(El::Exception);
+      };
+      
       void load_segmentors() throw(El::Exception);
+      void log_stat() throw(El::Exception);
+      void schedule_log_stat() throw(El::Exception);
 
     private:
 
@@ -129,7 +146,123 @@ namespace NewsGate
       
       typedef std::auto_ptr<SegmentorInfoArray> SegmentorInfoArrayPtr;
 
+      //
+      // LRU cache of segmented texts. Many feeds repost same titles, and
+      // many users search for same queries, so segmenting them again is
+      // avoided.
+      //
+      class TextCache
+      {
+      public:
+        TextCache(size_t max_size) throw(El::Exception);
+
+        bool get(const char* src, std::string& text) throw(El::Exception);
+        void set(const char* src, const std::string& text) throw(El::Exception);
+        void clear() throw();
+
+        void take_stat(unsigned long long& hits,
+                       unsigned long long& misses,
+                       size_t& size) throw();
+
+      private:
+        typedef ACE_Thread_Mutex Mutex;
+        typedef ACE_Guard<Mutex> Guard;
+
+        typedef std::list<std::string> SrcList;
+
+        struct Entry
+        {
+          std::string text;
+          SrcList::iterator position;
+        };
+
+        typedef __gnu_cxx::hash_map<std::string, Entry, El::Hash::String>
+        EntryMap;
+
+        Mutex lock_;
+        size_t max_size_;
+        SrcList lru_;
+        EntryMap entries_;
+        unsigned long long hits_;
+        unsigned long long misses_;
+      };
+
+      typedef std::auto_ptr<TextCache> TextCachePtr;
+
+      //
+      // Segments pack messages in chunks executed by thread pool
+      //
+      class SegmentPackTask : public virtual El::Service::ThreadPool::TaskBase
+      {
+      public:
+        SegmentPackTask(SegmentorImpl* segmentor,
+                        const SegmentorInfoArray& segmentors,
+                        const Transport::MessageArray& messages,
+                        Transport::SegmentedMessageArray& result,
+                        size_t chunk_size)
+          throw(El::Exception);
+
+        virtual ~SegmentPackTask() throw() {}
+
+        size_t chunks() const throw();
+
+        //
+        // If thread pool stops before all chunks are taken, waits for
+        // the taken ones and throws Exception
+        //
+        void wait(El::Service::ThreadPool* thread_pool)
+          throw(InvalidArgument, Exception, El::Exception);
+
+        virtual void execute() throw(El::Exception);
+
+      private:
+        typedef ACE_Thread_Mutex Mutex;
+        typedef ACE_Guard<Mutex> Guard;
+        typedef ACE_Condition<ACE_Thread_Mutex> Condition;
+
+        Mutex lock_;
+        Condition completed_;
+
+        SegmentorImpl* segmentor_;
+        const SegmentorInfoArray& segmentors_;
+        const Transport::MessageArray& messages_;
+        Transport::SegmentedMessageArray& result_;
+        size_t chunk_size_;
+        size_t chunks_;
+        size_t next_chunk_;
+        size_t completed_chunks_;
+        bool cancelled_;
+        bool invalid_argument_;
+        std::string error_;
+      };
+
+      typedef El::RefCount::SmartPtr<SegmentPackTask> SegmentPackTask_var;
+
+      void segment_message(const SegmentorInfoArray& segmentors,
+                           const Transport::Message& message,
+                           Transport::SegmentedMessage& result)
+        throw(InvalidArgument, Transport::Exception, El::Exception);
+
+      void count_pack(size_t messages, const ACE_Time_Value& time) throw();
+      
+    private:
+      
       SegmentorInfoArrayPtr segmentors_;
+
+      El::Service::ThreadPool_var thread_pool_;
+      size_t threads_;
+
+      TextCachePtr title_cache_;
+      TextCachePtr query_cache_;
+
+      typedef ACE_Thread_Mutex StatMutex;
+      typedef ACE_Guard<StatMutex> StatGuard;
+
+      StatMutex stat_lock_;
+      unsigned long long packs_;
+      unsigned long long messages_;
+      ACE_Time_Value segmentation_time_;
+      ACE_Time_Value stat_start_time_;
     };
 
     typedef El::RefCount::SmartPtr<SegmentorImpl> SegmentorImpl_var;
@@ -155,6 +288,140 @@ namespace NewsGate
           El::Service::CompoundServiceMessage(state, state)
     {
     }
+
+    //
+    // SegmentorImpl::LogStat class
+    //
+    inline
+    SegmentorImpl::LogStat::LogStat(SegmentorImpl* state)
+      throw(El::Exception)
+        : El__Service__CompoundServiceMessageBase(state, state, false),
+          El::Service::CompoundServiceMessage(state, state)
+    {
+    }
+
+    //
+    // SegmentorImpl::TextCache class
+    //
+    inline
+    SegmentorImpl::TextCache::TextCache(size_t max_size) throw(El::Exception)
+        : max_size_(max_size),
+          hits_(0),
+          misses_(0)
+    {
+    }
+
+    inline
+    bool
+    SegmentorImpl::TextCache::get(const char* src, std::string& text)
+      throw(El::Exception)
+    {
+      Guard guard(lock_);
+
+      EntryMap::iterator it = entries_.find(src);
+
+      if(it == entries_.end())
+      {
+        ++misses_;
+        return false;
+      }
+
+      lru_.splice(lru_.begin(), lru_, it->second.position);
+      text = it->second.text;
+
+      ++hits_;
+      return true;
+    }
+
+    inline
+    void
+    SegmentorImpl::TextCache::set(const char* src, const std::string& text)
+      throw(El::Exception)
+    {
+      Guard guard(lock_);
+
+      EntryMap::iterator it = entries_.find(src);
+
+      if(it != entries_.end())
+      {
+        lru_.splice(lru_.begin(), lru_, it->second.position);
+        it->second.text = text;
+        return;
+      }
+
+      if(entries_.size() >= max_size_ && !lru_.empty())
+      {
+        SrcList::iterator last = --lru_.end();
+        
+        entries_.erase(*last);
+        lru_.erase(last);
+      }
+      
+      lru_.push_front(src);
+      
+      Entry& entry = entries_[src];
+      entry.text = text;
+      entry.position = lru_.begin();
+    }
+
+    inline
+    void
+    SegmentorImpl::TextCache::clear() throw()
+    {
+      Guard guard(lock_);
+
+      entries_.clear();
+      lru_.clear();
+    }
+
+    inline
+    void
+    SegmentorImpl::TextCache::take_stat(unsigned long long& hits,
+                                        unsigned long long& misses,
+                                        size_t& size) throw()
+    {
+      Guard guard(lock_);
+
+      hits = hits_;
+      misses = misses_;
+      size = entries_.size();
+
+      hits_ = 0;
+      misses_ = 0;
+    }
+
+    //
+    // SegmentorImpl::SegmentPackTask class
+    //
+    inline
+    SegmentorImpl::SegmentPackTask::SegmentPackTask(
+      SegmentorImpl* segmentor,
+      const SegmentorInfoArray& segmentors,
+      const Transport::MessageArray& messages,
+      Transport::SegmentedMessageArray& result,
+      size_t chunk_size)
+      throw(El::Exception)
+        : TaskBase(false),
+          completed_(lock_),
+          segmentor_(segmentor),
+          segmentors_(segmentors),
+          messages_(messages),
+          result_(result),
+          chunk_size_(chunk_size ? chunk_size : 1),
+          chunks_((messages.size() + chunk_size_ - 1) / chunk_size_),
+          next_chunk_(0),
+          completed_chunks_(0),
+          cancelled_(false),
+          invalid_argument_(false)
+    {
+    }
+
+    inline
+    size_t
+    SegmentorImpl::SegmentPackTask::chunks() const throw()
+    {
+      return chunks_;
+    }
    
   }
 }
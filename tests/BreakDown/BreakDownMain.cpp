@@ -0,0 +1,468 @@
+/*
+ * product   : NewsGate - news search WEB server
+ * copyright : Copyright (c) 2005-2016 Karen Arutyunov
+ * licenses  : CC BY-NC-SA 3.0; see accompanying LICENSE file
+ *             Commercial; contact karen.arutyunov@gmail.com
+ */
+
+/**
+ * @file   NewsGate/Server/tests/BreakDown/BreakDownMain.cpp
+ * @author Karen Arutyunov
+ * $Id:$
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+#include <sstream>
+#include <fstream>
+#include <iostream>
+
+#include <ace/OS.h>
+#include <ace/High_Res_Timer.h>
+
+#include <El/Exception.hpp>
+#include <El/Moment.hpp>
+#include <El/String/Manip.hpp>
+#include <El/String/Unicode.hpp>
+
+#include <Commons/Message/StoredMessage.hpp>
+
+#include <tests/Commons/SourceText.hpp>
+
+EL_EXCEPTION(Exception, El::ExceptionBase);
+
+namespace
+{
+  const char USAGE[] =
+    "Usage: BreakDownTest --source-text=<file> [--source-text=<file> ...] "
+    "[--messages=<number>] [--length=<number>] [--runs=<number>] "
+    "[--record=<file>]\n"
+    "       BreakDownTest --replay=<file> [--runs=<number>]";
+}
+
+typedef std::vector<std::string> StringArray;
+
+//
+// Splits text into words the way StoredMessage::parse_text did before
+// reading UTF-8 directly
+//
+size_t
+wide_words(const char* text) throw(El::Exception)
+{
+  std::wstring wtext;
+  El::String::Manip::utf8_to_wchar(text, wtext);
+
+  std::wstring word;
+  size_t words = 0;
+
+  for(const wchar_t* ptr = wtext.c_str(); *ptr != L'\0'; ptr++)
+  {
+    if(El::String::Unicode::CharTable::is_space(*ptr))
+    {
+      words += !word.empty();
+      word.clear();
+    }
+    else
+    {
+      word.append(ptr, 1);
+    }
+  }
+
+  return words + !word.empty();
+}
+
+size_t
+utf8_words(const char* text) throw(El::Exception)
+{
+  NewsGate::Message::Utf8Reader reader(text);
+
+  std::wstring word;
+  size_t words = 0;
+
+  for(wchar_t chr = reader.get(); chr != L'\0'; chr = reader.get())
+  {
+    if(El::String::Unicode::CharTable::is_space(chr))
+    {
+      words += !word.empty();
+      word.clear();
+    }
+    else
+    {
+      word.append(1, chr);
+    }
+  }
+
+  return words + !word.empty();
+}
+
+void
+check(const StringArray& texts) throw(Exception, El::Exception)
+{
+  for(StringArray::const_iterator i(texts.begin()), e(texts.end()); i != e;
+      ++i)
+  {
+    std::wstring expected;
+    El::String::Manip::utf8_to_wchar(i->c_str(), expected);
+
+    std::wstring result;
+    NewsGate::Message::Utf8Reader reader(i->c_str());
+
+    for(wchar_t chr = reader.get(); chr != L'\0'; chr = reader.get())
+    {
+      result.append(1, chr);
+    }
+
+    if(result != expected)
+    {
+      std::ostringstream ostr;
+      ostr << "check: Utf8Reader result differs for text:\n" << *i;
+      throw Exception(ostr.str());
+    }
+  }
+}
+
+//
+// Broken down message in binary form; the same messages give the same
+// result
+//
+std::string
+break_down(const char* text) throw(El::Exception)
+{
+  NewsGate::Message::StoredMessage message;
+  message.content = new NewsGate::Message::StoredContent();
+
+  message.break_down("", text, 0, "");
+
+  std::ostringstream ostr;
+  message.write_broken_down(ostr);
+  message.content->write_complements(ostr);
+
+  return ostr.str();
+}
+
+void
+check_break_down(const StringArray& texts, const StringArray* results)
+  throw(Exception, El::Exception)
+{
+  std::string buffer;
+
+  for(size_t i = 0; i < texts.size(); ++i)
+  {
+    const std::string& text = texts[i];
+    std::string result = break_down(text.c_str());
+
+    if(results && result != (*results)[i])
+    {
+      std::ostringstream ostr;
+      ostr << "check_break_down: result differs from recorded one for "
+        "text:\n" << text;
+      throw Exception(ostr.str());
+    }
+
+    // Text placed at every offset within a machine word, so Utf8Reader
+    // meets the terminating zero at any place of its word reads
+
+    for(size_t offset = 1; offset < sizeof(uint64_t); ++offset)
+    {
+      buffer.assign(offset, ' ');
+      buffer.append(text);
+
+      if(break_down(buffer.c_str() + offset) != result)
+      {
+        std::ostringstream ostr;
+        ostr << "check_break_down: result differs for offset " << offset
+             << " of text:\n" << text;
+        throw Exception(ostr.str());
+      }
+    }
+  }
+}
+
+//
+// Record file is a sequence of text and its broken down message pairs,
+// each string preceded by its length. Recorded with former
+// StoredMessage::break_down it checks the current one gives the same result.
+//
+void
+write_string(std::ostream& ostr, const std::string& str) throw(El::Exception)
+{
+  uint32_t len = str.length();
+  ostr.write((const char*)&len, sizeof(len));
+  ostr.write(str.c_str(), len);
+}
+
+bool
+read_string(std::istream& istr, std::string& str) throw(El::Exception)
+{
+  uint32_t len = 0;
+  
+  if(!istr.read((char*)&len, sizeof(len)))
+  {
+    return false;
+  }
+
+  str.resize(len);
+
+  if(len && !istr.read(&str[0], len))
+  {
+    throw Exception("read_string: unexpected end of record file");
+  }
+
+  return true;
+}
+
+void
+record(const char* filename, const StringArray& texts)
+  throw(Exception, El::Exception)
+{
+  std::fstream file(filename, std::ios::out | std::ios::binary);
+
+  if(!file.is_open())
+  {
+    std::ostringstream ostr;
+    ostr << "record: failed to open file " << filename;
+    throw Exception(ostr.str());
+  }
+
+  for(StringArray::const_iterator i(texts.begin()), e(texts.end()); i != e;
+      ++i)
+  {
+    write_string(file, *i);
+    write_string(file, break_down(i->c_str()));
+  }
+
+  if(!file)
+  {
+    std::ostringstream ostr;
+    ostr << "record: failed to write file " << filename;
+    throw Exception(ostr.str());
+  }
+}
+
+void
+load(const char* filename, StringArray& texts, StringArray& results)
+  throw(Exception, El::Exception)
+{
+  std::fstream file(filename, std::ios::in | std::ios::binary);
+
+  if(!file.is_open())
+  {
+    std::ostringstream ostr;
+    ostr << "load: failed to open file " << filename;
+    throw Exception(ostr.str());
+  }
+
+  std::string text;
+  std::string result;
+
+  while(read_string(file, text))
+  {
+    if(!read_string(file, result))
+    {
+      throw Exception("load: unexpected end of record file");
+    }
+
+    texts.push_back(text);
+    results.push_back(result);
+  }
+}
+
+void
+report(const char* name,
+       const ACE_Time_Value& time,
+       size_t bytes,
+       size_t count)
+  throw(El::Exception)
+{
+  double sec = (double)time.sec() + (double)time.usec() / 1000000;
+
+  std::cerr << name << ": " << El::Moment::time(time) << " ("
+            << (sec > 0 ? (unsigned long long)(bytes / sec / 1024 / 1024) : 0)
+            << " Mb/sec, " << count << ")\n";
+}
+
+template<typename Tokenizer>
+void
+benchmark(const char* name,
+          const StringArray& texts,
+          size_t bytes,
+          size_t runs,
+          Tokenizer tokenizer)
+  throw(El::Exception)
+{
+  size_t words = 0;
+
+  ACE_High_Res_Timer timer;
+  timer.start();
+
+  for(size_t run = 0; run < runs; ++run)
+  {
+    for(StringArray::const_iterator i(texts.begin()), e(texts.end()); i != e;
+        ++i)
+    {
+      words += tokenizer(i->c_str());
+    }
+  }
+
+  timer.stop();
+
+  ACE_Time_Value time;
+  timer.elapsed_time(time);
+
+  report(name, time, bytes * runs, words);
+}
+
+void
+benchmark_break_down(const StringArray& texts, size_t bytes, size_t runs)
+  throw(El::Exception)
+{
+  size_t words = 0;
+
+  ACE_High_Res_Timer timer;
+  timer.start();
+
+  for(size_t run = 0; run < runs; ++run)
+  {
+    for(StringArray::const_iterator i(texts.begin()), e(texts.end()); i != e;
+        ++i)
+    {
+      NewsGate::Message::StoredMessage message;
+      message.content = new NewsGate::Message::StoredContent();
+
+      message.break_down("", i->c_str(), 0, "");
+      words += message.word_positions.size();
+    }
+  }
+
+  timer.stop();
+
+  ACE_Time_Value time;
+  timer.elapsed_time(time);
+
+  report("StoredMessage::break_down", time, bytes * runs, words);
+}
+
+int
+main(int argc, char** argv)
+{
+  try
+  {
+    NewsGate::Test::SourceText_var source_text;
+    const char* record_file = 0;
+    const char* replay_file = 0;
+
+    size_t messages = 10000;
+    size_t length = 500;
+    size_t runs = 5;
+
+    for(int i = 1; i < argc; i++)
+    {
+      const char* arg = argv[i];
+
+      if(!strncmp(arg, "--source-text=", 14))
+      {
+        if(source_text.in() == 0)
+        {
+          source_text = new NewsGate::Test::SourceText();
+        }
+
+        std::fstream file(arg + 14, std::ios::in);
+
+        if(!file.is_open())
+        {
+          std::ostringstream ostr;
+          ostr << "main: failed to open file " << arg + 14;
+          throw Exception(ostr.str());
+        }
+
+        source_text->load(file);
+      }
+      else if(!strncmp(arg, "--messages=", 11))
+      {
+        messages = atol(arg + 11);
+      }
+      else if(!strncmp(arg, "--length=", 9))
+      {
+        length = atol(arg + 9);
+      }
+      else if(!strncmp(arg, "--runs=", 7))
+      {
+        runs = atol(arg + 7);
+      }
+      else if(!strncmp(arg, "--record=", 9))
+      {
+        record_file = arg + 9;
+      }
+      else if(!strncmp(arg, "--replay=", 9))
+      {
+        replay_file = arg + 9;
+      }
+      else
+      {
+        std::ostringstream ostr;
+        ostr << "main: unexpected argument " << arg << std::endl << USAGE;
+        throw Exception(ostr.str());
+      }
+    }
+
+    if((source_text.in() == 0) == (replay_file == 0))
+    {
+      throw Exception(USAGE);
+    }
+
+    StringArray texts;
+    StringArray results;
+
+    if(replay_file)
+    {
+      load(replay_file, texts, results);
+    }
+    else
+    {
+      texts.reserve(messages);
+
+      for(size_t i = 0; i < messages; ++i)
+      {
+        texts.push_back(source_text->get_random_substr(length));
+      }
+    }
+
+    size_t bytes = 0;
+
+    for(StringArray::const_iterator i(texts.begin()), e(texts.end()); i != e;
+        ++i)
+    {
+      bytes += i->length();
+    }
+
+    check(texts);
+    check_break_down(texts, replay_file ? &results : 0);
+
+    if(record_file)
+    {
+      record(record_file, texts);
+    }
+
+    std::cerr << texts.size() << " texts, " << bytes << " bytes, " << runs
+              << " runs\n";
+
+    benchmark("wide text words", texts, bytes, runs, wide_words);
+    benchmark("utf8 reader words", texts, bytes, runs, utf8_words);
+    benchmark_break_down(texts, bytes, runs);
+
+    return 0;
+  }
+  catch (const El::Exception& e)
+  {
+    std::cerr << e.what() << std::endl;
+  }
+  catch (...)
+  {
+    std::cerr << "unknown exception caught.\n";
+  }
+
+  return -1;
+}
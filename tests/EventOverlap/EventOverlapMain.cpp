@@ -0,0 +1,338 @@
+/*
+ * product   : NewsGate - news search WEB server
+ * copyright : Copyright (c) 2005-2016 Karen Arutyunov
+ * licenses  : CC BY-NC-SA 3.0; see accompanying LICENSE file
+ *             Commercial; contact karen.arutyunov@gmail.com
+ */
+
+/**
+ * @file   NewsGate/Server/tests/EventOverlap/EventOverlapMain.cpp
+ * @author Karen Arutyunov
+ * $Id:$
+ */
+
+#include <stdlib.h>
+
+#include <string>
+#include <vector>
+#include <sstream>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+
+#include <ace/High_Res_Timer.h>
+
+#include <El/Exception.hpp>
+
+#include <Commons/Event/Event.hpp>
+
+EL_EXCEPTION(Exception, El::ExceptionBase);
+
+namespace
+{
+  const char USAGE[] =
+    "Usage:\n"
+    "  EventOverlapTest record <pair count> [<seed> "
+    "[<vocabulary size> <max words>]] > <pairs file>\n"
+    "  EventOverlapTest replay <pairs file> [<repeat count>]\n\n"
+    "Pairs file line: <overlap> <common words> <word ids1> <word ids2>\n"
+    "where word ids are comma separated in event word order.\n\n"
+    "EventPairs.txt is recorded with EventObject::words_overlap looking up\n"
+    "words in EventWordPosMap hash map (before sorted position arrays):\n"
+    "  EventOverlapTest record 2500 1 > EventPairs.txt\n"
+    "  EventOverlapTest record 500 2 12 5 >> EventPairs.txt\n"
+    "Replay it to check the current implementation gives the same "
+    "overlaps.\n";
+
+  const uint32_t VOCABULARY_SIZE = 3000;
+  const uint32_t MAX_WORDS = 30;
+  const uint32_t MIN_WORDS = 3;
+}
+
+typedef std::vector<uint32_t> WordIdArray;
+
+struct EventPair
+{
+  NewsGate::Event::EventObject event1;
+  NewsGate::Event::EventObject event2;
+  size_t overlap;
+  size_t common_words;
+};
+
+typedef std::vector<EventPair> EventPairArray;
+
+void
+set_words(NewsGate::Event::EventObject& event, const WordIdArray& ids)
+  throw(El::Exception)
+{
+  NewsGate::Event::EventWordWeightMap weights;
+
+  for(size_t i = 0; i < ids.size(); ++i)
+  {
+    weights[ids[i]] = NewsGate::Event::EventWordWC(ids.size() - i, 0);
+  }
+
+  event.set_words(weights, ids.size(), false);
+}
+
+void
+write_words(std::ostream& ostr, const NewsGate::Event::EventObject& event)
+  throw(El::Exception)
+{
+  for(size_t i = 0; i < event.words.size(); ++i)
+  {
+    ostr << (i ? "," : "") << event.words[i].word_id;
+  }
+}
+
+void
+read_words(std::istream& istr, WordIdArray& ids) throw(El::Exception)
+{
+  std::string list;
+  istr >> list;
+
+  std::istringstream lstr(list);
+  uint32_t id = 0;
+
+  while(lstr >> id)
+  {
+    ids.push_back(id);
+    lstr.ignore(1);
+  }
+}
+
+uint32_t
+random_word(uint32_t range) throw()
+{
+  // Squaring skews the distribution to lesser ids, so some words are
+  // common like in real events
+  double r = (double)rand() / ((double)RAND_MAX + 1);
+  return (uint32_t)(r * r * range) + 1;
+}
+
+void
+random_words(WordIdArray& ids, size_t count, uint32_t vocabulary_size)
+  throw(El::Exception)
+{
+  while(ids.size() < count)
+  {
+    uint32_t id = random_word(vocabulary_size);
+
+    if(std::find(ids.begin(), ids.end(), id) == ids.end())
+    {
+      ids.push_back(id);
+    }
+  }
+}
+
+//
+// Overlaps are calculated with the implementation the test is built with,
+// so record with a build of the implementation to compare against.
+// Small vocabulary and event sizes make events of less than 3 words
+// and many common words.
+//
+void
+record(size_t count,
+       unsigned int seed,
+       uint32_t vocabulary_size,
+       uint32_t max_words)
+  throw(El::Exception)
+{
+  srand(seed);
+
+  uint32_t min_words =
+    vocabulary_size == VOCABULARY_SIZE && max_words == MAX_WORDS ?
+    MIN_WORDS : 1;
+
+  for(size_t i = 0; i < count; ++i)
+  {
+    WordIdArray ids1;
+    
+    random_words(ids1,
+                 rand() % (max_words - min_words + 1) + min_words,
+                 vocabulary_size);
+
+    // Second event borrows some words of the first one, so overlap
+    // calculation passes its early exit for reasonable share of pairs
+    WordIdArray ids2;
+    size_t len2 = rand() % (max_words - min_words + 1) + min_words;
+
+    for(size_t j = 0; j < ids1.size() && ids2.size() < len2; ++j)
+    {
+      if(rand() % 2)
+      {
+        ids2.push_back(ids1[j]);
+      }
+    }
+
+    std::random_shuffle(ids2.begin(), ids2.end());
+    random_words(ids2, len2, vocabulary_size);
+
+    NewsGate::Event::EventObject event1;
+    NewsGate::Event::EventObject event2;
+
+    set_words(event1, ids1);
+    set_words(event2, ids2);
+
+    size_t common_words = 0;
+    size_t overlap = event1.words_overlap(event2, &common_words);
+
+    std::cout << overlap << " " << common_words << " ";
+    write_words(std::cout, event1);
+    std::cout << " ";
+    write_words(std::cout, event2);
+    std::cout << std::endl;
+  }
+}
+
+void
+replay(const char* filename, size_t repeat) throw(El::Exception)
+{
+  std::fstream file(filename, std::ios::in);
+
+  if(!file.is_open())
+  {
+    std::ostringstream ostr;
+    ostr << "replay: failed to open " << filename;
+    throw Exception(ostr.str());
+  }
+
+  EventPairArray pairs;
+  std::string line;
+
+  while(std::getline(file, line))
+  {
+    if(line.empty())
+    {
+      continue;
+    }
+
+    std::istringstream istr(line);
+
+    pairs.push_back(EventPair());
+    EventPair& pair = *pairs.rbegin();
+
+    istr >> pair.overlap >> pair.common_words;
+
+    WordIdArray ids1;
+    WordIdArray ids2;
+
+    read_words(istr, ids1);
+    read_words(istr, ids2);
+
+    if(istr.fail() || ids1.empty() || ids2.empty())
+    {
+      std::ostringstream ostr;
+      ostr << "replay: invalid line " << pairs.size() << " in " << filename;
+      throw Exception(ostr.str());
+    }
+
+    set_words(pair.event1, ids1);
+    set_words(pair.event2, ids2);
+  }
+
+  if(pairs.empty())
+  {
+    throw Exception("replay: no event pairs");
+  }
+
+  size_t mismatches = 0;
+
+  for(size_t i = 0; i < pairs.size(); ++i)
+  {
+    const EventPair& pair = pairs[i];
+
+    size_t common_words = 0;
+    size_t overlap = pair.event1.words_overlap(pair.event2, &common_words);
+
+    if(overlap != pair.overlap || common_words != pair.common_words)
+    {
+      std::cerr << "Pair " << i + 1 << ": overlap " << overlap << "/"
+                << common_words << " while recorded " << pair.overlap << "/"
+                << pair.common_words << std::endl;
+
+      ++mismatches;
+    }
+  }
+
+  ACE_High_Res_Timer timer;
+  size_t total = 0;
+
+  timer.start();
+
+  for(size_t r = 0; r < repeat; ++r)
+  {
+    for(EventPairArray::const_iterator i(pairs.begin()), e(pairs.end());
+        i != e; ++i)
+    {
+      total += i->event1.words_overlap(i->event2);
+    }
+  }
+
+  timer.stop();
+
+  ACE_Time_Value time;
+  timer.elapsed_time(time);
+
+  double nsec = ((double)time.sec() * 1000000 + time.usec()) * 1000 /
+    ((double)pairs.size() * repeat);
+
+  std::cerr << pairs.size() << " pairs, " << mismatches << " mismatches, "
+            << nsec << " nsec per overlap (checksum " << total << ")\n";
+
+  if(mismatches)
+  {
+    throw Exception("replay: overlap mismatches found");
+  }
+}
+
+int
+main(int argc, char** argv)
+{
+  try
+  {
+    if(argc < 3)
+    {
+      std::cerr << USAGE;
+      return -1;
+    }
+
+    std::string command(argv[1]);
+
+    if(command == "record")
+    {
+      if(argc == 5)
+      {
+        std::cerr << USAGE;
+        return -1;
+      }
+      
+      record(atol(argv[2]),
+             argc > 3 ? atol(argv[3]) : 1,
+             argc > 5 ? atol(argv[4]) : VOCABULARY_SIZE,
+             argc > 5 ? atol(argv[5]) : MAX_WORDS);
+    }
+    else if(command == "replay")
+    {
+      long repeat = argc > 3 ? atol(argv[3]) : 100;
+      replay(argv[2], repeat > 0 ? repeat : 1);
+    }
+    else
+    {
+      std::cerr << USAGE;
+      return -1;
+    }
+
+    return 0;
+  }
+  catch (const El::Exception& e)
+  {
+    std::cerr << e.what() << std::endl;
+  }
+  catch (...)
+  {
+    std::cerr << "unknown exception caught.\n";
+  }
+
+  return -1;
+}
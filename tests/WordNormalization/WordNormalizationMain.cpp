@@ -0,0 +1,320 @@
+/*
+ * product   : NewsGate - news search WEB server
+ * copyright : Copyright (c) 2005-2016 Karen Arutyunov
+ * licenses  : CC BY-NC-SA 3.0; see accompanying LICENSE file
+ *             Commercial; contact karen.arutyunov@gmail.com
+ */
+
+/**
+ * @file   NewsGate/Server/tests/WordNormalization/WordNormalizationMain.cpp
+ * @author Karen Arutyunov
+ * $Id:$
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+#include <sstream>
+#include <fstream>
+#include <iostream>
+
+#include <El/Exception.hpp>
+#include <El/Lang.hpp>
+#include <El/Dictionary/Morphology.hpp>
+
+#include <Commons/Message/StoredMessage.hpp>
+
+#include <tests/Commons/SourceText.hpp>
+
+EL_EXCEPTION(Exception, El::ExceptionBase);
+
+namespace
+{
+  const char USAGE[] =
+    "Usage: WordNormalizationTest --dict=<file> [--dict=<file> ...] "
+    "--source-text=<file> [--source-text=<file> ...] --lang=<l3 code> "
+    "[--messages=<number>] [--length=<number>]";
+}
+
+//
+// Compares message word normalization done by WordManager for the whole
+// message (as bank requests it with normalize_message_words) with
+// normalization of each word separately with the message language fixed
+// (as bank morphology cache does). Messages are first normalized as a
+// whole to settle their language, as the cache is used only for such
+// messages. Cache is only acceptable if message language, normal forms
+// and word languages are the same for all messages.
+//
+class Application
+{
+public:
+
+  Application() throw(El::Exception);
+
+  int run(int argc, char** argv) throw();
+
+private:
+
+  void normalize_message(NewsGate::Message::StoredMessage& msg)
+    throw(El::Exception);
+
+  void normalize_each_word(NewsGate::Message::StoredMessage& msg)
+    throw(El::Exception);
+
+  static void set_normal_forms(
+    NewsGate::Message::StoredMessage& msg,
+    const El::Dictionary::Morphology::WordInfoArray& word_infos)
+    throw(El::Exception);
+
+  static bool compare(const NewsGate::Message::StoredMessage& msg1,
+                      const NewsGate::Message::StoredMessage& msg2,
+                      std::ostream& ostr)
+    throw(El::Exception);
+
+private:
+
+  El::Dictionary::Morphology::WordInfoManager word_info_manager_;
+};
+
+Application::Application() throw(El::Exception)
+    : word_info_manager_(10, 51, 51)
+{
+}
+
+void
+Application::set_normal_forms(
+  NewsGate::Message::StoredMessage& msg,
+  const El::Dictionary::Morphology::WordInfoArray& word_infos)
+  throw(El::Exception)
+{
+  NewsGate::Message::WordPositionArray positions;
+
+  NewsGate::Message::StoredMessage::set_normal_forms(word_infos,
+                                                     msg.word_positions,
+                                                     msg.positions,
+                                                     msg.norm_form_positions,
+                                                     positions);
+  msg.positions = positions;
+
+  NewsGate::Message::MessageWordPosition& word_positions =
+    msg.word_positions;
+
+  for(size_t j = 0; j < word_positions.size(); j++)
+  {
+    word_positions[j].second.lang = word_infos[j].lang;
+  }
+}
+
+//
+// Same as WordManagerImpl::normalize_message_words does
+//
+void
+Application::normalize_message(NewsGate::Message::StoredMessage& msg)
+  throw(El::Exception)
+{
+  const NewsGate::Message::MessageWordPosition& word_positions =
+    msg.word_positions;
+
+  El::Dictionary::Morphology::WordArray words(word_positions.size());
+
+  for(size_t j = 0; j < word_positions.size(); j++)
+  {
+    words[j] = word_positions[j].first.c_str();
+  }
+
+  El::Lang lang = msg.lang;
+  El::Dictionary::Morphology::WordInfoArray word_infos;
+
+  word_info_manager_.normal_form_ids(words, word_infos, &lang, true);
+
+  set_normal_forms(msg, word_infos);
+  msg.lang = lang;
+}
+
+//
+// Same as WordManagerImpl::normalize_words does, called for each word
+//
+void
+Application::normalize_each_word(NewsGate::Message::StoredMessage& msg)
+  throw(El::Exception)
+{
+  const NewsGate::Message::MessageWordPosition& word_positions =
+    msg.word_positions;
+
+  El::Dictionary::Morphology::WordInfoArray word_infos(word_positions.size());
+
+  for(size_t j = 0; j < word_positions.size(); j++)
+  {
+    El::Dictionary::Morphology::WordArray words(1);
+    words[0] = word_positions[j].first.c_str();
+
+    El::Lang lang = msg.lang;
+    El::Dictionary::Morphology::WordInfoArray infos;
+
+    word_info_manager_.normal_form_ids(words, infos, &lang, false);
+    word_infos[j] = infos[0];
+  }
+
+  set_normal_forms(msg, word_infos);
+}
+
+bool
+Application::compare(const NewsGate::Message::StoredMessage& msg1,
+                     const NewsGate::Message::StoredMessage& msg2,
+                     std::ostream& ostr)
+  throw(El::Exception)
+{
+  bool equal = true;
+
+  if(msg1.lang != msg2.lang)
+  {
+    ostr << "  language " << msg1.lang.l3_code() << " != "
+         << msg2.lang.l3_code() << std::endl;
+
+    equal = false;
+  }
+
+  const NewsGate::Message::MessageWordPosition& wp1 = msg1.word_positions;
+  const NewsGate::Message::MessageWordPosition& wp2 = msg2.word_positions;
+
+  for(size_t j = 0; j < wp1.size(); j++)
+  {
+    if(wp1[j].second.lang != wp2[j].second.lang)
+    {
+      ostr << "  word " << wp1[j].first.c_str() << " language "
+           << wp1[j].second.lang.l3_code() << " != "
+           << wp2[j].second.lang.l3_code() << std::endl;
+
+      equal = false;
+    }
+  }
+
+  if(msg1.word_hash(false) != msg2.word_hash(false))
+  {
+    ostr << "  normal forms differ\n";
+    equal = false;
+  }
+
+  return equal;
+}
+
+int
+Application::run(int argc, char** argv) throw()
+{
+  try
+  {
+    NewsGate::Test::SourceText_var source_text;
+
+    El::Lang lang;
+    size_t messages = 1000;
+    size_t length = 500;
+
+    for(int i = 1; i < argc; i++)
+    {
+      const char* arg = argv[i];
+
+      if(!strncmp(arg, "--source-text=", 14))
+      {
+        if(source_text.in() == 0)
+        {
+          source_text = new NewsGate::Test::SourceText();
+        }
+
+        std::fstream file(arg + 14, std::ios::in);
+
+        if(!file.is_open())
+        {
+          std::ostringstream ostr;
+          ostr << "Application::run: failed to open file " << arg + 14;
+          throw Exception(ostr.str());
+        }
+
+        source_text->load(file);
+      }
+      else if(!strncmp(arg, "--dict=", 7))
+      {
+        std::cerr << "Loading dictionary from " << arg + 7 << " ...\n";
+        word_info_manager_.load(arg + 7, &std::cerr);
+      }
+      else if(!strncmp(arg, "--lang=", 7))
+      {
+        lang = El::Lang(arg + 7);
+      }
+      else if(!strncmp(arg, "--messages=", 11))
+      {
+        messages = atol(arg + 11);
+      }
+      else if(!strncmp(arg, "--length=", 9))
+      {
+        length = atol(arg + 9);
+      }
+      else
+      {
+        std::ostringstream ostr;
+        ostr << "Application::run: unexpected argument " << arg;
+        throw Exception(ostr.str());
+      }
+    }
+
+    if(source_text.in() == 0 || lang == El::Lang::null)
+    {
+      throw Exception("Application::run: source text and language should "
+                      "be specified");
+    }
+
+    size_t differ = 0;
+
+    for(size_t i = 0; i < messages; ++i)
+    {
+      std::string text = source_text->get_random_substr(length);
+
+      NewsGate::Message::StoredMessage msg;
+      msg.content = new NewsGate::Message::StoredContent();
+      msg.break_down("", text.c_str(), 0, "");
+      msg.lang = lang;
+
+      // Language guessed at message insertion
+      normalize_message(msg);
+
+      NewsGate::Message::StoredMessage msg1 = msg;
+      normalize_message(msg1);
+
+      NewsGate::Message::StoredMessage msg2 = msg;
+      normalize_each_word(msg2);
+
+      std::ostringstream ostr;
+
+      if(!compare(msg1, msg2, ostr))
+      {
+        std::cerr << "Message " << i << " normalized differently:\n"
+                  << ostr.str() << "Text:\n" << text << std::endl;
+
+        ++differ;
+      }
+    }
+
+    std::cerr << differ << " of " << messages
+              << " messages normalized differently\n";
+
+    return differ ? -1 : 0;
+  }
+  catch (const El::Exception& e)
+  {
+    std::cerr << e.what() << std::endl << USAGE << std::endl;
+  }
+  catch (...)
+  {
+    std::cerr << "unknown exception caught.\n";
+  }
+
+  return -1;
+}
+
+int
+main(int argc, char** argv)
+{
+  Application app;
+  return app.run(argc, argv);
+}
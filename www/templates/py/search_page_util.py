@@ -307,12 +307,19 @@ search_menu = "mod_menu=''',
       messages_count = 0
       total_matched_messages = 0
       suppressed_messages = 0
+      counts_approximate = False
       
     else:
       total_matched_messages = this.search_result.total_matched_messages
       suppressed_messages = this.search_result.suppressed_messages    
+      counts_approximate = this.search_result.counts_approximate
       messages_count = this.search_result.messages.size()
 
+    count_prefix = ""
+
+    if counts_approximate:
+      count_prefix = "~"
+
     if total_matched_messages > 0:
       if messages_count > 0:
 
@@ -322,7 +329,7 @@ search_menu = "mod_menu=''',
           
         else:
           page_heading = this.get_template("RESULTS_HEADING")
-          total_results = str(total_matched_messages)
+          total_results = count_prefix + str(total_matched_messages)
 
           if not this.informer_create_mode:
 
@@ -333,7 +340,8 @@ search_menu = "mod_menu=''',
                 suppressed_info = this.get_template("SUPPRESSED_INFO")
 
                 suppressed_info_vars = \
-                { "SUPPRESSED_RESULTS":suppressed_messages,
+                { "SUPPRESSED_RESULTS":
+                    count_prefix + str(suppressed_messages),
                   "ENABLE_DUPS_QUERY": 
                     el.string.manip.xml_encode(\
                       this.make_ref(this.search_link(extra_params = 'b=s-0'),